@@ -0,0 +1,761 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QThread>
+#include <QtTest>
+// KWin
+#include "../../src/server/clientconnection.h"
+#include "../../src/server/compositor_interface.h"
+#include "../../src/server/display.h"
+#include "../../src/server/output_interface.h"
+#include "../../src/server/plasmawindowmanagement_interface.h"
+#include "../../src/server/seat_interface.h"
+#include "../../src/server/surface_interface.h"
+#include "../../src/server/tablet_v2_interface.h"
+#include "KWayland/Client/compositor.h"
+#include "KWayland/Client/connection_thread.h"
+#include "KWayland/Client/event_queue.h"
+#include "KWayland/Client/output.h"
+#include "KWayland/Client/plasmawindowmanagement.h"
+#include "KWayland/Client/pointer.h"
+#include "KWayland/Client/registry.h"
+#include "KWayland/Client/seat.h"
+#include "KWayland/Client/shm_pool.h"
+#include "KWayland/Client/surface.h"
+#include "KWayland/Client/touch.h"
+// Wayland
+#include "qwayland-tablet-unstable-v2.h"
+
+#include <linux/input.h>
+
+using namespace KWaylandServer;
+
+static const QString s_socketName = QStringLiteral("kwayland-test-client-congestion-0");
+
+/**
+ * A client with a connection thread of its own, which can be blocked so the client stops
+ * reading its events.
+ */
+class Client
+{
+public:
+    ~Client();
+
+    bool connect();
+    SurfaceInterface *createSurface(CompositorInterface *compositorInterface);
+
+    /**
+     * Blocks the connection thread, the client doesn't read any events until unblock() is called.
+     */
+    void block();
+    void unblock();
+
+    KWayland::Client::ConnectionThread *connection = nullptr;
+    QThread *thread = nullptr;
+    KWayland::Client::EventQueue *queue = nullptr;
+    KWayland::Client::Registry *registry = nullptr;
+    KWayland::Client::Compositor *compositor = nullptr;
+    KWayland::Client::ShmPool *shm = nullptr;
+    KWayland::Client::Seat *seat = nullptr;
+    KWayland::Client::Surface *surface = nullptr;
+    QHash<QByteArray, KWayland::Client::Registry::AnnouncedInterface> globals;
+
+private:
+    struct Blocker
+    {
+        QSemaphore blocked;
+        QSemaphore unblocked;
+    };
+    QSharedPointer<Blocker> m_blocker;
+};
+
+Client::~Client()
+{
+    unblock();
+    delete surface;
+    delete seat;
+    delete shm;
+    delete compositor;
+    delete registry;
+    delete queue;
+    if (thread) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    delete connection;
+}
+
+bool Client::connect()
+{
+    connection = new KWayland::Client::ConnectionThread;
+    QSignalSpy connectedSpy(connection, &KWayland::Client::ConnectionThread::connected);
+    connection->setSocketName(s_socketName);
+
+    thread = new QThread;
+    connection->moveToThread(thread);
+    thread->start();
+
+    connection->initConnection();
+    if (!connectedSpy.wait()) {
+        return false;
+    }
+
+    queue = new KWayland::Client::EventQueue;
+    queue->setup(connection);
+
+    registry = new KWayland::Client::Registry;
+    QObject::connect(registry, &KWayland::Client::Registry::interfaceAnnounced, [this](const QByteArray &interface, quint32 name, quint32 version) {
+        globals.insert(interface, {name, version});
+    });
+    QSignalSpy interfacesAnnouncedSpy(registry, &KWayland::Client::Registry::interfacesAnnounced);
+    registry->setEventQueue(queue);
+    registry->create(connection->display());
+    registry->setup();
+    if (!interfacesAnnouncedSpy.wait()) {
+        return false;
+    }
+
+    const auto compositorGlobal = globals.value(QByteArrayLiteral("wl_compositor"));
+    compositor = registry->createCompositor(compositorGlobal.name, compositorGlobal.version);
+    const auto shmGlobal = globals.value(QByteArrayLiteral("wl_shm"));
+    shm = registry->createShmPool(shmGlobal.name, shmGlobal.version);
+    const auto seatGlobal = globals.value(QByteArrayLiteral("wl_seat"));
+    seat = registry->createSeat(seatGlobal.name, seatGlobal.version);
+    if (!compositor->isValid() || !shm->isValid() || !seat->isValid()) {
+        return false;
+    }
+
+    QSignalSpy hasPointerChangedSpy(seat, &KWayland::Client::Seat::hasPointerChanged);
+    return hasPointerChangedSpy.wait();
+}
+
+SurfaceInterface *Client::createSurface(CompositorInterface *compositorInterface)
+{
+    QSignalSpy surfaceCreatedSpy(compositorInterface, &CompositorInterface::surfaceCreated);
+    surface = compositor->createSurface();
+    if (!surfaceCreatedSpy.wait()) {
+        return nullptr;
+    }
+    auto serverSurface = surfaceCreatedSpy.first().first().value<SurfaceInterface *>();
+
+    QImage image(QSize(100, 100), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::black);
+    surface->attachBuffer(shm->createBuffer(image));
+    surface->damage(image.rect());
+    surface->commit(KWayland::Client::Surface::CommitFlag::None);
+    QSignalSpy committedSpy(serverSurface, &SurfaceInterface::committed);
+    if (!committedSpy.wait()) {
+        return nullptr;
+    }
+    return serverSurface;
+}
+
+void Client::block()
+{
+    m_blocker.reset(new Blocker);
+    // the blocker outlives the client if the thread only wakes up after it has been destroyed
+    QSharedPointer<Blocker> blocker = m_blocker;
+    QMetaObject::invokeMethod(
+        connection,
+        [blocker]() {
+            blocker->blocked.release();
+            blocker->unblocked.acquire();
+        },
+        Qt::QueuedConnection);
+    m_blocker->blocked.acquire();
+}
+
+void Client::unblock()
+{
+    if (m_blocker) {
+        m_blocker->unblocked.release();
+        m_blocker.reset();
+    }
+}
+
+class TabletTool : public QObject, public QtWayland::zwp_tablet_tool_v2
+{
+    Q_OBJECT
+public:
+    TabletTool(::zwp_tablet_tool_v2 *tool)
+        : QtWayland::zwp_tablet_tool_v2(tool)
+    {
+    }
+
+    void zwp_tablet_tool_v2_motion(wl_fixed_t x, wl_fixed_t y) override
+    {
+        motions << QPointF(wl_fixed_to_double(x), wl_fixed_to_double(y));
+    }
+
+    void zwp_tablet_tool_v2_pressure(uint32_t pressure) override
+    {
+        pressures << pressure;
+    }
+
+    void zwp_tablet_tool_v2_frame(uint32_t time) override
+    {
+        frames << time;
+        Q_EMIT frame();
+    }
+
+    QVector<QPointF> motions;
+    QVector<uint32_t> pressures;
+    QVector<uint32_t> frames;
+
+Q_SIGNALS:
+    void frame();
+};
+
+class TabletSeat : public QObject, public QtWayland::zwp_tablet_seat_v2
+{
+    Q_OBJECT
+public:
+    TabletSeat(::zwp_tablet_seat_v2 *seat)
+        : QtWayland::zwp_tablet_seat_v2(seat)
+    {
+    }
+    ~TabletSeat() override
+    {
+        qDeleteAll(tablets);
+        qDeleteAll(tools);
+    }
+
+    void zwp_tablet_seat_v2_tablet_added(struct ::zwp_tablet_v2 *id) override
+    {
+        tablets << new QtWayland::zwp_tablet_v2(id);
+    }
+
+    void zwp_tablet_seat_v2_tool_added(struct ::zwp_tablet_tool_v2 *id) override
+    {
+        tools << new TabletTool(id);
+        Q_EMIT toolAdded();
+    }
+
+    QVector<QtWayland::zwp_tablet_v2 *> tablets;
+    QVector<TabletTool *> tools;
+
+Q_SIGNALS:
+    void toolAdded();
+};
+
+class TestClientCongestion : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testPointerMotion();
+    void testTouchMotion();
+    void testTabletAxes();
+    void testOutput();
+    void testPlasmaWindow();
+    void testPointerLeave();
+    void testTouchCancel();
+    void testDisconnect();
+
+private:
+    KWaylandServer::Display *m_display = nullptr;
+    CompositorInterface *m_compositorInterface = nullptr;
+    SeatInterface *m_seatInterface = nullptr;
+    OutputInterface *m_outputInterface = nullptr;
+    PlasmaWindowManagementInterface *m_windowManagementInterface = nullptr;
+    TabletManagerV2Interface *m_tabletManagerInterface = nullptr;
+};
+
+void TestClientCongestion::init()
+{
+    m_display = new KWaylandServer::Display(this);
+    m_display->addSocketName(s_socketName);
+    m_display->start();
+    QVERIFY(m_display->isRunning());
+    m_display->createShm();
+
+    m_compositorInterface = new CompositorInterface(m_display, m_display);
+    m_seatInterface = new SeatInterface(m_display, m_display);
+    m_seatInterface->setName(QStringLiteral("seat0"));
+    m_seatInterface->setHasPointer(true);
+    m_seatInterface->setHasTouch(true);
+    m_outputInterface = new OutputInterface(m_display, m_display);
+    m_outputInterface->setMode(QSize(1024, 768));
+    m_windowManagementInterface = new PlasmaWindowManagementInterface(m_display, m_display);
+    m_tabletManagerInterface = new TabletManagerV2Interface(m_display, m_display);
+}
+
+void TestClientCongestion::cleanup()
+{
+    delete m_display;
+    m_display = nullptr;
+
+    // these are the children of the display
+    m_compositorInterface = nullptr;
+    m_seatInterface = nullptr;
+    m_outputInterface = nullptr;
+    m_windowManagementInterface = nullptr;
+    m_tabletManagerInterface = nullptr;
+}
+
+void TestClientCongestion::testPointerMotion()
+{
+    using namespace KWayland::Client;
+
+    Client client;
+    QVERIFY(client.connect());
+    QScopedPointer<Pointer> pointer(client.seat->createPointer());
+    QVERIFY(pointer->isValid());
+    SurfaceInterface *serverSurface = client.createSurface(m_compositorInterface);
+    QVERIFY(serverSurface);
+    ClientConnection *connection = serverSurface->client();
+
+    QSignalSpy enteredSpy(pointer.data(), &Pointer::entered);
+    QVERIFY(enteredSpy.isValid());
+    m_seatInterface->notifyPointerEnter(serverSurface, QPointF(0, 0));
+    QVERIFY(enteredSpy.wait());
+
+    QSignalSpy frameSpy(pointer.data(), &Pointer::frame);
+    QVERIFY(frameSpy.isValid());
+    QSignalSpy motionSpy(pointer.data(), &Pointer::motion);
+    QVERIFY(motionSpy.isValid());
+    QSignalSpy buttonSpy(pointer.data(), &Pointer::buttonStateChanged);
+    QVERIFY(buttonSpy.isValid());
+    int motionsBeforeButton = -1;
+    connect(pointer.data(), &Pointer::buttonStateChanged, this, [&motionSpy, &motionsBeforeButton]() {
+        motionsBeforeButton = motionSpy.count();
+    });
+
+    // the client stops reading while a motion is sent to it
+    m_display->setClientSendBufferHighWaterMark(1);
+    client.block();
+    m_seatInterface->setTimestamp(1);
+    m_seatInterface->notifyPointerMotion(QPointF(10, 10));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+
+    // only the latest motion is sent once it catches up
+    m_seatInterface->setTimestamp(2);
+    m_seatInterface->notifyPointerMotion(QPointF(20, 20));
+    m_seatInterface->notifyPointerFrame();
+    m_seatInterface->setTimestamp(3);
+    m_seatInterface->notifyPointerMotion(QPointF(30, 30));
+    m_seatInterface->notifyPointerFrame();
+    client.unblock();
+    QTRY_COMPARE(frameSpy.count(), 2);
+    QTRY_VERIFY(!connection->isCongested());
+    QCOMPARE(frameSpy.count(), 2);
+    QCOMPARE(motionSpy.count(), 2);
+    QCOMPARE(motionSpy.first().first().toPointF(), QPointF(10, 10));
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(30, 30));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(3));
+
+    // a withheld motion is sent before a button
+    client.block();
+    m_seatInterface->setTimestamp(4);
+    m_seatInterface->notifyPointerMotion(QPointF(40, 40));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+    m_seatInterface->setTimestamp(5);
+    m_seatInterface->notifyPointerMotion(QPointF(50, 50));
+    m_seatInterface->notifyPointerFrame();
+    m_seatInterface->setTimestamp(6);
+    m_seatInterface->notifyPointerButton(BTN_LEFT, PointerButtonState::Pressed);
+    m_seatInterface->notifyPointerFrame();
+    client.unblock();
+    QTRY_COMPARE(buttonSpy.count(), 1);
+    QTRY_COMPARE(frameSpy.count(), 5);
+    QCOMPARE(motionsBeforeButton, 4);
+    QCOMPARE(motionSpy.count(), 4);
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(50, 50));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(5));
+}
+
+void TestClientCongestion::testTouchMotion()
+{
+    using namespace KWayland::Client;
+
+    Client client;
+    QVERIFY(client.connect());
+    QScopedPointer<Touch> touch(client.seat->createTouch());
+    QVERIFY(touch->isValid());
+    SurfaceInterface *serverSurface = client.createSurface(m_compositorInterface);
+    QVERIFY(serverSurface);
+    ClientConnection *connection = serverSurface->client();
+
+    QSignalSpy sequenceStartedSpy(touch.data(), &Touch::sequenceStarted);
+    QVERIFY(sequenceStartedSpy.isValid());
+    QSignalSpy sequenceEndedSpy(touch.data(), &Touch::sequenceEnded);
+    QVERIFY(sequenceEndedSpy.isValid());
+    QSignalSpy pointMovedSpy(touch.data(), &Touch::pointMoved);
+    QVERIFY(pointMovedSpy.isValid());
+    QSignalSpy frameEndedSpy(touch.data(), &Touch::frameEnded);
+    QVERIFY(frameEndedSpy.isValid());
+    int motionsBeforeUp = -1;
+    connect(touch.data(), &Touch::sequenceEnded, this, [&pointMovedSpy, &motionsBeforeUp]() {
+        motionsBeforeUp = pointMovedSpy.count();
+    });
+
+    m_seatInterface->setFocusedTouchSurface(serverSurface);
+    m_seatInterface->notifyTouchDown(0, QPointF(0, 0));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(sequenceStartedSpy.wait());
+    TouchPoint *touchPoint = sequenceStartedSpy.first().first().value<TouchPoint *>();
+    QTRY_COMPARE(frameEndedSpy.count(), 1);
+
+    // the client stops reading while a motion is sent to it
+    m_display->setClientSendBufferHighWaterMark(1);
+    client.block();
+    m_seatInterface->notifyTouchMotion(0, QPointF(10, 10));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+
+    // only the latest motion is sent once it catches up
+    m_seatInterface->notifyTouchMotion(0, QPointF(20, 20));
+    m_seatInterface->notifyTouchFrame();
+    m_seatInterface->notifyTouchMotion(0, QPointF(30, 30));
+    m_seatInterface->notifyTouchFrame();
+    client.unblock();
+    QTRY_COMPARE(frameEndedSpy.count(), 3);
+    QTRY_VERIFY(!connection->isCongested());
+    QCOMPARE(frameEndedSpy.count(), 3);
+    QCOMPARE(pointMovedSpy.count(), 2);
+    QCOMPARE(touchPoint->positions(), (QVector<QPointF>{QPointF(0, 0), QPointF(10, 10), QPointF(30, 30)}));
+
+    // a withheld motion is sent before the touch point goes up
+    client.block();
+    m_seatInterface->notifyTouchMotion(0, QPointF(40, 40));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+    m_seatInterface->notifyTouchMotion(0, QPointF(50, 50));
+    m_seatInterface->notifyTouchFrame();
+    m_seatInterface->notifyTouchUp(0);
+    m_seatInterface->notifyTouchFrame();
+    client.unblock();
+    QTRY_COMPARE(sequenceEndedSpy.count(), 1);
+    QTRY_COMPARE(frameEndedSpy.count(), 6);
+    QCOMPARE(motionsBeforeUp, 4);
+    QCOMPARE(touchPoint->position(), QPointF(50, 50));
+    QVERIFY(!touchPoint->isDown());
+}
+
+void TestClientCongestion::testTabletAxes()
+{
+    TabletSeatV2Interface *tabletSeatInterface = m_tabletManagerInterface->seat(m_seatInterface);
+    TabletV2Interface *tabletInterface =
+        tabletSeatInterface->addTablet(1, 2, QStringLiteral("event33"), QStringLiteral("my tablet"), {QStringLiteral("/test/event33")});
+    TabletToolV2Interface *toolInterface = tabletSeatInterface->addTool(TabletToolV2Interface::Pen, 0, 0, {TabletToolV2Interface::Pressure});
+
+    Client client;
+    QVERIFY(client.connect());
+    SurfaceInterface *serverSurface = client.createSurface(m_compositorInterface);
+    QVERIFY(serverSurface);
+    ClientConnection *connection = serverSurface->client();
+
+    const auto tabletManagerGlobal = client.globals.value(QByteArrayLiteral("zwp_tablet_manager_v2"));
+    QtWayland::zwp_tablet_manager_v2 tabletManager(client.registry->registry(), tabletManagerGlobal.name, tabletManagerGlobal.version);
+    TabletSeat tabletSeat(tabletManager.get_tablet_seat(*client.seat));
+    QSignalSpy toolAddedSpy(&tabletSeat, &TabletSeat::toolAdded);
+    QVERIFY(toolAddedSpy.wait());
+    TabletTool *tool = tabletSeat.tools.first();
+    QSignalSpy frameSpy(tool, &TabletTool::frame);
+    QVERIFY(frameSpy.isValid());
+
+    toolInterface->setCurrentSurface(serverSurface);
+    toolInterface->sendProximityIn(tabletInterface);
+    toolInterface->sendFrame(0);
+    QVERIFY(frameSpy.wait());
+
+    // the client stops reading while the tool moves
+    m_display->setClientSendBufferHighWaterMark(1);
+    client.block();
+    toolInterface->sendMotion(QPointF(1, 1));
+    toolInterface->sendFrame(1);
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+
+    // only the latest values of the axes are sent once it catches up
+    toolInterface->sendMotion(QPointF(2, 2));
+    toolInterface->sendPressure(20);
+    toolInterface->sendFrame(2);
+    toolInterface->sendMotion(QPointF(3, 3));
+    toolInterface->sendFrame(3);
+    client.unblock();
+    QTRY_COMPARE(tool->frames, (QVector<uint32_t>{0, 1, 3}));
+    QTRY_VERIFY(!connection->isCongested());
+    QCOMPARE(tool->motions, (QVector<QPointF>{QPointF(1, 1), QPointF(3, 3)}));
+    QCOMPARE(tool->pressures, QVector<uint32_t>{20});
+
+    m_display->setClientSendBufferHighWaterMark(0);
+    toolInterface->sendProximityOut();
+    toolInterface->sendFrame(4);
+    QTRY_COMPARE(tool->frames.count(), 4);
+}
+
+void TestClientCongestion::testOutput()
+{
+    using namespace KWayland::Client;
+
+    Client client;
+    QVERIFY(client.connect());
+    const auto outputGlobal = client.globals.value(QByteArrayLiteral("wl_output"));
+    QScopedPointer<Output> output(client.registry->createOutput(outputGlobal.name, outputGlobal.version));
+    QSignalSpy changedSpy(output.data(), &Output::changed);
+    QVERIFY(changedSpy.isValid());
+    QVERIFY(changedSpy.wait());
+    QCOMPARE(output->scale(), 1);
+    ClientConnection *connection = m_display->connections().first();
+
+    // the client stops reading while the output changes
+    m_display->setClientSendBufferHighWaterMark(1);
+    client.block();
+    m_outputInterface->setScale(2);
+    m_outputInterface->done();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+
+    // only the latest state is sent once it catches up
+    m_outputInterface->setScale(3);
+    m_outputInterface->setMode(QSize(1920, 1080));
+    m_outputInterface->done();
+    m_outputInterface->setScale(4);
+    m_outputInterface->done();
+    client.unblock();
+    QTRY_COMPARE(changedSpy.count(), 3);
+    QTRY_VERIFY(!connection->isCongested());
+    QCOMPARE(changedSpy.count(), 3);
+    QCOMPARE(output->scale(), 4);
+    QCOMPARE(output->pixelSize(), QSize(1920, 1080));
+}
+
+void TestClientCongestion::testPlasmaWindow()
+{
+    using namespace KWayland::Client;
+
+    Client client;
+    QVERIFY(client.connect());
+    const auto windowManagementGlobal = client.globals.value(QByteArrayLiteral("org_kde_plasma_window_management"));
+    QScopedPointer<PlasmaWindowManagement> windowManagement(
+        client.registry->createPlasmaWindowManagement(windowManagementGlobal.name, windowManagementGlobal.version));
+    QSignalSpy windowCreatedSpy(windowManagement.data(), &PlasmaWindowManagement::windowCreated);
+    QVERIFY(windowCreatedSpy.isValid());
+    QScopedPointer<PlasmaWindowInterface> windowInterface(m_windowManagementInterface->createWindow(nullptr, QUuid::createUuid()));
+    QVERIFY(windowCreatedSpy.wait());
+    PlasmaWindow *window = windowCreatedSpy.first().first().value<PlasmaWindow *>();
+    QStringList titles;
+    connect(window, &PlasmaWindow::titleChanged, this, [window, &titles]() {
+        titles << window->title();
+    });
+    ClientConnection *connection = m_display->connections().first();
+
+    // the client stops reading while the title changes
+    m_display->setClientSendBufferHighWaterMark(1);
+    client.block();
+    windowInterface->setTitle(QStringLiteral("1"));
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+
+    // only the latest title is sent once it catches up
+    windowInterface->setTitle(QStringLiteral("2"));
+    windowInterface->setTitle(QStringLiteral("3"));
+    client.unblock();
+    QTRY_COMPARE(titles, (QStringList{QStringLiteral("1"), QStringLiteral("3")}));
+    QTRY_VERIFY(!connection->isCongested());
+    QCOMPARE(titles, (QStringList{QStringLiteral("1"), QStringLiteral("3")}));
+}
+
+void TestClientCongestion::testPointerLeave()
+{
+    using namespace KWayland::Client;
+
+    Client client;
+    QVERIFY(client.connect());
+    QScopedPointer<Pointer> pointer(client.seat->createPointer());
+    QVERIFY(pointer->isValid());
+    SurfaceInterface *serverSurface = client.createSurface(m_compositorInterface);
+    QVERIFY(serverSurface);
+    ClientConnection *connection = serverSurface->client();
+
+    QSignalSpy enteredSpy(pointer.data(), &Pointer::entered);
+    QVERIFY(enteredSpy.isValid());
+    QSignalSpy leftSpy(pointer.data(), &Pointer::left);
+    QVERIFY(leftSpy.isValid());
+    QSignalSpy frameSpy(pointer.data(), &Pointer::frame);
+    QVERIFY(frameSpy.isValid());
+    QSignalSpy motionSpy(pointer.data(), &Pointer::motion);
+    QVERIFY(motionSpy.isValid());
+    m_seatInterface->notifyPointerEnter(serverSurface, QPointF(0, 0));
+    QVERIFY(enteredSpy.wait());
+    QTRY_COMPARE(frameSpy.count(), 1);
+
+    m_display->setClientSendBufferHighWaterMark(1);
+    client.block();
+    m_seatInterface->notifyPointerMotion(QPointF(10, 10));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+    m_seatInterface->notifyPointerMotion(QPointF(20, 20));
+    m_seatInterface->notifyPointerFrame();
+
+    // the pointer leaves the surface while the motion is withheld, the motion is dropped
+    m_seatInterface->notifyPointerLeave();
+    m_display->setClientSendBufferHighWaterMark(0);
+    QVERIFY(!connection->isCongested());
+    client.unblock();
+    QVERIFY(leftSpy.wait());
+
+    // and frames are sent again after the pointer entered again
+    m_seatInterface->notifyPointerEnter(serverSurface, QPointF(0, 0));
+    m_seatInterface->notifyPointerMotion(QPointF(30, 30));
+    m_seatInterface->notifyPointerFrame();
+    QTRY_COMPARE(frameSpy.count(), 5);
+    QCOMPARE(motionSpy.count(), 2);
+    QCOMPARE(motionSpy.first().first().toPointF(), QPointF(10, 10));
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(30, 30));
+}
+
+void TestClientCongestion::testTouchCancel()
+{
+    using namespace KWayland::Client;
+
+    Client client;
+    QVERIFY(client.connect());
+    QScopedPointer<Touch> touch(client.seat->createTouch());
+    QVERIFY(touch->isValid());
+    SurfaceInterface *serverSurface = client.createSurface(m_compositorInterface);
+    QVERIFY(serverSurface);
+    ClientConnection *connection = serverSurface->client();
+
+    QSignalSpy sequenceStartedSpy(touch.data(), &Touch::sequenceStarted);
+    QVERIFY(sequenceStartedSpy.isValid());
+    QSignalSpy sequenceCanceledSpy(touch.data(), &Touch::sequenceCanceled);
+    QVERIFY(sequenceCanceledSpy.isValid());
+    QSignalSpy pointMovedSpy(touch.data(), &Touch::pointMoved);
+    QVERIFY(pointMovedSpy.isValid());
+    QSignalSpy frameEndedSpy(touch.data(), &Touch::frameEnded);
+    QVERIFY(frameEndedSpy.isValid());
+
+    m_seatInterface->setFocusedTouchSurface(serverSurface);
+    m_seatInterface->notifyTouchDown(0, QPointF(0, 0));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(sequenceStartedSpy.wait());
+    QTRY_COMPARE(frameEndedSpy.count(), 1);
+
+    m_display->setClientSendBufferHighWaterMark(1);
+    client.block();
+    m_seatInterface->notifyTouchMotion(0, QPointF(10, 10));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(connection->isCongested());
+    m_seatInterface->notifyTouchMotion(0, QPointF(20, 20));
+    m_seatInterface->notifyTouchFrame();
+
+    // the sequence is cancelled while the motion is withheld, the motion is dropped
+    m_seatInterface->notifyTouchCancel();
+    m_display->setClientSendBufferHighWaterMark(0);
+    QVERIFY(!connection->isCongested());
+    client.unblock();
+    QVERIFY(sequenceCanceledSpy.wait());
+
+    // and frames are sent again for the next sequence
+    m_seatInterface->notifyTouchDown(0, QPointF(30, 30));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(sequenceStartedSpy.wait());
+    QTRY_COMPARE(frameEndedSpy.count(), 3);
+    QCOMPARE(pointMovedSpy.count(), 1);
+}
+
+void TestClientCongestion::testDisconnect()
+{
+    using namespace KWayland::Client;
+
+    QScopedPointer<Client> congestedClient(new Client);
+    QVERIFY(congestedClient->connect());
+    QScopedPointer<Pointer> congestedPointer(congestedClient->seat->createPointer());
+    QVERIFY(congestedPointer->isValid());
+    QScopedPointer<Touch> congestedTouch(congestedClient->seat->createTouch());
+    QVERIFY(congestedTouch->isValid());
+    SurfaceInterface *congestedSurface = congestedClient->createSurface(m_compositorInterface);
+    QVERIFY(congestedSurface);
+    ClientConnection *congestedConnection = congestedSurface->client();
+
+    QSignalSpy enteredSpy(congestedPointer.data(), &Pointer::entered);
+    QVERIFY(enteredSpy.isValid());
+    QSignalSpy sequenceStartedSpy(congestedTouch.data(), &Touch::sequenceStarted);
+    QVERIFY(sequenceStartedSpy.isValid());
+    m_seatInterface->notifyPointerEnter(congestedSurface, QPointF(0, 0));
+    m_seatInterface->setFocusedTouchSurface(congestedSurface);
+    m_seatInterface->notifyTouchDown(0, QPointF(0, 0));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(sequenceStartedSpy.wait());
+    QTRY_COMPARE(enteredSpy.count(), 1);
+
+    // the client disconnects while the pointer and touch motions are withheld from it
+    m_display->setClientSendBufferHighWaterMark(1);
+    congestedClient->block();
+    m_seatInterface->notifyPointerMotion(QPointF(10, 10));
+    m_seatInterface->notifyPointerFrame();
+    m_seatInterface->notifyTouchMotion(0, QPointF(10, 10));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(QMetaObject::invokeMethod(m_display, "flush"));
+    QVERIFY(congestedConnection->isCongested());
+    m_seatInterface->notifyPointerMotion(QPointF(20, 20));
+    m_seatInterface->notifyPointerFrame();
+    m_seatInterface->notifyTouchMotion(0, QPointF(20, 20));
+    m_seatInterface->notifyTouchFrame();
+
+    QSignalSpy disconnectedSpy(m_display, &KWaylandServer::Display::clientDisconnected);
+    QVERIFY(disconnectedSpy.isValid());
+    congestedConnection->destroy();
+    QCOMPARE(disconnectedSpy.count(), 1);
+    QVERIFY(!m_seatInterface->focusedPointerSurface());
+    m_display->setClientSendBufferHighWaterMark(0);
+    m_seatInterface->notifyTouchCancel();
+    congestedClient->unblock();
+
+    // the next client gets frames
+    Client client;
+    QVERIFY(client.connect());
+    QScopedPointer<Pointer> pointer(client.seat->createPointer());
+    QVERIFY(pointer->isValid());
+    QScopedPointer<Touch> touch(client.seat->createTouch());
+    QVERIFY(touch->isValid());
+    SurfaceInterface *serverSurface = client.createSurface(m_compositorInterface);
+    QVERIFY(serverSurface);
+
+    QSignalSpy frameSpy(pointer.data(), &Pointer::frame);
+    QVERIFY(frameSpy.isValid());
+    QSignalSpy motionSpy(pointer.data(), &Pointer::motion);
+    QVERIFY(motionSpy.isValid());
+    m_seatInterface->notifyPointerEnter(serverSurface, QPointF(0, 0));
+    m_seatInterface->notifyPointerMotion(QPointF(30, 30));
+    m_seatInterface->notifyPointerFrame();
+    QTRY_COMPARE(frameSpy.count(), 2);
+    QCOMPARE(motionSpy.count(), 1);
+
+    QSignalSpy frameEndedSpy(touch.data(), &Touch::frameEnded);
+    QVERIFY(frameEndedSpy.isValid());
+    QSignalSpy pointMovedSpy(touch.data(), &Touch::pointMoved);
+    QVERIFY(pointMovedSpy.isValid());
+    m_seatInterface->setFocusedTouchSurface(serverSurface);
+    m_seatInterface->notifyTouchDown(0, QPointF(30, 30));
+    m_seatInterface->notifyTouchFrame();
+    m_seatInterface->notifyTouchMotion(0, QPointF(40, 40));
+    m_seatInterface->notifyTouchFrame();
+    QTRY_COMPARE(frameEndedSpy.count(), 2);
+    QCOMPARE(pointMovedSpy.count(), 1);
+
+    congestedTouch.reset();
+    congestedPointer.reset();
+    congestedClient.reset();
+}
+
+QTEST_GUILESS_MAIN(TestClientCongestion)
+#include "test_client_congestion.moc"
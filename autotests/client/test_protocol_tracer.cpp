@@ -0,0 +1,225 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QBuffer>
+#include <QtTest>
+// KWin
+#include "../../src/server/compositor_interface.h"
+#include "../../src/server/display.h"
+#include "../../src/server/output_interface.h"
+#include "../../src/server/protocoltracer.h"
+#include "../../src/server/surface_interface.h"
+#include "KWayland/Client/compositor.h"
+#include "KWayland/Client/connection_thread.h"
+#include "KWayland/Client/event_queue.h"
+#include "KWayland/Client/output.h"
+#include "KWayland/Client/registry.h"
+#include "KWayland/Client/surface.h"
+
+#include <unistd.h>
+
+using namespace KWayland::Client;
+using KWaylandServer::ProtocolTracer;
+
+class TestProtocolTracer : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testDisabled();
+    void testRecordRequests();
+    void testRecordEvents();
+    void testClear();
+
+private:
+    void commitSurface();
+
+    KWaylandServer::Display *m_display = nullptr;
+    KWaylandServer::CompositorInterface *m_compositorInterface = nullptr;
+    KWayland::Client::ConnectionThread *m_connection = nullptr;
+    KWayland::Client::Compositor *m_compositor = nullptr;
+    KWayland::Client::EventQueue *m_queue = nullptr;
+    QThread *m_thread = nullptr;
+};
+
+static const QString s_socketName = QStringLiteral("kwayland-test-protocol-tracer-0");
+
+void TestProtocolTracer::init()
+{
+    using namespace KWaylandServer;
+    delete m_display;
+    m_display = new KWaylandServer::Display(this);
+    m_display->addSocketName(s_socketName);
+    m_display->start();
+    QVERIFY(m_display->isRunning());
+    m_compositorInterface = new CompositorInterface(m_display, m_display);
+
+    // setup connection
+    m_connection = new KWayland::Client::ConnectionThread;
+    QSignalSpy connectedSpy(m_connection, &ConnectionThread::connected);
+    QVERIFY(connectedSpy.isValid());
+    m_connection->setSocketName(s_socketName);
+
+    m_thread = new QThread(this);
+    m_connection->moveToThread(m_thread);
+    m_thread->start();
+
+    m_connection->initConnection();
+    QVERIFY(connectedSpy.wait());
+
+    m_queue = new KWayland::Client::EventQueue(this);
+    m_queue->setup(m_connection);
+    QVERIFY(m_queue->isValid());
+
+    Registry registry;
+    QSignalSpy compositorSpy(&registry, &Registry::compositorAnnounced);
+    QVERIFY(compositorSpy.isValid());
+    registry.setEventQueue(m_queue);
+    registry.create(m_connection->display());
+    QVERIFY(registry.isValid());
+    registry.setup();
+    QVERIFY(compositorSpy.wait());
+    m_compositor = registry.createCompositor(compositorSpy.first().first().value<quint32>(), compositorSpy.first().last().value<quint32>(), this);
+
+    ProtocolTracer::clear();
+}
+
+void TestProtocolTracer::cleanup()
+{
+    ProtocolTracer::setEnabled(false);
+    ProtocolTracer::clear();
+
+    delete m_compositor;
+    m_compositor = nullptr;
+    delete m_queue;
+    m_queue = nullptr;
+    if (m_connection) {
+        m_connection->deleteLater();
+        m_connection = nullptr;
+    }
+    if (m_thread) {
+        m_thread->quit();
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+    delete m_display;
+    m_display = nullptr;
+    m_compositorInterface = nullptr;
+}
+
+void TestProtocolTracer::commitSurface()
+{
+    QSignalSpy surfaceCreatedSpy(m_compositorInterface, &KWaylandServer::CompositorInterface::surfaceCreated);
+    QVERIFY(surfaceCreatedSpy.isValid());
+    QScopedPointer<Surface> surface(m_compositor->createSurface());
+    QVERIFY(surfaceCreatedSpy.wait());
+    auto serverSurface = surfaceCreatedSpy.first().first().value<KWaylandServer::SurfaceInterface *>();
+
+    QSignalSpy committedSpy(serverSurface, &KWaylandServer::SurfaceInterface::committed);
+    QVERIFY(committedSpy.isValid());
+    surface->commit(Surface::CommitFlag::None);
+    QVERIFY(committedSpy.wait());
+}
+
+void TestProtocolTracer::testDisabled()
+{
+    QVERIFY(!ProtocolTracer::isEnabled());
+    commitSurface();
+    QVERIFY(ProtocolTracer::records().isEmpty());
+}
+
+void TestProtocolTracer::testRecordRequests()
+{
+    ProtocolTracer::setEnabled(true);
+    QVERIFY(ProtocolTracer::isEnabled());
+    commitSurface();
+
+    const QVector<ProtocolTracer::Record> records = ProtocolTracer::records();
+    auto it = std::find_if(records.begin(), records.end(), [](const ProtocolTracer::Record &record) {
+        return record.interface == QByteArrayLiteral("wl_compositor") && record.message == QByteArrayLiteral("create_surface");
+    });
+    QVERIFY(it != records.end());
+    QCOMPARE(it->direction, ProtocolTracer::Request);
+    QCOMPARE(it->opcode, 0u);
+    QCOMPARE(it->pid, getpid());
+    QCOMPARE(it->size, 12u);
+
+    it = std::find_if(it, records.end(), [](const ProtocolTracer::Record &record) {
+        return record.interface == QByteArrayLiteral("wl_surface") && record.message == QByteArrayLiteral("commit");
+    });
+    QVERIFY(it != records.end());
+    QCOMPARE(it->direction, ProtocolTracer::Request);
+    QCOMPARE(it->opcode, 6u);
+    QCOMPARE(it->size, 8u);
+    QVERIFY(it->duration.count() >= 0);
+
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::WriteOnly));
+    QVERIFY(ProtocolTracer::dump(&buffer));
+    QCOMPARE(buffer.data().count('\n'), records.count());
+    QVERIFY(buffer.data().contains("\trequest\twl_surface\tcommit\t6\t8\t"));
+}
+
+void TestProtocolTracer::testRecordEvents()
+{
+    // binding an output makes the server send the current state as events
+    ProtocolTracer::setEnabled(true);
+    KWaylandServer::OutputInterface serverOutput(m_display);
+    serverOutput.setMode(QSize(1024, 768), 60000);
+
+    Registry registry;
+    QSignalSpy announcedSpy(&registry, &Registry::outputAnnounced);
+    QVERIFY(announcedSpy.isValid());
+    registry.setEventQueue(m_queue);
+    registry.create(m_connection->display());
+    QVERIFY(registry.isValid());
+    registry.setup();
+    QVERIFY(announcedSpy.wait());
+
+    QScopedPointer<Output> output(registry.createOutput(announcedSpy.first().first().value<quint32>(), announcedSpy.first().last().value<quint32>()));
+    QSignalSpy outputChangedSpy(output.data(), &Output::changed);
+    QVERIFY(outputChangedSpy.isValid());
+    QVERIFY(outputChangedSpy.wait());
+
+    const QVector<ProtocolTracer::Record> records = ProtocolTracer::records();
+    auto it = std::find_if(records.begin(), records.end(), [](const ProtocolTracer::Record &record) {
+        return record.interface == QByteArrayLiteral("wl_output") && record.message == QByteArrayLiteral("mode");
+    });
+    QVERIFY(it != records.end());
+    QCOMPARE(it->direction, ProtocolTracer::Event);
+    QCOMPARE(it->opcode, 1u);
+    QCOMPARE(it->pid, getpid());
+    QCOMPARE(it->size, 24u);
+
+    it = std::find_if(it, records.end(), [](const ProtocolTracer::Record &record) {
+        return record.interface == QByteArrayLiteral("wl_output") && record.message == QByteArrayLiteral("done");
+    });
+    QVERIFY(it != records.end());
+    QCOMPARE(it->direction, ProtocolTracer::Event);
+    QCOMPARE(it->opcode, 2u);
+    QCOMPARE(it->size, 8u);
+
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::WriteOnly));
+    QVERIFY(ProtocolTracer::dump(&buffer));
+    QVERIFY(buffer.data().contains("\tevent\twl_output\tmode\t1\t24\t"));
+}
+
+void TestProtocolTracer::testClear()
+{
+    ProtocolTracer::setEnabled(true);
+    commitSurface();
+    QVERIFY(!ProtocolTracer::records().isEmpty());
+
+    ProtocolTracer::clear();
+    QVERIFY(ProtocolTracer::records().isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestProtocolTracer)
+#include "test_protocol_tracer.moc"
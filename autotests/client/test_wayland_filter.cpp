@@ -34,6 +34,7 @@ private Q_SLOTS:
     void cleanup();
     void testFilter_data();
     void testFilter();
+    void testCachedDecisions();
 
 private:
     TestDisplay *m_display;
@@ -51,6 +52,7 @@ public:
     TestDisplay(QObject *parent);
     bool allowInterface(KWaylandServer::ClientConnection *client, const QByteArray &interfaceName) override;
     QList<wl_client *> m_allowedClients;
+    int m_blurDecisionCount = 0;
 };
 
 TestDisplay::TestDisplay(QObject *parent)
@@ -61,6 +63,7 @@ TestDisplay::TestDisplay(QObject *parent)
 bool TestDisplay::allowInterface(KWaylandServer::ClientConnection *client, const QByteArray &interfaceName)
 {
     if (interfaceName == "org_kde_kwin_blur_manager") {
+        m_blurDecisionCount++;
         return m_allowedClients.contains(*client);
     }
     return true;
@@ -145,5 +148,67 @@ void TestFilter::testFilter()
     thread->wait();
 }
 
+void TestFilter::testCachedDecisions()
+{
+    // setup connection
+    QScopedPointer<KWayland::Client::ConnectionThread> connection(new KWayland::Client::ConnectionThread());
+    QSignalSpy connectedSpy(connection.data(), &ConnectionThread::connected);
+    QVERIFY(connectedSpy.isValid());
+    connection->setSocketName(s_socketName);
+
+    QScopedPointer<QThread> thread(new QThread(this));
+    connection->moveToThread(thread.data());
+    thread->start();
+
+    connection->initConnection();
+    QVERIFY(connectedSpy.wait());
+
+    KWayland::Client::EventQueue queue;
+    queue.setup(connection.data());
+
+    // the first registry asks for the decision
+    Registry registry;
+    QSignalSpy registryDoneSpy(&registry, &Registry::interfacesAnnounced);
+    QSignalSpy blurSpy(&registry, &Registry::blurAnnounced);
+    registry.setEventQueue(&queue);
+    registry.create(connection->display());
+    QVERIFY(registry.isValid());
+    registry.setup();
+    QVERIFY(registryDoneSpy.wait());
+    QCOMPARE(blurSpy.count(), 0);
+    QCOMPARE(m_display->m_blurDecisionCount, 1);
+
+    // the second one uses the cached decision, even though the policy has changed
+    wl_client *clientConnection;
+    wl_client_for_each(clientConnection, wl_display_get_client_list(*m_display))
+    {
+        m_display->m_allowedClients << clientConnection;
+    }
+    Registry registry2;
+    QSignalSpy registry2DoneSpy(&registry2, &Registry::interfacesAnnounced);
+    QSignalSpy blur2Spy(&registry2, &Registry::blurAnnounced);
+    registry2.setEventQueue(&queue);
+    registry2.create(connection->display());
+    registry2.setup();
+    QVERIFY(registry2DoneSpy.wait());
+    QCOMPARE(blur2Spy.count(), 0);
+    QCOMPARE(m_display->m_blurDecisionCount, 1);
+
+    // after invalidating, the new policy applies
+    m_display->invalidateInterfaceFilter();
+    Registry registry3;
+    QSignalSpy registry3DoneSpy(&registry3, &Registry::interfacesAnnounced);
+    QSignalSpy blur3Spy(&registry3, &Registry::blurAnnounced);
+    registry3.setEventQueue(&queue);
+    registry3.create(connection->display());
+    registry3.setup();
+    QVERIFY(registry3DoneSpy.wait());
+    QCOMPARE(blur3Spy.count(), 1);
+    QCOMPARE(m_display->m_blurDecisionCount, 2);
+
+    thread->quit();
+    thread->wait();
+}
+
 QTEST_GUILESS_MAIN(TestFilter)
 #include "test_wayland_filter.moc"
@@ -6,6 +6,7 @@
 // Qt
 #include <QtTest>
 // KWin
+#include "../../src/server/clientconnection.h"
 #include "../../src/server/compositor_interface.h"
 #include "../../src/server/datadevicemanager_interface.h"
 #include "../../src/server/datasource_interface.h"
@@ -18,6 +19,7 @@
 #include "../../src/server/shmclientbuffer.h"
 #include "../../src/server/subcompositor_interface.h"
 #include "../../src/server/surface_interface.h"
+#include "../../src/server/touch_interface.h"
 #include "KWayland/Client/compositor.h"
 #include "KWayland/Client/connection_thread.h"
 #include "KWayland/Client/datadevice.h"
@@ -69,12 +71,15 @@ private Q_SLOTS:
     void testPointerHoldGesture_data();
     void testPointerHoldGesture();
     void testPointerAxis();
+    void testPointerMotionCoalescing();
+    void testInputBatch();
     void testCursor();
     void testCursorDamage();
     void testKeyboard();
     void testSelection();
     void testDataDeviceForKeyboardSurface();
     void testTouch();
+    void testFocusedResourcesChanged();
     void testKeymap();
 
 private:
@@ -1310,6 +1315,199 @@ void TestWaylandSeat::testPointerAxis()
     QCOMPARE(axisStoppedSpy.count(), 1);
 }
 
+void TestWaylandSeat::testPointerMotionCoalescing()
+{
+    using namespace KWayland::Client;
+    using namespace KWaylandServer;
+
+    QSignalSpy hasPointerChangedSpy(m_seat, &Seat::hasPointerChanged);
+    QVERIFY(hasPointerChangedSpy.isValid());
+    m_seatInterface->setHasPointer(true);
+    QVERIFY(hasPointerChangedSpy.wait());
+    QScopedPointer<Pointer> pointer(m_seat->createPointer());
+    QVERIFY(pointer);
+
+    QSignalSpy surfaceCreatedSpy(m_compositorInterface, &CompositorInterface::surfaceCreated);
+    QVERIFY(surfaceCreatedSpy.isValid());
+    QScopedPointer<Surface> surface(m_compositor->createSurface());
+    QVERIFY(surfaceCreatedSpy.wait());
+    auto serverSurface = surfaceCreatedSpy.first().first().value<SurfaceInterface *>();
+    QVERIFY(serverSurface);
+
+    QImage image(QSize(100, 100), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::black);
+    surface->attachBuffer(m_shm->createBuffer(image));
+    surface->damage(image.rect());
+    surface->commit(Surface::CommitFlag::None);
+    QSignalSpy committedSpy(serverSurface, &KWaylandServer::SurfaceInterface::committed);
+    QVERIFY(committedSpy.wait());
+
+    QVERIFY(!m_seatInterface->isPointerMotionCoalescingEnabled());
+    m_seatInterface->setPointerMotionCoalescingEnabled(true);
+    QVERIFY(m_seatInterface->isPointerMotionCoalescingEnabled());
+
+    m_seatInterface->notifyPointerEnter(serverSurface, QPointF(0, 0));
+    QSignalSpy frameSpy(pointer.data(), &Pointer::frame);
+    QVERIFY(frameSpy.isValid());
+    QVERIFY(frameSpy.wait());
+    QCOMPARE(frameSpy.count(), 1);
+
+    QSignalSpy motionSpy(pointer.data(), &Pointer::motion);
+    QVERIFY(motionSpy.isValid());
+    QSignalSpy buttonSpy(pointer.data(), &Pointer::buttonStateChanged);
+    QVERIFY(buttonSpy.isValid());
+
+    // the motion between two frames is sent as a single event with the latest position
+    m_seatInterface->setTimestamp(1);
+    m_seatInterface->notifyPointerMotion(QPointF(10, 10));
+    m_seatInterface->setTimestamp(2);
+    m_seatInterface->notifyPointerMotion(QPointF(20, 20));
+    m_seatInterface->setTimestamp(3);
+    m_seatInterface->notifyPointerMotion(QPointF(30, 30));
+    QCOMPARE(m_seatInterface->pointerPos(), QPointF(30, 30));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(frameSpy.wait());
+    QCOMPARE(frameSpy.count(), 2);
+    QCOMPARE(motionSpy.count(), 1);
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(30, 30));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(3));
+
+    // a button event is never sent before the motion that happened earlier
+    connect(pointer.data(), &Pointer::buttonStateChanged, this, [&motionSpy]() {
+        QCOMPARE(motionSpy.count(), 2);
+    });
+    m_seatInterface->setTimestamp(4);
+    m_seatInterface->notifyPointerMotion(QPointF(40, 40));
+    m_seatInterface->setTimestamp(5);
+    m_seatInterface->notifyPointerButton(BTN_LEFT, PointerButtonState::Pressed);
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(frameSpy.wait());
+    QCOMPARE(frameSpy.count(), 3);
+    QCOMPARE(buttonSpy.count(), 1);
+    QCOMPARE(motionSpy.count(), 2);
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(40, 40));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(4));
+
+    // with a window, the motion after the first one is withheld until the window ends
+    m_seatInterface->setPointerMotionCoalescingWindow(std::chrono::milliseconds(100));
+    QCOMPARE(m_seatInterface->pointerMotionCoalescingWindow(), std::chrono::milliseconds(100));
+    m_seatInterface->setTimestamp(6);
+    m_seatInterface->notifyPointerMotion(QPointF(50, 50));
+    m_seatInterface->notifyPointerFrame();
+    m_seatInterface->setTimestamp(7);
+    m_seatInterface->notifyPointerMotion(QPointF(60, 60));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(frameSpy.wait());
+    QCOMPARE(frameSpy.count(), 4);
+    QCOMPARE(motionSpy.count(), 3);
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(60, 60));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(7));
+
+    // disabling coalescing sends the withheld motion along with a frame
+    m_seatInterface->setTimestamp(8);
+    m_seatInterface->notifyPointerMotion(QPointF(70, 70));
+    m_seatInterface->notifyPointerFrame();
+    m_seatInterface->setPointerMotionCoalescingEnabled(false);
+    QVERIFY(frameSpy.wait());
+    QCOMPARE(frameSpy.count(), 5);
+    QCOMPARE(motionSpy.count(), 4);
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(70, 70));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(8));
+
+    // but no frame is sent if no motion is withheld
+    m_seatInterface->setPointerMotionCoalescingEnabled(true);
+    m_seatInterface->setPointerMotionCoalescingEnabled(false);
+    m_seatInterface->setTimestamp(9);
+    m_seatInterface->notifyPointerMotion(QPointF(80, 80));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(frameSpy.wait());
+    QCOMPARE(frameSpy.count(), 6);
+    QCOMPARE(motionSpy.count(), 5);
+
+    m_seatInterface->setPointerMotionCoalescingWindow(std::chrono::microseconds::zero());
+}
+
+void TestWaylandSeat::testInputBatch()
+{
+    using namespace KWayland::Client;
+    using namespace KWaylandServer;
+
+    QSignalSpy hasPointerChangedSpy(m_seat, &Seat::hasPointerChanged);
+    QVERIFY(hasPointerChangedSpy.isValid());
+    m_seatInterface->setHasPointer(true);
+    QVERIFY(hasPointerChangedSpy.wait());
+    QScopedPointer<Pointer> pointer(m_seat->createPointer());
+    QVERIFY(pointer);
+
+    QSignalSpy surfaceCreatedSpy(m_compositorInterface, &CompositorInterface::surfaceCreated);
+    QVERIFY(surfaceCreatedSpy.isValid());
+    QScopedPointer<Surface> surface(m_compositor->createSurface());
+    QVERIFY(surfaceCreatedSpy.wait());
+    auto serverSurface = surfaceCreatedSpy.first().first().value<SurfaceInterface *>();
+    QVERIFY(serverSurface);
+
+    QImage image(QSize(100, 100), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::black);
+    surface->attachBuffer(m_shm->createBuffer(image));
+    surface->damage(image.rect());
+    surface->commit(Surface::CommitFlag::None);
+    QSignalSpy committedSpy(serverSurface, &KWaylandServer::SurfaceInterface::committed);
+    QVERIFY(committedSpy.wait());
+
+    m_seatInterface->notifyPointerEnter(serverSurface, QPointF(0, 0));
+    QSignalSpy frameSpy(pointer.data(), &Pointer::frame);
+    QVERIFY(frameSpy.isValid());
+    QVERIFY(frameSpy.wait());
+    QCOMPARE(frameSpy.count(), 1);
+
+    QSignalSpy motionSpy(pointer.data(), &Pointer::motion);
+    QVERIFY(motionSpy.isValid());
+    QSignalSpy buttonSpy(pointer.data(), &Pointer::buttonStateChanged);
+    QVERIFY(buttonSpy.isValid());
+    QSignalSpy pointerPosChangedSpy(m_seatInterface, &SeatInterface::pointerPosChanged);
+    QVERIFY(pointerPosChangedSpy.isValid());
+    QSignalSpy timestampChangedSpy(m_seatInterface, &SeatInterface::timestampChanged);
+    QVERIFY(timestampChangedSpy.isValid());
+
+    // the motion of a frame is merged, the button is sent after it and empty frames are dropped
+    m_seatInterface->processInputBatch({
+        InputEvent::pointerMotion(1, QPointF(10, 10)),
+        InputEvent::pointerMotion(2, QPointF(20, 20)),
+        InputEvent::pointerButton(3, BTN_LEFT, PointerButtonState::Pressed),
+        InputEvent::pointerFrame(),
+        InputEvent::pointerFrame(),
+        InputEvent::pointerMotion(4, QPointF(30, 30)),
+        InputEvent::pointerFrame(),
+    });
+    QCOMPARE(m_seatInterface->pointerPos(), QPointF(30, 30));
+    QCOMPARE(m_seatInterface->timestamp(), quint32(4));
+    QCOMPARE(timestampChangedSpy.count(), 1);
+    QCOMPARE(pointerPosChangedSpy.count(), 2);
+
+    QTRY_COMPARE(frameSpy.count(), 3);
+    QCOMPARE(motionSpy.count(), 2);
+    QCOMPARE(motionSpy.first().first().toPointF(), QPointF(20, 20));
+    QCOMPARE(motionSpy.first().last().value<quint32>(), quint32(2));
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(30, 30));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(4));
+    QCOMPARE(buttonSpy.count(), 1);
+    QCOMPARE(buttonSpy.first().at(1).value<quint32>(), quint32(3));
+    QCOMPARE(buttonSpy.first().at(2).value<quint32>(), quint32(BTN_LEFT));
+
+    // the motion flushed at the end of the batch doesn't rewind the timestamp
+    m_seatInterface->processInputBatch({
+        InputEvent::pointerMotion(4, QPointF(40, 40)),
+        InputEvent::keyboardKey(5, KEY_A, KeyboardKeyState::Pressed),
+    });
+    QCOMPARE(m_seatInterface->pointerPos(), QPointF(40, 40));
+    QCOMPARE(m_seatInterface->timestamp(), quint32(5));
+    QCOMPARE(timestampChangedSpy.count(), 2);
+    QCOMPARE(timestampChangedSpy.last().first().value<quint32>(), quint32(5));
+    QTRY_COMPARE(motionSpy.count(), 3);
+    QCOMPARE(motionSpy.last().first().toPointF(), QPointF(40, 40));
+    QCOMPARE(motionSpy.last().last().value<quint32>(), quint32(4));
+}
+
 void TestWaylandSeat::testCursor()
 {
     using namespace KWayland::Client;
@@ -2057,6 +2255,137 @@ void TestWaylandSeat::testTouch()
     QCOMPARE(touch->sequence().first()->position(), QPointF(0, 0));
 }
 
+void TestWaylandSeat::testFocusedResourcesChanged()
+{
+    // this test verifies that input events reach the resources bound after the focus was set,
+    // and that released resources are no longer used
+    using namespace KWayland::Client;
+    using namespace KWaylandServer;
+
+    QSignalSpy hasPointerChangedSpy(m_seat, &Seat::hasPointerChanged);
+    QVERIFY(hasPointerChangedSpy.isValid());
+    QSignalSpy hasKeyboardChangedSpy(m_seat, &Seat::hasKeyboardChanged);
+    QVERIFY(hasKeyboardChangedSpy.isValid());
+    QSignalSpy hasTouchChangedSpy(m_seat, &Seat::hasTouchChanged);
+    QVERIFY(hasTouchChangedSpy.isValid());
+    m_seatInterface->setHasPointer(true);
+    m_seatInterface->setHasKeyboard(true);
+    m_seatInterface->setHasTouch(true);
+    QTRY_VERIFY(m_seat->hasPointer() && m_seat->hasKeyboard() && m_seat->hasTouch());
+
+    QSignalSpy surfaceCreatedSpy(m_compositorInterface, &CompositorInterface::surfaceCreated);
+    QVERIFY(surfaceCreatedSpy.isValid());
+    QScopedPointer<Surface> surface(m_compositor->createSurface());
+    QVERIFY(surfaceCreatedSpy.wait());
+    auto serverSurface = surfaceCreatedSpy.first().first().value<SurfaceInterface *>();
+    QVERIFY(serverSurface);
+
+    QImage image(QSize(100, 100), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::black);
+    surface->attachBuffer(m_shm->createBuffer(image));
+    surface->damage(image.rect());
+    surface->commit(Surface::CommitFlag::None);
+    QSignalSpy committedSpy(serverSurface, &SurfaceInterface::committed);
+    QVERIFY(committedSpy.wait());
+    ClientConnection *clientConnection = serverSurface->client();
+
+    // pointer
+    QScopedPointer<Pointer> pointer1(m_seat->createPointer());
+    QVERIFY(pointer1->isValid());
+    QSignalSpy pointer1EnteredSpy(pointer1.data(), &Pointer::entered);
+    QVERIFY(pointer1EnteredSpy.isValid());
+    m_seatInterface->notifyPointerEnter(serverSurface, QPointF(0, 0));
+    QVERIFY(pointer1EnteredSpy.wait());
+
+    QScopedPointer<Pointer> pointer2(m_seat->createPointer());
+    QVERIFY(pointer2->isValid());
+    const quint32 pointer1Id = wl_proxy_get_id(reinterpret_cast<wl_proxy *>(static_cast<wl_pointer *>(*pointer1)));
+    const quint32 pointer2Id = wl_proxy_get_id(reinterpret_cast<wl_proxy *>(static_cast<wl_pointer *>(*pointer2)));
+    wl_display_flush(m_connection->display());
+    QTRY_VERIFY(clientConnection->getResource(pointer2Id));
+
+    QSignalSpy pointer1MotionSpy(pointer1.data(), &Pointer::motion);
+    QVERIFY(pointer1MotionSpy.isValid());
+    QSignalSpy pointer2MotionSpy(pointer2.data(), &Pointer::motion);
+    QVERIFY(pointer2MotionSpy.isValid());
+    m_seatInterface->notifyPointerMotion(QPointF(10, 10));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(pointer2MotionSpy.wait());
+    QTRY_COMPARE(pointer1MotionSpy.count(), 1);
+
+    pointer1->release();
+    wl_display_flush(m_connection->display());
+    QTRY_VERIFY(!clientConnection->getResource(pointer1Id));
+    m_seatInterface->notifyPointerMotion(QPointF(20, 20));
+    m_seatInterface->notifyPointerFrame();
+    QVERIFY(pointer2MotionSpy.wait());
+    QCOMPARE(pointer2MotionSpy.count(), 2);
+    QCOMPARE(pointer2MotionSpy.last().first().toPointF(), QPointF(20, 20));
+    QCOMPARE(pointer1MotionSpy.count(), 1);
+
+    // keyboard
+    m_seatInterface->setFocusedKeyboardSurface(serverSurface);
+    QScopedPointer<Keyboard> keyboard1(m_seat->createKeyboard());
+    QVERIFY(keyboard1->isValid());
+    QScopedPointer<Keyboard> keyboard2(m_seat->createKeyboard());
+    QVERIFY(keyboard2->isValid());
+    const quint32 keyboard1Id = wl_proxy_get_id(reinterpret_cast<wl_proxy *>(static_cast<wl_keyboard *>(*keyboard1)));
+    const quint32 keyboard2Id = wl_proxy_get_id(reinterpret_cast<wl_proxy *>(static_cast<wl_keyboard *>(*keyboard2)));
+    wl_display_flush(m_connection->display());
+    QTRY_VERIFY(clientConnection->getResource(keyboard2Id));
+
+    QSignalSpy keyboard1KeySpy(keyboard1.data(), &Keyboard::keyChanged);
+    QVERIFY(keyboard1KeySpy.isValid());
+    QSignalSpy keyboard2KeySpy(keyboard2.data(), &Keyboard::keyChanged);
+    QVERIFY(keyboard2KeySpy.isValid());
+    m_seatInterface->notifyKeyboardKey(KEY_A, KeyboardKeyState::Pressed);
+    QVERIFY(keyboard2KeySpy.wait());
+    QTRY_COMPARE(keyboard1KeySpy.count(), 1);
+
+    keyboard1->release();
+    wl_display_flush(m_connection->display());
+    QTRY_VERIFY(!clientConnection->getResource(keyboard1Id));
+    m_seatInterface->notifyKeyboardKey(KEY_A, KeyboardKeyState::Released);
+    QVERIFY(keyboard2KeySpy.wait());
+    QCOMPARE(keyboard2KeySpy.count(), 2);
+    QCOMPARE(keyboard1KeySpy.count(), 1);
+
+    // touch
+    m_seatInterface->setFocusedTouchSurface(serverSurface);
+    QScopedPointer<Touch> touch1(m_seat->createTouch());
+    QVERIFY(touch1->isValid());
+    QScopedPointer<Touch> touch2(m_seat->createTouch());
+    QVERIFY(touch2->isValid());
+    const quint32 touch1Id = wl_proxy_get_id(reinterpret_cast<wl_proxy *>(static_cast<wl_touch *>(*touch1)));
+    const quint32 touch2Id = wl_proxy_get_id(reinterpret_cast<wl_proxy *>(static_cast<wl_touch *>(*touch2)));
+    wl_display_flush(m_connection->display());
+    QTRY_VERIFY(clientConnection->getResource(touch2Id));
+
+    QSignalSpy touch1StartedSpy(touch1.data(), &Touch::sequenceStarted);
+    QVERIFY(touch1StartedSpy.isValid());
+    QSignalSpy touch2StartedSpy(touch2.data(), &Touch::sequenceStarted);
+    QVERIFY(touch2StartedSpy.isValid());
+    QSignalSpy touch2EndedSpy(touch2.data(), &Touch::sequenceEnded);
+    QVERIFY(touch2EndedSpy.isValid());
+    m_seatInterface->notifyTouchDown(0, QPointF(10, 10));
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(touch2StartedSpy.wait());
+    QTRY_COMPARE(touch1StartedSpy.count(), 1);
+
+    touch1->release();
+    wl_display_flush(m_connection->display());
+    QTRY_VERIFY(!clientConnection->getResource(touch1Id));
+    m_seatInterface->notifyTouchUp(0);
+    m_seatInterface->notifyTouchFrame();
+    QVERIFY(touch2EndedSpy.wait());
+    QCOMPARE(touch2EndedSpy.count(), 1);
+
+    // the focus is reset when the surface is destroyed, the touch doesn't use it anymore
+    surface.reset();
+    QTRY_VERIFY(!m_seatInterface->focusedTouchSurface());
+    QVERIFY(!m_seatInterface->touch()->focusedSurface());
+}
+
 void TestWaylandSeat::testKeymap()
 {
     using namespace KWayland::Client;
@@ -2086,12 +2415,14 @@ void TestWaylandSeat::testKeymap()
     QVERIFY(keymapChangedSpy.wait());
     int fd = keymapChangedSpy.first().first().toInt();
     QVERIFY(fd != -1);
-    QCOMPARE(keymapChangedSpy.first().last().value<quint32>(), 3u);
+    // the size includes the terminating null byte
+    QCOMPARE(keymapChangedSpy.first().last().value<quint32>(), 4u);
     QFile file;
     QVERIFY(file.open(fd, QIODevice::ReadOnly));
     const char *address = reinterpret_cast<char *>(file.map(0, keymapChangedSpy.first().last().value<quint32>()));
     QVERIFY(address);
     QCOMPARE(qstrcmp(address, "foo"), 0);
+    QCOMPARE(address[3], '\0');
     file.close();
 
     // change the keymap
@@ -2100,8 +2431,8 @@ void TestWaylandSeat::testKeymap()
     QVERIFY(keymapChangedSpy.wait());
     fd = keymapChangedSpy.first().first().toInt();
     QVERIFY(fd != -1);
-    QCOMPARE(keymapChangedSpy.first().last().value<quint32>(), 3u);
-    QVERIFY(file.open(fd, QIODevice::ReadWrite));
+    QCOMPARE(keymapChangedSpy.first().last().value<quint32>(), 4u);
+    QVERIFY(file.open(fd, QIODevice::ReadOnly));
     address = reinterpret_cast<char *>(file.map(0, keymapChangedSpy.first().last().value<quint32>()));
     QVERIFY(address);
     QCOMPARE(qstrcmp(address, "bar"), 0);
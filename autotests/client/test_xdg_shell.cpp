@@ -43,6 +43,7 @@ private Q_SLOTS:
     void testCreateSurface();
     void testTitle();
     void testWindowClass();
+    void testNonAsciiTitleAndWindowClass();
     void testMaximize();
     void testMinimize();
     void testFullscreen();
@@ -271,6 +272,37 @@ void XdgShellTest::testWindowClass()
     QCOMPARE(serverXdgToplevel->windowClass(), QByteArrayLiteral("org.kde.xdgsurfacetest"));
 }
 
+void XdgShellTest::testNonAsciiTitleAndWindowClass()
+{
+    // this test verifies that the title and the window class are decoded as UTF-8
+    SURFACE
+
+    QSignalSpy titleChangedSpy(serverXdgToplevel, &XdgToplevelInterface::windowTitleChanged);
+    QVERIFY(titleChangedSpy.isValid());
+    QSignalSpy windowClassChanged(serverXdgToplevel, &XdgToplevelInterface::windowClassChanged);
+    QVERIFY(windowClassChanged.isValid());
+
+    const QString title = QStringLiteral("Übersicht — Ünïcödé ✓ 窓");
+    xdgSurface->setTitle(title);
+    xdgSurface->setAppId(QByteArrayLiteral("org.kde.übersicht"));
+    QVERIFY(windowClassChanged.wait());
+    QCOMPARE(titleChangedSpy.count(), 1);
+    QCOMPARE(titleChangedSpy.first().first().toString(), title);
+    QCOMPARE(serverXdgToplevel->windowTitle(), title);
+    QCOMPARE(windowClassChanged.count(), 1);
+    QCOMPARE(windowClassChanged.first().first().toString(), QStringLiteral("org.kde.übersicht"));
+    QCOMPARE(serverXdgToplevel->windowClass(), QStringLiteral("org.kde.übersicht"));
+
+    // setting the same values again doesn't emit a change
+    xdgSurface->setTitle(title);
+    xdgSurface->setAppId(QByteArrayLiteral("org.kde.übersicht"));
+    xdgSurface->setTitle(QStringLiteral("Übersicht"));
+    QVERIFY(titleChangedSpy.wait());
+    QCOMPARE(titleChangedSpy.count(), 2);
+    QCOMPARE(titleChangedSpy.last().first().toString(), QStringLiteral("Übersicht"));
+    QCOMPARE(windowClassChanged.count(), 1);
+}
+
 void XdgShellTest::testMaximize()
 {
     // this test verifies that the maximize/unmaximize calls work
@@ -11,6 +11,7 @@
 #include "../../src/server/output_interface.h"
 #include "../../src/server/outputmanagement_v2_interface.h"
 // Wayland
+#include <wayland-client.h>
 #include <wayland-server.h>
 // system
 #include <sys/socket.h>
@@ -27,6 +28,11 @@ private Q_SLOTS:
     void testStartStop();
     void testAddRemoveOutput();
     void testClientConnection();
+    void testFlushStatistics();
+    void testRequestStatistics();
+    void testObjectAccounting();
+    void testClientQuota();
+    void testCongestion();
     void testConnectNoSocket();
     void testOutputManagement();
     void testAutoSocketName();
@@ -161,6 +167,240 @@ void TestWaylandServerDisplay::testClientConnection()
     QVERIFY(display.connections().isEmpty());
 }
 
+void TestWaylandServerDisplay::testFlushStatistics()
+{
+    KWaylandServer::Display display;
+    display.addSocketName(QStringLiteral("kwin-wayland-server-display-test-flush-statistics"));
+    display.start();
+    QVERIFY(!display.isClientTrafficAccountingEnabled());
+    display.setClientTrafficAccountingEnabled(true);
+
+    int sv[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) >= 0);
+    ClientConnection *connection = display.createClient(sv[0]);
+    QVERIFY(connection);
+    QCOMPARE(connection->flushCount(), quint64(0));
+    QCOMPARE(connection->queuedEventBytes(), quint64(0));
+
+    // wl_display.error with a header, object, code and "no memory" padded to 12 bytes
+    wl_client_post_no_memory(connection->client());
+    QCOMPARE(connection->queuedEventBytes(), quint64(32));
+    QCOMPARE(connection->pendingEventBytes(), quint64(32));
+
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QCOMPARE(connection->flushCount(), quint64(1));
+    QCOMPARE(connection->pendingEventBytes(), quint64(0));
+    QCOMPARE(connection->queuedEventBytes(), quint64(32));
+
+    // nothing pending, so nothing to flush
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QCOMPARE(connection->flushCount(), quint64(1));
+
+    // without the accounting every client gets flushed, but nothing is counted
+    display.setClientTrafficAccountingEnabled(false);
+    wl_client_post_no_memory(connection->client());
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QCOMPARE(connection->flushCount(), quint64(1));
+    QCOMPARE(connection->queuedEventBytes(), quint64(32));
+    char buffer[128];
+    QCOMPARE(recv(sv[1], buffer, sizeof(buffer), MSG_DONTWAIT), ssize_t(64));
+
+    connection->destroy();
+    close(sv[0]);
+    close(sv[1]);
+}
+
+void TestWaylandServerDisplay::testRequestStatistics()
+{
+    KWaylandServer::Display display;
+    display.start();
+    QSignalSpy thresholdSpy(&display, &Display::clientRequestThresholdExceeded);
+    display.setClientRequestReportThreshold(3);
+    QCOMPARE(display.clientRequestReportThreshold(), 3);
+
+    int sv[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) >= 0);
+    ClientConnection *connection = display.createClient(sv[0]);
+    QVERIFY(connection);
+    wl_display *clientDisplay = wl_display_connect_to_fd(sv[1]);
+    QVERIFY(clientDisplay);
+    QCOMPARE(connection->requestCount(), quint64(0));
+
+    auto sendRequests = [&](int count) {
+        for (int i = 0; i < count; ++i) {
+            wl_callback_destroy(wl_display_sync(clientDisplay));
+        }
+        wl_display_flush(clientDisplay);
+        display.dispatchEvents();
+    };
+
+    // under the threshold nothing is reported
+    sendRequests(2);
+    QCOMPARE(connection->requestCount(), quint64(2));
+    QCOMPARE(connection->lastDispatchRequestCount(), 2);
+    QVERIFY(connection->lastDispatchDuration().count() >= 0);
+    QVERIFY(thresholdSpy.isEmpty());
+
+    // the requests are dispatched anyway, the signal only reports them
+    sendRequests(5);
+    QCOMPARE(connection->requestCount(), quint64(7));
+    QCOMPARE(connection->lastDispatchRequestCount(), 5);
+    QCOMPARE(thresholdSpy.count(), 1);
+    QCOMPARE(thresholdSpy.last().at(0).value<ClientConnection *>(), connection);
+    QCOMPARE(thresholdSpy.last().at(1).toInt(), 5);
+
+    // an iteration without requests doesn't reset the last count
+    display.dispatchEvents();
+    QCOMPARE(connection->lastDispatchRequestCount(), 5);
+
+    // a threshold of 0 disables the reports and the accounting
+    display.setClientRequestReportThreshold(0);
+    sendRequests(5);
+    QCOMPARE(connection->requestCount(), quint64(7));
+    QCOMPARE(connection->lastDispatchRequestCount(), 5);
+
+    // unless the accounting has been enabled explicitly
+    display.setClientTrafficAccountingEnabled(true);
+    sendRequests(5);
+    QCOMPARE(connection->requestCount(), quint64(12));
+    QCOMPARE(thresholdSpy.count(), 1);
+
+    wl_display_disconnect(clientDisplay);
+    connection->destroy();
+    close(sv[0]);
+}
+
+void TestWaylandServerDisplay::testObjectAccounting()
+{
+    KWaylandServer::Display display;
+    display.start();
+
+    int sv[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) >= 0);
+    ClientConnection *connection = display.createClient(sv[0]);
+    QVERIFY(connection);
+    QCOMPARE(connection->objectCount(), 0);
+
+    // objects created before accounting got enabled are counted, too
+    display.setClientObjectAccountingEnabled(true);
+    QCOMPARE(connection->objectCount(), 1);
+    QCOMPARE(connection->objectCount(QByteArrayLiteral("wl_display")), 1);
+
+    wl_resource *callback = wl_resource_create(connection->client(), &wl_callback_interface, 1, 0);
+    QVERIFY(callback);
+    QCOMPARE(connection->objectCount(), 2);
+    QCOMPARE(connection->objectCount(QByteArrayLiteral("wl_callback")), 1);
+    QCOMPARE(connection->objectCounts().value(QByteArrayLiteral("wl_callback")), 1);
+
+    wl_resource_destroy(callback);
+    QCOMPARE(connection->objectCount(), 1);
+    QCOMPARE(connection->objectCount(QByteArrayLiteral("wl_callback")), 0);
+    QVERIFY(!connection->objectCounts().contains(QByteArrayLiteral("wl_callback")));
+
+    display.setClientObjectAccountingEnabled(false);
+    QCOMPARE(connection->objectCount(), 0);
+    QVERIFY(wl_resource_create(connection->client(), &wl_callback_interface, 1, 0));
+    QCOMPARE(connection->objectCount(), 0);
+
+    connection->destroy();
+    close(sv[0]);
+    close(sv[1]);
+}
+
+void TestWaylandServerDisplay::testClientQuota()
+{
+    KWaylandServer::Display display;
+    display.start();
+    QSignalSpy softQuotaSpy(&display, &Display::clientSoftQuotaExceeded);
+    QSignalSpy hardQuotaSpy(&display, &Display::clientHardQuotaExceeded);
+    QSignalSpy disconnectedSpy(&display, &Display::clientDisconnected);
+
+    ClientQuota softQuota;
+    softQuota.objects = 2;
+    display.setClientSoftQuota(softQuota);
+    ClientQuota hardQuota;
+    hardQuota.objects = 3;
+    display.setClientHardQuota(hardQuota);
+
+    int sv[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) >= 0);
+    ClientConnection *connection = display.createClient(sv[0]);
+    QVERIFY(connection);
+    QCOMPARE(connection->objectCount(), 1);
+
+    QVERIFY(wl_resource_create(connection->client(), &wl_callback_interface, 1, 0));
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QVERIFY(softQuotaSpy.isEmpty());
+
+    // the signal is only emitted once the iteration is done
+    wl_resource *callback = wl_resource_create(connection->client(), &wl_callback_interface, 1, 0);
+    QVERIFY(callback);
+    QVERIFY(softQuotaSpy.isEmpty());
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QCOMPARE(softQuotaSpy.count(), 1);
+    QCOMPARE(softQuotaSpy.last().at(0).value<ClientConnection *>(), connection);
+    QCOMPARE(softQuotaSpy.last().at(1).value<ClientConnection::Resources>(), ClientConnection::Resources(ClientConnection::Resource::Objects));
+
+    // and again only after going back under the limit
+    wl_resource_destroy(callback);
+    callback = wl_resource_create(connection->client(), &wl_callback_interface, 1, 0);
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QCOMPARE(softQuotaSpy.count(), 2);
+
+    QVERIFY(wl_resource_create(connection->client(), &wl_callback_interface, 1, 0));
+    QVERIFY(disconnectedSpy.isEmpty());
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QCOMPARE(hardQuotaSpy.count(), 1);
+    QCOMPARE(hardQuotaSpy.last().at(0).value<ClientConnection *>(), connection);
+    QCOMPARE(hardQuotaSpy.last().at(1).value<ClientConnection::Resources>(), ClientConnection::Resources(ClientConnection::Resource::Objects));
+    QCOMPARE(disconnectedSpy.count(), 1);
+    QCOMPARE(softQuotaSpy.count(), 2);
+
+    close(sv[0]);
+    close(sv[1]);
+}
+
+void TestWaylandServerDisplay::testCongestion()
+{
+    KWaylandServer::Display display;
+    display.start();
+    QSignalSpy congestionSpy(&display, &Display::clientCongestionChanged);
+
+    int sv[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) >= 0);
+    ClientConnection *connection = display.createClient(sv[0]);
+    QVERIFY(connection);
+    wl_resource *callback = wl_resource_create(connection->client(), &wl_callback_interface, 1, 0);
+    QVERIFY(callback);
+
+    // nothing is checked without a high-water mark
+    wl_callback_send_done(callback, 0);
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QCOMPARE(connection->unsentEventBytes(), quint64(0));
+    QVERIFY(!connection->isCongested());
+
+    // the other end of the socket doesn't read the events
+    display.setClientSendBufferHighWaterMark(1);
+    wl_callback_send_done(callback, 0);
+    QVERIFY(QMetaObject::invokeMethod(&display, "flush"));
+    QVERIFY(connection->unsentEventBytes() > 1);
+    QVERIFY(connection->isCongested());
+    QCOMPARE(congestionSpy.count(), 1);
+    QCOMPARE(congestionSpy.last().at(0).value<ClientConnection *>(), connection);
+    QCOMPARE(congestionSpy.last().at(1).toBool(), true);
+
+    char buffer[64];
+    while (recv(sv[1], buffer, sizeof(buffer), MSG_DONTWAIT) > 0) { }
+    QVERIFY(congestionSpy.wait());
+    QVERIFY(!connection->isCongested());
+    QCOMPARE(connection->unsentEventBytes(), quint64(0));
+    QCOMPARE(congestionSpy.last().at(1).toBool(), false);
+
+    connection->destroy();
+    close(sv[0]);
+    close(sv[1]);
+}
+
 void TestWaylandServerDisplay::testConnectNoSocket()
 {
     KWaylandServer::Display display;
@@ -0,0 +1,362 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// Wayland
+#include <wayland-client.h>
+
+#include "qwayland-server-wayland.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+class Output : public QtWaylandServer::wl_output
+{
+public:
+    explicit Output(wl_display *display)
+        : QtWaylandServer::wl_output(display, 2)
+    {
+    }
+
+    QVector<Resource *> boundResources;
+
+protected:
+    void output_bind_resource(Resource *resource) override
+    {
+        boundResources.append(resource);
+    }
+};
+
+struct TestClient {
+    wl_client *serverClient = nullptr;
+    wl_display *display = nullptr;
+    wl_registry *registry = nullptr;
+    quint32 outputName = 0;
+    QVector<wl_output *> outputs;
+
+    // received events
+    int geometryCount = 0;
+    QByteArray make;
+    QByteArray model;
+    int scaleCount = 0;
+    int scale = 0;
+    int modeCount = 0;
+};
+
+class TestGeneratedResources : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testAllResources();
+    void testSkipOlderVersions();
+    void testSingleClient();
+    void testForEachResource();
+    void testForEachResourceDestroy();
+
+private:
+    void connectClient(TestClient *client);
+    void bindOutput(TestClient *client, quint32 version);
+    void dispatch();
+
+    static void registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version);
+    static void registryGlobalRemove(void *data, wl_registry *registry, uint32_t name);
+    static void outputGeometry(void *data,
+                               wl_output *output,
+                               int32_t x,
+                               int32_t y,
+                               int32_t physicalWidth,
+                               int32_t physicalHeight,
+                               int32_t subpixel,
+                               const char *make,
+                               const char *model,
+                               int32_t transform);
+    static void outputMode(void *data, wl_output *output, uint32_t flags, int32_t width, int32_t height, int32_t refresh);
+    static void outputDone(void *data, wl_output *output);
+    static void outputScale(void *data, wl_output *output, int32_t factor);
+
+    static const wl_registry_listener s_registryListener;
+
+    wl_display *m_display = nullptr;
+    wl_event_loop *m_eventLoop = nullptr;
+    Output *m_output = nullptr;
+    TestClient m_clients[2];
+};
+
+const wl_registry_listener TestGeneratedResources::s_registryListener = {
+    registryGlobal,
+    registryGlobalRemove,
+};
+
+void TestGeneratedResources::registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version)
+{
+    Q_UNUSED(registry)
+    Q_UNUSED(version)
+    auto client = static_cast<TestClient *>(data);
+    if (strcmp(interface, wl_output_interface.name) == 0) {
+        client->outputName = name;
+    }
+}
+
+void TestGeneratedResources::registryGlobalRemove(void *data, wl_registry *registry, uint32_t name)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(registry)
+    Q_UNUSED(name)
+}
+
+void TestGeneratedResources::outputGeometry(void *data,
+                                   wl_output *output,
+                                   int32_t x,
+                                   int32_t y,
+                                   int32_t physicalWidth,
+                                   int32_t physicalHeight,
+                                   int32_t subpixel,
+                                   const char *make,
+                                   const char *model,
+                                   int32_t transform)
+{
+    Q_UNUSED(output)
+    Q_UNUSED(x)
+    Q_UNUSED(y)
+    Q_UNUSED(physicalWidth)
+    Q_UNUSED(physicalHeight)
+    Q_UNUSED(subpixel)
+    Q_UNUSED(transform)
+    auto client = static_cast<TestClient *>(data);
+    client->geometryCount++;
+    client->make = make;
+    client->model = model;
+}
+
+void TestGeneratedResources::outputMode(void *data, wl_output *output, uint32_t flags, int32_t width, int32_t height, int32_t refresh)
+{
+    Q_UNUSED(output)
+    Q_UNUSED(flags)
+    Q_UNUSED(width)
+    Q_UNUSED(height)
+    Q_UNUSED(refresh)
+    static_cast<TestClient *>(data)->modeCount++;
+}
+
+void TestGeneratedResources::outputDone(void *data, wl_output *output)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(output)
+}
+
+void TestGeneratedResources::outputScale(void *data, wl_output *output, int32_t factor)
+{
+    Q_UNUSED(output)
+    auto client = static_cast<TestClient *>(data);
+    client->scaleCount++;
+    client->scale = factor;
+}
+
+void TestGeneratedResources::init()
+{
+    m_display = wl_display_create();
+    QVERIFY(m_display);
+    m_eventLoop = wl_display_get_event_loop(m_display);
+    m_output = new Output(m_display);
+
+    for (TestClient &client : m_clients) {
+        connectClient(&client);
+        QVERIFY(client.outputName);
+    }
+}
+
+void TestGeneratedResources::cleanup()
+{
+    for (TestClient &client : m_clients) {
+        for (wl_output *output : qAsConst(client.outputs)) {
+            wl_output_destroy(output);
+        }
+        if (client.registry) {
+            wl_registry_destroy(client.registry);
+        }
+        if (client.display) {
+            wl_display_disconnect(client.display);
+        }
+        client = TestClient();
+    }
+
+    wl_display_destroy_clients(m_display);
+    delete m_output;
+    m_output = nullptr;
+    wl_display_destroy(m_display);
+    m_display = nullptr;
+    m_eventLoop = nullptr;
+}
+
+void TestGeneratedResources::connectClient(TestClient *client)
+{
+    int sv[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0);
+    client->serverClient = wl_client_create(m_display, sv[0]);
+    QVERIFY(client->serverClient);
+    client->display = wl_display_connect_to_fd(sv[1]);
+    QVERIFY(client->display);
+
+    client->registry = wl_display_get_registry(client->display);
+    wl_registry_add_listener(client->registry, &s_registryListener, client);
+    dispatch();
+}
+
+void TestGeneratedResources::bindOutput(TestClient *client, quint32 version)
+{
+    // the listener struct grows with new libwayland versions, the newer events are never sent
+    static wl_output_listener listener = [] {
+        wl_output_listener listener = {};
+        listener.geometry = outputGeometry;
+        listener.mode = outputMode;
+        listener.done = outputDone;
+        listener.scale = outputScale;
+        return listener;
+    }();
+
+    auto output = static_cast<wl_output *>(wl_registry_bind(client->registry, client->outputName, &wl_output_interface, version));
+    wl_output_add_listener(output, &listener, client);
+    client->outputs.append(output);
+}
+
+void TestGeneratedResources::dispatch()
+{
+    // client to server
+    for (TestClient &client : m_clients) {
+        if (client.display) {
+            wl_display_flush(client.display);
+        }
+    }
+    wl_event_loop_dispatch(m_eventLoop, 0);
+
+    // server to client
+    wl_display_flush_clients(m_display);
+    for (TestClient &client : m_clients) {
+        if (client.display) {
+            if (wl_display_prepare_read(client.display) == 0) {
+                wl_display_read_events(client.display);
+            }
+            wl_display_dispatch_pending(client.display);
+        }
+    }
+}
+
+void TestGeneratedResources::testAllResources()
+{
+    // this test verifies that broadcast_* sends the event to every resource of every client
+    bindOutput(&m_clients[0], 2);
+    bindOutput(&m_clients[1], 2);
+    bindOutput(&m_clients[1], 2);
+    dispatch();
+
+    m_output->broadcast_geometry(0, 0, 300, 200, QtWaylandServer::wl_output::subpixel_unknown, QStringLiteral("Ünïcödé"), QStringLiteral("Model"), QtWaylandServer::wl_output::transform_normal);
+    dispatch();
+
+    QCOMPARE(m_clients[0].geometryCount, 1);
+    QCOMPARE(m_clients[0].make, QStringLiteral("Ünïcödé").toUtf8());
+    QCOMPARE(m_clients[0].model, QByteArrayLiteral("Model"));
+    QCOMPARE(m_clients[1].geometryCount, 2);
+    QCOMPARE(m_clients[1].make, QStringLiteral("Ünïcödé").toUtf8());
+    QCOMPARE(m_clients[1].model, QByteArrayLiteral("Model"));
+}
+
+void TestGeneratedResources::testSkipOlderVersions()
+{
+    // this test verifies that resources bound with a version older than the event are skipped
+    bindOutput(&m_clients[0], 1);
+    bindOutput(&m_clients[1], 2);
+    dispatch();
+
+    m_output->broadcast_scale(2);
+    dispatch();
+
+    QCOMPARE(m_clients[0].scaleCount, 0);
+    QCOMPARE(m_clients[1].scaleCount, 1);
+    QCOMPARE(m_clients[1].scale, 2);
+}
+
+void TestGeneratedResources::testSingleClient()
+{
+    // this test verifies that the client overload only sends to the resources of that client
+    // a client without resources is ignored
+    m_output->broadcast_mode(m_clients[0].serverClient, QtWaylandServer::wl_output::mode_current, 1920, 1080, 60000);
+
+    bindOutput(&m_clients[0], 2);
+    bindOutput(&m_clients[1], 2);
+    bindOutput(&m_clients[1], 2);
+    dispatch();
+
+    m_output->broadcast_mode(m_clients[1].serverClient, QtWaylandServer::wl_output::mode_current, 1920, 1080, 60000);
+    dispatch();
+
+    QCOMPARE(m_clients[0].modeCount, 0);
+    QCOMPARE(m_clients[1].modeCount, 2);
+}
+
+void TestGeneratedResources::testForEachResource()
+{
+    // this test verifies that forEachResource() visits the resources of a client in bind order
+    QVERIFY(!m_output->hasResources(m_clients[0].serverClient));
+    QVERIFY(!m_output->hasResources(m_clients[1].serverClient));
+
+    // dispatch after every bind, the order the clients are dispatched in is unspecified
+    bindOutput(&m_clients[1], 2);
+    dispatch();
+    bindOutput(&m_clients[0], 2);
+    dispatch();
+    bindOutput(&m_clients[1], 2);
+    dispatch();
+    bindOutput(&m_clients[1], 1);
+    dispatch();
+    QCOMPARE(m_output->boundResources.count(), 4);
+
+    QVERIFY(m_output->hasResources(m_clients[0].serverClient));
+    QVERIFY(m_output->hasResources(m_clients[1].serverClient));
+
+    QVector<QtWaylandServer::wl_output::Resource *> visited;
+    m_output->forEachResource(m_clients[1].serverClient, [&visited](QtWaylandServer::wl_output::Resource *resource) {
+        visited.append(resource);
+    });
+    const QVector<QtWaylandServer::wl_output::Resource *> expected{m_output->boundResources[0], m_output->boundResources[2], m_output->boundResources[3]};
+    QCOMPARE(visited, expected);
+
+    visited.clear();
+    m_output->forEachResource(m_clients[0].serverClient, [&visited](QtWaylandServer::wl_output::Resource *resource) {
+        visited.append(resource);
+    });
+    QCOMPARE(visited, QVector<QtWaylandServer::wl_output::Resource *>{m_output->boundResources[1]});
+}
+
+void TestGeneratedResources::testForEachResourceDestroy()
+{
+    // this test verifies that the function may destroy the resource it is called with
+    bindOutput(&m_clients[0], 2);
+    bindOutput(&m_clients[1], 2);
+    bindOutput(&m_clients[1], 2);
+    dispatch();
+
+    int visited = 0;
+    m_output->forEachResource(m_clients[1].serverClient, [&visited](QtWaylandServer::wl_output::Resource *resource) {
+        visited++;
+        wl_resource_destroy(resource->handle);
+    });
+    QCOMPARE(visited, 2);
+    QVERIFY(!m_output->hasResources(m_clients[1].serverClient));
+    QVERIFY(m_output->hasResources(m_clients[0].serverClient));
+
+    visited = 0;
+    m_output->forEachResource(m_clients[1].serverClient, [&visited](QtWaylandServer::wl_output::Resource *resource) {
+        Q_UNUSED(resource)
+        visited++;
+    });
+    QCOMPARE(visited, 0);
+}
+
+QTEST_GUILESS_MAIN(TestGeneratedResources)
+#include "test_generated_resources.moc"
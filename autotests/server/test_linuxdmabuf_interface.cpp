@@ -0,0 +1,703 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+// Qt
+#include <QThread>
+#include <QtTest>
+
+// WaylandServer
+#include "../../src/server/clientconnection.h"
+#include "../../src/server/compositor_interface.h"
+#include "../../src/server/display.h"
+#include "../../src/server/drm_fourcc.h"
+#include "../../src/server/linuxdmabufv1clientbuffer.h"
+#include "../../src/server/surface_interface.h"
+
+#include <KWayland/Client/compositor.h>
+#include <KWayland/Client/connection_thread.h>
+#include <KWayland/Client/event_queue.h>
+#include <KWayland/Client/registry.h>
+#include <KWayland/Client/surface.h>
+
+#include "qwayland-linux-dmabuf-unstable-v1.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace KWaylandServer;
+
+Q_DECLARE_OPAQUE_POINTER(::wl_buffer *)
+Q_DECLARE_METATYPE(::wl_buffer *)
+
+static const QSize s_bufferSize(64, 64);
+static const quint32 s_stride = 64 * 4;
+
+// Faux-client API for tests
+
+class DmaBuf : public QtWayland::zwp_linux_dmabuf_v1
+{
+public:
+    ~DmaBuf()
+    {
+        destroy();
+    }
+};
+
+class BufferParams : public QObject, public QtWayland::zwp_linux_buffer_params_v1
+{
+    Q_OBJECT
+public:
+    explicit BufferParams(::zwp_linux_buffer_params_v1 *params)
+        : QtWayland::zwp_linux_buffer_params_v1(params)
+    {
+    }
+    ~BufferParams()
+    {
+        destroy();
+    }
+
+Q_SIGNALS:
+    void created(::wl_buffer *buffer);
+    void failed();
+
+protected:
+    void zwp_linux_buffer_params_v1_created(::wl_buffer *buffer) override
+    {
+        Q_EMIT created(buffer);
+    }
+    void zwp_linux_buffer_params_v1_failed() override
+    {
+        Q_EMIT failed();
+    }
+};
+
+class DmaBufFeedback : public QObject, public QtWayland::zwp_linux_dmabuf_feedback_v1
+{
+    Q_OBJECT
+public:
+    explicit DmaBufFeedback(::zwp_linux_dmabuf_feedback_v1 *feedback)
+        : QtWayland::zwp_linux_dmabuf_feedback_v1(feedback)
+    {
+    }
+    ~DmaBufFeedback()
+    {
+        destroy();
+    }
+
+    // the formats of the tranches of the last feedback, decoded with its format table and sorted
+    QVector<QVector<quint32>> tranches;
+
+Q_SIGNALS:
+    void done();
+
+protected:
+    void zwp_linux_dmabuf_feedback_v1_format_table(int32_t fd, uint32_t size) override
+    {
+        m_formatTable.clear();
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            // every entry consists of the format, 4 bytes of padding and the modifier
+            const char *entries = static_cast<const char *>(data);
+            for (uint32_t offset = 0; offset + 16 <= size; offset += 16) {
+                m_formatTable.append(*reinterpret_cast<const quint32 *>(entries + offset));
+            }
+            munmap(data, size);
+        }
+        close(fd);
+    }
+    void zwp_linux_dmabuf_feedback_v1_tranche_formats(wl_array *indices) override
+    {
+        const quint16 *data = static_cast<const quint16 *>(indices->data);
+        for (size_t i = 0; i < indices->size / sizeof(quint16); ++i) {
+            m_pendingTranche.append(m_formatTable.value(data[i]));
+        }
+        std::sort(m_pendingTranche.begin(), m_pendingTranche.end());
+    }
+    void zwp_linux_dmabuf_feedback_v1_tranche_done() override
+    {
+        m_pendingTranches.append(std::exchange(m_pendingTranche, {}));
+    }
+    void zwp_linux_dmabuf_feedback_v1_done() override
+    {
+        tranches = std::exchange(m_pendingTranches, {});
+        Q_EMIT done();
+    }
+
+private:
+    QVector<quint32> m_formatTable;
+    QVector<quint32> m_pendingTranche;
+    QVector<QVector<quint32>> m_pendingTranches;
+};
+
+// Fake compositor side
+
+class FakeBuffer : public LinuxDmaBufV1ClientBuffer
+{
+    Q_OBJECT
+public:
+    FakeBuffer(const QSize &size, quint32 format, quint32 flags, const QVector<LinuxDmaBufV1Plane> &planes)
+        : LinuxDmaBufV1ClientBuffer(size, format, flags, planes)
+    {
+    }
+    ~FakeBuffer() override
+    {
+        s_destroyed++;
+    }
+
+    static int s_destroyed;
+};
+
+int FakeBuffer::s_destroyed = 0;
+
+// Imports every buffer without touching the file descriptors. Asynchronous imports are
+// finished with finishImports(), or before importBufferAsync() returns.
+class FakeRenderer : public LinuxDmaBufV1ClientBufferIntegration::RendererInterface
+{
+public:
+    enum class Mode {
+        Synchronous,
+        Asynchronous,
+        AsynchronousImmediate,
+    };
+
+    LinuxDmaBufV1ClientBuffer *importBuffer(const QVector<LinuxDmaBufV1Plane> &planes, quint32 format, const QSize &size, quint32 flags) override
+    {
+        importCount++;
+        if (failImports) {
+            return nullptr;
+        }
+        return new FakeBuffer(size, format, flags, planes);
+    }
+
+    LinuxDmaBufV1ClientBuffer *reimportBuffer(LinuxDmaBufV1ClientBuffer *buffer, const QVector<LinuxDmaBufV1Plane> &planes) override
+    {
+        reimportedBuffers.append(buffer);
+        if (!shareImports) {
+            return RendererInterface::reimportBuffer(buffer, planes);
+        }
+        return new FakeBuffer(buffer->size(), buffer->format(), buffer->flags(), planes);
+    }
+
+    bool importBufferAsync(const QVector<LinuxDmaBufV1Plane> &planes, quint32 format, const QSize &size, quint32 flags, ImportCallback callback) override
+    {
+        switch (mode) {
+        case Mode::Synchronous:
+            return false;
+        case Mode::AsynchronousImmediate:
+            callback(importBuffer(planes, format, size, flags));
+            return true;
+        case Mode::Asynchronous:
+            pendingPlanes.append(planes);
+            pendingImports.append([this, planes, format, size, flags, callback]() {
+                callback(importBuffer(planes, format, size, flags));
+            });
+            return true;
+        }
+        Q_UNREACHABLE();
+    }
+
+    void finishImports()
+    {
+        const QVector<std::function<void()>> imports = std::exchange(pendingImports, {});
+        pendingPlanes.clear();
+        for (const auto &import : imports) {
+            import();
+        }
+    }
+
+    Mode mode = Mode::Synchronous;
+    bool failImports = false;
+    bool shareImports = true;
+    int importCount = 0;
+    QVector<LinuxDmaBufV1ClientBuffer *> reimportedBuffers;
+    QVector<std::function<void()>> pendingImports;
+    QVector<QVector<LinuxDmaBufV1Plane>> pendingPlanes;
+};
+
+Q_DECLARE_METATYPE(FakeRenderer::Mode)
+
+// The test itself
+
+class TestLinuxDmaBufInterface : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testCreate_data();
+    void testCreate();
+    void testParamsDestroyedWhileImportPending();
+    void testIntegrationDestroyedWhileImportPending();
+    void testDisplayDestroyedWhileImportPending();
+    void testImportCacheHit_data();
+    void testImportCacheHit();
+    void testImportCacheMiss();
+    void testImportCacheInvalidation();
+    void testFeedbackTranchesChanged();
+    void testFeedbackFormatTableChanged();
+
+private:
+    BufferParams *createParams(int fd, quint32 stride = s_stride);
+    ::wl_buffer *createBuffer(int fd, const QSize &size = s_bufferSize, quint32 stride = s_stride);
+    FakeBuffer *serverBuffer(::wl_buffer *buffer) const;
+    int createDmaBuf() const;
+
+    KWayland::Client::ConnectionThread *m_connection;
+    KWayland::Client::EventQueue *m_queue;
+    DmaBuf *m_dmabuf = nullptr;
+    KWayland::Client::Compositor *m_clientCompositor = nullptr;
+
+    QThread *m_thread;
+    KWaylandServer::Display *m_display;
+    CompositorInterface *m_serverCompositor;
+    LinuxDmaBufV1ClientBufferIntegration *m_integration;
+    FakeRenderer m_renderer;
+    ClientConnection *m_serverConnection = nullptr;
+};
+
+static const QString s_socketName = QStringLiteral("kwayland-test-linux-dmabuf-0");
+
+void TestLinuxDmaBufInterface::init()
+{
+    m_renderer = FakeRenderer();
+    FakeBuffer::s_destroyed = 0;
+
+    m_display = new KWaylandServer::Display();
+    m_display->addSocketName(s_socketName);
+    m_display->start();
+    QVERIFY(m_display->isRunning());
+
+    m_serverCompositor = new CompositorInterface(m_display, this);
+    m_integration = new LinuxDmaBufV1ClientBufferIntegration(m_display);
+    m_integration->setRendererInterface(&m_renderer);
+
+    LinuxDmaBufV1Feedback::Tranche tranche;
+    tranche.device = 0;
+    tranche.formatTable.insert(DRM_FORMAT_XRGB8888, {DRM_FORMAT_MOD_LINEAR});
+    m_integration->setSupportedFormatsWithModifiers({tranche});
+
+    // setup connection
+    m_connection = new KWayland::Client::ConnectionThread;
+    QSignalSpy connectedSpy(m_connection, &KWayland::Client::ConnectionThread::connected);
+    m_connection->setSocketName(s_socketName);
+
+    m_thread = new QThread(this);
+    m_connection->moveToThread(m_thread);
+    m_thread->start();
+
+    m_connection->initConnection();
+    QVERIFY(connectedSpy.wait());
+    QVERIFY(!m_connection->connections().isEmpty());
+
+    m_queue = new KWayland::Client::EventQueue(this);
+    m_queue->setup(m_connection);
+    QVERIFY(m_queue->isValid());
+
+    KWayland::Client::Registry registry;
+    QSignalSpy interfacesAnnouncedSpy(&registry, &KWayland::Client::Registry::interfacesAnnounced);
+    QSignalSpy compositorSpy(&registry, &KWayland::Client::Registry::compositorAnnounced);
+    connect(&registry, &KWayland::Client::Registry::interfaceAnnounced, this, [this, &registry](const QByteArray &interface, quint32 name, quint32 version) {
+        if (interface == "zwp_linux_dmabuf_v1") {
+            m_dmabuf = new DmaBuf;
+            m_dmabuf->init(registry.registry(), name, std::min(version, 4u));
+        }
+    });
+    registry.setEventQueue(m_queue);
+    registry.create(m_connection->display());
+    QVERIFY(registry.isValid());
+    registry.setup();
+    QVERIFY(interfacesAnnouncedSpy.wait());
+    QVERIFY(m_dmabuf);
+    QCOMPARE(compositorSpy.count(), 1);
+    m_clientCompositor = registry.createCompositor(compositorSpy.first().first().value<quint32>(), compositorSpy.first().last().value<quint32>(), this);
+    QVERIFY(m_clientCompositor->isValid());
+
+    QCOMPARE(m_display->connections().count(), 1);
+    m_serverConnection = m_display->connections().first();
+}
+
+void TestLinuxDmaBufInterface::cleanup()
+{
+#define CLEANUP(variable)   \
+    if (variable) {         \
+        delete variable;    \
+        variable = nullptr; \
+    }
+    CLEANUP(m_dmabuf)
+    CLEANUP(m_clientCompositor)
+    CLEANUP(m_queue)
+    if (m_connection) {
+        m_connection->deleteLater();
+        m_connection = nullptr;
+    }
+    if (m_thread) {
+        m_thread->quit();
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+    CLEANUP(m_display)
+#undef CLEANUP
+
+    // these are the children of the display
+    m_serverCompositor = nullptr;
+    m_integration = nullptr;
+    m_serverConnection = nullptr;
+
+    // the imports that are still pending have been cancelled
+    m_renderer.finishImports();
+}
+
+int TestLinuxDmaBufInterface::createDmaBuf() const
+{
+    // a memfd stands in for the dma-buf, the display only looks at its inode and size
+    const int fd = memfd_create("kwaylandserver-test", MFD_CLOEXEC);
+    if (fd != -1 && ftruncate(fd, s_stride * s_bufferSize.height()) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+BufferParams *TestLinuxDmaBufInterface::createParams(int fd, quint32 stride)
+{
+    auto params = new BufferParams(m_dmabuf->create_params());
+    params->add(fd, 0, 0, stride, DRM_FORMAT_MOD_LINEAR >> 32, DRM_FORMAT_MOD_LINEAR & 0xffffffff);
+    return params;
+}
+
+::wl_buffer *TestLinuxDmaBufInterface::createBuffer(int fd, const QSize &size, quint32 stride)
+{
+    QScopedPointer<BufferParams> params(createParams(fd, stride));
+    QSignalSpy createdSpy(params.data(), &BufferParams::created);
+    params->create(size.width(), size.height(), DRM_FORMAT_XRGB8888, 0);
+    if (!createdSpy.wait()) {
+        return nullptr;
+    }
+    return createdSpy.first().first().value<::wl_buffer *>();
+}
+
+FakeBuffer *TestLinuxDmaBufInterface::serverBuffer(::wl_buffer *buffer) const
+{
+    wl_resource *resource = m_serverConnection->getResource(wl_proxy_get_id(reinterpret_cast<wl_proxy *>(buffer)));
+    return qobject_cast<FakeBuffer *>(m_display->clientBufferForResource(resource));
+}
+
+void TestLinuxDmaBufInterface::testCreate_data()
+{
+    QTest::addColumn<FakeRenderer::Mode>("mode");
+    QTest::addColumn<bool>("fail");
+
+    QTest::newRow("sync") << FakeRenderer::Mode::Synchronous << false;
+    QTest::newRow("sync failed") << FakeRenderer::Mode::Synchronous << true;
+    QTest::newRow("async") << FakeRenderer::Mode::Asynchronous << false;
+    QTest::newRow("async failed") << FakeRenderer::Mode::Asynchronous << true;
+    QTest::newRow("async, immediate callback") << FakeRenderer::Mode::AsynchronousImmediate << false;
+    QTest::newRow("async failed, immediate callback") << FakeRenderer::Mode::AsynchronousImmediate << true;
+}
+
+void TestLinuxDmaBufInterface::testCreate()
+{
+    // this test verifies that the create request results in a created or a failed event, no
+    // matter whether and when the renderer imports the buffer asynchronously
+    QFETCH(FakeRenderer::Mode, mode);
+    QFETCH(bool, fail);
+    m_renderer.mode = mode;
+    m_renderer.failImports = fail;
+
+    const int fd = createDmaBuf();
+    QVERIFY(fd != -1);
+    QScopedPointer<BufferParams> params(createParams(fd));
+    close(fd);
+    QSignalSpy createdSpy(params.data(), &BufferParams::created);
+    QSignalSpy failedSpy(params.data(), &BufferParams::failed);
+    params->create(s_bufferSize.width(), s_bufferSize.height(), DRM_FORMAT_XRGB8888, 0);
+
+    if (mode == FakeRenderer::Mode::Asynchronous) {
+        QTRY_COMPARE(m_renderer.pendingImports.count(), 1);
+        QVERIFY(!createdSpy.wait(100));
+        QVERIFY(failedSpy.isEmpty());
+        m_renderer.finishImports();
+    }
+
+    if (fail) {
+        QVERIFY(failedSpy.wait());
+        QVERIFY(createdSpy.isEmpty());
+        QCOMPARE(FakeBuffer::s_destroyed, 0);
+        return;
+    }
+
+    QVERIFY(createdSpy.wait());
+    QVERIFY(failedSpy.isEmpty());
+    auto buffer = createdSpy.first().first().value<::wl_buffer *>();
+    QVERIFY(buffer);
+    QCOMPARE(m_renderer.importCount, 1);
+
+    FakeBuffer *clientBuffer = serverBuffer(buffer);
+    QVERIFY(clientBuffer);
+    QCOMPARE(clientBuffer->size(), s_bufferSize);
+    QCOMPARE(clientBuffer->format(), DRM_FORMAT_XRGB8888);
+
+    QSignalSpy bufferDestroyedSpy(clientBuffer, &QObject::destroyed);
+    wl_buffer_destroy(buffer);
+    QVERIFY(bufferDestroyedSpy.wait());
+}
+
+void TestLinuxDmaBufInterface::testParamsDestroyedWhileImportPending()
+{
+    // this test verifies that the file descriptors stay valid while an import is pending and
+    // the imported buffer is dropped if the client has destroyed the params object meanwhile
+    m_renderer.mode = FakeRenderer::Mode::Asynchronous;
+
+    const int fd = createDmaBuf();
+    QVERIFY(fd != -1);
+    QScopedPointer<BufferParams> params(createParams(fd));
+    close(fd);
+    const quint32 paramsId = wl_proxy_get_id(reinterpret_cast<wl_proxy *>(params->object()));
+    params->create(s_bufferSize.width(), s_bufferSize.height(), DRM_FORMAT_XRGB8888, 0);
+    QTRY_COMPARE(m_renderer.pendingImports.count(), 1);
+    const int serverFd = m_renderer.pendingPlanes.first().first().fd;
+
+    params.reset();
+    QTRY_VERIFY(!m_serverConnection->getResource(paramsId));
+    QVERIFY(fcntl(serverFd, F_GETFD) != -1);
+
+    m_renderer.finishImports();
+    QCOMPARE(FakeBuffer::s_destroyed, 1);
+    QCOMPARE(fcntl(serverFd, F_GETFD), -1);
+}
+
+void TestLinuxDmaBufInterface::testIntegrationDestroyedWhileImportPending()
+{
+    // this test verifies that destroying the integration cancels the pending imports
+    m_renderer.mode = FakeRenderer::Mode::Asynchronous;
+
+    const int fd = createDmaBuf();
+    QVERIFY(fd != -1);
+    QScopedPointer<BufferParams> params(createParams(fd));
+    close(fd);
+    QSignalSpy createdSpy(params.data(), &BufferParams::created);
+    QSignalSpy failedSpy(params.data(), &BufferParams::failed);
+    params->create(s_bufferSize.width(), s_bufferSize.height(), DRM_FORMAT_XRGB8888, 0);
+    QTRY_COMPARE(m_renderer.pendingImports.count(), 1);
+    const int serverFd = m_renderer.pendingPlanes.first().first().fd;
+
+    delete m_integration;
+    m_integration = nullptr;
+    QVERIFY(failedSpy.wait());
+    QVERIFY(fcntl(serverFd, F_GETFD) != -1);
+
+    m_renderer.finishImports();
+    QCOMPARE(FakeBuffer::s_destroyed, 1);
+    QCOMPARE(fcntl(serverFd, F_GETFD), -1);
+    QVERIFY(!createdSpy.wait(100));
+}
+
+void TestLinuxDmaBufInterface::testDisplayDestroyedWhileImportPending()
+{
+    // this test verifies that an import can finish after the display has been destroyed
+    m_renderer.mode = FakeRenderer::Mode::Asynchronous;
+
+    const int fd = createDmaBuf();
+    QVERIFY(fd != -1);
+    QScopedPointer<BufferParams> params(createParams(fd));
+    close(fd);
+    params->create(s_bufferSize.width(), s_bufferSize.height(), DRM_FORMAT_XRGB8888, 0);
+    QTRY_COMPARE(m_renderer.pendingImports.count(), 1);
+    const int serverFd = m_renderer.pendingPlanes.first().first().fd;
+
+    delete m_display;
+    m_display = nullptr;
+    m_integration = nullptr;
+    m_serverConnection = nullptr;
+    QVERIFY(fcntl(serverFd, F_GETFD) != -1);
+
+    m_renderer.finishImports();
+    QCOMPARE(FakeBuffer::s_destroyed, 1);
+    QCOMPARE(fcntl(serverFd, F_GETFD), -1);
+}
+
+void TestLinuxDmaBufInterface::testImportCacheHit_data()
+{
+    QTest::addColumn<bool>("shareImports");
+
+    QTest::newRow("default reimport") << false;
+    QTest::newRow("shared import") << true;
+}
+
+void TestLinuxDmaBufInterface::testImportCacheHit()
+{
+    // this test verifies that a buffer with the same dma-buf and layout as an imported
+    // buffer is imported with reimportBuffer()
+    QFETCH(bool, shareImports);
+    m_renderer.shareImports = shareImports;
+
+    const int fd = createDmaBuf();
+    QVERIFY(fd != -1);
+    ::wl_buffer *buffer1 = createBuffer(fd);
+    QVERIFY(buffer1);
+    QCOMPARE(m_renderer.importCount, 1);
+    QVERIFY(m_renderer.reimportedBuffers.isEmpty());
+
+    ::wl_buffer *buffer2 = createBuffer(fd);
+    QVERIFY(buffer2);
+    QCOMPARE(m_renderer.reimportedBuffers.count(), 1);
+    QCOMPARE(m_renderer.reimportedBuffers.first(), serverBuffer(buffer1));
+    // the default implementation imports the buffer again
+    QCOMPARE(m_renderer.importCount, shareImports ? 1 : 2);
+
+    FakeBuffer *clientBuffer2 = serverBuffer(buffer2);
+    QVERIFY(clientBuffer2);
+    QVERIFY(clientBuffer2 != serverBuffer(buffer1));
+    QCOMPARE(clientBuffer2->size(), s_bufferSize);
+    QCOMPARE(clientBuffer2->format(), DRM_FORMAT_XRGB8888);
+
+    // every buffer owns its own file descriptor
+    QCOMPARE(clientBuffer2->planes().count(), 1);
+    QVERIFY(clientBuffer2->planes().first().fd != serverBuffer(buffer1)->planes().first().fd);
+
+    wl_buffer_destroy(buffer1);
+    wl_buffer_destroy(buffer2);
+    close(fd);
+}
+
+void TestLinuxDmaBufInterface::testImportCacheMiss()
+{
+    // this test verifies that buffers with a different dma-buf or layout are not served
+    // from the import cache
+    const int fd = createDmaBuf();
+    QVERIFY(fd != -1);
+    ::wl_buffer *buffer = createBuffer(fd);
+    QVERIFY(buffer);
+    QCOMPARE(m_renderer.importCount, 1);
+
+    // another dma-buf
+    const int otherFd = createDmaBuf();
+    QVERIFY(otherFd != -1);
+    ::wl_buffer *otherDmaBuf = createBuffer(otherFd);
+    QVERIFY(otherDmaBuf);
+    QCOMPARE(m_renderer.importCount, 2);
+
+    // the same dma-buf with another size
+    ::wl_buffer *otherSize = createBuffer(fd, s_bufferSize / 2);
+    QVERIFY(otherSize);
+    QCOMPARE(m_renderer.importCount, 3);
+
+    // the same dma-buf with another stride
+    ::wl_buffer *otherStride = createBuffer(fd, s_bufferSize, s_stride / 2);
+    QVERIFY(otherStride);
+    QCOMPARE(m_renderer.importCount, 4);
+
+    QVERIFY(m_renderer.reimportedBuffers.isEmpty());
+
+    wl_buffer_destroy(buffer);
+    wl_buffer_destroy(otherDmaBuf);
+    wl_buffer_destroy(otherSize);
+    wl_buffer_destroy(otherStride);
+    close(fd);
+    close(otherFd);
+}
+
+void TestLinuxDmaBufInterface::testImportCacheInvalidation()
+{
+    // this test verifies that destroyed buffers are removed from the import cache
+    const int fd = createDmaBuf();
+    QVERIFY(fd != -1);
+    ::wl_buffer *buffer1 = createBuffer(fd);
+    QVERIFY(buffer1);
+    ::wl_buffer *buffer2 = createBuffer(fd);
+    QVERIFY(buffer2);
+    QCOMPARE(m_renderer.importCount, 1);
+    QCOMPARE(m_renderer.reimportedBuffers.count(), 1);
+
+    // the remaining buffer is reused
+    QSignalSpy buffer1DestroyedSpy(serverBuffer(buffer1), &QObject::destroyed);
+    wl_buffer_destroy(buffer1);
+    QVERIFY(buffer1DestroyedSpy.wait());
+    FakeBuffer *clientBuffer2 = serverBuffer(buffer2);
+    ::wl_buffer *buffer3 = createBuffer(fd);
+    QVERIFY(buffer3);
+    QCOMPARE(m_renderer.importCount, 1);
+    QCOMPARE(m_renderer.reimportedBuffers.count(), 2);
+    QCOMPARE(m_renderer.reimportedBuffers.last(), clientBuffer2);
+
+    // all buffers are gone, the dma-buf has to be imported again
+    QSignalSpy buffer2DestroyedSpy(clientBuffer2, &QObject::destroyed);
+    QSignalSpy buffer3DestroyedSpy(serverBuffer(buffer3), &QObject::destroyed);
+    wl_buffer_destroy(buffer2);
+    wl_buffer_destroy(buffer3);
+    QVERIFY(buffer3DestroyedSpy.wait());
+    QCOMPARE(buffer2DestroyedSpy.count(), 1);
+    ::wl_buffer *buffer4 = createBuffer(fd);
+    QVERIFY(buffer4);
+    QCOMPARE(m_renderer.importCount, 2);
+    QCOMPARE(m_renderer.reimportedBuffers.count(), 2);
+
+    wl_buffer_destroy(buffer4);
+    close(fd);
+}
+
+void TestLinuxDmaBufInterface::testFeedbackTranchesChanged()
+{
+    // this test verifies that the feedback is encoded again when its tranches change while
+    // the format table stays the same
+    LinuxDmaBufV1Feedback::Tranche tranche;
+    tranche.device = 0;
+    tranche.formatTable.insert(DRM_FORMAT_XRGB8888, {DRM_FORMAT_MOD_LINEAR});
+    tranche.formatTable.insert(DRM_FORMAT_ARGB8888, {DRM_FORMAT_MOD_LINEAR});
+    m_integration->setSupportedFormatsWithModifiers({tranche});
+
+    QSignalSpy surfaceCreatedSpy(m_serverCompositor, &CompositorInterface::surfaceCreated);
+    QScopedPointer<KWayland::Client::Surface> surface(m_clientCompositor->createSurface());
+    QVERIFY(surfaceCreatedSpy.wait());
+    auto serverSurface = surfaceCreatedSpy.first().first().value<SurfaceInterface *>();
+
+    QScopedPointer<DmaBufFeedback> feedback(new DmaBufFeedback(m_dmabuf->get_surface_feedback(*surface)));
+    QSignalSpy doneSpy(feedback.data(), &DmaBufFeedback::done);
+    QVERIFY(doneSpy.wait());
+    QVERIFY(serverSurface->dmabufFeedbackV1());
+    const QVector<quint32> defaultFormats{DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888};
+    QCOMPARE(feedback->tranches, (QVector<QVector<quint32>>{defaultFormats}));
+
+    LinuxDmaBufV1Feedback::Tranche scanoutTranche;
+    scanoutTranche.device = 0;
+    scanoutTranche.flags = LinuxDmaBufV1Feedback::TrancheFlag::Scanout;
+    scanoutTranche.formatTable.insert(DRM_FORMAT_XRGB8888, {DRM_FORMAT_MOD_LINEAR});
+    serverSurface->dmabufFeedbackV1()->setTranches({scanoutTranche});
+    QVERIFY(doneSpy.wait());
+    QCOMPARE(feedback->tranches, (QVector<QVector<quint32>>{{DRM_FORMAT_XRGB8888}, defaultFormats}));
+
+    scanoutTranche.formatTable.clear();
+    scanoutTranche.formatTable.insert(DRM_FORMAT_ARGB8888, {DRM_FORMAT_MOD_LINEAR});
+    serverSurface->dmabufFeedbackV1()->setTranches({scanoutTranche});
+    QVERIFY(doneSpy.wait());
+    QCOMPARE(feedback->tranches, (QVector<QVector<quint32>>{{DRM_FORMAT_ARGB8888}, defaultFormats}));
+}
+
+void TestLinuxDmaBufInterface::testFeedbackFormatTableChanged()
+{
+    // this test verifies that the feedback is encoded again for the new format table
+    QScopedPointer<DmaBufFeedback> feedback(new DmaBufFeedback(m_dmabuf->get_default_feedback()));
+    QSignalSpy doneSpy(feedback.data(), &DmaBufFeedback::done);
+    QVERIFY(doneSpy.wait());
+    QCOMPARE(feedback->tranches, (QVector<QVector<quint32>>{{DRM_FORMAT_XRGB8888}}));
+
+    LinuxDmaBufV1Feedback::Tranche tranche;
+    tranche.device = 0;
+    tranche.formatTable.insert(DRM_FORMAT_XRGB8888, {DRM_FORMAT_MOD_LINEAR});
+    tranche.formatTable.insert(DRM_FORMAT_ARGB8888, {DRM_FORMAT_MOD_LINEAR});
+    tranche.formatTable.insert(DRM_FORMAT_XBGR8888, {DRM_FORMAT_MOD_LINEAR});
+    m_integration->setSupportedFormatsWithModifiers({tranche});
+    QVERIFY(doneSpy.wait());
+    QCOMPARE(feedback->tranches, (QVector<QVector<quint32>>{{DRM_FORMAT_XBGR8888, DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888}}));
+}
+
+QTEST_GUILESS_MAIN(TestLinuxDmaBufInterface)
+#include "test_linuxdmabuf_interface.moc"
@@ -0,0 +1,102 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// WaylandServer
+#include "../../src/server/utils/ramfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace KWaylandServer;
+
+class TestRamFile : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testSealed();
+    void testFallback();
+    void testNullTerminated_data();
+    void testNullTerminated();
+};
+
+static QByteArray readAll(int fd, int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    if (pread(fd, data.data(), size, 0) != size) {
+        return QByteArray();
+    }
+    return data;
+}
+
+void TestRamFile::testSealed()
+{
+    RamFile file("test", QByteArrayLiteral("foobar"));
+    QVERIFY(file.isValid());
+    QCOMPARE(file.size(), 6);
+    QCOMPARE(readAll(file.fd(), file.size()), QByteArrayLiteral("foobar"));
+
+#if defined(F_GET_SEALS)
+    if (!file.isSealed()) {
+        QSKIP("memfds can't be sealed on this system");
+    }
+    const int seals = fcntl(file.fd(), F_GET_SEALS);
+    QVERIFY(seals != -1);
+    QVERIFY(seals & F_SEAL_WRITE);
+    QVERIFY(seals & F_SEAL_SHRINK);
+    QVERIFY(seals & F_SEAL_GROW);
+    QVERIFY(seals & F_SEAL_SEAL);
+
+    // no client can modify the data, not even through a writable mapping
+    QCOMPARE(pwrite(file.fd(), "baz", 3, 0), ssize_t(-1));
+    QCOMPARE(mmap(nullptr, file.size(), PROT_READ | PROT_WRITE, MAP_SHARED, file.fd(), 0), MAP_FAILED);
+    QCOMPARE(ftruncate(file.fd(), 0), -1);
+    QCOMPARE(readAll(file.fd(), file.size()), QByteArrayLiteral("foobar"));
+#else
+    QVERIFY(!file.isSealed());
+#endif
+}
+
+void TestRamFile::testFallback()
+{
+    RamFile file("test", QByteArrayLiteral("foobar"), RamFile::Flag::NoMemfd);
+    QVERIFY(file.isValid());
+    QVERIFY(!file.isSealed());
+    QCOMPARE(file.size(), 6);
+    QCOMPARE(readAll(file.fd(), file.size()), QByteArrayLiteral("foobar"));
+
+    // the file descriptor is read-only
+    QCOMPARE(fcntl(file.fd(), F_GETFL) & O_ACCMODE, O_RDONLY);
+    QCOMPARE(pwrite(file.fd(), "baz", 3, 0), ssize_t(-1));
+    QCOMPARE(mmap(nullptr, file.size(), PROT_READ | PROT_WRITE, MAP_SHARED, file.fd(), 0), MAP_FAILED);
+    QCOMPARE(readAll(file.fd(), file.size()), QByteArrayLiteral("foobar"));
+}
+
+void TestRamFile::testNullTerminated_data()
+{
+    QTest::addColumn<bool>("noMemfd");
+
+    QTest::addRow("memfd") << false;
+    QTest::addRow("fallback") << true;
+}
+
+void TestRamFile::testNullTerminated()
+{
+    QFETCH(bool, noMemfd);
+
+    RamFile::Flags flags = RamFile::Flag::NullTerminated;
+    if (noMemfd) {
+        flags |= RamFile::Flag::NoMemfd;
+    }
+    RamFile file("test", QByteArrayLiteral("foo"), flags);
+    QVERIFY(file.isValid());
+    QCOMPARE(file.size(), 4);
+    QCOMPARE(readAll(file.fd(), file.size()), QByteArray("foo", 4));
+}
+
+QTEST_GUILESS_MAIN(TestRamFile)
+#include "test_ramfile.moc"
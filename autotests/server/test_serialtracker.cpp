@@ -0,0 +1,115 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// WaylandServer
+#include "../../src/server/display.h"
+#include "../../src/server/seat_interface.h"
+#include "../../src/server/serialtracker.h"
+
+#include <linux/input.h>
+
+using namespace KWaylandServer;
+
+class TestSerialTracker : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testTrack();
+    void testUnknown();
+    void testEviction();
+    void testImplicitPointerGrab();
+};
+
+void TestSerialTracker::testTrack()
+{
+    Display display;
+    SeatInterface seat(&display);
+    seat.setTimestamp(42);
+    SerialTracker *tracker = display.serialTracker();
+    QVERIFY(tracker);
+
+    const quint32 serial = tracker->next(SerialTracker::EventType::PointerButtonPress, &seat, nullptr, BTN_LEFT);
+    QCOMPARE(display.serial(), serial);
+
+    const SerialTracker::Event *event = tracker->find(serial);
+    QVERIFY(event);
+    QCOMPARE(event->serial, serial);
+    QCOMPARE(event->type, SerialTracker::EventType::PointerButtonPress);
+    QCOMPARE(event->detail, quint32(BTN_LEFT));
+    QCOMPARE(event->timestamp, quint32(42));
+    QCOMPARE(event->seat, &seat);
+    QVERIFY(!event->surface);
+
+    QVERIFY(tracker->isValid(serial, SerialTracker::EventType::PointerButtonPress));
+    QVERIFY(tracker->isValid(serial, SerialTracker::EventType::PointerButtonPress | SerialTracker::EventType::TouchDown, &seat));
+    QVERIFY(!tracker->isValid(serial, SerialTracker::EventType::KeyboardKeyPress));
+
+    SeatInterface otherSeat(&display);
+    QVERIFY(!tracker->isValid(serial, SerialTracker::EventType::PointerButtonPress, &otherSeat));
+}
+
+void TestSerialTracker::testUnknown()
+{
+    Display display;
+    SerialTracker *tracker = display.serialTracker();
+
+    QVERIFY(!tracker->find(0));
+    QVERIFY(!tracker->find(display.nextSerial()));
+    QVERIFY(!tracker->find(display.serial() + 1));
+}
+
+void TestSerialTracker::testEviction()
+{
+    Display display;
+    SeatInterface seat(&display);
+    SerialTracker *tracker = display.serialTracker();
+
+    const quint32 serial = tracker->next(SerialTracker::EventType::KeyboardKeyPress, &seat, nullptr, KEY_A);
+
+    // untracked serials don't evict it
+    for (int i = 0; i < SerialTracker::capacity() * 2; ++i) {
+        display.nextSerial();
+    }
+    QVERIFY(tracker->isValid(serial, SerialTracker::EventType::KeyboardKeyPress));
+
+    // a newer tracked serial in the same place does
+    for (int i = 0; i < SerialTracker::capacity(); ++i) {
+        tracker->next(SerialTracker::EventType::KeyboardKeyRelease, &seat, nullptr, KEY_A);
+    }
+    QVERIFY(!tracker->find(serial));
+}
+
+void TestSerialTracker::testImplicitPointerGrab()
+{
+    Display display;
+    SeatInterface seat(&display);
+    seat.setHasPointer(true);
+
+    seat.notifyPointerButton(BTN_LEFT, PointerButtonState::Pressed);
+    const quint32 pressSerial = seat.pointerButtonSerial(BTN_LEFT);
+    QVERIFY(seat.hasImplicitPointerGrab(pressSerial));
+    QVERIFY(!seat.hasImplicitPointerGrab(display.nextSerial()));
+
+    // the button is still held after many other serials
+    for (int i = 0; i < SerialTracker::capacity() * 2; ++i) {
+        display.serialTracker()->next(SerialTracker::EventType::KeyboardKeyPress, &seat, nullptr, KEY_A);
+    }
+    QVERIFY(!display.serialTracker()->find(pressSerial));
+    QVERIFY(seat.hasImplicitPointerGrab(pressSerial));
+
+    seat.notifyPointerButton(BTN_LEFT, PointerButtonState::Released);
+    const quint32 releaseSerial = seat.pointerButtonSerial(BTN_LEFT);
+    QVERIFY(!seat.hasImplicitPointerGrab(pressSerial));
+    QVERIFY(!seat.hasImplicitPointerGrab(releaseSerial));
+
+    seat.notifyPointerButton(BTN_RIGHT, PointerButtonState::Pressed);
+    QVERIFY(seat.hasImplicitPointerGrab(seat.pointerButtonSerial(BTN_RIGHT)));
+    QVERIFY(!seat.hasImplicitPointerGrab(releaseSerial));
+}
+
+QTEST_GUILESS_MAIN(TestSerialTracker)
+#include "test_serialtracker.moc"
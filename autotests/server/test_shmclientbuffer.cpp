@@ -0,0 +1,424 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+// Qt
+#include <QImage>
+#include <QThread>
+#include <QtTest>
+
+// WaylandServer
+#include "../../src/server/clientconnection.h"
+#include "../../src/server/display.h"
+#include "../../src/server/drm_fourcc.h"
+#include "../../src/server/shmclientbuffer.h"
+
+#include <KWayland/Client/connection_thread.h>
+#include <KWayland/Client/registry.h>
+
+#include <wayland-client-protocol.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace KWaylandServer;
+
+Q_DECLARE_METATYPE(KWaylandServer::Display::ShmOptions)
+
+static const QSize s_bufferSize(16, 16);
+static const int s_stride = 16 * 4;
+static const int s_pageSize = 4096;
+static const QRgb s_color = qRgb(255, 0, 0);
+
+class TestShmClientBuffer : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testData_data();
+    void testData();
+    void testDataAfterDestroy_data();
+    void testDataAfterDestroy();
+    void testResizePool();
+    void testTruncatedPool_data();
+    void testTruncatedPool();
+    void testUndersizedSealedPool_data();
+    void testUndersizedSealedPool();
+    void testDmaBufPlanesFallback_data();
+    void testDmaBufPlanesFallback();
+    void testDmaBufPlanes();
+
+private:
+    void connectClient(Display::ShmOptions options);
+    int createPoolFile(int size, int seals) const;
+    ::wl_buffer *createBuffer(::wl_shm_pool *pool, int offset);
+    ShmClientBuffer *serverBuffer(::wl_buffer *buffer) const;
+
+    KWaylandServer::Display *m_display = nullptr;
+    KWayland::Client::ConnectionThread *m_connection = nullptr;
+    QThread *m_thread = nullptr;
+    ::wl_shm *m_shm = nullptr;
+};
+
+static const QString s_socketName = QStringLiteral("kwayland-test-shm-client-buffer-0");
+
+void TestShmClientBuffer::init()
+{
+    m_display = new KWaylandServer::Display(this);
+    m_display->addSocketName(s_socketName);
+    m_display->start();
+    QVERIFY(m_display->isRunning());
+}
+
+void TestShmClientBuffer::connectClient(Display::ShmOptions options)
+{
+    m_display->createShm(options);
+
+    m_connection = new KWayland::Client::ConnectionThread;
+    QSignalSpy connectedSpy(m_connection, &KWayland::Client::ConnectionThread::connected);
+    m_connection->setSocketName(s_socketName);
+
+    m_thread = new QThread(this);
+    m_connection->moveToThread(m_thread);
+    m_thread->start();
+
+    m_connection->initConnection();
+    QVERIFY(connectedSpy.wait());
+
+    KWayland::Client::Registry registry;
+    QSignalSpy shmSpy(&registry, &KWayland::Client::Registry::shmAnnounced);
+    registry.create(m_connection->display());
+    QVERIFY(registry.isValid());
+    registry.setup();
+    QVERIFY(shmSpy.wait());
+    m_shm = registry.bindShm(shmSpy.first().first().value<quint32>(), shmSpy.first().last().value<quint32>());
+    QVERIFY(m_shm);
+}
+
+void TestShmClientBuffer::cleanup()
+{
+    if (m_shm) {
+        wl_shm_destroy(m_shm);
+        m_shm = nullptr;
+    }
+    if (m_thread) {
+        m_thread->quit();
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+    delete m_connection;
+    m_connection = nullptr;
+
+    delete m_display;
+    m_display = nullptr;
+}
+
+int TestShmClientBuffer::createPoolFile(int size, int seals) const
+{
+    // The pool contains a page of zeros followed by the buffer data, if it's large enough.
+    const int fd = memfd_create("kwaylandserver-test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        return -1;
+    }
+    if (ftruncate(fd, size) == -1) {
+        close(fd);
+        return -1;
+    }
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (size >= s_pageSize + s_stride * s_bufferSize.height()) {
+        QImage image(static_cast<uchar *>(data) + s_pageSize, s_bufferSize.width(), s_bufferSize.height(), s_stride, QImage::Format_RGB32);
+        image.fill(s_color);
+    }
+    munmap(data, size);
+
+    if (seals && fcntl(fd, F_ADD_SEALS, seals) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+::wl_buffer *TestShmClientBuffer::createBuffer(::wl_shm_pool *pool, int offset)
+{
+    ::wl_buffer *buffer = wl_shm_pool_create_buffer(pool, offset, s_bufferSize.width(), s_bufferSize.height(), s_stride, WL_SHM_FORMAT_XRGB8888);
+    m_connection->flush();
+    return buffer;
+}
+
+ShmClientBuffer *TestShmClientBuffer::serverBuffer(::wl_buffer *buffer) const
+{
+    const QVector<ClientConnection *> connections = m_display->connections();
+    if (connections.isEmpty()) {
+        return nullptr;
+    }
+    wl_resource *resource = connections.first()->getResource(wl_proxy_get_id(reinterpret_cast<wl_proxy *>(buffer)));
+    if (!resource) {
+        return nullptr;
+    }
+    return qobject_cast<ShmClientBuffer *>(m_display->clientBufferForResource(resource));
+}
+
+void TestShmClientBuffer::testData_data()
+{
+    QTest::addColumn<Display::ShmOptions>("options");
+    QTest::addColumn<int>("seals");
+
+    QTest::newRow("libwayland") << Display::ShmOptions() << 0;
+    QTest::newRow("libwayland, sealed") << Display::ShmOptions() << (F_SEAL_SHRINK | F_SEAL_SEAL);
+    QTest::newRow("promotion") << Display::ShmOptions(Display::ShmOption::DmaBufPromotion) << 0;
+    QTest::newRow("promotion, sealed") << Display::ShmOptions(Display::ShmOption::DmaBufPromotion) << (F_SEAL_SHRINK | F_SEAL_SEAL);
+}
+
+void TestShmClientBuffer::testData()
+{
+    // this test verifies that the buffer data can be accessed with both wl_shm implementations
+    QFETCH(Display::ShmOptions, options);
+    QFETCH(int, seals);
+    connectClient(options);
+
+    const int fd = createPoolFile(2 * s_pageSize, seals);
+    QVERIFY(fd != -1);
+    ::wl_shm_pool *pool = wl_shm_create_pool(m_shm, fd, 2 * s_pageSize);
+    close(fd);
+    ::wl_buffer *buffer = createBuffer(pool, s_pageSize);
+
+    ShmClientBuffer *clientBuffer = nullptr;
+    QTRY_VERIFY((clientBuffer = serverBuffer(buffer)));
+    QCOMPARE(clientBuffer->size(), s_bufferSize);
+    QVERIFY(!clientBuffer->hasAlphaChannel());
+    QCOMPARE(clientBuffer->drmFormat(), DRM_FORMAT_XRGB8888);
+
+    const QImage image = clientBuffer->data();
+    QCOMPARE(image.size(), s_bufferSize);
+    QCOMPARE(image.format(), QImage::Format_RGB32);
+    QCOMPARE(image.pixel(0, 0), s_color);
+    QCOMPARE(image.pixel(s_bufferSize.width() - 1, s_bufferSize.height() - 1), s_color);
+
+    wl_buffer_destroy(buffer);
+    wl_shm_pool_destroy(pool);
+}
+
+void TestShmClientBuffer::testDataAfterDestroy_data()
+{
+    QTest::addColumn<Display::ShmOptions>("options");
+
+    QTest::newRow("libwayland") << Display::ShmOptions();
+    QTest::newRow("promotion") << Display::ShmOptions(Display::ShmOption::DmaBufPromotion);
+}
+
+void TestShmClientBuffer::testDataAfterDestroy()
+{
+    // this test verifies that a referenced buffer can be accessed after the client has
+    // destroyed the wl_buffer and the wl_shm_pool
+    QFETCH(Display::ShmOptions, options);
+    connectClient(options);
+
+    const int fd = createPoolFile(2 * s_pageSize, 0);
+    QVERIFY(fd != -1);
+    ::wl_shm_pool *pool = wl_shm_create_pool(m_shm, fd, 2 * s_pageSize);
+    close(fd);
+    ::wl_buffer *buffer = createBuffer(pool, s_pageSize);
+
+    ShmClientBuffer *clientBuffer = nullptr;
+    QTRY_VERIFY((clientBuffer = serverBuffer(buffer)));
+    clientBuffer->ref();
+
+    wl_buffer_destroy(buffer);
+    wl_shm_pool_destroy(pool);
+    m_connection->flush();
+    QTRY_VERIFY(clientBuffer->isDestroyed());
+
+    QCOMPARE(clientBuffer->data().pixel(0, 0), s_color);
+
+    QSignalSpy destroyedSpy(clientBuffer, &QObject::destroyed);
+    clientBuffer->unref();
+    QCOMPARE(destroyedSpy.count(), 1);
+}
+
+void TestShmClientBuffer::testResizePool()
+{
+    // this test verifies that buffers can be created in the grown part of a pool
+    connectClient(Display::ShmOption::DmaBufPromotion);
+    QSignalSpy errorSpy(m_connection, &KWayland::Client::ConnectionThread::errorOccurred);
+
+    const int fd = createPoolFile(2 * s_pageSize, 0);
+    QVERIFY(fd != -1);
+    ::wl_shm_pool *pool = wl_shm_create_pool(m_shm, fd, s_pageSize);
+    close(fd);
+
+    ::wl_buffer *buffer1 = createBuffer(pool, 0);
+    ShmClientBuffer *clientBuffer1 = nullptr;
+    QTRY_VERIFY((clientBuffer1 = serverBuffer(buffer1)));
+
+    // the resize is deferred while the pool is accessed
+    QImage image = clientBuffer1->data();
+    QCOMPARE(image.pixel(0, 0), qRgb(0, 0, 0));
+    wl_shm_pool_resize(pool, 2 * s_pageSize);
+    ::wl_buffer *buffer2 = createBuffer(pool, 0);
+    QTRY_VERIFY(serverBuffer(buffer2));
+    QCOMPARE(image.pixel(0, 0), qRgb(0, 0, 0));
+    image = QImage();
+
+    ::wl_buffer *buffer3 = createBuffer(pool, s_pageSize);
+    ShmClientBuffer *clientBuffer3 = nullptr;
+    QTRY_VERIFY((clientBuffer3 = serverBuffer(buffer3)));
+    QCOMPARE(clientBuffer3->data().pixel(0, 0), s_color);
+    QVERIFY(errorSpy.isEmpty());
+
+    // shrinking a pool is a protocol error
+    wl_shm_pool_resize(pool, s_pageSize);
+    m_connection->flush();
+    QVERIFY(errorSpy.wait());
+
+    wl_buffer_destroy(buffer1);
+    wl_buffer_destroy(buffer2);
+    wl_buffer_destroy(buffer3);
+    wl_shm_pool_destroy(pool);
+}
+
+void TestShmClientBuffer::testTruncatedPool_data()
+{
+    QTest::addColumn<Display::ShmOptions>("options");
+
+    QTest::newRow("libwayland") << Display::ShmOptions();
+    QTest::newRow("promotion") << Display::ShmOptions(Display::ShmOption::DmaBufPromotion);
+}
+
+void TestShmClientBuffer::testTruncatedPool()
+{
+    // this test verifies that the display survives a client truncating a pool that is being
+    // accessed, and that the client gets a protocol error
+    QFETCH(Display::ShmOptions, options);
+    connectClient(options);
+    QSignalSpy errorSpy(m_connection, &KWayland::Client::ConnectionThread::errorOccurred);
+
+    const int fd = createPoolFile(2 * s_pageSize, 0);
+    QVERIFY(fd != -1);
+    ::wl_shm_pool *pool = wl_shm_create_pool(m_shm, fd, 2 * s_pageSize);
+    ::wl_buffer *buffer = createBuffer(pool, s_pageSize);
+
+    ShmClientBuffer *clientBuffer = nullptr;
+    QTRY_VERIFY((clientBuffer = serverBuffer(buffer)));
+
+    QVERIFY(ftruncate(fd, 0) == 0);
+    close(fd);
+    {
+        const QImage image = clientBuffer->data();
+        QCOMPARE(image.pixel(0, 0), qRgb(0, 0, 0));
+    }
+    QVERIFY(errorSpy.wait());
+}
+
+void TestShmClientBuffer::testUndersizedSealedPool_data()
+{
+    QTest::addColumn<bool>("resize");
+
+    QTest::newRow("create") << false;
+    QTest::newRow("resize") << true;
+}
+
+void TestShmClientBuffer::testUndersizedSealedPool()
+{
+    // this test verifies that a pool sealed against shrinking that is larger than its file
+    // doesn't crash the display when the part past the end of the file is accessed
+    QFETCH(bool, resize);
+    connectClient(Display::ShmOption::DmaBufPromotion);
+    QSignalSpy errorSpy(m_connection, &KWayland::Client::ConnectionThread::errorOccurred);
+
+    const int fd = createPoolFile(s_pageSize, F_SEAL_SHRINK | F_SEAL_SEAL);
+    QVERIFY(fd != -1);
+    ::wl_shm_pool *pool = wl_shm_create_pool(m_shm, fd, resize ? s_pageSize : 2 * s_pageSize);
+    close(fd);
+    if (resize) {
+        wl_shm_pool_resize(pool, 2 * s_pageSize);
+    }
+    ::wl_buffer *buffer = createBuffer(pool, s_pageSize);
+
+    ShmClientBuffer *clientBuffer = nullptr;
+    QTRY_VERIFY((clientBuffer = serverBuffer(buffer)));
+    QVERIFY(clientBuffer->dmaBufPlanes().isEmpty());
+    {
+        const QImage image = clientBuffer->data();
+        QCOMPARE(image.pixel(0, 0), qRgb(0, 0, 0));
+    }
+    QVERIFY(errorSpy.wait());
+}
+
+void TestShmClientBuffer::testDmaBufPlanesFallback_data()
+{
+    QTest::addColumn<Display::ShmOptions>("options");
+    QTest::addColumn<int>("seals");
+
+    QTest::newRow("libwayland") << Display::ShmOptions() << (F_SEAL_SHRINK | F_SEAL_SEAL);
+    QTest::newRow("not sealed") << Display::ShmOptions(Display::ShmOption::DmaBufPromotion) << 0;
+    QTest::newRow("sealed against writing") << Display::ShmOptions(Display::ShmOption::DmaBufPromotion) << (F_SEAL_SHRINK | F_SEAL_WRITE | F_SEAL_SEAL);
+}
+
+void TestShmClientBuffer::testDmaBufPlanesFallback()
+{
+    // this test verifies that buffers that can't be promoted to dma-bufs have no planes
+    QFETCH(Display::ShmOptions, options);
+    QFETCH(int, seals);
+    connectClient(options);
+
+    const int fd = createPoolFile(2 * s_pageSize, seals);
+    QVERIFY(fd != -1);
+    ::wl_shm_pool *pool = wl_shm_create_pool(m_shm, fd, 2 * s_pageSize);
+    close(fd);
+    ::wl_buffer *buffer = createBuffer(pool, s_pageSize);
+
+    ShmClientBuffer *clientBuffer = nullptr;
+    QTRY_VERIFY((clientBuffer = serverBuffer(buffer)));
+    QVERIFY(clientBuffer->dmaBufPlanes().isEmpty());
+    // the buffer can still be uploaded
+    QCOMPARE(clientBuffer->data().pixel(0, 0), s_color);
+
+    wl_buffer_destroy(buffer);
+    wl_shm_pool_destroy(pool);
+}
+
+void TestShmClientBuffer::testDmaBufPlanes()
+{
+    // this test verifies that buffers in a sealed memfd are promoted to dma-bufs
+    const int udmabuf = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (udmabuf == -1) {
+        QSKIP("/dev/udmabuf is not available");
+    }
+    close(udmabuf);
+    connectClient(Display::ShmOption::DmaBufPromotion);
+
+    const int fd = createPoolFile(2 * s_pageSize, F_SEAL_SHRINK | F_SEAL_SEAL);
+    QVERIFY(fd != -1);
+    ::wl_shm_pool *pool = wl_shm_create_pool(m_shm, fd, 2 * s_pageSize);
+    close(fd);
+    ::wl_buffer *buffer = createBuffer(pool, s_pageSize);
+
+    ShmClientBuffer *clientBuffer = nullptr;
+    QTRY_VERIFY((clientBuffer = serverBuffer(buffer)));
+    const QVector<LinuxDmaBufV1Plane> planes = clientBuffer->dmaBufPlanes();
+    QCOMPARE(planes.count(), 1);
+    QVERIFY(planes.first().fd != -1);
+    QCOMPARE(planes.first().offset, 0u);
+    QCOMPARE(planes.first().stride, quint32(s_stride));
+    QCOMPARE(planes.first().modifier, DRM_FORMAT_MOD_LINEAR);
+
+    // the dma-buf is created only once
+    QCOMPARE(clientBuffer->dmaBufPlanes().first().fd, planes.first().fd);
+
+    wl_buffer_destroy(buffer);
+    wl_shm_pool_destroy(pool);
+}
+
+QTEST_GUILESS_MAIN(TestShmClientBuffer)
+#include "test_shmclientbuffer.moc"
@@ -0,0 +1,157 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QBuffer>
+#include <QtTest>
+// WaylandServer
+#include "../../src/server/compositor_interface.h"
+#include "../../src/server/display.h"
+#include "../../src/server/surface_interface.h"
+// Wayland
+#include <wayland-server.h>
+
+#include "wirereplayer.h"
+
+using namespace KWaylandServer;
+
+class RequestBuilder
+{
+public:
+    RequestBuilder(quint32 object, quint16 opcode)
+        : m_object(object)
+        , m_opcode(opcode)
+    {
+    }
+
+    RequestBuilder &u32(quint32 value)
+    {
+        m_arguments.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        return *this;
+    }
+
+    RequestBuilder &string(const QByteArray &value)
+    {
+        u32(value.size() + 1);
+        m_arguments.append(value);
+        m_arguments.append('\0');
+        while (m_arguments.size() % 4) {
+            m_arguments.append('\0');
+        }
+        return *this;
+    }
+
+    QByteArray message() const
+    {
+        const quint32 header[2] = {m_object, quint32(8 + m_arguments.size()) << 16 | m_opcode};
+        return QByteArray(reinterpret_cast<const char *>(header), sizeof(header)) + m_arguments;
+    }
+
+private:
+    quint32 m_object;
+    quint16 m_opcode;
+    QByteArray m_arguments;
+};
+
+class TestWireReplay : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testSaveLoad();
+    void testReplay();
+
+private:
+    WireRecording createRecording() const;
+};
+
+// Creates a surface, commits it ten times and attaches an shm buffer,
+// the globals are bound with bogus names the replayer has to rewrite.
+WireRecording TestWireReplay::createRecording() const
+{
+    WireRecording recording;
+
+    WireRecording::Chunk registry;
+    registry.data += RequestBuilder(1, 1).u32(2).message(); // wl_display.get_registry
+    registry.data += RequestBuilder(1, 0).u32(3).message(); // wl_display.sync
+    recording.chunks.append(registry);
+
+    WireRecording::Chunk surface;
+    surface.timestamp = 1000;
+    surface.data += RequestBuilder(2, 0).u32(0xdead).string("wl_compositor").u32(4).u32(4).message(); // wl_registry.bind
+    surface.data += RequestBuilder(4, 0).u32(5).message(); // wl_compositor.create_surface
+    for (int i = 0; i < 10; ++i) {
+        surface.data += RequestBuilder(5, 6).message(); // wl_surface.commit
+    }
+    recording.chunks.append(surface);
+
+    WireRecording::Chunk buffer;
+    buffer.timestamp = 2000;
+    buffer.data += RequestBuilder(2, 0).u32(0xbeef).string("wl_shm").u32(1).u32(6).message(); // wl_registry.bind
+    buffer.data += RequestBuilder(6, 0).u32(7).u32(4096).message(); // wl_shm.create_pool, the fd is passed separately
+    buffer.data += RequestBuilder(7, 0).u32(8).u32(0).u32(16).u32(16).u32(64).u32(WL_SHM_FORMAT_XRGB8888).message(); // wl_shm_pool.create_buffer
+    buffer.data += RequestBuilder(5, 1).u32(8).u32(0).u32(0).message(); // wl_surface.attach
+    buffer.data += RequestBuilder(5, 6).message(); // wl_surface.commit
+    buffer.fileDescriptorSizes.append(4096);
+    recording.chunks.append(buffer);
+
+    return recording;
+}
+
+void TestWireReplay::testSaveLoad()
+{
+    const WireRecording recording = createRecording();
+
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::ReadWrite));
+    QVERIFY(recording.save(&buffer));
+
+    buffer.seek(0);
+    WireRecording loaded;
+    QVERIFY(loaded.load(&buffer));
+    QCOMPARE(loaded.chunks.count(), recording.chunks.count());
+    for (int i = 0; i < recording.chunks.count(); ++i) {
+        QCOMPARE(loaded.chunks[i].timestamp, recording.chunks[i].timestamp);
+        QCOMPARE(loaded.chunks[i].data, recording.chunks[i].data);
+        QCOMPARE(loaded.chunks[i].fileDescriptorSizes, recording.chunks[i].fileDescriptorSizes);
+    }
+
+    // not a recording
+    QBuffer invalid;
+    invalid.setData(QByteArrayLiteral("KWLREC00"));
+    QVERIFY(invalid.open(QIODevice::ReadOnly));
+    QVERIFY(!loaded.load(&invalid));
+    QCOMPARE(loaded.chunks.count(), recording.chunks.count());
+}
+
+void TestWireReplay::testReplay()
+{
+    Display display;
+    display.createShm();
+    CompositorInterface compositor(&display);
+
+    int commitCount = 0;
+    SurfaceInterface *surface = nullptr;
+    connect(&compositor, &CompositorInterface::surfaceCreated, this, [&](SurfaceInterface *createdSurface) {
+        surface = createdSurface;
+        connect(surface, &SurfaceInterface::committed, this, [&commitCount]() {
+            commitCount++;
+        });
+    });
+
+    WireReplayer replayer(&display);
+    const WireReplayer::Result result = replayer.replay(createRecording());
+    QVERIFY(result.ok);
+    QCOMPARE(result.requestCount, 19);
+    QVERIFY(result.dispatchTime.count() > 0);
+    QVERIFY(result.requestsPerSecond() > 0);
+    QVERIFY(result.allocationCount > 0);
+    QVERIFY(result.processMaxResidentSetSize > 0);
+
+    QVERIFY(surface);
+    QCOMPARE(commitCount, 11);
+}
+
+QTEST_GUILESS_MAIN(TestWireReplay)
+#include "test_wire_replay.moc"
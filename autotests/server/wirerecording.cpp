@@ -0,0 +1,52 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "wirerecording.h"
+
+#include <QDataStream>
+#include <QIODevice>
+
+static const char s_magic[] = "KWLREC01";
+static const int s_magicSize = sizeof(s_magic) - 1;
+
+bool WireRecording::save(QIODevice *device) const
+{
+    if (device->write(s_magic, s_magicSize) != s_magicSize) {
+        return false;
+    }
+
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << quint32(chunks.count());
+    for (const Chunk &chunk : chunks) {
+        stream << chunk.timestamp << chunk.data << chunk.fileDescriptorSizes;
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool WireRecording::load(QIODevice *device)
+{
+    if (device->read(s_magicSize) != QByteArray(s_magic, s_magicSize)) {
+        return false;
+    }
+
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_5_15);
+    quint32 count = 0;
+    stream >> count;
+
+    QVector<Chunk> loadedChunks;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Chunk chunk;
+        stream >> chunk.timestamp >> chunk.data >> chunk.fileDescriptorSizes;
+        loadedChunks.append(chunk);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    chunks = loadedChunks;
+    return true;
+}
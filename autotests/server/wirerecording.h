@@ -0,0 +1,34 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+
+class QIODevice;
+
+/**
+ * The raw request stream a client sent over its Wayland connection, as captured by the
+ * waylandRecorder tool and replayed by the WireReplayer.
+ *
+ * File descriptors passed along with the data are only stored as their size, they are
+ * replaced by memfds of the same size when the recording is replayed.
+ */
+struct WireRecording {
+    struct Chunk {
+        /**
+         * Nanoseconds since the start of the recording.
+         */
+        qint64 timestamp = 0;
+        QByteArray data;
+        QVector<qint64> fileDescriptorSizes;
+    };
+
+    QVector<Chunk> chunks;
+
+    bool save(QIODevice *device) const;
+    bool load(QIODevice *device);
+};
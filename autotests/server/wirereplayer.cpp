@@ -0,0 +1,329 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "wirereplayer.h"
+
+#include "../../src/server/clientconnection.h"
+#include "../../src/server/display.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::atomic<quint64> s_allocationCount{0};
+
+void *operator new(std::size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+// Messages start with the object id, followed by the size in the upper and the opcode in the lower 16 bits.
+static const quint32 s_headerSize = 8;
+static const int s_maxFileDescriptors = 28;
+
+static const quint32 s_displayObject = 1;
+static const quint32 s_displayGetRegistryOpcode = 1;
+static const quint32 s_registryBindOpcode = 0;
+static const quint32 s_registryGlobalOpcode = 0;
+
+static quint32 word(const char *message, int index)
+{
+    quint32 value;
+    memcpy(&value, message + index * sizeof(quint32), sizeof(value));
+    return value;
+}
+
+static quint32 messageSize(const char *message)
+{
+    return word(message, 1) >> 16;
+}
+
+static quint32 messageOpcode(const char *message)
+{
+    return word(message, 1) & 0xffff;
+}
+
+// wl_registry.bind and wl_registry.global start with the name, followed by the interface
+static QByteArray interfaceArgument(const char *message, quint32 size)
+{
+    if (size < s_headerSize + 8) {
+        return QByteArray();
+    }
+    const quint32 length = word(message, 3);
+    if (length == 0 || s_headerSize + 8 + length > size) {
+        return QByteArray();
+    }
+    return QByteArray(message + s_headerSize + 8, length - 1);
+}
+
+static int createStandIn(qint64 size)
+{
+    const int fd = memfd_create("kwaylandserver-replay", MFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (size > 0 && ftruncate(fd, size) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+double WireReplayer::Result::requestsPerSecond() const
+{
+    if (dispatchTime.count() == 0) {
+        return 0;
+    }
+    return requestCount / std::chrono::duration<double>(dispatchTime).count();
+}
+
+WireReplayer::WireReplayer(KWaylandServer::Display *display)
+    : m_display(display)
+{
+}
+
+WireReplayer::Result WireReplayer::replay(const WireRecording &recording)
+{
+    Result result;
+    m_registries.clear();
+    m_globals.clear();
+    m_events.clear();
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        return result;
+    }
+    fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+
+    KWaylandServer::ClientConnection *connection = m_display->createClient(sv[0]);
+    if (!connection) {
+        close(sv[0]);
+        close(sv[1]);
+        return result;
+    }
+    bool disconnected = false;
+    QObject::connect(connection, &KWaylandServer::ClientConnection::disconnected, connection, [&disconnected]() {
+        disconnected = true;
+    });
+
+    QByteArray stream;
+    for (const WireRecording::Chunk &chunk : recording.chunks) {
+        stream += chunk.data;
+    }
+
+    const quint64 allocationsBefore = s_allocationCount.load(std::memory_order_relaxed);
+
+    int parsed = 0;
+    int sent = 0;
+    for (const WireRecording::Chunk &chunk : recording.chunks) {
+        const int end = sent + chunk.data.size();
+
+        // The registry globals are known by now, rewrite the requests starting in this chunk.
+        while (parsed < end && parsed + int(s_headerSize) <= stream.size()) {
+            char *message = stream.data() + parsed;
+            const quint32 size = messageSize(message);
+            if (size < s_headerSize || parsed + int(size) > stream.size()) {
+                break;
+            }
+            rewriteRequest(message, size);
+            result.requestCount++;
+            parsed += size;
+        }
+
+        QVector<int> fileDescriptors;
+        for (qint64 size : chunk.fileDescriptorSizes) {
+            const int fd = createStandIn(size);
+            if (fd != -1) {
+                fileDescriptors.append(fd);
+            }
+        }
+        const bool ok = send(sv[1], stream.constData() + sent, chunk.data.size(), fileDescriptors, result);
+        for (int fd : qAsConst(fileDescriptors)) {
+            close(fd);
+        }
+        sent = end;
+
+        if (!ok || disconnected) {
+            break;
+        }
+        dispatch(result);
+        readEvents(sv[1]);
+        if (disconnected) {
+            break;
+        }
+    }
+
+    result.allocationCount = s_allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        result.processMaxResidentSetSize = usage.ru_maxrss;
+    }
+
+    result.ok = !disconnected;
+    if (!disconnected) {
+        connection->destroy();
+    }
+    close(sv[1]);
+
+    return result;
+}
+
+void WireReplayer::rewriteRequest(char *message, quint32 size)
+{
+    const quint32 object = word(message, 0);
+    const quint32 opcode = messageOpcode(message);
+
+    if (object == s_displayObject && opcode == s_displayGetRegistryOpcode && size >= s_headerSize + 4) {
+        m_registries.insert(word(message, 2));
+    } else if (opcode == s_registryBindOpcode && m_registries.contains(object)) {
+        // Global names depend on the compositor, use the one announced by our display.
+        const auto it = m_globals.constFind(interfaceArgument(message, size));
+        if (it != m_globals.constEnd()) {
+            const quint32 name = *it;
+            memcpy(message + s_headerSize, &name, sizeof(name));
+        }
+    }
+}
+
+bool WireReplayer::send(int fd, const char *data, int size, const QVector<int> &fileDescriptors, Result &result)
+{
+    int written = 0;
+    bool fileDescriptorsSent = fileDescriptors.isEmpty();
+    while (written < size) {
+        iovec iov;
+        iov.iov_base = const_cast<char *>(data + written);
+        iov.iov_len = size - written;
+
+        msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        char control[CMSG_SPACE(sizeof(int) * s_maxFileDescriptors)] = {};
+        if (!fileDescriptorsSent) {
+            const int count = std::min(fileDescriptors.count(), s_maxFileDescriptors);
+            message.msg_control = control;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+            cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+            memcpy(CMSG_DATA(header), fileDescriptors.constData(), sizeof(int) * count);
+        }
+
+        const ssize_t length = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (length == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return false;
+            }
+            // The socket buffer is full, let the display catch up.
+            dispatch(result);
+            readEvents(fd);
+            continue;
+        }
+        fileDescriptorsSent = true;
+        written += length;
+    }
+    return true;
+}
+
+void WireReplayer::dispatch(Result &result)
+{
+    QElapsedTimer timer;
+    timer.start();
+    m_display->dispatchEvents();
+    m_display->flush();
+    result.dispatchTime += std::chrono::nanoseconds(timer.nsecsElapsed());
+}
+
+void WireReplayer::readEvents(int fd)
+{
+    while (true) {
+        char buffer[4096];
+        iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer);
+
+        char control[CMSG_SPACE(sizeof(int) * s_maxFileDescriptors)];
+        msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        const ssize_t length = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+        if (length <= 0) {
+            if (length == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        // Keymaps and the like are of no interest.
+        for (cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+                const int count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                int fds[s_maxFileDescriptors];
+                memcpy(fds, CMSG_DATA(header), sizeof(int) * std::min(count, s_maxFileDescriptors));
+                for (int i = 0; i < std::min(count, s_maxFileDescriptors); ++i) {
+                    close(fds[i]);
+                }
+            }
+        }
+
+        m_events.append(buffer, length);
+    }
+
+    int offset = 0;
+    while (offset + int(s_headerSize) <= m_events.size()) {
+        const char *event = m_events.constData() + offset;
+        const quint32 size = messageSize(event);
+        if (size < s_headerSize || offset + int(size) > m_events.size()) {
+            break;
+        }
+        handleEvent(event, size);
+        offset += size;
+    }
+    m_events.remove(0, offset);
+}
+
+void WireReplayer::handleEvent(const char *message, quint32 size)
+{
+    const quint32 object = word(message, 0);
+    if (messageOpcode(message) == s_registryGlobalOpcode && m_registries.contains(object)) {
+        const QByteArray interface = interfaceArgument(message, size);
+        if (!interface.isEmpty() && !m_globals.contains(interface)) {
+            m_globals.insert(interface, word(message, 2));
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include "wirerecording.h"
+
+#include <QHash>
+#include <QSet>
+
+#include <chrono>
+
+namespace KWaylandServer
+{
+class Display;
+}
+
+/**
+ * The WireReplayer replays a WireRecording against an in-process Display, over a socketpair
+ * created with Display::createClient(). The Display must not be started, the replayer
+ * dispatches it itself after every chunk.
+ *
+ * The stream is replayed as is, with two exceptions: file descriptors are replaced by memfds
+ * of the recorded size and wl_registry.bind requests are rewritten to the global names of the
+ * Display. Events are read and discarded, so the recording must not depend on objects created
+ * by the compositor that recorded it, e.g. data offers.
+ *
+ * Heap allocations are counted by replacing the global operator new, the allocations made by
+ * C code and the Qt containers are not included.
+ */
+class WireReplayer
+{
+public:
+    struct Result {
+        /**
+         * @c false if the client got disconnected, e.g. because of a protocol error.
+         */
+        bool ok = false;
+        int requestCount = 0;
+        /**
+         * Time spent in Display::dispatchEvents() and Display::flush().
+         */
+        std::chrono::nanoseconds dispatchTime = std::chrono::nanoseconds::zero();
+        quint64 allocationCount = 0;
+        /**
+         * The maximum resident set size the process has had so far in KiB, after the replay.
+         * This covers the whole lifetime of the process, not just the replay.
+         */
+        qint64 processMaxResidentSetSize = 0;
+
+        double requestsPerSecond() const;
+    };
+
+    explicit WireReplayer(KWaylandServer::Display *display);
+
+    Result replay(const WireRecording &recording);
+
+private:
+    void rewriteRequest(char *message, quint32 size);
+    void readEvents(int fd);
+    void handleEvent(const char *message, quint32 size);
+    bool send(int fd, const char *data, int size, const QVector<int> &fileDescriptors, Result &result);
+    void dispatch(Result &result);
+
+    KWaylandServer::Display *m_display;
+    QSet<quint32> m_registries;
+    QHash<QByteArray, quint32> m_globals;
+    QByteArray m_events;
+};
@@ -0,0 +1,150 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// WaylandServer
+#include "../src/server/clientconnection.h"
+#include "../src/server/display.h"
+#include "../src/server/drm_fourcc.h"
+#include "../src/server/linuxdmabufv1clientbuffer.h"
+
+#include "benchmarkclient.h"
+#include "wayland-linux-dmabuf-unstable-v1-client-protocol.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace KWaylandServer;
+
+// Imports every buffer without touching the file descriptors, the benchmark measures the
+// protocol handling and the buffer bookkeeping, not a renderer.
+class FakeRenderer : public LinuxDmaBufV1ClientBufferIntegration::RendererInterface
+{
+public:
+    LinuxDmaBufV1ClientBuffer *importBuffer(const QVector<LinuxDmaBufV1Plane> &planes, quint32 format, const QSize &size, quint32 flags) override
+    {
+        return new LinuxDmaBufV1ClientBuffer(size, format, flags, planes);
+    }
+};
+
+class DmaBufBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void benchmarkCreateBuffer_data();
+    void benchmarkCreateBuffer();
+
+private:
+    int createDmaBuf() const;
+
+    Display *m_display = nullptr;
+    LinuxDmaBufV1ClientBufferIntegration *m_integration = nullptr;
+    FakeRenderer m_renderer;
+    BenchmarkClient *m_client = nullptr;
+    zwp_linux_dmabuf_v1 *m_dmabuf = nullptr;
+};
+
+static const QSize s_bufferSize(256, 256);
+static const quint32 s_stride = 256 * 4;
+
+void DmaBufBenchmark::init()
+{
+    m_display = new Display(this);
+    m_integration = new LinuxDmaBufV1ClientBufferIntegration(m_display);
+    m_integration->setRendererInterface(&m_renderer);
+
+    LinuxDmaBufV1Feedback::Tranche tranche;
+    tranche.device = 0;
+    tranche.formatTable.insert(DRM_FORMAT_XRGB8888, {DRM_FORMAT_MOD_LINEAR});
+    m_integration->setSupportedFormatsWithModifiers({tranche});
+
+    m_client = new BenchmarkClient(m_display);
+    QVERIFY(m_client->isValid());
+    m_dmabuf = m_client->bind<zwp_linux_dmabuf_v1>(&zwp_linux_dmabuf_v1_interface, 3);
+    QVERIFY(m_dmabuf);
+    m_client->roundtrip();
+}
+
+void DmaBufBenchmark::cleanup()
+{
+    if (m_dmabuf) {
+        zwp_linux_dmabuf_v1_destroy(m_dmabuf);
+        m_dmabuf = nullptr;
+    }
+    delete m_client;
+    m_client = nullptr;
+    delete m_display;
+    m_display = nullptr;
+}
+
+int DmaBufBenchmark::createDmaBuf() const
+{
+    // a memfd stands in for the dma-buf, the display only looks at its inode and size
+    const int fd = memfd_create("kwaylandserver-benchmark", MFD_CLOEXEC);
+    if (fd != -1 && ftruncate(fd, s_stride * s_bufferSize.height()) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void DmaBufBenchmark::benchmarkCreateBuffer_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("uncached") << false;
+    QTest::newRow("cached") << true;
+}
+
+void DmaBufBenchmark::benchmarkCreateBuffer()
+{
+    // creates a params object, adds a plane and creates a wl_buffer with create_immed, then
+    // looks up the ClientBuffer of the new wl_buffer. If the dma-buf is still used by another
+    // buffer, the import is served from the import cache
+    QFETCH(bool, cached);
+
+    const int sharedFd = createDmaBuf();
+    QVERIFY(sharedFd != -1);
+
+    // keeps the import of the shared dma-buf alive
+    zwp_linux_buffer_params_v1 *sharedParams = zwp_linux_dmabuf_v1_create_params(m_dmabuf);
+    zwp_linux_buffer_params_v1_add(sharedParams, sharedFd, 0, 0, s_stride, DRM_FORMAT_MOD_LINEAR >> 32, DRM_FORMAT_MOD_LINEAR & 0xffffffff);
+    wl_buffer *sharedBuffer = zwp_linux_buffer_params_v1_create_immed(sharedParams, s_bufferSize.width(), s_bufferSize.height(), DRM_FORMAT_XRGB8888, 0);
+    zwp_linux_buffer_params_v1_destroy(sharedParams);
+    m_client->roundtrip();
+    QVERIFY(m_display->clientBufferForResource(m_client->connection()->getResource(wl_proxy_get_id(reinterpret_cast<wl_proxy *>(sharedBuffer)))));
+
+    QBENCHMARK {
+        const int fd = cached ? sharedFd : createDmaBuf();
+        zwp_linux_buffer_params_v1 *params = zwp_linux_dmabuf_v1_create_params(m_dmabuf);
+        zwp_linux_buffer_params_v1_add(params, fd, 0, 0, s_stride, DRM_FORMAT_MOD_LINEAR >> 32, DRM_FORMAT_MOD_LINEAR & 0xffffffff);
+        wl_buffer *buffer = zwp_linux_buffer_params_v1_create_immed(params, s_bufferSize.width(), s_bufferSize.height(), DRM_FORMAT_XRGB8888, 0);
+        zwp_linux_buffer_params_v1_destroy(params);
+        if (!cached) {
+            // the fd has been sent already
+            close(fd);
+        }
+        m_client->dispatch();
+
+        wl_resource *resource = m_client->connection()->getResource(wl_proxy_get_id(reinterpret_cast<wl_proxy *>(buffer)));
+        ClientBuffer *clientBuffer = m_display->clientBufferForResource(resource);
+        Q_ASSERT(clientBuffer);
+        Q_UNUSED(clientBuffer)
+
+        wl_buffer_destroy(buffer);
+    }
+
+    wl_buffer_destroy(sharedBuffer);
+    close(sharedFd);
+    m_client->roundtrip();
+    QVERIFY(m_client->isValid());
+}
+
+QTEST_GUILESS_MAIN(DmaBufBenchmark)
+#include "benchmark_dmabuf.moc"
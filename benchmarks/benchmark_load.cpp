@@ -0,0 +1,76 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+
+#include "loadgenerator.h"
+
+using namespace std::chrono_literals;
+
+class LoadBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void benchmarkScaling_data();
+    void benchmarkScaling();
+};
+
+void LoadBenchmark::benchmarkScaling_data()
+{
+    QTest::addColumn<int>("clientCount");
+    QTest::addColumn<int>("commitRate");
+
+    for (int clientCount : {10, 50, 100, 250, 500}) {
+        for (int commitRate : {60, 144}) {
+            QTest::addRow("%d clients at %d Hz", clientCount, commitRate) << clientCount << commitRate;
+        }
+    }
+}
+
+void LoadBenchmark::benchmarkScaling()
+{
+    // every client commits a window at the given rate, opens a popup every second and
+    // changes the clipboard and the cursor a few times per second
+    //
+    // The result is the median wall time of a step. Set KWAYLANDSERVER_LOAD_REPORT to also
+    // print the CPU time per client, the latency percentiles and the memory growth.
+    QFETCH(int, clientCount);
+    QFETCH(int, commitRate);
+
+    LoadGenerator::Workload workload;
+    workload.commitRate = commitRate;
+    workload.popupRate = 2;
+    workload.clipboardRate = 1;
+    workload.cursorRate = 5;
+
+    LoadGenerator generator;
+    generator.setRefreshRate(commitRate);
+    QVERIFY(generator.addClients(clientCount, workload));
+
+    // warm up, so one-time allocations don't count as memory growth
+    QVERIFY(generator.run(100ms).ok);
+
+    const LoadGenerator::Report report = generator.run(2s);
+    QVERIFY(report.ok);
+
+    // the server CPU time per client and second is the number to watch when the client count
+    // grows, but QtTest only knows CPU ticks, so it is only part of the detailed report
+    if (qEnvironmentVariableIsSet("KWAYLANDSERVER_LOAD_REPORT")) {
+        qInfo("clients=%d rate=%d cpu_per_client_ns=%lld latency_p50_ns=%lld latency_p99_ns=%lld latency_max_ns=%lld memory_growth_kib=%lld",
+              report.clientCount,
+              commitRate,
+              qint64(report.cpuTimePerClient().count()),
+              qint64(report.latency(50).count()),
+              qint64(report.latency(99).count()),
+              qint64(report.latency(100).count()),
+              report.memoryGrowth);
+    }
+
+    QTest::setBenchmarkResult(report.latency(50).count(), QTest::WalltimeNanoseconds);
+}
+
+QTEST_GUILESS_MAIN(LoadBenchmark)
+#include "benchmark_load.moc"
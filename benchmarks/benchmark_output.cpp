@@ -0,0 +1,125 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// WaylandServer
+#include "../src/server/display.h"
+#include "../src/server/output_interface.h"
+
+#include "benchmarkclient.h"
+
+using namespace KWaylandServer;
+
+class OutputBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void benchmarkHotplug_data();
+    void benchmarkHotplug();
+
+private:
+    Display *m_display = nullptr;
+};
+
+struct OutputClient {
+    BenchmarkClient *client;
+    wl_registry *registry;
+    QHash<quint32, wl_output *> outputs;
+};
+
+static void registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version)
+{
+    Q_UNUSED(version)
+    // bind every announced output, like a client that keeps track of the screens does
+    if (qstrcmp(interface, wl_output_interface.name) == 0) {
+        auto outputClient = static_cast<OutputClient *>(data);
+        outputClient->outputs.insert(name, static_cast<wl_output *>(wl_registry_bind(registry, name, &wl_output_interface, 3)));
+    }
+}
+
+static void registryGlobalRemove(void *data, wl_registry *registry, uint32_t name)
+{
+    Q_UNUSED(registry)
+    auto outputClient = static_cast<OutputClient *>(data);
+    if (wl_output *output = outputClient->outputs.take(name)) {
+        wl_output_release(output);
+    }
+}
+
+static const wl_registry_listener s_registryListener = {
+    registryGlobal,
+    registryGlobalRemove,
+};
+
+void OutputBenchmark::init()
+{
+    m_display = new Display(this);
+}
+
+void OutputBenchmark::cleanup()
+{
+    delete m_display;
+    m_display = nullptr;
+}
+
+void OutputBenchmark::benchmarkHotplug_data()
+{
+    QTest::addColumn<int>("clientCount");
+
+    QTest::newRow("10 clients") << 10;
+    QTest::newRow("100 clients") << 100;
+}
+
+void OutputBenchmark::benchmarkHotplug()
+{
+    // an output is plugged in, every client binds it as soon as it is announced and receives
+    // the output state, then the output is unplugged again
+    QFETCH(int, clientCount);
+
+    QVector<BenchmarkClient *> clients;
+    QVector<OutputClient *> outputClients;
+    for (int i = 0; i < clientCount; ++i) {
+        auto client = new BenchmarkClient(m_display);
+        QVERIFY(client->isValid());
+        auto outputClient = new OutputClient{client, wl_display_get_registry(client->display()), {}};
+        wl_registry_add_listener(outputClient->registry, &s_registryListener, outputClient);
+        client->roundtrip();
+        clients.append(client);
+        outputClients.append(outputClient);
+    }
+
+    QBENCHMARK {
+        auto output = new OutputInterface(m_display);
+        output->setManufacturer(QStringLiteral("KDE"));
+        output->setModel(QStringLiteral("Benchmark"));
+        output->setPhysicalSize(QSize(600, 340));
+        output->setMode(QSize(3840, 2160), 60000);
+        output->done();
+
+        // the first dispatch announces the global, the second one binds it
+        dispatchClients(m_display, clients);
+        dispatchClients(m_display, clients);
+
+        delete output;
+        dispatchClients(m_display, clients);
+    }
+
+    for (OutputClient *outputClient : qAsConst(outputClients)) {
+        for (wl_output *output : qAsConst(outputClient->outputs)) {
+            wl_output_release(output);
+        }
+        wl_registry_destroy(outputClient->registry);
+        QVERIFY(outputClient->client->isValid());
+        delete outputClient->client;
+        delete outputClient;
+    }
+}
+
+QTEST_GUILESS_MAIN(OutputBenchmark)
+#include "benchmark_output.moc"
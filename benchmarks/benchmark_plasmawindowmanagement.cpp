@@ -0,0 +1,83 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// WaylandServer
+#include "../src/server/display.h"
+#include "../src/server/plasmawindowmanagement_interface.h"
+
+#include "benchmarkclient.h"
+#include "wayland-plasma-window-management-client-protocol.h"
+
+using namespace KWaylandServer;
+
+class PlasmaWindowManagementBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void benchmarkBind_data();
+    void benchmarkBind();
+
+private:
+    Display *m_display = nullptr;
+    PlasmaWindowManagementInterface *m_windowManagementInterface = nullptr;
+};
+
+void PlasmaWindowManagementBenchmark::init()
+{
+    m_display = new Display(this);
+    m_windowManagementInterface = new PlasmaWindowManagementInterface(m_display, m_display);
+}
+
+void PlasmaWindowManagementBenchmark::cleanup()
+{
+    delete m_display;
+    m_display = nullptr;
+}
+
+void PlasmaWindowManagementBenchmark::benchmarkBind_data()
+{
+    QTest::addColumn<int>("windowCount");
+
+    QTest::newRow("100 windows") << 100;
+    QTest::newRow("1000 windows") << 1000;
+}
+
+void PlasmaWindowManagementBenchmark::benchmarkBind()
+{
+    // a client such as a task manager connects and binds the window management global, which
+    // announces every window and the stacking order
+    QFETCH(int, windowCount);
+
+    QObject windowParent;
+    QVector<quint32> stackingOrder;
+    QVector<QString> stackingOrderUuids;
+    for (int i = 0; i < windowCount; ++i) {
+        PlasmaWindowInterface *window = m_windowManagementInterface->createWindow(&windowParent, QUuid::createUuid());
+        window->setTitle(QStringLiteral("Window %1").arg(i));
+        window->setAppId(QStringLiteral("org.kde.benchmark"));
+        stackingOrder.append(window->internalId());
+        stackingOrderUuids.append(window->uuid());
+    }
+    m_windowManagementInterface->setStackingOrder(stackingOrder);
+    m_windowManagementInterface->setStackingOrderUuids(stackingOrderUuids);
+
+    QBENCHMARK {
+        BenchmarkClient client(m_display);
+        QVERIFY(client.isValid());
+        auto windowManagement = client.bind<org_kde_plasma_window_management>(&org_kde_plasma_window_management_interface, 14);
+        QVERIFY(windowManagement);
+        client.roundtrip();
+        QVERIFY(client.isValid());
+        org_kde_plasma_window_management_destroy(windowManagement);
+    }
+}
+
+QTEST_GUILESS_MAIN(PlasmaWindowManagementBenchmark)
+#include "benchmark_plasmawindowmanagement.moc"
@@ -0,0 +1,178 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// WaylandServer
+#include "../src/server/compositor_interface.h"
+#include "../src/server/display.h"
+#include "../src/server/seat_interface.h"
+#include "../src/server/surface_interface.h"
+
+#include "benchmarkclient.h"
+
+#include <linux/input.h>
+
+using namespace KWaylandServer;
+
+class SeatBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void benchmarkPointerMotion_data();
+    void benchmarkPointerMotion();
+    void benchmarkKeyboardKey_data();
+    void benchmarkKeyboardKey();
+
+private:
+    SurfaceInterface *createSurface(wl_surface **clientSurface);
+
+    Display *m_display = nullptr;
+    CompositorInterface *m_compositorInterface = nullptr;
+    SeatInterface *m_seatInterface = nullptr;
+    BenchmarkClient *m_client = nullptr;
+    wl_compositor *m_compositor = nullptr;
+    wl_seat *m_seat = nullptr;
+    quint32 m_timestamp = 0;
+};
+
+void SeatBenchmark::init()
+{
+    m_display = new Display(this);
+    m_compositorInterface = new CompositorInterface(m_display, m_display);
+    m_seatInterface = new SeatInterface(m_display, m_display);
+    m_seatInterface->setHasPointer(true);
+    m_seatInterface->setHasKeyboard(true);
+
+    m_client = new BenchmarkClient(m_display);
+    QVERIFY(m_client->isValid());
+    m_compositor = m_client->bind<wl_compositor>(&wl_compositor_interface, 4);
+    QVERIFY(m_compositor);
+    m_seat = m_client->bind<wl_seat>(&wl_seat_interface, 7);
+    QVERIFY(m_seat);
+    m_client->roundtrip();
+}
+
+void SeatBenchmark::cleanup()
+{
+    if (m_seat) {
+        wl_seat_destroy(m_seat);
+        m_seat = nullptr;
+    }
+    if (m_compositor) {
+        wl_compositor_destroy(m_compositor);
+        m_compositor = nullptr;
+    }
+    delete m_client;
+    m_client = nullptr;
+    delete m_display;
+    m_display = nullptr;
+}
+
+SurfaceInterface *SeatBenchmark::createSurface(wl_surface **clientSurface)
+{
+    SurfaceInterface *surface = nullptr;
+    auto connection = connect(m_compositorInterface, &CompositorInterface::surfaceCreated, this, [&surface](SurfaceInterface *createdSurface) {
+        surface = createdSurface;
+    });
+    *clientSurface = wl_compositor_create_surface(m_compositor);
+    m_client->roundtrip();
+    disconnect(connection);
+    return surface;
+}
+
+void SeatBenchmark::benchmarkPointerMotion_data()
+{
+    QTest::addColumn<int>("motionsPerFocus");
+
+    QTest::newRow("focus change every motion") << 1;
+    QTest::newRow("focus change every 16 motions") << 16;
+}
+
+void SeatBenchmark::benchmarkPointerMotion()
+{
+    // moves the pointer back and forth between two surfaces, every focus change sends a
+    // leave and an enter event, all motion is followed by a pointer frame
+    QFETCH(int, motionsPerFocus);
+
+    wl_surface *clientSurfaces[2];
+    SurfaceInterface *surfaces[2] = {createSurface(&clientSurfaces[0]), createSurface(&clientSurfaces[1])};
+    QVERIFY(surfaces[0]);
+    QVERIFY(surfaces[1]);
+
+    wl_pointer *pointer = wl_seat_get_pointer(m_seat);
+    m_client->roundtrip();
+
+    int focus = 0;
+    QBENCHMARK {
+        m_seatInterface->setTimestamp(++m_timestamp);
+        m_seatInterface->notifyPointerEnter(surfaces[focus], QPointF(focus * 100, 0), QPointF(focus * 100, 0));
+        for (int i = 0; i < motionsPerFocus; ++i) {
+            m_seatInterface->setTimestamp(++m_timestamp);
+            m_seatInterface->notifyPointerMotion(QPointF(focus * 100 + i % 100, i % 100));
+            m_seatInterface->notifyPointerFrame();
+        }
+        focus = 1 - focus;
+        m_client->dispatch();
+    }
+
+    m_seatInterface->notifyPointerLeave();
+    wl_pointer_release(pointer);
+    wl_surface_destroy(clientSurfaces[0]);
+    wl_surface_destroy(clientSurfaces[1]);
+    m_client->roundtrip();
+    QVERIFY(m_client->isValid());
+}
+
+void SeatBenchmark::benchmarkKeyboardKey_data()
+{
+    QTest::addColumn<int>("keyboardCount");
+
+    QTest::newRow("1 keyboard") << 1;
+    QTest::newRow("10 keyboards") << 10;
+    QTest::newRow("100 keyboards") << 100;
+}
+
+void SeatBenchmark::benchmarkKeyboardKey()
+{
+    // presses and releases a key, the focused client has bound the given number of wl_keyboard objects
+    QFETCH(int, keyboardCount);
+
+    wl_surface *clientSurface;
+    SurfaceInterface *surface = createSurface(&clientSurface);
+    QVERIFY(surface);
+
+    QVector<wl_keyboard *> keyboards;
+    keyboards.reserve(keyboardCount);
+    for (int i = 0; i < keyboardCount; ++i) {
+        keyboards.append(wl_seat_get_keyboard(m_seat));
+    }
+    m_client->roundtrip();
+
+    m_seatInterface->setFocusedKeyboardSurface(surface);
+    m_client->dispatch();
+
+    QBENCHMARK {
+        m_seatInterface->setTimestamp(++m_timestamp);
+        m_seatInterface->notifyKeyboardKey(KEY_A, KeyboardKeyState::Pressed);
+        m_seatInterface->setTimestamp(++m_timestamp);
+        m_seatInterface->notifyKeyboardKey(KEY_A, KeyboardKeyState::Released);
+        m_client->dispatch();
+    }
+
+    m_seatInterface->setFocusedKeyboardSurface(nullptr);
+    for (wl_keyboard *keyboard : qAsConst(keyboards)) {
+        wl_keyboard_release(keyboard);
+    }
+    wl_surface_destroy(clientSurface);
+    m_client->roundtrip();
+    QVERIFY(m_client->isValid());
+}
+
+QTEST_GUILESS_MAIN(SeatBenchmark)
+#include "benchmark_seat.moc"
@@ -0,0 +1,171 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// WaylandServer
+#include "../src/server/compositor_interface.h"
+#include "../src/server/display.h"
+#include "../src/server/subcompositor_interface.h"
+#include "../src/server/surface_interface.h"
+
+#include "benchmarkclient.h"
+
+using namespace KWaylandServer;
+
+class SurfaceBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void benchmarkCommitWithDamage_data();
+    void benchmarkCommitWithDamage();
+    void benchmarkSynchronizedSubsurfaces_data();
+    void benchmarkSynchronizedSubsurfaces();
+
+private:
+    Display *m_display = nullptr;
+    CompositorInterface *m_compositorInterface = nullptr;
+    SubCompositorInterface *m_subCompositorInterface = nullptr;
+    BenchmarkClient *m_client = nullptr;
+    wl_compositor *m_compositor = nullptr;
+    wl_subcompositor *m_subCompositor = nullptr;
+    wl_shm *m_shm = nullptr;
+};
+
+void SurfaceBenchmark::init()
+{
+    m_display = new Display(this);
+    m_display->createShm();
+    m_compositorInterface = new CompositorInterface(m_display, m_display);
+    m_subCompositorInterface = new SubCompositorInterface(m_display, m_display);
+
+    m_client = new BenchmarkClient(m_display);
+    QVERIFY(m_client->isValid());
+    m_compositor = m_client->bind<wl_compositor>(&wl_compositor_interface, 4);
+    QVERIFY(m_compositor);
+    m_subCompositor = m_client->bind<wl_subcompositor>(&wl_subcompositor_interface, 1);
+    QVERIFY(m_subCompositor);
+    m_shm = m_client->bind<wl_shm>(&wl_shm_interface, 1);
+    QVERIFY(m_shm);
+}
+
+void SurfaceBenchmark::cleanup()
+{
+    if (m_shm) {
+        wl_shm_destroy(m_shm);
+        m_shm = nullptr;
+    }
+    if (m_subCompositor) {
+        wl_subcompositor_destroy(m_subCompositor);
+        m_subCompositor = nullptr;
+    }
+    if (m_compositor) {
+        wl_compositor_destroy(m_compositor);
+        m_compositor = nullptr;
+    }
+    delete m_client;
+    m_client = nullptr;
+    delete m_display;
+    m_display = nullptr;
+}
+
+void SurfaceBenchmark::benchmarkCommitWithDamage_data()
+{
+    QTest::addColumn<int>("rectCount");
+
+    QTest::newRow("1 rect") << 1;
+    QTest::newRow("16 rects") << 16;
+}
+
+void SurfaceBenchmark::benchmarkCommitWithDamage()
+{
+    // attaches a buffer, damages it with a number of small rects and commits the surface
+    QFETCH(int, rectCount);
+
+    wl_surface *surface = wl_compositor_create_surface(m_compositor);
+    wl_buffer *buffer = createShmBuffer(m_shm, QSize(256, 256));
+    QVERIFY(buffer);
+    m_client->roundtrip();
+
+    QBENCHMARK {
+        wl_surface_attach(surface, buffer, 0, 0);
+        for (int i = 0; i < rectCount; ++i) {
+            wl_surface_damage_buffer(surface, i * 16, i * 16, 8, 8);
+        }
+        wl_surface_commit(surface);
+        m_client->dispatch();
+    }
+
+    wl_buffer_destroy(buffer);
+    wl_surface_destroy(surface);
+    m_client->roundtrip();
+    QVERIFY(m_client->isValid());
+}
+
+void SurfaceBenchmark::benchmarkSynchronizedSubsurfaces_data()
+{
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<int>("childCount");
+
+    QTest::newRow("flat 8") << 1 << 8;
+    QTest::newRow("flat 64") << 1 << 64;
+    QTest::newRow("nested 4x4") << 4 << 4;
+}
+
+void SurfaceBenchmark::benchmarkSynchronizedSubsurfaces()
+{
+    // commits every surface of a tree of synchronized subsurfaces, the state of the children
+    // is cached until the root surface is committed, which applies the whole tree
+    QFETCH(int, depth);
+    QFETCH(int, childCount);
+
+    wl_surface *root = wl_compositor_create_surface(m_compositor);
+
+    QVector<wl_surface *> surfaces;
+    QVector<wl_subsurface *> subsurfaces;
+    QVector<wl_surface *> parents{root};
+    for (int level = 0; level < depth; ++level) {
+        QVector<wl_surface *> children;
+        for (wl_surface *parent : qAsConst(parents)) {
+            for (int i = 0; i < childCount; ++i) {
+                wl_surface *child = wl_compositor_create_surface(m_compositor);
+                wl_subsurface *subsurface = wl_subcompositor_get_subsurface(m_subCompositor, child, parent);
+                wl_subsurface_set_position(subsurface, i, i);
+                children.append(child);
+                subsurfaces.append(subsurface);
+            }
+        }
+        surfaces += children;
+        // only the first child of every level gets children of its own, that keeps the tree size linear
+        parents = {children.first()};
+    }
+    m_client->roundtrip();
+
+    QBENCHMARK {
+        // children first, the parents apply the cached state of their children
+        for (auto it = surfaces.crbegin(); it != surfaces.crend(); ++it) {
+            wl_surface_damage_buffer(*it, 0, 0, 1, 1);
+            wl_surface_commit(*it);
+        }
+        wl_surface_commit(root);
+        m_client->dispatch();
+    }
+
+    for (wl_subsurface *subsurface : qAsConst(subsurfaces)) {
+        wl_subsurface_destroy(subsurface);
+    }
+    for (wl_surface *surface : qAsConst(surfaces)) {
+        wl_surface_destroy(surface);
+    }
+    wl_surface_destroy(root);
+    m_client->roundtrip();
+    QVERIFY(m_client->isValid());
+}
+
+QTEST_GUILESS_MAIN(SurfaceBenchmark)
+#include "benchmark_surface.moc"
@@ -0,0 +1,299 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Qt
+#include <QtTest>
+// Wayland
+#include <wayland-client.h>
+
+#include "qwayland-server-wayland.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+// damage_buffer and commit are 32 bytes on the wire, a batch fits into the socket buffer
+static const int s_requestsPerBatch = 64;
+
+struct DispatchCounters {
+    int damageRequests = 0;
+    int commitRequests = 0;
+};
+
+class VirtualSurface : public QtWaylandServer::wl_surface
+{
+public:
+    VirtualSurface(wl_resource *resource, DispatchCounters *counters)
+        : QtWaylandServer::wl_surface(resource)
+        , m_counters(counters)
+    {
+    }
+
+protected:
+    void surface_destroy_resource(Resource *resource) override
+    {
+        Q_UNUSED(resource)
+        delete this;
+    }
+
+    void surface_destroy(Resource *resource) override
+    {
+        wl_resource_destroy(resource->handle);
+    }
+
+    void surface_damage_buffer(Resource *resource, int32_t x, int32_t y, int32_t width, int32_t height) override
+    {
+        Q_UNUSED(resource)
+        m_damage |= QRect(x, y, width, height);
+        m_counters->damageRequests++;
+    }
+
+    void surface_commit(Resource *resource) override
+    {
+        Q_UNUSED(resource)
+        m_damage = QRect();
+        m_counters->commitRequests++;
+    }
+
+private:
+    DispatchCounters *m_counters;
+    QRect m_damage;
+};
+
+class StaticSurface : public QtWaylandServer::wl_surface_static<StaticSurface>
+{
+public:
+    StaticSurface(wl_resource *resource, DispatchCounters *counters)
+        : QtWaylandServer::wl_surface_static<StaticSurface>(resource)
+        , m_counters(counters)
+    {
+    }
+
+protected:
+    void surface_destroy_resource(Resource *resource) override
+    {
+        Q_UNUSED(resource)
+        delete this;
+    }
+
+    void surface_destroy(Resource *resource) override
+    {
+        wl_resource_destroy(resource->handle);
+    }
+
+    void surface_damage_buffer(Resource *resource, int32_t x, int32_t y, int32_t width, int32_t height) override
+    {
+        Q_UNUSED(resource)
+        m_damage |= QRect(x, y, width, height);
+        m_counters->damageRequests++;
+    }
+
+    void surface_commit(Resource *resource) override
+    {
+        Q_UNUSED(resource)
+        m_damage = QRect();
+        m_counters->commitRequests++;
+    }
+
+private:
+    friend class QtWaylandServer::wl_surface_static<StaticSurface>;
+
+    DispatchCounters *m_counters;
+    QRect m_damage;
+};
+
+class Compositor : public QtWaylandServer::wl_compositor
+{
+public:
+    Compositor(wl_display *display, bool staticDispatch)
+        : QtWaylandServer::wl_compositor(display, 4)
+        , m_staticDispatch(staticDispatch)
+    {
+    }
+
+    DispatchCounters counters;
+
+protected:
+    void compositor_create_surface(Resource *resource, uint32_t id) override
+    {
+        wl_resource *surfaceResource = wl_resource_create(resource->client(), &wl_surface_interface, resource->version(), id);
+        if (!surfaceResource) {
+            wl_resource_post_no_memory(resource->handle);
+            return;
+        }
+        if (m_staticDispatch) {
+            new StaticSurface(surfaceResource, &counters);
+        } else {
+            new VirtualSurface(surfaceResource, &counters);
+        }
+    }
+
+private:
+    bool m_staticDispatch;
+};
+
+class SurfaceDispatchBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void benchmarkDispatch_data();
+    void benchmarkDispatch();
+
+private:
+    void dispatch();
+    void roundtrip();
+
+    static void registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version);
+    static void registryGlobalRemove(void *data, wl_registry *registry, uint32_t name);
+    static void callbackDone(void *data, wl_callback *callback, uint32_t serial);
+
+    static const wl_registry_listener s_registryListener;
+    static const wl_callback_listener s_callbackListener;
+
+    wl_display *m_display = nullptr;
+    wl_event_loop *m_eventLoop = nullptr;
+    Compositor *m_compositor = nullptr;
+
+    wl_display *m_clientDisplay = nullptr;
+    wl_registry *m_registry = nullptr;
+    wl_compositor *m_clientCompositor = nullptr;
+};
+
+const wl_registry_listener SurfaceDispatchBenchmark::s_registryListener = {
+    registryGlobal,
+    registryGlobalRemove,
+};
+
+const wl_callback_listener SurfaceDispatchBenchmark::s_callbackListener = {
+    callbackDone,
+};
+
+void SurfaceDispatchBenchmark::registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version)
+{
+    Q_UNUSED(version)
+    auto benchmark = static_cast<SurfaceDispatchBenchmark *>(data);
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        benchmark->m_clientCompositor = static_cast<wl_compositor *>(wl_registry_bind(registry, name, &wl_compositor_interface, 4));
+    }
+}
+
+void SurfaceDispatchBenchmark::registryGlobalRemove(void *data, wl_registry *registry, uint32_t name)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(registry)
+    Q_UNUSED(name)
+}
+
+void SurfaceDispatchBenchmark::callbackDone(void *data, wl_callback *callback, uint32_t serial)
+{
+    Q_UNUSED(serial)
+    *static_cast<bool *>(data) = true;
+    wl_callback_destroy(callback);
+}
+
+void SurfaceDispatchBenchmark::init()
+{
+    m_display = wl_display_create();
+    QVERIFY(m_display);
+    m_eventLoop = wl_display_get_event_loop(m_display);
+
+    int sv[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0);
+    QVERIFY(wl_client_create(m_display, sv[0]));
+    m_clientDisplay = wl_display_connect_to_fd(sv[1]);
+    QVERIFY(m_clientDisplay);
+}
+
+void SurfaceDispatchBenchmark::cleanup()
+{
+    if (m_clientCompositor) {
+        wl_compositor_destroy(m_clientCompositor);
+        m_clientCompositor = nullptr;
+    }
+    if (m_registry) {
+        wl_registry_destroy(m_registry);
+        m_registry = nullptr;
+    }
+    if (m_clientDisplay) {
+        wl_display_disconnect(m_clientDisplay);
+        m_clientDisplay = nullptr;
+    }
+
+    wl_display_destroy_clients(m_display);
+    delete m_compositor;
+    m_compositor = nullptr;
+    wl_display_destroy(m_display);
+    m_display = nullptr;
+    m_eventLoop = nullptr;
+}
+
+void SurfaceDispatchBenchmark::dispatch()
+{
+    // client to server
+    wl_display_flush(m_clientDisplay);
+    wl_event_loop_dispatch(m_eventLoop, 0);
+
+    // server to client
+    wl_display_flush_clients(m_display);
+    if (wl_display_prepare_read(m_clientDisplay) == 0) {
+        wl_display_read_events(m_clientDisplay);
+    }
+    wl_display_dispatch_pending(m_clientDisplay);
+}
+
+void SurfaceDispatchBenchmark::roundtrip()
+{
+    bool done = false;
+    wl_callback *callback = wl_display_sync(m_clientDisplay);
+    wl_callback_add_listener(callback, &s_callbackListener, &done);
+    while (!done) {
+        dispatch();
+    }
+}
+
+void SurfaceDispatchBenchmark::benchmarkDispatch_data()
+{
+    QTest::addColumn<bool>("staticDispatch");
+
+    QTest::newRow("virtual") << false;
+    QTest::newRow("static") << true;
+}
+
+void SurfaceDispatchBenchmark::benchmarkDispatch()
+{
+    // this benchmark measures how many damage_buffer and commit requests are dispatched per second,
+    // the requests are sent in batches from an in-process client on the same thread
+    QFETCH(bool, staticDispatch);
+    m_compositor = new Compositor(m_display, staticDispatch);
+
+    m_registry = wl_display_get_registry(m_clientDisplay);
+    wl_registry_add_listener(m_registry, &s_registryListener, this);
+    roundtrip();
+    QVERIFY(m_clientCompositor);
+
+    wl_surface *surface = wl_compositor_create_surface(m_clientCompositor);
+    roundtrip();
+
+    int batchCount = 0;
+    QBENCHMARK {
+        for (int i = 0; i < s_requestsPerBatch / 2; ++i) {
+            wl_surface_damage_buffer(surface, i, i, 1, 1);
+            wl_surface_commit(surface);
+        }
+        dispatch();
+        batchCount++;
+    }
+
+    roundtrip();
+    QCOMPARE(m_compositor->counters.damageRequests, batchCount * s_requestsPerBatch / 2);
+    QCOMPARE(m_compositor->counters.commitRequests, batchCount * s_requestsPerBatch / 2);
+
+    wl_surface_destroy(surface);
+    roundtrip();
+}
+
+QTEST_GUILESS_MAIN(SurfaceDispatchBenchmark)
+#include "benchmark_surface_dispatch.moc"
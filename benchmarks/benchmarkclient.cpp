@@ -0,0 +1,164 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "benchmarkclient.h"
+
+#include "../src/server/clientconnection.h"
+#include "../src/server/display.h"
+
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const wl_registry_listener BenchmarkClient::s_registryListener = {
+    registryGlobal,
+    registryGlobalRemove,
+};
+
+BenchmarkClient::BenchmarkClient(KWaylandServer::Display *display)
+    : m_serverDisplay(display)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        return;
+    }
+    m_connection = display->createClient(sv[0]);
+    if (!m_connection) {
+        close(sv[0]);
+        close(sv[1]);
+        return;
+    }
+    m_display = wl_display_connect_to_fd(sv[1]);
+    if (!m_display) {
+        close(sv[1]);
+        return;
+    }
+
+    m_registry = wl_display_get_registry(m_display);
+    wl_registry_add_listener(m_registry, &s_registryListener, this);
+    roundtrip();
+}
+
+BenchmarkClient::~BenchmarkClient()
+{
+    if (m_registry) {
+        wl_registry_destroy(m_registry);
+    }
+    if (m_display) {
+        wl_display_disconnect(m_display);
+        // let the display notice the disconnect and clean up the resources of the client
+        m_serverDisplay->dispatchEvents();
+    }
+}
+
+bool BenchmarkClient::isValid() const
+{
+    return m_display && !wl_display_get_error(m_display);
+}
+
+wl_display *BenchmarkClient::display() const
+{
+    return m_display;
+}
+
+KWaylandServer::ClientConnection *BenchmarkClient::connection() const
+{
+    return m_connection;
+}
+
+void *BenchmarkClient::bindGlobal(const wl_interface *interface, quint32 version)
+{
+    const auto it = m_globals.constFind(QByteArray(interface->name));
+    if (it == m_globals.constEnd()) {
+        return nullptr;
+    }
+    return wl_registry_bind(m_registry, it->name, interface, std::min(version, it->version));
+}
+
+void BenchmarkClient::dispatch()
+{
+    dispatchClients(m_serverDisplay, {this});
+}
+
+void BenchmarkClient::roundtrip()
+{
+    static const wl_callback_listener listener = {
+        [](void *data, wl_callback *callback, uint32_t serial) {
+            Q_UNUSED(serial)
+            *static_cast<bool *>(data) = true;
+            wl_callback_destroy(callback);
+        },
+    };
+
+    bool done = false;
+    wl_callback *callback = wl_display_sync(m_display);
+    wl_callback_add_listener(callback, &listener, &done);
+    while (!done && isValid()) {
+        dispatch();
+    }
+}
+
+void BenchmarkClient::readEvents()
+{
+    // the socket isn't polled, so this doesn't block if there is nothing to read
+    if (wl_display_prepare_read(m_display) == 0) {
+        wl_display_read_events(m_display);
+    }
+    wl_display_dispatch_pending(m_display);
+}
+
+void BenchmarkClient::registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version)
+{
+    Q_UNUSED(registry)
+    auto client = static_cast<BenchmarkClient *>(data);
+    client->m_globals.insert(QByteArray(interface), Global{name, version});
+}
+
+void BenchmarkClient::registryGlobalRemove(void *data, wl_registry *registry, uint32_t name)
+{
+    Q_UNUSED(registry)
+    auto client = static_cast<BenchmarkClient *>(data);
+    for (auto it = client->m_globals.begin(); it != client->m_globals.end(); ++it) {
+        if (it->name == name) {
+            client->m_globals.erase(it);
+            break;
+        }
+    }
+}
+
+void dispatchClients(KWaylandServer::Display *display, const QVector<BenchmarkClient *> &clients)
+{
+    for (BenchmarkClient *client : clients) {
+        wl_display_flush(client->display());
+    }
+    display->dispatchEvents();
+    display->flush();
+    for (BenchmarkClient *client : clients) {
+        client->readEvents();
+    }
+}
+
+wl_buffer *createShmBuffer(wl_shm *shm, const QSize &size)
+{
+    const int stride = size.width() * 4;
+    const int poolSize = stride * size.height();
+
+    const int fd = memfd_create("kwaylandserver-benchmark", MFD_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    if (ftruncate(fd, poolSize) == -1) {
+        close(fd);
+        return nullptr;
+    }
+
+    wl_shm_pool *pool = wl_shm_create_pool(shm, fd, poolSize);
+    wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, size.width(), size.height(), stride, WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return buffer;
+}
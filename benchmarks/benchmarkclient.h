@@ -0,0 +1,92 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QSize>
+#include <QVector>
+
+#include <wayland-client.h>
+
+namespace KWaylandServer
+{
+class ClientConnection;
+class Display;
+}
+
+/**
+ * The BenchmarkClient is an in-process client connected to a Display over a socketpair
+ * created with Display::createClient(). It uses the raw libwayland client API and runs on
+ * the same thread as the Display, which must not be started. The client drives the display
+ * itself, so the benchmarks measure the server side without any thread hand-offs.
+ */
+class BenchmarkClient
+{
+public:
+    explicit BenchmarkClient(KWaylandServer::Display *display);
+    ~BenchmarkClient();
+
+    bool isValid() const;
+
+    wl_display *display() const;
+    KWaylandServer::ClientConnection *connection() const;
+
+    /**
+     * Binds the global with the given @p interface, or returns @c nullptr if the display
+     * doesn't announce it.
+     */
+    template<typename T>
+    T *bind(const wl_interface *interface, quint32 version)
+    {
+        return static_cast<T *>(bindGlobal(interface, version));
+    }
+
+    /**
+     * Sends the pending requests, lets the display dispatch them and reads its events.
+     */
+    void dispatch();
+
+    /**
+     * Dispatches until the display has handled all requests sent so far.
+     */
+    void roundtrip();
+
+    /**
+     * Reads and dispatches the events the display has sent to this client, without
+     * dispatching the display.
+     */
+    void readEvents();
+
+private:
+    void *bindGlobal(const wl_interface *interface, quint32 version);
+
+    static void registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version);
+    static void registryGlobalRemove(void *data, wl_registry *registry, uint32_t name);
+    static const wl_registry_listener s_registryListener;
+
+    struct Global {
+        quint32 name;
+        quint32 version;
+    };
+
+    KWaylandServer::Display *m_serverDisplay;
+    KWaylandServer::ClientConnection *m_connection = nullptr;
+    wl_display *m_display = nullptr;
+    wl_registry *m_registry = nullptr;
+    QHash<QByteArray, Global> m_globals;
+};
+
+/**
+ * Lets the display dispatch the requests of all @p clients and reads the events, use this
+ * instead of BenchmarkClient::dispatch() if the display sends events to many clients.
+ */
+void dispatchClients(KWaylandServer::Display *display, const QVector<BenchmarkClient *> &clients);
+
+/**
+ * Creates an XRGB8888 shm buffer of the given @p size, backed by a memfd.
+ */
+wl_buffer *createShmBuffer(wl_shm *shm, const QSize &size);
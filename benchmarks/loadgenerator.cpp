@@ -0,0 +1,635 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "loadgenerator.h"
+#include "benchmarkclient.h"
+
+#include "../src/server/compositor_interface.h"
+#include "../src/server/datadevicemanager_interface.h"
+#include "../src/server/display.h"
+#include "../src/server/seat_interface.h"
+#include "../src/server/surface_interface.h"
+#include "../src/server/xdgshell_interface.h"
+
+#include "wayland-xdg-shell-client-protocol.h"
+
+#include <QFile>
+
+#include <algorithm>
+
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace KWaylandServer;
+
+class SyntheticClient;
+
+class LoadGeneratorPrivate
+{
+public:
+    LoadGeneratorPrivate();
+
+    void focusKeyboard(SyntheticClient *client);
+    void focusPointer(SyntheticClient *client);
+    void step(double now);
+
+    Display display;
+    CompositorInterface *compositor;
+    SeatInterface *seat;
+    XdgShellInterface *xdgShell;
+
+    QVector<SyntheticClient *> clients;
+    QVector<SurfaceInterface *> windows;
+    XdgToplevelInterface *lastToplevel = nullptr;
+    SyntheticClient *keyboardFocus = nullptr;
+    SyntheticClient *pointerFocus = nullptr;
+
+    double now = 0;
+    double nextVblank = 0;
+    int refreshRate = 60;
+    quint32 timestamp = 0;
+};
+
+class SyntheticClient
+{
+public:
+    enum Action {
+        Commit,
+        Popup,
+        Clipboard,
+        Cursor,
+        ActionCount,
+    };
+
+    SyntheticClient(Display *display, const LoadGenerator::Workload &workload);
+    ~SyntheticClient();
+
+    bool setup();
+    bool isValid() const;
+    bool isDue(Action action, double now);
+    void schedule(double now, double phase);
+
+    void commit();
+    void togglePopup();
+    void setSelection();
+    void changeCursor();
+
+    BenchmarkClient connection;
+    SurfaceInterface *serverSurface = nullptr;
+
+private:
+    static void handlePing(void *data, xdg_wm_base *wmBase, uint32_t serial);
+    static void handleToplevelSurfaceConfigure(void *data, xdg_surface *xdgSurface, uint32_t serial);
+    static void handlePopupSurfaceConfigure(void *data, xdg_surface *xdgSurface, uint32_t serial);
+    static void handleFrameDone(void *data, wl_callback *callback, uint32_t time);
+    static void handlePointerEnter(void *data, wl_pointer *pointer, uint32_t serial, wl_surface *surface, wl_fixed_t x, wl_fixed_t y);
+    static void handleDataOffer(void *data, wl_data_device *dataDevice, wl_data_offer *offer);
+    static void handleSelection(void *data, wl_data_device *dataDevice, wl_data_offer *offer);
+    static void handleSourceCancelled(void *data, wl_data_source *source);
+
+    struct Schedule {
+        double interval = 0;
+        double next = 0;
+    };
+
+    LoadGenerator::Workload m_workload;
+    Schedule m_schedules[ActionCount];
+
+    wl_compositor *m_compositor = nullptr;
+    wl_shm *m_shm = nullptr;
+    wl_seat *m_seat = nullptr;
+    xdg_wm_base *m_wmBase = nullptr;
+    wl_data_device_manager *m_dataDeviceManager = nullptr;
+
+    wl_surface *m_surface = nullptr;
+    xdg_surface *m_xdgSurface = nullptr;
+    xdg_toplevel *m_toplevel = nullptr;
+    wl_buffer *m_buffers[2] = {};
+    int m_frame = 0;
+    bool m_configured = false;
+
+    wl_surface *m_popupSurface = nullptr;
+    xdg_surface *m_popupXdgSurface = nullptr;
+    xdg_popup *m_popup = nullptr;
+    wl_buffer *m_popupBuffer = nullptr;
+
+    wl_data_device *m_dataDevice = nullptr;
+    wl_data_offer *m_selectionOffer = nullptr;
+
+    wl_pointer *m_pointer = nullptr;
+    wl_surface *m_cursorSurface = nullptr;
+    wl_buffer *m_cursorBuffers[2] = {};
+    int m_cursorFrame = 0;
+    quint32 m_serial = 0;
+};
+
+template<typename... Args>
+static void ignore(void *, Args...)
+{
+}
+
+SyntheticClient::SyntheticClient(Display *display, const LoadGenerator::Workload &workload)
+    : connection(display)
+    , m_workload(workload)
+{
+    const int rates[ActionCount] = {workload.commitRate, workload.popupRate, workload.clipboardRate, workload.cursorRate};
+    for (int i = 0; i < ActionCount; ++i) {
+        if (rates[i] > 0) {
+            m_schedules[i].interval = 1000.0 / rates[i];
+        }
+    }
+}
+
+SyntheticClient::~SyntheticClient()
+{
+    if (m_popup) {
+        togglePopup();
+    }
+    if (m_selectionOffer) {
+        wl_data_offer_destroy(m_selectionOffer);
+    }
+    if (m_dataDevice) {
+        wl_data_device_release(m_dataDevice);
+    }
+    if (m_pointer) {
+        wl_pointer_release(m_pointer);
+    }
+    for (wl_buffer *buffer : {m_buffers[0], m_buffers[1], m_popupBuffer, m_cursorBuffers[0], m_cursorBuffers[1]}) {
+        if (buffer) {
+            wl_buffer_destroy(buffer);
+        }
+    }
+    if (m_cursorSurface) {
+        wl_surface_destroy(m_cursorSurface);
+    }
+    if (m_toplevel) {
+        xdg_toplevel_destroy(m_toplevel);
+    }
+    if (m_xdgSurface) {
+        xdg_surface_destroy(m_xdgSurface);
+    }
+    if (m_surface) {
+        wl_surface_destroy(m_surface);
+    }
+    if (m_dataDeviceManager) {
+        wl_data_device_manager_destroy(m_dataDeviceManager);
+    }
+    if (m_wmBase) {
+        xdg_wm_base_destroy(m_wmBase);
+    }
+    if (m_seat) {
+        wl_seat_destroy(m_seat);
+    }
+    if (m_shm) {
+        wl_shm_destroy(m_shm);
+    }
+    if (m_compositor) {
+        wl_compositor_destroy(m_compositor);
+    }
+}
+
+bool SyntheticClient::setup()
+{
+    if (!connection.isValid()) {
+        return false;
+    }
+
+    m_compositor = connection.bind<wl_compositor>(&wl_compositor_interface, 4);
+    m_shm = connection.bind<wl_shm>(&wl_shm_interface, 1);
+    m_seat = connection.bind<wl_seat>(&wl_seat_interface, 5);
+    m_wmBase = connection.bind<xdg_wm_base>(&xdg_wm_base_interface, 2);
+    m_dataDeviceManager = connection.bind<wl_data_device_manager>(&wl_data_device_manager_interface, 3);
+    if (!m_compositor || !m_shm || !m_seat || !m_wmBase || !m_dataDeviceManager) {
+        return false;
+    }
+
+    static const xdg_wm_base_listener wmBaseListener = {
+        handlePing,
+    };
+    xdg_wm_base_add_listener(m_wmBase, &wmBaseListener, this);
+
+    static const wl_pointer_listener pointerListener = {
+        handlePointerEnter,
+        ignore<wl_pointer *, uint32_t, wl_surface *>,
+        ignore<wl_pointer *, uint32_t, wl_fixed_t, wl_fixed_t>,
+        ignore<wl_pointer *, uint32_t, uint32_t, uint32_t, uint32_t>,
+        ignore<wl_pointer *, uint32_t, uint32_t, wl_fixed_t>,
+        ignore<wl_pointer *>,
+        ignore<wl_pointer *, uint32_t>,
+        ignore<wl_pointer *, uint32_t, uint32_t>,
+        ignore<wl_pointer *, uint32_t, int32_t>,
+    };
+    m_pointer = wl_seat_get_pointer(m_seat);
+    wl_pointer_add_listener(m_pointer, &pointerListener, this);
+
+    static const wl_data_device_listener dataDeviceListener = {
+        handleDataOffer,
+        ignore<wl_data_device *, uint32_t, wl_surface *, wl_fixed_t, wl_fixed_t, wl_data_offer *>,
+        ignore<wl_data_device *>,
+        ignore<wl_data_device *, uint32_t, wl_fixed_t, wl_fixed_t>,
+        ignore<wl_data_device *>,
+        handleSelection,
+    };
+    m_dataDevice = wl_data_device_manager_get_data_device(m_dataDeviceManager, m_seat);
+    wl_data_device_add_listener(m_dataDevice, &dataDeviceListener, this);
+
+    // the window, which is mapped once the compositor has configured it
+    static const xdg_surface_listener xdgSurfaceListener = {
+        handleToplevelSurfaceConfigure,
+    };
+    static const xdg_toplevel_listener toplevelListener = {
+        ignore<xdg_toplevel *, int32_t, int32_t, wl_array *>,
+        ignore<xdg_toplevel *>,
+    };
+    m_surface = wl_compositor_create_surface(m_compositor);
+    m_xdgSurface = xdg_wm_base_get_xdg_surface(m_wmBase, m_surface);
+    xdg_surface_add_listener(m_xdgSurface, &xdgSurfaceListener, this);
+    m_toplevel = xdg_surface_get_toplevel(m_xdgSurface);
+    xdg_toplevel_add_listener(m_toplevel, &toplevelListener, this);
+    xdg_toplevel_set_title(m_toplevel, "Synthetic client");
+    xdg_toplevel_set_app_id(m_toplevel, "org.kde.kwaylandserver.loadgenerator");
+    wl_surface_commit(m_surface);
+    connection.roundtrip();
+    if (!m_configured) {
+        return false;
+    }
+
+    m_buffers[0] = createShmBuffer(m_shm, m_workload.windowSize);
+    m_buffers[1] = createShmBuffer(m_shm, m_workload.windowSize);
+    if (m_workload.popupRate > 0) {
+        m_popupBuffer = createShmBuffer(m_shm, QSize(100, 100));
+    }
+    if (m_workload.cursorRate > 0) {
+        m_cursorSurface = wl_compositor_create_surface(m_compositor);
+        m_cursorBuffers[0] = createShmBuffer(m_shm, QSize(24, 24));
+        m_cursorBuffers[1] = createShmBuffer(m_shm, QSize(24, 24));
+    }
+    commit();
+    connection.roundtrip();
+    return isValid();
+}
+
+bool SyntheticClient::isValid() const
+{
+    return connection.isValid();
+}
+
+void SyntheticClient::schedule(double now, double phase)
+{
+    for (Schedule &schedule : m_schedules) {
+        schedule.next = now + schedule.interval * phase;
+    }
+}
+
+bool SyntheticClient::isDue(Action action, double now)
+{
+    Schedule &schedule = m_schedules[action];
+    if (schedule.interval <= 0 || now < schedule.next) {
+        return false;
+    }
+    schedule.next += schedule.interval;
+    return true;
+}
+
+void SyntheticClient::commit()
+{
+    static const wl_callback_listener frameListener = {
+        handleFrameDone,
+    };
+
+    const QSize &size = m_workload.windowSize;
+    wl_surface_attach(m_surface, m_buffers[m_frame++ % 2], 0, 0);
+    wl_surface_damage_buffer(m_surface, 0, 0, size.width(), size.height());
+    wl_callback_add_listener(wl_surface_frame(m_surface), &frameListener, this);
+    wl_surface_commit(m_surface);
+}
+
+void SyntheticClient::togglePopup()
+{
+    if (m_popup) {
+        xdg_popup_destroy(m_popup);
+        xdg_surface_destroy(m_popupXdgSurface);
+        wl_surface_destroy(m_popupSurface);
+        m_popup = nullptr;
+        m_popupXdgSurface = nullptr;
+        m_popupSurface = nullptr;
+        return;
+    }
+
+    static const xdg_surface_listener xdgSurfaceListener = {
+        handlePopupSurfaceConfigure,
+    };
+    static const xdg_popup_listener popupListener = {
+        ignore<xdg_popup *, int32_t, int32_t, int32_t, int32_t>,
+        ignore<xdg_popup *>,
+    };
+
+    xdg_positioner *positioner = xdg_wm_base_create_positioner(m_wmBase);
+    xdg_positioner_set_size(positioner, 100, 100);
+    xdg_positioner_set_anchor_rect(positioner, 10, 10, 1, 1);
+
+    m_popupSurface = wl_compositor_create_surface(m_compositor);
+    m_popupXdgSurface = xdg_wm_base_get_xdg_surface(m_wmBase, m_popupSurface);
+    xdg_surface_add_listener(m_popupXdgSurface, &xdgSurfaceListener, this);
+    m_popup = xdg_surface_get_popup(m_popupXdgSurface, m_xdgSurface, positioner);
+    xdg_popup_add_listener(m_popup, &popupListener, this);
+    xdg_positioner_destroy(positioner);
+    wl_surface_commit(m_popupSurface);
+}
+
+void SyntheticClient::setSelection()
+{
+    static const wl_data_source_listener sourceListener = {
+        ignore<wl_data_source *, const char *>,
+        [](void *, wl_data_source *, const char *, int32_t fd) {
+            close(fd);
+        },
+        handleSourceCancelled,
+        ignore<wl_data_source *>,
+        ignore<wl_data_source *>,
+        ignore<wl_data_source *, uint32_t>,
+    };
+
+    wl_data_source *source = wl_data_device_manager_create_data_source(m_dataDeviceManager);
+    wl_data_source_add_listener(source, &sourceListener, this);
+    wl_data_source_offer(source, "text/plain;charset=utf-8");
+    wl_data_source_offer(source, "text/plain");
+    wl_data_device_set_selection(m_dataDevice, source, m_serial);
+}
+
+void SyntheticClient::changeCursor()
+{
+    wl_pointer_set_cursor(m_pointer, m_serial, m_cursorSurface, 0, 0);
+    wl_surface_attach(m_cursorSurface, m_cursorBuffers[m_cursorFrame++ % 2], 0, 0);
+    wl_surface_damage_buffer(m_cursorSurface, 0, 0, 24, 24);
+    wl_surface_commit(m_cursorSurface);
+}
+
+void SyntheticClient::handlePing(void *data, xdg_wm_base *wmBase, uint32_t serial)
+{
+    Q_UNUSED(data)
+    xdg_wm_base_pong(wmBase, serial);
+}
+
+void SyntheticClient::handleToplevelSurfaceConfigure(void *data, xdg_surface *xdgSurface, uint32_t serial)
+{
+    auto client = static_cast<SyntheticClient *>(data);
+    xdg_surface_ack_configure(xdgSurface, serial);
+    client->m_configured = true;
+}
+
+void SyntheticClient::handlePopupSurfaceConfigure(void *data, xdg_surface *xdgSurface, uint32_t serial)
+{
+    auto client = static_cast<SyntheticClient *>(data);
+    xdg_surface_ack_configure(xdgSurface, serial);
+    wl_surface_attach(client->m_popupSurface, client->m_popupBuffer, 0, 0);
+    wl_surface_damage_buffer(client->m_popupSurface, 0, 0, 100, 100);
+    wl_surface_commit(client->m_popupSurface);
+}
+
+void SyntheticClient::handleFrameDone(void *data, wl_callback *callback, uint32_t time)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(time)
+    wl_callback_destroy(callback);
+}
+
+void SyntheticClient::handlePointerEnter(void *data, wl_pointer *pointer, uint32_t serial, wl_surface *surface, wl_fixed_t x, wl_fixed_t y)
+{
+    Q_UNUSED(pointer)
+    Q_UNUSED(surface)
+    Q_UNUSED(x)
+    Q_UNUSED(y)
+    static_cast<SyntheticClient *>(data)->m_serial = serial;
+}
+
+void SyntheticClient::handleDataOffer(void *data, wl_data_device *dataDevice, wl_data_offer *offer)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(dataDevice)
+    Q_UNUSED(offer)
+    // the offer is announced before the selection event
+}
+
+void SyntheticClient::handleSelection(void *data, wl_data_device *dataDevice, wl_data_offer *offer)
+{
+    Q_UNUSED(dataDevice)
+    auto client = static_cast<SyntheticClient *>(data);
+    if (client->m_selectionOffer && client->m_selectionOffer != offer) {
+        wl_data_offer_destroy(client->m_selectionOffer);
+    }
+    client->m_selectionOffer = offer;
+}
+
+void SyntheticClient::handleSourceCancelled(void *data, wl_data_source *source)
+{
+    Q_UNUSED(data)
+    wl_data_source_destroy(source);
+}
+
+static std::chrono::nanoseconds threadCpuTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+static std::chrono::nanoseconds monotonicTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+// The resident set size in KiB.
+static qint64 residentMemory()
+{
+    QFile file(QStringLiteral("/proc/self/statm"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.count() < 2) {
+        return 0;
+    }
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+LoadGeneratorPrivate::LoadGeneratorPrivate()
+{
+    // every client uses two sockets, raise the soft limit so hundreds of clients fit
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    display.createShm();
+    compositor = new CompositorInterface(&display, &display);
+    seat = new SeatInterface(&display, &display);
+    seat->setHasPointer(true);
+    seat->setHasKeyboard(true);
+    new DataDeviceManagerInterface(&display, &display);
+    xdgShell = new XdgShellInterface(&display, &display);
+
+    QObject::connect(xdgShell, &XdgShellInterface::toplevelCreated, &display, [this](XdgToplevelInterface *toplevel) {
+        lastToplevel = toplevel;
+        QObject::connect(toplevel, &XdgToplevelInterface::initializeRequested, toplevel, [toplevel]() {
+            toplevel->sendConfigure(QSize(), XdgToplevelInterface::States());
+        });
+    });
+    QObject::connect(xdgShell, &XdgShellInterface::popupCreated, &display, [](XdgPopupInterface *popup) {
+        QObject::connect(popup, &XdgPopupInterface::initializeRequested, popup, [popup]() {
+            popup->sendConfigure(QRect(10, 10, 100, 100));
+        });
+    });
+}
+
+void LoadGeneratorPrivate::focusKeyboard(SyntheticClient *client)
+{
+    if (keyboardFocus != client) {
+        seat->setFocusedKeyboardSurface(client->serverSurface);
+        keyboardFocus = client;
+    }
+}
+
+void LoadGeneratorPrivate::focusPointer(SyntheticClient *client)
+{
+    if (pointerFocus != client) {
+        seat->setTimestamp(++timestamp);
+        seat->notifyPointerEnter(client->serverSurface, QPointF(50, 50), QPointF());
+        seat->notifyPointerFrame();
+        pointerFocus = client;
+    }
+}
+
+void LoadGeneratorPrivate::step(double time)
+{
+    now = time;
+    for (SyntheticClient *client : qAsConst(clients)) {
+        while (client->isDue(SyntheticClient::Commit, now)) {
+            client->commit();
+        }
+        while (client->isDue(SyntheticClient::Popup, now)) {
+            client->togglePopup();
+        }
+        while (client->isDue(SyntheticClient::Clipboard, now)) {
+            focusKeyboard(client);
+            client->setSelection();
+        }
+        while (client->isDue(SyntheticClient::Cursor, now)) {
+            focusPointer(client);
+            client->changeCursor();
+        }
+    }
+}
+
+std::chrono::nanoseconds LoadGenerator::Report::cpuTimePerClient() const
+{
+    if (!clientCount || !duration.count()) {
+        return std::chrono::nanoseconds::zero();
+    }
+    return serverCpuTime * 1000 / (clientCount * duration.count());
+}
+
+std::chrono::nanoseconds LoadGenerator::Report::latency(int percentile) const
+{
+    if (iterationLatencies.isEmpty()) {
+        return std::chrono::nanoseconds::zero();
+    }
+    const int index = std::min<int>(iterationLatencies.count() - 1, iterationLatencies.count() * percentile / 100);
+    return iterationLatencies.at(index);
+}
+
+LoadGenerator::LoadGenerator()
+    : d(new LoadGeneratorPrivate)
+{
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    qDeleteAll(d->clients);
+}
+
+Display *LoadGenerator::display() const
+{
+    return &d->display;
+}
+
+void LoadGenerator::setRefreshRate(int hz)
+{
+    d->refreshRate = hz;
+}
+
+int LoadGenerator::clientCount() const
+{
+    return d->clients.count();
+}
+
+bool LoadGenerator::addClients(int count, const Workload &workload)
+{
+    for (int i = 0; i < count; ++i) {
+        auto client = new SyntheticClient(&d->display, workload);
+        d->lastToplevel = nullptr;
+        if (!client->setup() || !d->lastToplevel) {
+            delete client;
+            return false;
+        }
+        client->serverSurface = d->lastToplevel->surface();
+        // spread the clients over the interval, so they don't all commit in the same step
+        client->schedule(d->now, (i + 0.5) / count);
+        d->clients.append(client);
+        d->windows.append(client->serverSurface);
+    }
+    return true;
+}
+
+LoadGenerator::Report LoadGenerator::run(std::chrono::milliseconds duration, std::chrono::milliseconds step)
+{
+    Report report;
+    report.clientCount = d->clients.count();
+    report.duration = duration;
+
+    const qint64 memoryBefore = residentMemory();
+    const double end = d->now + duration.count();
+    if (d->nextVblank < d->now) {
+        d->nextVblank = d->now;
+    }
+
+    while (d->now < end) {
+        d->step(d->now + step.count());
+        for (SyntheticClient *client : qAsConst(d->clients)) {
+            wl_display_flush(client->connection.display());
+        }
+
+        const std::chrono::nanoseconds cpuStart = threadCpuTime();
+        const std::chrono::nanoseconds wallStart = monotonicTime();
+
+        d->display.dispatchEvents();
+        if (d->now >= d->nextVblank) {
+            for (SurfaceInterface *window : qAsConst(d->windows)) {
+                window->frameRendered(quint32(d->now));
+            }
+            d->nextVblank += 1000.0 / d->refreshRate;
+        }
+        d->display.flush();
+
+        report.serverCpuTime += threadCpuTime() - cpuStart;
+        report.iterationLatencies.append(monotonicTime() - wallStart);
+        report.iterationCount++;
+
+        for (SyntheticClient *client : qAsConst(d->clients)) {
+            client->connection.readEvents();
+        }
+    }
+
+    report.memoryGrowth = residentMemory() - memoryBefore;
+    std::sort(report.iterationLatencies.begin(), report.iterationLatencies.end());
+    report.ok = std::all_of(d->clients.cbegin(), d->clients.cend(), [](SyntheticClient *client) {
+        return client->isValid();
+    });
+    return report;
+}
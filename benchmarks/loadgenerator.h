@@ -0,0 +1,89 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include <QScopedPointer>
+#include <QSize>
+#include <QVector>
+
+#include <chrono>
+
+namespace KWaylandServer
+{
+class Display;
+}
+
+class LoadGeneratorPrivate;
+
+/**
+ * The LoadGenerator creates a Display with the globals of a typical desktop session and a
+ * number of synthetic in-process clients, which are connected with Display::createClient().
+ *
+ * Every client maps an xdg-toplevel and runs a scripted Workload: it commits new shm buffers
+ * at a fixed rate, opens and closes popups, sets the clipboard selection and changes the
+ * cursor. The LoadGenerator plays the compositor, it configures the windows, moves the input
+ * focus to the clients that need it and sends frame callbacks.
+ *
+ * The workloads run on a simulated clock, run() advances it in fixed steps without sleeping.
+ * Only the time the display spends dispatching the requests and sending the events of a step
+ * is measured; the clients and the display share one thread.
+ */
+class LoadGenerator
+{
+public:
+    struct Workload {
+        int commitRate = 60; ///< buffer commits per second
+        int popupRate = 0; ///< popups opened per second, every popup is closed before the next one opens
+        int clipboardRate = 0; ///< clipboard selections set per second
+        int cursorRate = 0; ///< cursor changes per second
+        QSize windowSize = QSize(256, 256);
+    };
+
+    struct Report {
+        bool ok = false; ///< whether all clients are still connected
+        int clientCount = 0;
+        std::chrono::milliseconds duration{0}; ///< simulated time
+        int iterationCount = 0;
+        std::chrono::nanoseconds serverCpuTime{0};
+        QVector<std::chrono::nanoseconds> iterationLatencies; ///< sorted, wall time per step
+        qint64 memoryGrowth = 0; ///< resident set growth during the run in KiB, includes the clients
+
+        /**
+         * Server CPU time per client and simulated second.
+         */
+        std::chrono::nanoseconds cpuTimePerClient() const;
+        /**
+         * Returns the step latency at the given @p percentile (0-100).
+         */
+        std::chrono::nanoseconds latency(int percentile) const;
+    };
+
+    LoadGenerator();
+    ~LoadGenerator();
+
+    KWaylandServer::Display *display() const;
+
+    /**
+     * Sets the refresh rate of the simulated output, frame callbacks are sent at this rate.
+     * The default is 60 Hz.
+     */
+    void setRefreshRate(int hz);
+
+    /**
+     * Connects @p count clients that run the given @p workload and maps their windows.
+     * Returns @c false if a client could not be set up.
+     */
+    bool addClients(int count, const Workload &workload);
+    int clientCount() const;
+
+    /**
+     * Runs the workloads for the simulated @p duration in steps of @p step.
+     */
+    Report run(std::chrono::milliseconds duration, std::chrono::milliseconds step = std::chrono::milliseconds(1));
+
+private:
+    QScopedPointer<LoadGeneratorPrivate> d;
+};
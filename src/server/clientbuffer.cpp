@@ -24,6 +24,8 @@ ClientBuffer::ClientBuffer(wl_resource *resource, ClientBufferPrivate &dd)
 
 ClientBuffer::~ClientBuffer()
 {
+    Q_D(ClientBuffer);
+    wl_list_remove(&d->registryListener.listener.link);
 }
 
 void ClientBuffer::initialize(wl_resource *resource)
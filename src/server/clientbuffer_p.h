@@ -8,18 +8,46 @@
 
 #include "clientbuffer.h"
 
+#include <wayland-server-core.h>
+
 namespace KWaylandServer
 {
 class ClientBufferPrivate
 {
 public:
+    ClientBufferPrivate()
+    {
+        wl_list_init(&registryListener.listener.link);
+    }
+
     virtual ~ClientBufferPrivate()
     {
     }
 
+    static ClientBufferPrivate *get(ClientBuffer *buffer)
+    {
+        return buffer->d_func();
+    }
+
     int refCount = 0;
     wl_resource *resource = nullptr;
     bool isDestroyed = false;
+
+    /**
+     * The destroy listener that binds the ClientBuffer to its wl_buffer resource. It is
+     * embedded here so looking up the ClientBuffer for a given resource requires neither
+     * a hash lookup nor an extra allocation, see Display::clientBufferForResource().
+     */
+    struct RegistryListener
+    {
+        wl_listener listener;
+        ClientBuffer *buffer;
+        // Whether and with which size the buffer is accounted to its client,
+        // see ClientConnection::clientBufferBytes().
+        bool accounted = false;
+        quint64 bytes = 0;
+    };
+    RegistryListener registryListener;
 };
 
 } // namespace KWaylandServer
@@ -4,71 +4,292 @@
     SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
 */
 #include "clientconnection.h"
+#include "clientconnection_p.h"
 #include "display.h"
+#include "display_p.h"
 #include "utils/executable_path.h"
 // Qt
 #include <QFileInfo>
-#include <QVector>
 // Wayland
 #include <wayland-server.h>
+// std
+#include <utility>
 
 namespace KWaylandServer
 {
-class ClientConnectionPrivate
-{
-public:
-    ClientConnectionPrivate(wl_client *c, Display *display, ClientConnection *q);
-    ~ClientConnectionPrivate();
-
-    wl_client *client;
-    Display *display;
-    pid_t pid = 0;
-    uid_t user = 0;
-    gid_t group = 0;
-    QString executablePath;
-
-private:
-    static void destroyListenerCallback(wl_listener *listener, void *data);
-    ClientConnection *q;
-    wl_listener listener;
-    static QVector<ClientConnectionPrivate *> s_allClients;
-};
-
-QVector<ClientConnectionPrivate *> ClientConnectionPrivate::s_allClients;
-
 ClientConnectionPrivate::ClientConnectionPrivate(wl_client *c, Display *display, ClientConnection *q)
     : client(c)
     , display(display)
     , q(q)
 {
-    s_allClients << this;
-    listener.notify = destroyListenerCallback;
-    wl_client_add_destroy_listener(c, &listener);
+    listener.receiver = this;
+    listener.listener.notify = destroyListenerCallback;
+    wl_client_add_destroy_listener(c, &listener.listener);
     wl_client_get_credentials(client, &pid, &user, &group);
     executablePath = executablePathFromPid(pid);
+
+    resourceCreatedListener.receiver = this;
+    resourceCreatedListener.listener.notify = resourceCreatedCallback;
+    wl_list_init(&resourceCreatedListener.listener.link);
+    setObjectAccountingEnabled(DisplayPrivate::get(display)->objectAccounting());
 }
 
 ClientConnectionPrivate::~ClientConnectionPrivate()
 {
     if (client) {
-        wl_list_remove(&listener.link);
+        setObjectAccountingEnabled(false);
+        wl_list_remove(&listener.listener.link);
+    }
+}
+
+ClientConnectionPrivate *ClientConnectionPrivate::get(wl_client *client)
+{
+    wl_listener *listener = wl_client_get_destroy_listener(client, destroyListenerCallback);
+    if (!listener) {
+        return nullptr;
+    }
+    return reinterpret_cast<DestroyListener *>(listener)->receiver;
+}
+
+ClientConnectionPrivate *ClientConnectionPrivate::get(ClientConnection *connection)
+{
+    return connection->d.data();
+}
+
+bool ClientConnectionPrivate::queueEvent(quint32 size)
+{
+    queuedBytes += size;
+    pendingBytes += size;
+    if (dirty) {
+        return false;
+    }
+    dirty = true;
+    return true;
+}
+
+void ClientConnectionPrivate::markFlushed()
+{
+    if (!dirty) {
+        return;
+    }
+    dirty = false;
+    if (pendingBytes) {
+        pendingBytes = 0;
+        ++flushCount;
+        releaseQuota(ClientConnection::Resource::PendingEventBytes, 0);
+    }
+}
+
+static quint64 quotaLimit(const ClientQuota &quota, ClientConnection::Resource resource)
+{
+    switch (resource) {
+    case ClientConnection::Resource::Objects:
+        return quota.objects;
+    case ClientConnection::Resource::ClientBuffers:
+        return quota.clientBuffers;
+    case ClientConnection::Resource::ClientBufferBytes:
+        return quota.clientBufferBytes;
+    case ClientConnection::Resource::FrameCallbacks:
+        return quota.frameCallbacks;
+    case ClientConnection::Resource::PendingEventBytes:
+        return quota.pendingEventBytes;
+    }
+    Q_UNREACHABLE();
+}
+
+void ClientConnectionPrivate::checkQuota(ClientConnection::Resource resource, quint64 value)
+{
+    const DisplayPrivate *displayPrivate = DisplayPrivate::get(display);
+
+    const quint64 hardLimit = quotaLimit(displayPrivate->hardQuota, resource);
+    if (hardLimit && value > hardLimit) {
+        hardQuotaExceeded |= resource;
+        markOverQuota();
+        return;
+    }
+
+    const quint64 softLimit = quotaLimit(displayPrivate->softQuota, resource);
+    if (softLimit && value > softLimit && !softQuotaExceeded.testFlag(resource)) {
+        softQuotaExceeded |= resource;
+        softQuotaPending |= resource;
+        markOverQuota();
     }
-    s_allClients.removeAt(s_allClients.indexOf(this));
+}
+
+void ClientConnectionPrivate::releaseQuota(ClientConnection::Resource resource, quint64 value)
+{
+    if (softQuotaExceeded.testFlag(resource) && value <= quotaLimit(DisplayPrivate::get(display)->softQuota, resource)) {
+        softQuotaExceeded &= ~ClientConnection::Resources(resource);
+    }
+}
+
+void ClientConnectionPrivate::markOverQuota()
+{
+    if (quotaPending) {
+        return;
+    }
+    quotaPending = true;
+    DisplayPrivate::get(display)->overQuotaClients.append(q);
+}
+
+void ClientConnectionPrivate::addClientBuffer(quint64 bytes)
+{
+    ++clientBuffers;
+    clientBufferBytes += bytes;
+    checkQuota(ClientConnection::Resource::ClientBuffers, clientBuffers);
+    checkQuota(ClientConnection::Resource::ClientBufferBytes, clientBufferBytes);
+}
+
+void ClientConnectionPrivate::removeClientBuffer(quint64 bytes)
+{
+    --clientBuffers;
+    clientBufferBytes -= bytes;
+    releaseQuota(ClientConnection::Resource::ClientBuffers, clientBuffers);
+    releaseQuota(ClientConnection::Resource::ClientBufferBytes, clientBufferBytes);
+}
+
+void ClientConnectionPrivate::addFrameCallback()
+{
+    ++frameCallbacks;
+    checkQuota(ClientConnection::Resource::FrameCallbacks, frameCallbacks);
+}
+
+void ClientConnectionPrivate::removeFrameCallback()
+{
+    --frameCallbacks;
+    releaseQuota(ClientConnection::Resource::FrameCallbacks, frameCallbacks);
+}
+
+void ClientConnectionPrivate::coalesce(const void *key, QObject *context, std::function<void()> &&send)
+{
+    for (CoalescedEvent &event : coalescedEvents) {
+        if (event.key == key) {
+            event.context = context;
+            event.send = std::move(send);
+            return;
+        }
+    }
+    coalescedEvents.append(CoalescedEvent{key, context, std::move(send)});
+}
+
+void ClientConnectionPrivate::flushCoalesced(const void *key)
+{
+    for (int i = 0; i < coalescedEvents.count(); ++i) {
+        if (coalescedEvents[i].key == key) {
+            const CoalescedEvent event = coalescedEvents.takeAt(i);
+            if (event.context) {
+                event.send();
+            }
+            return;
+        }
+    }
+}
+
+void ClientConnectionPrivate::dropCoalesced(const void *key)
+{
+    for (int i = 0; i < coalescedEvents.count(); ++i) {
+        if (coalescedEvents[i].key == key) {
+            coalescedEvents.remove(i);
+            return;
+        }
+    }
+}
+
+void ClientConnectionPrivate::sendCoalesced()
+{
+    const QVector<CoalescedEvent> events = std::exchange(coalescedEvents, {});
+    for (const CoalescedEvent &event : events) {
+        if (event.context) {
+            event.send();
+        }
+    }
+}
+
+void ClientConnectionPrivate::setObjectAccountingEnabled(bool enabled)
+{
+    if (objectAccounting == enabled || !client) {
+        return;
+    }
+    objectAccounting = enabled;
+
+    if (enabled) {
+        wl_client_add_resource_created_listener(client, &resourceCreatedListener.listener);
+        // objects created before the ClientConnection, at least the wl_display
+        wl_client_for_each_resource(
+            client,
+            [](wl_resource *resource, void *userData) {
+                static_cast<ClientConnectionPrivate *>(userData)->trackObject(resource);
+                return WL_ITERATOR_CONTINUE;
+            },
+            this);
+    } else {
+        wl_list_remove(&resourceCreatedListener.listener.link);
+        wl_list_init(&resourceCreatedListener.listener.link);
+        wl_client_for_each_resource(
+            client,
+            [](wl_resource *resource, void *) {
+                if (wl_listener *listener = wl_resource_get_destroy_listener(resource, objectDestroyedCallback)) {
+                    wl_list_remove(&listener->link);
+                    delete reinterpret_cast<ObjectListener *>(listener);
+                }
+                return WL_ITERATOR_CONTINUE;
+            },
+            nullptr);
+        objects.clear();
+        objectCount = 0;
+        softQuotaExceeded &= ~ClientConnection::Resources(ClientConnection::Resource::Objects);
+    }
+}
+
+void ClientConnectionPrivate::trackObject(wl_resource *resource)
+{
+    auto objectListener = new ObjectListener;
+    objectListener->listener.notify = objectDestroyedCallback;
+    objectListener->receiver = this;
+    objectListener->interface = wl_resource_get_class(resource);
+    wl_resource_add_destroy_listener(resource, &objectListener->listener);
+
+    ++objects[objectListener->interface];
+    ++objectCount;
+    checkQuota(ClientConnection::Resource::Objects, objectCount);
+}
+
+void ClientConnectionPrivate::resourceCreatedCallback(wl_listener *listener, void *data)
+{
+    auto p = reinterpret_cast<ResourceCreatedListener *>(listener)->receiver;
+    p->trackObject(static_cast<wl_resource *>(data));
+}
+
+void ClientConnectionPrivate::objectDestroyedCallback(wl_listener *listener, void *data)
+{
+    Q_UNUSED(data)
+    auto objectListener = reinterpret_cast<ObjectListener *>(listener);
+    ClientConnectionPrivate *p = objectListener->receiver;
+
+    auto it = p->objects.find(objectListener->interface);
+    if (it != p->objects.end() && --(*it) == 0) {
+        p->objects.erase(it);
+    }
+    --p->objectCount;
+    p->releaseQuota(ClientConnection::Resource::Objects, p->objectCount);
+
+    wl_list_remove(&objectListener->listener.link);
+    delete objectListener;
 }
 
 void ClientConnectionPrivate::destroyListenerCallback(wl_listener *listener, void *data)
 {
-    Q_UNUSED(listener)
-    wl_client *client = reinterpret_cast<wl_client *>(data);
-    auto it = std::find_if(s_allClients.constBegin(), s_allClients.constEnd(), [client](ClientConnectionPrivate *c) {
-        return c->client == client;
-    });
-    Q_ASSERT(it != s_allClients.constEnd());
-    auto p = (*it);
+    Q_UNUSED(data)
+    auto p = reinterpret_cast<DestroyListener *>(listener)->receiver;
     auto q = p->q;
     Q_EMIT q->aboutToBeDestroyed();
     p->client = nullptr;
-    wl_list_remove(&p->listener.link);
+    wl_list_remove(&p->listener.listener.link);
+    p->coalescedEvents.clear();
+    // The resources of the client are destroyed after this, the object listeners are
+    // still notified and freed then.
+    wl_list_remove(&p->resourceCreatedListener.listener.link);
+    wl_list_init(&p->resourceCreatedListener.listener.link);
     Q_EMIT q->disconnected(q);
     q->deleteLater();
 }
@@ -81,12 +302,106 @@ ClientConnection::ClientConnection(wl_client *c, Display *parent)
 
 ClientConnection::~ClientConnection() = default;
 
+ClientConnection *ClientConnection::get(wl_client *client)
+{
+    ClientConnectionPrivate *clientPrivate = ClientConnectionPrivate::get(client);
+    return clientPrivate ? clientPrivate->q : nullptr;
+}
+
 void ClientConnection::flush()
 {
     if (!d->client) {
         return;
     }
     wl_client_flush(d->client);
+    // The client stays in the display's dirty list, so anything the socket could not take
+    // right now is written out once the event loop is about to block.
+    if (d->dirty) {
+        ++d->flushCount;
+        d->pendingBytes = 0;
+        d->releaseQuota(ClientConnection::Resource::PendingEventBytes, 0);
+    }
+}
+
+quint64 ClientConnection::requestCount() const
+{
+    return d->requestCount;
+}
+
+int ClientConnection::lastDispatchRequestCount() const
+{
+    return d->lastDispatchRequests;
+}
+
+std::chrono::nanoseconds ClientConnection::lastDispatchDuration() const
+{
+    return d->lastDispatchDuration;
+}
+
+quint64 ClientConnection::flushCount() const
+{
+    return d->flushCount;
+}
+
+quint64 ClientConnection::queuedEventBytes() const
+{
+    return d->queuedBytes;
+}
+
+quint64 ClientConnection::pendingEventBytes() const
+{
+    return d->pendingBytes;
+}
+
+quint64 ClientConnection::unsentEventBytes() const
+{
+    return d->unsentBytes;
+}
+
+bool ClientConnection::isCongested() const
+{
+    return d->congested;
+}
+
+int ClientConnection::objectCount() const
+{
+    return d->objectCount;
+}
+
+int ClientConnection::objectCount(const QByteArray &interface) const
+{
+    int count = 0;
+    for (auto it = d->objects.constBegin(); it != d->objects.constEnd(); ++it) {
+        if (interface == it.key()) {
+            count += it.value();
+        }
+    }
+    return count;
+}
+
+QHash<QByteArray, int> ClientConnection::objectCounts() const
+{
+    // Interfaces generated into several libraries have several name constants.
+    QHash<QByteArray, int> counts;
+    for (auto it = d->objects.constBegin(); it != d->objects.constEnd(); ++it) {
+        counts[QByteArray(it.key())] += it.value();
+    }
+    return counts;
+}
+
+int ClientConnection::clientBufferCount() const
+{
+    return d->clientBuffers;
+}
+
+quint64 ClientConnection::clientBufferBytes() const
+{
+    return d->clientBufferBytes;
+}
+
+int ClientConnection::frameCallbackCount() const
+{
+    return d->frameCallbacks;
 }
 
 void ClientConnection::destroy()
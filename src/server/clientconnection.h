@@ -7,8 +7,11 @@
 
 #include <sys/types.h>
 
+#include <QHash>
 #include <QObject>
 
+#include <chrono>
+
 #include <KWaylandServer/kwaylandserver_export.h>
 
 struct wl_client;
@@ -32,12 +35,146 @@ class KWAYLANDSERVER_EXPORT ClientConnection : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * The resources of a client that are accounted and can be limited with a ClientQuota.
+     */
+    enum class Resource {
+        /**
+         * Live protocol objects of any interface, see objectCount().
+         */
+        Objects = 0x1,
+        /**
+         * ClientBuffers backed by a live wl_buffer, see clientBufferCount().
+         */
+        ClientBuffers = 0x2,
+        /**
+         * The pixel bytes of the ClientBuffers, see clientBufferBytes().
+         */
+        ClientBufferBytes = 0x4,
+        /**
+         * Frame callbacks that haven't been signalled yet, see frameCallbackCount().
+         */
+        FrameCallbacks = 0x8,
+        /**
+         * Bytes of events queued since the last flush, see pendingEventBytes().
+         */
+        PendingEventBytes = 0x10,
+    };
+    Q_ENUM(Resource)
+    Q_DECLARE_FLAGS(Resources, Resource)
+    Q_FLAG(Resources)
+
     virtual ~ClientConnection();
 
     /**
      * Flushes the connection to this client. Ensures that all events are pushed to the client.
+     *
+     * The Display flushes the clients that have pending events when the event loop is about
+     * to block. Use this method for latency critical events, e.g. input sent to the focused
+     * client, that should not wait until the event loop goes idle.
      */
     void flush();
+    /**
+     * Returns the number of times pending events have been flushed to this client.
+     *
+     * The events are only accounted while client traffic accounting is enabled.
+     *
+     * @see queuedEventBytes
+     * @see Display::setClientTrafficAccountingEnabled
+     */
+    quint64 flushCount() const;
+    /**
+     * Returns the total number of bytes of events that have been queued for this client
+     * since it connected. File descriptors passed along with the events are not included.
+     *
+     * @see pendingEventBytes
+     */
+    quint64 queuedEventBytes() const;
+    /**
+     * Returns the number of bytes of events that have been queued for this client since
+     * the last flush.
+     */
+    quint64 pendingEventBytes() const;
+    /**
+     * Returns the number of bytes the kernel held in the send buffer of the client's socket
+     * when it was last checked. This includes the bookkeeping overhead of the kernel.
+     *
+     * The send buffer is only checked while a high-water mark is set.
+     *
+     * @see Display::setClientSendBufferHighWaterMark
+     */
+    quint64 unsentEventBytes() const;
+    /**
+     * Returns @c true if the client doesn't read its events fast enough, i.e. the send buffer
+     * went over the high-water mark and hasn't been drained to half of it yet.
+     *
+     * Coalescible events, such as pointer, touch and tablet motion, wl_output property changes
+     * and plasma window property changes, are merged while a client is congested, only the
+     * latest state is sent once the client catches up.
+     *
+     * @see Display::clientCongestionChanged
+     */
+    bool isCongested() const;
+
+    /**
+     * Returns the total number of requests dispatched for this client.
+     *
+     * The requests are only accounted while client traffic accounting is enabled or a request
+     * report threshold is set.
+     *
+     * @see Display::setClientTrafficAccountingEnabled
+     * @see Display::setClientRequestReportThreshold
+     */
+    quint64 requestCount() const;
+    /**
+     * Returns the number of requests dispatched for this client in the last event loop
+     * iteration in which the client sent any requests.
+     *
+     * @see Display::setClientRequestReportThreshold
+     */
+    int lastDispatchRequestCount() const;
+    /**
+     * Returns the approximate time spent dispatching the requests of this client in the last
+     * event loop iteration in which the client sent any requests. Other clients and input
+     * events handled in the same iteration were delayed by this amount of time.
+     */
+    std::chrono::nanoseconds lastDispatchDuration() const;
+
+    /**
+     * Returns the number of live protocol objects of this client.
+     *
+     * Protocol objects are only counted while object accounting is enabled or an object quota
+     * is set, otherwise this returns @c 0.
+     *
+     * @see Display::setClientObjectAccountingEnabled
+     */
+    int objectCount() const;
+    /**
+     * Returns the number of live protocol objects of this client with the given @p interface,
+     * e.g. "wl_surface".
+     */
+    int objectCount(const QByteArray &interface) const;
+    /**
+     * Returns the number of live protocol objects of this client per interface name.
+     */
+    QHash<QByteArray, int> objectCounts() const;
+    /**
+     * Returns the number of ClientBuffers of this client whose wl_buffer is still alive.
+     * A wl_buffer gets a ClientBuffer once it is attached to a surface.
+     */
+    int clientBufferCount() const;
+    /**
+     * Returns the size of the ClientBuffers of this client in bytes, assuming four bytes
+     * per pixel.
+     *
+     * @see clientBufferCount
+     */
+    quint64 clientBufferBytes() const;
+    /**
+     * Returns the number of frame callbacks of this client that haven't been signalled yet.
+     */
+    int frameCallbackCount() const;
+
     /**
      * Get the wl_resource associated with the given @p id.
      */
@@ -121,10 +258,13 @@ Q_SIGNALS:
 
 private:
     friend class Display;
+    friend class ClientConnectionPrivate;
     explicit ClientConnection(wl_client *c, Display *parent);
+    static ClientConnection *get(wl_client *client);
     QScopedPointer<ClientConnectionPrivate> d;
 };
 
 }
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(KWaylandServer::ClientConnection::Resources)
 Q_DECLARE_METATYPE(KWaylandServer::ClientConnection *)
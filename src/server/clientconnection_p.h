@@ -0,0 +1,154 @@
+/*
+    SPDX-FileCopyrightText: 2014 Martin Gräßlin <mgraesslin@kde.org>
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include "clientconnection.h"
+
+#include <QHash>
+#include <QPointer>
+#include <QString>
+#include <QVector>
+
+#include <chrono>
+#include <functional>
+
+#include <wayland-server-core.h>
+
+namespace KWaylandServer
+{
+class ClientConnectionPrivate
+{
+public:
+    ClientConnectionPrivate(wl_client *c, Display *display, ClientConnection *q);
+    ~ClientConnectionPrivate();
+
+    static ClientConnectionPrivate *get(wl_client *client);
+    static ClientConnectionPrivate *get(ClientConnection *connection);
+
+    /**
+     * Records that an event of @p size bytes has been queued for the client. Returns @c true
+     * if the client had no pending events before, i.e. it just became dirty.
+     */
+    bool queueEvent(quint32 size);
+    /**
+     * Records that the pending events of the client have been handed over to libwayland for
+     * writing.
+     */
+    void markFlushed();
+
+    /**
+     * Starts or stops counting the live protocol objects of the client.
+     */
+    void setObjectAccountingEnabled(bool enabled);
+    void addClientBuffer(quint64 bytes);
+    void removeClientBuffer(quint64 bytes);
+    void addFrameCallback();
+    void removeFrameCallback();
+    /**
+     * Compares the accounted @p value of the @p resource with the quotas of the display. Going
+     * over a quota is only recorded here, the display acts on it once it is safe to do so.
+     */
+    void checkQuota(ClientConnection::Resource resource, quint64 value);
+    /**
+     * Re-arms the soft quota of the @p resource once its @p value is back under the limit.
+     */
+    void releaseQuota(ClientConnection::Resource resource, quint64 value);
+
+    /**
+     * Withholds a coalescible event while the client is congested. The @p send function
+     * replaces the one withheld earlier with the same @p key, it is called once the client
+     * is not congested anymore unless the @p context has been destroyed by then.
+     */
+    void coalesce(const void *key, QObject *context, std::function<void()> &&send);
+    /**
+     * Sends the event withheld with the @p key right away, e.g. because an event that
+     * must not overtake it is about to be sent.
+     */
+    void flushCoalesced(const void *key);
+    /**
+     * Forgets the event withheld with the @p key, e.g. because it is obsolete.
+     */
+    void dropCoalesced(const void *key);
+    /**
+     * Sends all withheld events in the order they have been withheld first.
+     */
+    void sendCoalesced();
+
+    wl_client *client;
+    Display *display;
+    pid_t pid = 0;
+    uid_t user = 0;
+    gid_t group = 0;
+    QString executablePath;
+    ClientConnection *q;
+
+    bool dirty = false;
+    quint64 flushCount = 0;
+    quint64 queuedBytes = 0;
+    quint64 pendingBytes = 0;
+
+    quint64 requestCount = 0;
+    int dispatchRequests = 0;
+    qint64 dispatchTime = 0;
+    int lastDispatchRequests = 0;
+    std::chrono::nanoseconds lastDispatchDuration = std::chrono::nanoseconds::zero();
+
+    // Keyed by the name of the interface, which is a string constant of the wl_interface.
+    QHash<const char *, int> objects;
+    int objectCount = 0;
+    int clientBuffers = 0;
+    quint64 clientBufferBytes = 0;
+    int frameCallbacks = 0;
+
+    bool quotaPending = false;
+    ClientConnection::Resources softQuotaExceeded;
+    ClientConnection::Resources softQuotaPending;
+    ClientConnection::Resources hardQuotaExceeded;
+
+    bool congested = false;
+    quint64 unsentBytes = 0;
+
+    struct CoalescedEvent
+    {
+        const void *key;
+        QPointer<QObject> context;
+        std::function<void()> send;
+    };
+    QVector<CoalescedEvent> coalescedEvents;
+
+private:
+    static void destroyListenerCallback(wl_listener *listener, void *data);
+    static void resourceCreatedCallback(wl_listener *listener, void *data);
+    static void objectDestroyedCallback(wl_listener *listener, void *data);
+    void trackObject(wl_resource *resource);
+    void markOverQuota();
+
+    // The destroy listener doubles as the link from the wl_client to its ClientConnection.
+    struct DestroyListener
+    {
+        wl_listener listener;
+        ClientConnectionPrivate *receiver;
+    };
+    DestroyListener listener;
+
+    struct ResourceCreatedListener
+    {
+        wl_listener listener;
+        ClientConnectionPrivate *receiver;
+    };
+    ResourceCreatedListener resourceCreatedListener;
+    bool objectAccounting = false;
+
+    // Allocated per protocol object while object accounting is enabled.
+    struct ObjectListener
+    {
+        wl_listener listener;
+        ClientConnectionPrivate *receiver;
+        const char *interface;
+    };
+};
+
+} // namespace KWaylandServer
@@ -5,20 +5,34 @@
     SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
 */
 #include "display.h"
+#include "clientbuffer_p.h"
 #include "clientbufferintegration.h"
+#include "clientconnection_p.h"
 #include "display_p.h"
 #include "drmclientbuffer.h"
 #include "logging.h"
 #include "output_interface.h"
+#include "seat_interface.h"
 #include "shmclientbuffer.h"
+#include "surface_interface.h"
 
 #include <QAbstractEventDispatcher>
 #include <QCoreApplication>
 #include <QDebug>
 #include <QRect>
 
+#include <algorithm>
+#include <string.h>
+#include <utility>
+
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+
 namespace KWaylandServer
 {
+static const int s_focusedClientThresholdFactor = 4;
+static const int s_congestionPollInterval = 16;
+
 DisplayPrivate *DisplayPrivate::get(Display *display)
 {
     return display->d.data();
@@ -29,6 +43,260 @@ DisplayPrivate::DisplayPrivate(Display *q)
 {
 }
 
+/**
+ * Returns the size of the given message on the wire, see wl_closure_send(). File descriptors
+ * are passed out of band and do not count.
+ */
+static quint32 messageSize(const wl_protocol_logger_message *message)
+{
+    quint32 size = 8; // sender id, opcode and size
+    int argument = 0;
+    for (const char *signature = message->message->signature; *signature; ++signature) {
+        switch (*signature) {
+        case 'i':
+        case 'u':
+        case 'f':
+        case 'o':
+        case 'n':
+            size += 4;
+            ++argument;
+            break;
+        case 's':
+            size += 4;
+            if (const char *string = message->arguments[argument].s) {
+                size += (strlen(string) + 1 + 3) & ~3;
+            }
+            ++argument;
+            break;
+        case 'a':
+            size += 4;
+            if (const wl_array *array = message->arguments[argument].a) {
+                size += (array->size + 3) & ~3;
+            }
+            ++argument;
+            break;
+        case 'h':
+            ++argument;
+            break;
+        default:
+            // since version numbers and nullable markers
+            break;
+        }
+    }
+    return size;
+}
+
+void DisplayPrivate::eventLoggerCallback(void *userData, wl_protocol_logger_type type, const wl_protocol_logger_message *message)
+{
+    auto displayPrivate = static_cast<DisplayPrivate *>(userData);
+    wl_client *client = wl_resource_get_client(message->resource);
+
+    // Clients without a ClientConnection are not tracked individually, which only
+    // happens until the first interface touches them.
+    ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(client);
+
+    if (type == WL_PROTOCOL_LOGGER_REQUEST) {
+        if (connectionPrivate && displayPrivate->accountingRequests) {
+            displayPrivate->accountRequest(connectionPrivate);
+        }
+        return;
+    }
+
+    if (!connectionPrivate) {
+        displayPrivate->untrackedClientsDirty = true;
+        return;
+    }
+    if (connectionPrivate->queueEvent(messageSize(message))) {
+        displayPrivate->dirtyClients.append(connectionPrivate->q);
+    }
+    connectionPrivate->checkQuota(ClientConnection::Resource::PendingEventBytes, connectionPrivate->pendingBytes);
+}
+
+void DisplayPrivate::accountRequest(ClientConnectionPrivate *connectionPrivate)
+{
+    // Requests are logged right before they are dispatched, so the time until the next
+    // request is attributed to the client that sent the previous one.
+    const qint64 timestamp = dispatchTimer.nsecsElapsed();
+    if (lastRequestClient) {
+        lastRequestClient->dispatchTime += timestamp - lastRequestTimestamp;
+    }
+    lastRequestClient = connectionPrivate;
+    lastRequestTimestamp = timestamp;
+
+    ++connectionPrivate->requestCount;
+    if (connectionPrivate->dispatchRequests++ == 0) {
+        dispatchedClients.append(connectionPrivate->q);
+    }
+}
+
+void DisplayPrivate::finishDispatch()
+{
+    if (lastRequestClient) {
+        lastRequestClient->dispatchTime += dispatchTimer.nsecsElapsed() - lastRequestTimestamp;
+        lastRequestClient = nullptr;
+    }
+
+    const QVector<ClientConnection *> connections = std::exchange(dispatchedClients, {});
+    for (ClientConnection *connection : connections) {
+        ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(connection);
+        const int requestCount = connectionPrivate->dispatchRequests;
+        connectionPrivate->lastDispatchRequests = requestCount;
+        connectionPrivate->lastDispatchDuration = std::chrono::nanoseconds(connectionPrivate->dispatchTime);
+        connectionPrivate->dispatchRequests = 0;
+        connectionPrivate->dispatchTime = 0;
+
+        if (clientRequestReportThreshold > 0 && requestCount > requestReportThreshold(connection)) {
+            Q_EMIT q->clientRequestThresholdExceeded(connection, requestCount);
+        }
+    }
+
+    enforceQuotas();
+}
+
+void DisplayPrivate::updateCongestion(ClientConnection *connection)
+{
+    ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(connection);
+    if (!connectionPrivate->client) {
+        return;
+    }
+
+    // For a unix socket this is what the peer hasn't read yet.
+    int unsentBytes = 0;
+    if (ioctl(wl_client_get_fd(connectionPrivate->client), SIOCOUTQ, &unsentBytes) == -1) {
+        return;
+    }
+    connectionPrivate->unsentBytes = unsentBytes;
+
+    if (!connectionPrivate->congested) {
+        if (connectionPrivate->unsentBytes > sendBufferHighWaterMark) {
+            setCongested(connection, true);
+        }
+    } else if (connectionPrivate->unsentBytes <= sendBufferHighWaterMark / 2) {
+        setCongested(connection, false);
+    }
+}
+
+void DisplayPrivate::setCongested(ClientConnection *connection, bool congested)
+{
+    ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(connection);
+    connectionPrivate->congested = congested;
+
+    if (congested) {
+        congestedClients.append(connection);
+        // nothing wakes us up when the client reads its events
+        if (!congestionTimer) {
+            congestionTimer = new QTimer(q);
+            congestionTimer->setInterval(s_congestionPollInterval);
+            QObject::connect(congestionTimer, &QTimer::timeout, q, [this]() {
+                pollCongestedClients();
+            });
+        }
+        congestionTimer->start();
+    } else {
+        congestedClients.removeOne(connection);
+        if (congestedClients.isEmpty() && congestionTimer) {
+            congestionTimer->stop();
+        }
+        connectionPrivate->sendCoalesced();
+    }
+
+    Q_EMIT q->clientCongestionChanged(connection, congested);
+}
+
+void DisplayPrivate::pollCongestedClients()
+{
+    const QVector<ClientConnection *> connections = congestedClients;
+    for (ClientConnection *connection : connections) {
+        updateCongestion(connection);
+    }
+}
+
+bool DisplayPrivate::objectAccounting() const
+{
+    return objectAccountingEnabled || softQuota.objects || hardQuota.objects;
+}
+
+void DisplayPrivate::updateObjectAccounting()
+{
+    const bool enabled = objectAccounting();
+    for (ClientConnection *connection : qAsConst(clients)) {
+        ClientConnectionPrivate::get(connection)->setObjectAccountingEnabled(enabled);
+    }
+}
+
+bool DisplayPrivate::trafficAccounting() const
+{
+    return trafficAccountingEnabled || softQuota.pendingEventBytes || hardQuota.pendingEventBytes || sendBufferHighWaterMark
+        || clientRequestReportThreshold;
+}
+
+bool DisplayPrivate::requestAccounting() const
+{
+    return trafficAccountingEnabled || clientRequestReportThreshold;
+}
+
+void DisplayPrivate::updateTrafficAccounting()
+{
+    const bool enabled = trafficAccounting();
+    if (enabled == bool(eventLogger)) {
+        return;
+    }
+    if (enabled) {
+        eventLogger = wl_display_add_protocol_logger(display, eventLoggerCallback, this);
+        // the events queued so far have not been tracked
+        untrackedClientsDirty = true;
+        return;
+    }
+    wl_protocol_logger_destroy(eventLogger);
+    eventLogger = nullptr;
+    // Display::flush() falls back to flushing every client
+    for (ClientConnection *connection : qAsConst(dirtyClients)) {
+        ClientConnectionPrivate::get(connection)->markFlushed();
+    }
+    dirtyClients.clear();
+    untrackedClientsDirty = false;
+}
+
+void DisplayPrivate::enforceQuotas()
+{
+    // Clients that go over a quota are only recorded while requests are dispatched or
+    // events are sent, destroying them or running arbitrary slots right then is not safe.
+    const QVector<ClientConnection *> connections = std::exchange(overQuotaClients, {});
+    for (ClientConnection *connection : connections) {
+        ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(connection);
+        connectionPrivate->quotaPending = false;
+        if (!connectionPrivate->client) {
+            continue;
+        }
+
+        if (const ClientConnection::Resources resources = std::exchange(connectionPrivate->hardQuotaExceeded, {})) {
+            connectionPrivate->softQuotaPending = {};
+            qCWarning(KWAYLAND_SERVER) << "Disconnecting" << connection->executablePath() << "for exceeding its hard quota of" << resources;
+            Q_EMIT q->clientHardQuotaExceeded(connection, resources);
+            if (connectionPrivate->client) {
+                wl_client_post_implementation_error(connectionPrivate->client, "exceeded the resource quota of the compositor");
+                // make sure the client gets to see why it has been disconnected
+                wl_client_flush(connectionPrivate->client);
+                connection->destroy();
+            }
+        } else if (const ClientConnection::Resources resources = std::exchange(connectionPrivate->softQuotaPending, {})) {
+            Q_EMIT q->clientSoftQuotaExceeded(connection, resources);
+        }
+    }
+}
+
+int DisplayPrivate::requestReportThreshold(ClientConnection *connection) const
+{
+    for (SeatInterface *seat : seats) {
+        const SurfaceInterface *keyboardFocus = seat->focusedKeyboardSurface();
+        const SurfaceInterface *pointerFocus = seat->focusedPointerSurface();
+        if ((keyboardFocus && keyboardFocus->client() == connection) || (pointerFocus && pointerFocus->client() == connection)) {
+            return clientRequestReportThreshold * s_focusedClientThresholdFactor;
+        }
+    }
+    return clientRequestReportThreshold;
+}
+
 void DisplayPrivate::registerSocketName(const QString &socketName)
 {
     socketNames.append(socketName);
@@ -41,11 +309,15 @@ Display::Display(QObject *parent)
 {
     d->display = wl_display_create();
     d->loop = wl_display_get_event_loop(d->display);
+    d->serialTracker.reset(new SerialTracker(this));
 }
 
 Display::~Display()
 {
     wl_display_destroy_clients(d->display);
+    if (d->eventLogger) {
+        wl_protocol_logger_destroy(d->eventLogger);
+    }
     wl_display_destroy(d->display);
 }
 
@@ -111,20 +383,142 @@ bool Display::start()
 
 void Display::dispatchEvents()
 {
+    // decided once per iteration, the timer must be running while requests are accounted
+    d->accountingRequests = d->requestAccounting();
+    if (d->accountingRequests) {
+        d->dispatchTimer.start();
+    }
     if (wl_event_loop_dispatch(d->loop, 0) != 0) {
         qCWarning(KWAYLAND_SERVER) << "Error on dispatching Wayland event loop";
     }
+    d->accountingRequests = false;
+    d->finishDispatch();
+}
+
+void Display::setClientRequestReportThreshold(int threshold)
+{
+    d->clientRequestReportThreshold = std::max(threshold, 0);
+    d->updateTrafficAccounting();
+}
+
+int Display::clientRequestReportThreshold() const
+{
+    return d->clientRequestReportThreshold;
+}
+
+void Display::setClientSoftQuota(const ClientQuota &quota)
+{
+    d->softQuota = quota;
+    d->updateObjectAccounting();
+    d->updateTrafficAccounting();
+}
+
+ClientQuota Display::clientSoftQuota() const
+{
+    return d->softQuota;
+}
+
+void Display::setClientHardQuota(const ClientQuota &quota)
+{
+    d->hardQuota = quota;
+    d->updateObjectAccounting();
+    d->updateTrafficAccounting();
+}
+
+ClientQuota Display::clientHardQuota() const
+{
+    return d->hardQuota;
+}
+
+void Display::setClientObjectAccountingEnabled(bool enabled)
+{
+    d->objectAccountingEnabled = enabled;
+    d->updateObjectAccounting();
+}
+
+bool Display::isClientObjectAccountingEnabled() const
+{
+    return d->objectAccountingEnabled;
+}
+
+void Display::setClientTrafficAccountingEnabled(bool enabled)
+{
+    d->trafficAccountingEnabled = enabled;
+    d->updateTrafficAccounting();
+}
+
+bool Display::isClientTrafficAccountingEnabled() const
+{
+    return d->trafficAccountingEnabled;
+}
+
+void Display::setClientSendBufferHighWaterMark(quint64 bytes)
+{
+    d->sendBufferHighWaterMark = bytes;
+    if (bytes) {
+        d->pollCongestedClients();
+    } else {
+        const QVector<ClientConnection *> connections = d->congestedClients;
+        for (ClientConnection *connection : connections) {
+            d->setCongested(connection, false);
+        }
+    }
+    d->updateTrafficAccounting();
+}
+
+quint64 Display::clientSendBufferHighWaterMark() const
+{
+    return d->sendBufferHighWaterMark;
 }
 
 void Display::flush()
 {
+    // before markFlushed() forgets the pending event bytes
+    d->enforceQuotas();
+
+    if (!d->eventLogger) {
+        // nothing tracks which clients have pending events
+        wl_display_flush_clients(d->display);
+        return;
+    }
+    if (d->dirtyClients.isEmpty() && !d->untrackedClientsDirty) {
+        return;
+    }
+
+    for (ClientConnection *connection : qAsConst(d->dirtyClients)) {
+        ClientConnectionPrivate::get(connection)->markFlushed();
+    }
+    d->untrackedClientsDirty = false;
+
+    // Only libwayland knows whether a write would block and arms the writable watch for
+    // the client in that case, so the actual writing is left to wl_display_flush_clients().
+    // Clients without pending events are skipped there without a syscall.
     wl_display_flush_clients(d->display);
+
+    if (!d->sendBufferHighWaterMark) {
+        d->dirtyClients.clear();
+        return;
+    }
+
+    const QVector<ClientConnection *> flushedClients = std::exchange(d->dirtyClients, {});
+    for (ClientConnection *connection : flushedClients) {
+        d->updateCongestion(connection);
+    }
+    // the clients that caught up have been sent the events withheld from them
+    if (!d->dirtyClients.isEmpty()) {
+        flush();
+    }
 }
 
 void Display::createShm()
+{
+    createShm(ShmOptions());
+}
+
+void Display::createShm(ShmOptions options)
 {
     Q_ASSERT(d->display);
-    new ShmClientBufferIntegration(this);
+    new ShmClientBufferIntegration(this, options);
 }
 
 quint32 Display::nextSerial()
@@ -137,6 +531,11 @@ quint32 Display::serial()
     return wl_display_get_serial(d->display);
 }
 
+SerialTracker *Display::serialTracker() const
+{
+    return d->serialTracker.data();
+}
+
 bool Display::isRunning() const
 {
     return d->running;
@@ -182,11 +581,8 @@ QVector<SeatInterface *> Display::seats() const
 ClientConnection *Display::getConnection(wl_client *client)
 {
     Q_ASSERT(client);
-    auto it = std::find_if(d->clients.constBegin(), d->clients.constEnd(), [client](ClientConnection *c) {
-        return c->client() == client;
-    });
-    if (it != d->clients.constEnd()) {
-        return *it;
+    if (ClientConnection *connection = ClientConnection::get(client)) {
+        return connection;
     }
     // no ConnectionData yet, create it
     auto c = new ClientConnection(client, this);
@@ -196,6 +592,15 @@ ClientConnection *Display::getConnection(wl_client *client)
         Q_ASSERT(index != -1);
         d->clients.remove(index);
         Q_ASSERT(d->clients.indexOf(c) == -1);
+        d->dirtyClients.removeOne(c);
+        d->dispatchedClients.removeOne(c);
+        d->overQuotaClients.removeOne(c);
+        if (d->congestedClients.removeOne(c) && d->congestedClients.isEmpty()) {
+            d->congestionTimer->stop();
+        }
+        if (d->lastRequestClient && d->lastRequestClient->q == c) {
+            d->lastRequestClient = nullptr;
+        }
         Q_EMIT clientDisconnected(c);
     });
     Q_EMIT clientConnected(c);
@@ -233,46 +638,30 @@ void *Display::eglDisplay() const
     return d->eglDisplay;
 }
 
-struct ClientBufferDestroyListener : wl_listener
+static void bufferDestroyCallback(wl_listener *listener, void *data)
 {
-    ClientBufferDestroyListener(Display *display, ClientBuffer *buffer);
-    ~ClientBufferDestroyListener();
-
-    Display *display;
-};
-
-void bufferDestroyCallback(wl_listener *listener, void *data)
-{
-    ClientBufferDestroyListener *destroyListener = static_cast<ClientBufferDestroyListener *>(listener);
-    DisplayPrivate *displayPrivate = DisplayPrivate::get(destroyListener->display);
-
-    ClientBuffer *buffer = displayPrivate->q->clientBufferForResource(static_cast<wl_resource *>(data));
-    displayPrivate->unregisterClientBuffer(buffer);
-
-    buffer->markAsDestroyed();
-}
+    auto registryListener = reinterpret_cast<ClientBufferPrivate::RegistryListener *>(listener);
+    wl_list_remove(&registryListener->listener.link);
+    wl_list_init(&registryListener->listener.link);
 
-ClientBufferDestroyListener::ClientBufferDestroyListener(Display *display, ClientBuffer *buffer)
-    : display(display)
-{
-    notify = bufferDestroyCallback;
-
-    link.prev = nullptr;
-    link.next = nullptr;
-
-    wl_resource_add_destroy_listener(buffer->resource(), this);
-}
+    // not found anymore while the client is being destroyed
+    auto resource = static_cast<wl_resource *>(data);
+    if (registryListener->accounted) {
+        if (ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(wl_resource_get_client(resource))) {
+            connectionPrivate->removeClientBuffer(registryListener->bytes);
+        }
+    }
 
-ClientBufferDestroyListener::~ClientBufferDestroyListener()
-{
-    wl_list_remove(&link);
+    registryListener->buffer->markAsDestroyed();
 }
 
 ClientBuffer *Display::clientBufferForResource(wl_resource *resource) const
 {
-    ClientBuffer *buffer = d->resourceToBuffer.value(resource);
-    if (buffer) {
-        return buffer;
+    // The ClientBuffer owns the destroy listener attached to its wl_buffer resource, so
+    // the buffer can be found by walking the (usually very short) listener list instead
+    // of a separate resource to buffer map.
+    if (wl_listener *listener = wl_resource_get_destroy_listener(resource, bufferDestroyCallback)) {
+        return reinterpret_cast<ClientBufferPrivate::RegistryListener *>(listener)->buffer;
     }
 
     for (ClientBufferIntegration *integration : qAsConst(d->bufferIntegrations)) {
@@ -287,15 +676,17 @@ ClientBuffer *Display::clientBufferForResource(wl_resource *resource) const
 
 void DisplayPrivate::registerClientBuffer(ClientBuffer *buffer)
 {
-    resourceToBuffer.insert(buffer->resource(), buffer);
-    bufferToListener.insert(buffer, new ClientBufferDestroyListener(q, buffer));
-}
+    ClientBufferPrivate *bufferPrivate = ClientBufferPrivate::get(buffer);
+    bufferPrivate->registryListener.buffer = buffer;
+    bufferPrivate->registryListener.listener.notify = bufferDestroyCallback;
+    wl_resource_add_destroy_listener(buffer->resource(), &bufferPrivate->registryListener.listener);
 
-void DisplayPrivate::unregisterClientBuffer(ClientBuffer *buffer)
-{
-    Q_ASSERT_X(buffer->resource(), "unregisterClientBuffer", "buffer must have valid resource");
-    resourceToBuffer.remove(buffer->resource());
-    delete bufferToListener.take(buffer);
+    if (ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(wl_resource_get_client(buffer->resource()))) {
+        const QSize size = buffer->size();
+        bufferPrivate->registryListener.accounted = true;
+        bufferPrivate->registryListener.bytes = quint64(size.width()) * size.height() * 4;
+        connectionPrivate->addClientBuffer(bufferPrivate->registryListener.bytes);
+    }
 }
 
 }
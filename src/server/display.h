@@ -38,6 +38,28 @@ class DisplayPrivate;
 class OutputInterface;
 class OutputDeviceV2Interface;
 class SeatInterface;
+class SerialTracker;
+
+/**
+ * @brief Limits on the resources a single client may hold.
+ *
+ * A limit of @c 0, the default, disables the limit.
+ *
+ * @see Display::setClientSoftQuota
+ * @see Display::setClientHardQuota
+ */
+struct ClientQuota
+{
+    int objects = 0;
+    int clientBuffers = 0;
+    /**
+     * The size of the client's buffers is estimated as four bytes per pixel, whatever their
+     * actual format and planes are, see ClientConnection::clientBufferBytes().
+     */
+    quint64 clientBufferBytes = 0;
+    int frameCallbacks = 0;
+    quint64 pendingEventBytes = 0;
+};
 
 /**
  * @brief Class holding the Wayland server display loop.
@@ -83,6 +105,12 @@ public:
     quint32 serial();
     quint32 nextSerial();
 
+    /**
+     * Returns the tracker that remembers which input events the recent serials have been
+     * sent with.
+     */
+    SerialTracker *serialTracker() const;
+
     /**
      * Start accepting client connections. If the display has started successfully, this
      * function returns @c true; otherwise @c false is returned.
@@ -90,6 +118,85 @@ public:
     bool start();
     void dispatchEvents();
 
+    /**
+     * Sets the number of requests a client may send per event loop iteration before it gets
+     * reported to @p threshold. If a client sends more requests in an iteration, the
+     * clientRequestThresholdExceeded() signal is emitted once the iteration has been dispatched.
+     * Clients that own the keyboard or pointer focus of a seat are only reported above four
+     * times the threshold, since the user interacting with them makes them busier.
+     *
+     * This is for telemetry only, the requests are neither deferred nor throttled. libwayland
+     * dispatches everything a client has sent once its socket is readable, the compositor can
+     * only react afterwards.
+     *
+     * A @p threshold of @c 0, the default, disables the reports and, unless client traffic
+     * accounting is enabled, the accounting of the requests.
+     *
+     * @see ClientConnection::lastDispatchRequestCount
+     * @see ClientConnection::lastDispatchDuration
+     */
+    void setClientRequestReportThreshold(int threshold);
+    int clientRequestReportThreshold() const;
+
+    /**
+     * Sets the soft @p quota of every client. When a client goes over one of its limits, the
+     * clientSoftQuotaExceeded() signal is emitted once the current event loop iteration has
+     * been dispatched. The signal is emitted again for that resource only after the client
+     * went back under the limit.
+     *
+     * @see ClientConnection::Resource
+     */
+    void setClientSoftQuota(const ClientQuota &quota);
+    ClientQuota clientSoftQuota() const;
+    /**
+     * Sets the hard @p quota of every client. A client that goes over one of its limits is
+     * sent a protocol error and disconnected once the current event loop iteration has been
+     * dispatched.
+     *
+     * @see clientHardQuotaExceeded
+     */
+    void setClientHardQuota(const ClientQuota &quota);
+    ClientQuota clientHardQuota() const;
+    /**
+     * Sets whether the live protocol objects of every client are counted. Counting them costs
+     * a small allocation per object, so it is disabled by default. It is always enabled while
+     * the soft or hard quota limits the number of objects.
+     *
+     * @see ClientConnection::objectCounts
+     */
+    void setClientObjectAccountingEnabled(bool enabled);
+    bool isClientObjectAccountingEnabled() const;
+    /**
+     * Sets whether the requests and events of every client are accounted. This hooks into
+     * every message libwayland sends or dispatches, so it is disabled by default. The requests
+     * are always accounted while a request report threshold is set, the events while the soft
+     * or hard quota limits the pending event bytes or a send buffer high-water mark is set.
+     *
+     * While it is disabled, Display::flush() flushes every client.
+     *
+     * @see ClientConnection::flushCount
+     * @see ClientConnection::requestCount
+     */
+    void setClientTrafficAccountingEnabled(bool enabled);
+    bool isClientTrafficAccountingEnabled() const;
+
+    /**
+     * Sets the number of bytes the kernel may hold in the send buffer of a client's socket
+     * before the client is considered congested to @p bytes. The send buffers of the clients
+     * are checked after they have been flushed; a client stays congested until it has drained
+     * its send buffer to half of the high-water mark.
+     *
+     * The high-water mark should be well below the size of the socket send buffer, otherwise
+     * libwayland buffers the events itself and eventually disconnects the client.
+     *
+     * A high-water mark of @c 0, the default, disables the checks.
+     *
+     * @see ClientConnection::isCongested
+     * @see clientCongestionChanged
+     */
+    void setClientSendBufferHighWaterMark(quint64 bytes);
+    quint64 clientSendBufferHighWaterMark() const;
+
     /**
      * Create a client for the given file descriptor.
      *
@@ -107,7 +214,27 @@ public:
     operator wl_display *() const;
     bool isRunning() const;
 
+    enum class ShmOption {
+        /**
+         * Allow shared memory buffers to be accessed as dma-bufs created with /dev/udmabuf,
+         * so the renderer can import them without uploading the pixel data.
+         *
+         * libwayland doesn't expose the file descriptors of shm pools, so this option replaces
+         * libwayland's wl_shm implementation entirely, not just the buffer export: the wl_shm
+         * global, the pools and the buffers are implemented by KWaylandServer, and a process-wide
+         * SIGBUS handler is installed to survive clients truncating their pools.
+         *
+         * @see ShmClientBuffer::dmaBufPlanes()
+         */
+        DmaBufPromotion = 0x1,
+    };
+    Q_DECLARE_FLAGS(ShmOptions, ShmOption)
+
     void createShm();
+    /**
+     * Creates the wl_shm global with the given @p options.
+     */
+    void createShm(ShmOptions options);
     /**
      * @returns All SeatInterface currently managed on the Display.
      */
@@ -154,6 +281,35 @@ Q_SIGNALS:
     void runningChanged(bool);
     void clientConnected(KWaylandServer::ClientConnection *);
     void clientDisconnected(KWaylandServer::ClientConnection *);
+    /**
+     * This signal is emitted when the client @p connection sent @p requestCount requests in
+     * the last event loop iteration, which is more than its report threshold. The requests
+     * have already been dispatched.
+     *
+     * @see setClientRequestReportThreshold
+     */
+    void clientRequestThresholdExceeded(KWaylandServer::ClientConnection *connection, int requestCount);
+    /**
+     * This signal is emitted when the client @p connection went over the soft quota of the
+     * given @p resources.
+     *
+     * @see setClientSoftQuota
+     */
+    void clientSoftQuotaExceeded(KWaylandServer::ClientConnection *connection, KWaylandServer::ClientConnection::Resources resources);
+    /**
+     * This signal is emitted when the client @p connection went over the hard quota of the
+     * given @p resources, right before it is disconnected.
+     *
+     * @see setClientHardQuota
+     */
+    void clientHardQuotaExceeded(KWaylandServer::ClientConnection *connection, KWaylandServer::ClientConnection::Resources resources);
+    /**
+     * This signal is emitted when the client @p connection became unresponsive, i.e. it
+     * stopped reading its events, or caught up again.
+     *
+     * @see setClientSendBufferHighWaterMark
+     */
+    void clientCongestionChanged(KWaylandServer::ClientConnection *connection, bool congested);
 
 private:
     friend class DisplayPrivate;
@@ -161,3 +317,5 @@ private:
 };
 
 }
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KWaylandServer::Display::ShmOptions)
@@ -9,14 +9,19 @@
 
 #include <wayland-server-core.h>
 
+#include <QElapsedTimer>
 #include <QHash>
 #include <QList>
 #include <QSocketNotifier>
 #include <QString>
+#include <QTimer>
 #include <QVector>
 
 #include <EGL/egl.h>
 
+#include "display.h"
+#include "serialtracker.h"
+
 struct wl_resource;
 
 namespace KWaylandServer
@@ -24,11 +29,11 @@ namespace KWaylandServer
 class ClientBufferIntegration;
 class ClientBuffer;
 class ClientConnection;
+class ClientConnectionPrivate;
 class Display;
 class OutputInterface;
 class OutputDeviceV2Interface;
 class SeatInterface;
-struct ClientBufferDestroyListener;
 
 class DisplayPrivate
 {
@@ -39,7 +44,20 @@ public:
     void registerSocketName(const QString &socketName);
 
     void registerClientBuffer(ClientBuffer *clientBuffer);
-    void unregisterClientBuffer(ClientBuffer *clientBuffer);
+
+    static void eventLoggerCallback(void *userData, wl_protocol_logger_type type, const wl_protocol_logger_message *message);
+    void accountRequest(ClientConnectionPrivate *connectionPrivate);
+    void finishDispatch();
+    int requestReportThreshold(ClientConnection *connection) const;
+    bool objectAccounting() const;
+    void updateObjectAccounting();
+    bool trafficAccounting() const;
+    bool requestAccounting() const;
+    void updateTrafficAccounting();
+    void enforceQuotas();
+    void updateCongestion(ClientConnection *connection);
+    void setCongested(ClientConnection *connection, bool congested);
+    void pollCongestedClients();
 
     Display *q;
     QSocketNotifier *socketNotifier = nullptr;
@@ -50,11 +68,27 @@ public:
     QList<OutputDeviceV2Interface *> outputdevicesV2;
     QVector<SeatInterface *> seats;
     QVector<ClientConnection *> clients;
+    wl_protocol_logger *eventLogger = nullptr;
+    bool trafficAccountingEnabled = false;
+    QVector<ClientConnection *> dirtyClients;
+    bool untrackedClientsDirty = false;
+    int clientRequestReportThreshold = 0;
+    bool accountingRequests = false;
+    QElapsedTimer dispatchTimer;
+    qint64 lastRequestTimestamp = 0;
+    ClientConnectionPrivate *lastRequestClient = nullptr;
+    QVector<ClientConnection *> dispatchedClients;
+    ClientQuota softQuota;
+    ClientQuota hardQuota;
+    bool objectAccountingEnabled = false;
+    QVector<ClientConnection *> overQuotaClients;
+    quint64 sendBufferHighWaterMark = 0;
+    QVector<ClientConnection *> congestedClients;
+    QTimer *congestionTimer = nullptr;
     QStringList socketNames;
     EGLDisplay eglDisplay = EGL_NO_DISPLAY;
-    QHash<::wl_resource *, ClientBuffer *> resourceToBuffer;
-    QHash<ClientBuffer *, ClientBufferDestroyListener *> bufferToListener;
     QList<ClientBufferIntegration *> bufferIntegrations;
+    QScopedPointer<SerialTracker> serialTracker;
 };
 
 } // namespace KWaylandServer
@@ -5,10 +5,12 @@
 */
 
 #include "filtered_display.h"
+#include "clientconnection.h"
 
 #include <wayland-server.h>
 
 #include <QByteArray>
+#include <QHash>
 
 namespace KWaylandServer
 {
@@ -17,13 +19,35 @@ class FilteredDisplayPrivate
 public:
     FilteredDisplayPrivate(FilteredDisplay *_q);
     FilteredDisplay *q;
+
+    // The decisions only depend on the interface name, so the wl_interface is used as the key,
+    // which saves hashing the name. Announcing a global asks for every client in a row, and
+    // creating a registry asks for every global, so the last used client is remembered.
+    using Decisions = QHash<const wl_interface *, bool>;
+    QHash<ClientConnection *, Decisions> decisions;
+    ClientConnection *lastClient = nullptr;
+    Decisions *lastDecisions = nullptr;
+
+    Decisions *decisionsForClient(ClientConnection *client);
+    void forgetClient(ClientConnection *client);
+
     static bool globalFilterCallback(const wl_client *client, const wl_global *global, void *data)
     {
         auto t = static_cast<FilteredDisplayPrivate *>(data);
         auto clientConnection = t->q->getConnection(const_cast<wl_client *>(client));
         auto interface = wl_global_get_interface(global);
+
+        Decisions *clientDecisions = t->decisionsForClient(clientConnection);
+        auto it = clientDecisions->constFind(interface);
+        if (it != clientDecisions->constEnd()) {
+            return *it;
+        }
+
         auto name = QByteArray::fromRawData(interface->name, strlen(interface->name));
-        return t->q->allowInterface(clientConnection, name);
+        const bool allowed = t->q->allowInterface(clientConnection, name);
+        // allowInterface() may have invalidated the cache
+        t->decisionsForClient(clientConnection)->insert(interface, allowed);
+        return allowed;
     };
 };
 
@@ -32,6 +56,24 @@ FilteredDisplayPrivate::FilteredDisplayPrivate(FilteredDisplay *_q)
 {
 }
 
+FilteredDisplayPrivate::Decisions *FilteredDisplayPrivate::decisionsForClient(ClientConnection *client)
+{
+    if (lastClient != client) {
+        lastClient = client;
+        lastDecisions = &decisions[client];
+    }
+    return lastDecisions;
+}
+
+void FilteredDisplayPrivate::forgetClient(ClientConnection *client)
+{
+    decisions.remove(client);
+    if (lastClient == client) {
+        lastClient = nullptr;
+        lastDecisions = nullptr;
+    }
+}
+
 FilteredDisplay::FilteredDisplay(QObject *parent)
     : Display(parent)
     , d(new FilteredDisplayPrivate(this))
@@ -42,10 +84,25 @@ FilteredDisplay::FilteredDisplay(QObject *parent)
         }
         wl_display_set_global_filter(*this, FilteredDisplayPrivate::globalFilterCallback, d.data());
     });
+    connect(this, &Display::clientDisconnected, this, [this](ClientConnection *client) {
+        d->forgetClient(client);
+    });
 }
 
 FilteredDisplay::~FilteredDisplay()
 {
 }
 
+void FilteredDisplay::invalidateInterfaceFilter()
+{
+    d->decisions.clear();
+    d->lastClient = nullptr;
+    d->lastDecisions = nullptr;
+}
+
+void FilteredDisplay::invalidateInterfaceFilter(ClientConnection *client)
+{
+    d->forgetClient(client);
+}
+
 }
@@ -32,10 +32,29 @@ public:
      * When false will not see these globals for a given interface in the registry,
      * and any manual attempts to bind will fail
      *
+     * The decision is cached per client and interface, so this is called only once for
+     * every pair. Implementations whose decision depends on state that changes over time,
+     * e.g. a list of trusted clients that is updated later on, must call
+     * invalidateInterfaceFilter() after the change, otherwise the old decision keeps applying.
+     *
      * @return true if the client should be able to access the global with the following interfaceName
      */
     virtual bool allowInterface(ClientConnection *client, const QByteArray &interfaceName) = 0;
 
+    /**
+     * Forgets the cached allowInterface() decisions for all clients.
+     *
+     * The new decisions apply to globals created from now on, to registries created from now
+     * on and to bind requests. Globals that have already been announced to a client are not
+     * withdrawn.
+     */
+    void invalidateInterfaceFilter();
+
+    /**
+     * Forgets the cached allowInterface() decisions for the given @p client.
+     */
+    void invalidateInterfaceFilter(ClientConnection *client);
+
 private:
     QScopedPointer<FilteredDisplayPrivate> d;
 };
@@ -0,0 +1,92 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include <QVarLengthArray>
+
+struct wl_client;
+
+namespace KWaylandServer
+{
+/**
+ * Caches the resources the focused client has bound of a generated @c Interface, so sending
+ * an input event to them doesn't need to look them up again.
+ *
+ * The cache is rebuilt lazily, after the focused client changed or invalidate() has been called.
+ * The owner must call invalidate() whenever a resource is bound or destroyed.
+ *
+ * The resources are visited in the order they have been bound, as with forEachResource() of the
+ * generated classes.
+ */
+template<typename Interface>
+class FocusedResources
+{
+public:
+    using Resource = typename Interface::Resource;
+
+    explicit FocusedResources(const Interface *interface)
+        : m_interface(interface)
+    {
+    }
+
+    ::wl_client *client() const
+    {
+        return m_client;
+    }
+
+    void setClient(::wl_client *client)
+    {
+        if (m_client != client) {
+            m_client = client;
+            m_dirty = true;
+        }
+    }
+
+    void invalidate()
+    {
+        m_dirty = true;
+    }
+
+    bool isEmpty()
+    {
+        update();
+        return m_resources.isEmpty();
+    }
+
+    template<typename Function>
+    void forEach(Function &&function)
+    {
+        update();
+        // iterate over a copy on the stack, so the function may destroy the resource it is called
+        // with, it must not destroy the other resources
+        const QVarLengthArray<Resource *, 4> resources = m_resources;
+        for (Resource *resource : resources) {
+            function(resource);
+        }
+    }
+
+private:
+    void update()
+    {
+        if (!m_dirty) {
+            return;
+        }
+        m_dirty = false;
+        m_resources.clear();
+        if (m_client) {
+            m_interface->forEachResource(m_client, [this](Resource *resource) {
+                m_resources.append(resource);
+            });
+        }
+    }
+
+    const Interface *m_interface;
+    ::wl_client *m_client = nullptr;
+    QVarLengthArray<Resource *, 4> m_resources;
+    bool m_dirty = true;
+};
+
+} // namespace KWaylandServer
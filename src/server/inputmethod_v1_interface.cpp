@@ -13,9 +13,9 @@
 #include "seat_interface.h"
 #include "surface_interface.h"
 #include "surfacerole_p.h"
+#include "utils/ramfile.h"
 
 #include <QHash>
-#include <QTemporaryFile>
 
 #include <unistd.h>
 
@@ -33,6 +33,9 @@ public:
     InputKeyboardV1InterfacePrivate()
     {
     }
+
+    QByteArray keymapContent;
+    QScopedPointer<RamFile> keymap;
 };
 
 InputMethodGrabV1::InputMethodGrabV1(QObject *parent)
@@ -47,30 +50,19 @@ InputMethodGrabV1::~InputMethodGrabV1()
 
 void InputMethodGrabV1::sendKeymap(const QByteArray &keymap)
 {
-    QScopedPointer<QTemporaryFile> tmp(new QTemporaryFile());
-    if (!tmp->open()) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to create keymap file:" << tmp->errorString();
-        return;
-    }
-
-    unlink(tmp->fileName().toUtf8().constData());
-    if (!tmp->resize(keymap.size())) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to resize keymap file:" << tmp->errorString();
-        return;
-    }
-
-    uchar *address = tmp->map(0, keymap.size());
-    if (!address) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to map keymap file:" << tmp->errorString();
-        return;
+    // Input method keyboards are grabbed over and over with the same keymap, reuse its file.
+    if (!d->keymap || d->keymapContent != keymap) {
+        QScopedPointer<RamFile> keymapFile(new RamFile("kwaylandserver-keymap", keymap, RamFile::Flag::NullTerminated));
+        if (!keymapFile->isValid()) {
+            return;
+        }
+        d->keymap.swap(keymapFile);
+        d->keymapContent = keymap;
     }
 
-    qstrncpy(reinterpret_cast<char *>(address), keymap.constData(), keymap.size() + 1);
-    tmp->unmap(address);
-
     const auto resources = d->resourceMap();
     for (auto r : resources) {
-        d->send_keymap(r->handle, QtWaylandServer::wl_keyboard::keymap_format::keymap_format_xkb_v1, tmp->handle(), tmp->size());
+        d->send_keymap(r->handle, QtWaylandServer::wl_keyboard::keymap_format::keymap_format_xkb_v1, d->keymap->fd(), d->keymap->size());
     }
 }
 
@@ -8,12 +8,10 @@
 #include "logging.h"
 #include "seat_interface.h"
 #include "seat_interface_p.h"
+#include "serialtracker.h"
 #include "surface_interface.h"
-// Qt
-#include <QTemporaryFile>
-#include <QVector>
 
-#include <unistd.h>
+#include <algorithm>
 
 namespace KWaylandServer
 {
@@ -29,73 +27,51 @@ void KeyboardInterfacePrivate::keyboard_release(Resource *resource)
 
 void KeyboardInterfacePrivate::keyboard_bind_resource(Resource *resource)
 {
+    focusedResources.invalidate();
+
     const ClientConnection *focusedClient = focusedSurface ? focusedSurface->client() : nullptr;
 
     if (resource->version() >= WL_KEYBOARD_REPEAT_INFO_SINCE_VERSION) {
         send_repeat_info(resource->handle, keyRepeat.charactersPerSecond, keyRepeat.delay);
     }
-    if (!keymap.isNull()) {
+    if (keymap) {
         sendKeymap(resource);
     }
 
     if (focusedClient && focusedClient->client() == resource->client()) {
-        const QVector<quint32> keys = pressedKeys();
-        const QByteArray keysData = QByteArray::fromRawData(reinterpret_cast<const char *>(keys.data()), sizeof(quint32) * keys.count());
-        const quint32 serial = seat->display()->nextSerial();
+        const QByteArray keysData = pressedKeysData();
+        const quint32 serial = seat->display()->serialTracker()->next(SerialTracker::EventType::KeyboardEnter, seat, focusedSurface);
 
         send_enter(resource->handle, serial, focusedSurface->resource(), keysData);
         send_modifiers(resource->handle, serial, modifiers.depressed, modifiers.latched, modifiers.locked, modifiers.group);
     }
 }
 
-QList<KeyboardInterfacePrivate::Resource *> KeyboardInterfacePrivate::keyboardsForClient(ClientConnection *client) const
+void KeyboardInterfacePrivate::keyboard_destroy_resource(Resource *resource)
 {
-    return resourceMap().values(client->client());
+    Q_UNUSED(resource)
+    focusedResources.invalidate();
 }
 
 void KeyboardInterfacePrivate::sendLeave(SurfaceInterface *surface, quint32 serial)
 {
-    const QList<Resource *> keyboards = keyboardsForClient(surface->client());
-    for (Resource *keyboardResource : keyboards) {
+    forEachResource(surface->client()->client(), [this, surface, serial](Resource *keyboardResource) {
         send_leave(keyboardResource->handle, serial, surface->resource());
-    }
+    });
 }
 
 void KeyboardInterfacePrivate::sendEnter(SurfaceInterface *surface, quint32 serial)
 {
-    const auto states = pressedKeys();
-    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(states.constData()), sizeof(quint32) * states.size());
+    const QByteArray data = pressedKeysData();
 
-    const QList<Resource *> keyboards = keyboardsForClient(surface->client());
-    for (Resource *keyboardResource : keyboards) {
+    forEachResource(surface->client()->client(), [this, surface, serial, &data](Resource *keyboardResource) {
         send_enter(keyboardResource->handle, serial, surface->resource(), data);
-    }
+    });
 }
 
 void KeyboardInterfacePrivate::sendKeymap(Resource *resource)
 {
-    QScopedPointer<QTemporaryFile> tmp(new QTemporaryFile());
-    if (!tmp->open()) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to create keymap file:" << tmp->errorString();
-        return;
-    }
-
-    unlink(tmp->fileName().toUtf8().constData());
-    if (!tmp->resize(keymap.size())) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to resize keymap file:" << tmp->errorString();
-        return;
-    }
-
-    uchar *address = tmp->map(0, keymap.size());
-    if (!address) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to map keymap file:" << tmp->errorString();
-        return;
-    }
-
-    qstrncpy(reinterpret_cast<char *>(address), keymap.constData(), keymap.size() + 1);
-    tmp->unmap(address);
-
-    send_keymap(resource->handle, keymap_format::keymap_format_xkb_v1, tmp->handle(), tmp->size());
+    send_keymap(resource->handle, keymap_format::keymap_format_xkb_v1, keymap->fd(), keymap->size());
 }
 
 void KeyboardInterface::setKeymap(const QByteArray &content)
@@ -104,7 +80,12 @@ void KeyboardInterface::setKeymap(const QByteArray &content)
         return;
     }
 
-    d->keymap = content;
+    // The keymap file is shared by all wl_keyboard objects, it's created only once per keymap.
+    QScopedPointer<RamFile> keymap(new RamFile("kwaylandserver-keymap", content, RamFile::Flag::NullTerminated));
+    if (!keymap->isValid()) {
+        return;
+    }
+    d->keymap.swap(keymap);
 
     const auto keyboardResources = d->resourceMap();
     for (KeyboardInterfacePrivate::Resource *resource : keyboardResources) {
@@ -114,26 +95,40 @@ void KeyboardInterface::setKeymap(const QByteArray &content)
 
 void KeyboardInterfacePrivate::sendModifiers(quint32 depressed, quint32 latched, quint32 locked, quint32 group, quint32 serial)
 {
-    const QList<Resource *> keyboards = keyboardsForClient(focusedSurface->client());
-    for (Resource *keyboardResource : keyboards) {
+    focusedResources.forEach([this, serial, depressed, latched, locked, group](Resource *keyboardResource) {
         send_modifiers(keyboardResource->handle, serial, depressed, latched, locked, group);
-    }
+    });
 }
 
 bool KeyboardInterfacePrivate::updateKey(quint32 key, KeyboardKeyState state)
 {
-    auto it = states.find(key);
-    if (it == states.end()) {
-        states.insert(key, state);
+    if (key >= s_keyCount) {
+        // beyond KEY_MAX, there is no state to track
         return true;
     }
-    if (it.value() == state) {
+
+    const bool pressed = state == KeyboardKeyState::Pressed;
+    if (knownKeyStates.test(key) && pressedKeyStates.test(key) == pressed) {
         return false;
     }
-    it.value() = state;
+    knownKeyStates.set(key);
+    pressedKeyStates.set(key, pressed);
+
+    if (pressed) {
+        pressedKeys.append(key);
+    } else if (const auto it = std::find(pressedKeys.begin(), pressedKeys.end(), key); it != pressedKeys.end()) {
+        // the order of the keys in wl_keyboard.enter doesn't matter
+        *it = pressedKeys.last();
+        pressedKeys.removeLast();
+    }
     return true;
 }
 
+QByteArray KeyboardInterfacePrivate::pressedKeysData() const
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(pressedKeys.constData()), sizeof(quint32) * pressedKeys.size());
+}
+
 KeyboardInterface::KeyboardInterface(SeatInterface *seat)
     : d(new KeyboardInterfacePrivate(seat))
 {
@@ -158,29 +153,20 @@ void KeyboardInterface::setFocusedSurface(SurfaceInterface *surface, quint32 ser
     }
 
     d->focusedSurface = surface;
+    d->focusedResources.setClient(surface ? surface->client()->client() : nullptr);
     if (!d->focusedSurface) {
         return;
     }
     d->destroyConnection = connect(d->focusedSurface, &SurfaceInterface::aboutToBeDestroyed, this, [this] {
         d->sendLeave(d->focusedSurface, d->seat->display()->nextSerial());
         d->focusedSurface = nullptr;
+        d->focusedResources.setClient(nullptr);
     });
 
     d->sendEnter(d->focusedSurface, serial);
     d->sendModifiers();
 }
 
-QVector<quint32> KeyboardInterfacePrivate::pressedKeys() const
-{
-    QVector<quint32> keys;
-    for (auto it = states.constBegin(); it != states.constEnd(); ++it) {
-        if (it.value() == KeyboardKeyState::Pressed) {
-            keys << it.key();
-        }
-    }
-    return keys;
-}
-
 void KeyboardInterface::sendKey(quint32 key, KeyboardKeyState state)
 {
     if (!d->updateKey(key, state)) {
@@ -191,11 +177,13 @@ void KeyboardInterface::sendKey(quint32 key, KeyboardKeyState state)
         return;
     }
 
-    const QList<KeyboardInterfacePrivate::Resource *> keyboards = d->keyboardsForClient(d->focusedSurface->client());
-    const quint32 serial = d->seat->display()->nextSerial();
-    for (KeyboardInterfacePrivate::Resource *keyboardResource : keyboards) {
-        d->send_key(keyboardResource->handle, serial, d->seat->timestamp(), key, quint32(state));
-    }
+    const SerialTracker::EventType eventType =
+        state == KeyboardKeyState::Pressed ? SerialTracker::EventType::KeyboardKeyPress : SerialTracker::EventType::KeyboardKeyRelease;
+    const quint32 serial = d->seat->display()->serialTracker()->next(eventType, d->seat, d->focusedSurface, key);
+    const quint32 timestamp = d->seat->timestamp();
+    d->focusedResources.forEach([this, serial, timestamp, key, state](KeyboardInterfacePrivate::Resource *keyboardResource) {
+        d->send_key(keyboardResource->handle, serial, timestamp, key, quint32(state));
+    });
 }
 
 void KeyboardInterface::sendModifiers(quint32 depressed, quint32 latched, quint32 locked, quint32 group)
@@ -5,17 +5,19 @@
 */
 #pragma once
 
+#include "focusedresources_p.h"
 #include "keyboard_interface.h"
+#include "utils/ramfile.h"
 
 #include <qwayland-server-wayland.h>
 
-#include <QHash>
 #include <QPointer>
+#include <QVarLengthArray>
+
+#include <bitset>
 
 namespace KWaylandServer
 {
-class ClientConnection;
-
 class KeyboardInterfacePrivate : public QtWaylandServer::wl_keyboard
 {
 public:
@@ -25,7 +27,6 @@ public:
     void sendModifiers();
     void sendModifiers(quint32 depressed, quint32 latched, quint32 locked, quint32 group, quint32 serial);
 
-    QList<Resource *> keyboardsForClient(ClientConnection *client) const;
     void sendLeave(SurfaceInterface *surface, quint32 serial);
     void sendEnter(SurfaceInterface *surface, quint32 serial);
 
@@ -36,8 +37,9 @@ public:
 
     SeatInterface *seat;
     SurfaceInterface *focusedSurface = nullptr;
+    FocusedResources<QtWaylandServer::wl_keyboard> focusedResources{this};
     QMetaObject::Connection destroyConnection;
-    QByteArray keymap;
+    QScopedPointer<RamFile> keymap;
 
     struct
     {
@@ -55,13 +57,23 @@ public:
     };
     Modifiers modifiers;
 
-    QHash<quint32, KeyboardKeyState> states;
+    // evdev key codes go up to KEY_MAX, 0x2ff
+    static constexpr quint32 s_keyCount = 0x300;
+    std::bitset<s_keyCount> pressedKeyStates;
+    // keys that have been pressed or released at least once
+    std::bitset<s_keyCount> knownKeyStates;
+    /**
+     * The pressed keys, kept up to date as keys change so that it can be sent with
+     * wl_keyboard.enter as it is.
+     */
+    QVarLengthArray<quint32, 16> pressedKeys;
     bool updateKey(quint32 key, KeyboardKeyState state);
-    QVector<quint32> pressedKeys() const;
+    QByteArray pressedKeysData() const;
 
 protected:
     void keyboard_release(Resource *resource) override;
     void keyboard_bind_resource(Resource *resource) override;
+    void keyboard_destroy_resource(Resource *resource) override;
 };
 
 }
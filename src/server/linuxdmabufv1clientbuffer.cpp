@@ -15,9 +15,9 @@
 #include "logging.h"
 #include "surface_interface_p.h"
 
-#include <QTemporaryFile>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace KWaylandServer
@@ -31,6 +31,71 @@ LinuxDmaBufV1ClientBufferIntegrationPrivate::LinuxDmaBufV1ClientBufferIntegratio
 {
 }
 
+LinuxDmaBufV1ClientBufferIntegrationPrivate::~LinuxDmaBufV1ClientBufferIntegrationPrivate()
+{
+    for (LinuxDmaBufV1ClientBuffer *buffer : qAsConst(importCache)) {
+        LinuxDmaBufV1ClientBufferPrivate::get(buffer)->integration = nullptr;
+    }
+    for (LinuxDmaBufParamsV1 *params : qAsConst(pendingImports)) {
+        params->cancelImport();
+    }
+}
+
+LinuxDmaBufV1ClientBufferIntegrationPrivate *LinuxDmaBufV1ClientBufferIntegrationPrivate::get(LinuxDmaBufV1ClientBufferIntegration *integration)
+{
+    return integration->d.data();
+}
+
+LinuxDmaBufV1ImportKey LinuxDmaBufV1ImportKey::create(const QVector<LinuxDmaBufV1Plane> &planes, int planeCount, quint32 format, const QSize &size, quint32 flags)
+{
+    LinuxDmaBufV1ImportKey key;
+    for (int i = 0; i < planeCount; ++i) {
+        const LinuxDmaBufV1Plane &plane = planes.at(i);
+
+        struct stat info;
+        if (plane.fd == -1 || fstat(plane.fd, &info) == -1) {
+            return LinuxDmaBufV1ImportKey();
+        }
+
+        key.planes[i].device = info.st_dev;
+        key.planes[i].inode = info.st_ino;
+        key.planes[i].offset = plane.offset;
+        key.planes[i].stride = plane.stride;
+        key.planes[i].modifier = plane.modifier;
+    }
+    key.planeCount = planeCount;
+    key.format = format;
+    key.size = size;
+    key.flags = flags;
+    return key;
+}
+
+bool operator==(const LinuxDmaBufV1ImportKey &key1, const LinuxDmaBufV1ImportKey &key2)
+{
+    if (key1.planeCount != key2.planeCount || key1.format != key2.format || key1.size != key2.size || key1.flags != key2.flags) {
+        return false;
+    }
+    for (int i = 0; i < key1.planeCount; ++i) {
+        const LinuxDmaBufV1ImportKey::Plane &plane1 = key1.planes[i];
+        const LinuxDmaBufV1ImportKey::Plane &plane2 = key2.planes[i];
+        if (plane1.device != plane2.device || plane1.inode != plane2.inode || plane1.offset != plane2.offset
+            || plane1.stride != plane2.stride || plane1.modifier != plane2.modifier) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint qHash(const LinuxDmaBufV1ImportKey &key, uint seed)
+{
+    uint hash = seed ^ ::qHash(key.format) ^ ::qHash(key.size.width()) ^ (::qHash(key.size.height()) << 1);
+    for (int i = 0; i < key.planeCount; ++i) {
+        hash = 31 * hash + ::qHash(key.planes[i].inode);
+        hash = 31 * hash + ::qHash(key.planes[i].offset);
+    }
+    return hash;
+}
+
 void LinuxDmaBufV1ClientBufferIntegrationPrivate::zwp_linux_dmabuf_v1_bind_resource(Resource *resource)
 {
     if (resource->version() < ZWP_LINUX_DMABUF_V1_GET_DEFAULT_FEEDBACK_SINCE_VERSION) {
@@ -103,7 +168,10 @@ LinuxDmaBufParamsV1::~LinuxDmaBufParamsV1()
 void LinuxDmaBufParamsV1::zwp_linux_buffer_params_v1_destroy_resource(Resource *resource)
 {
     Q_UNUSED(resource)
-    delete this;
+    // The renderer still uses the file descriptors, finishAsyncImport() deletes the object.
+    if (!m_isImportPending) {
+        delete this;
+    }
 }
 
 void LinuxDmaBufParamsV1::zwp_linux_buffer_params_v1_destroy(Resource *resource)
@@ -154,30 +222,95 @@ void LinuxDmaBufParamsV1::zwp_linux_buffer_params_v1_create(Resource *resource,
         return;
     }
 
-    if (Q_UNLIKELY(!test(resource, width, height))) {
+    const LinuxDmaBufV1ImportKey key = LinuxDmaBufV1ImportKey::create(m_planes, m_planeCount, format, QSize(width, height), flags);
+    LinuxDmaBufV1ClientBuffer *cachedBuffer = LinuxDmaBufV1ClientBufferIntegrationPrivate::get(m_integration)->importCache.value(key);
+
+    if (Q_UNLIKELY(!test(resource, width, height, !cachedBuffer))) {
         return;
     }
 
     m_isUsed = true;
     m_planes.resize(m_planeCount);
 
-    LinuxDmaBufV1ClientBuffer *clientBuffer = m_integration->rendererInterface()->importBuffer(m_planes, format, QSize(width, height), flags);
+    // The created event may be sent later, so let the renderer import the buffer off the
+    // Wayland thread if it can. Cached imports are cheap and are always done synchronously.
+    if (!cachedBuffer) {
+        // The params object is not deleted while an import is pending, see finishAsyncImport().
+        auto callback = [this, key](LinuxDmaBufV1ClientBuffer *clientBuffer) {
+            finishAsyncImport(key, clientBuffer);
+        };
+        // The renderer may invoke the callback before importBufferAsync() returns.
+        LinuxDmaBufV1ClientBufferIntegrationPrivate *integrationPrivate = LinuxDmaBufV1ClientBufferIntegrationPrivate::get(m_integration);
+        m_isImportPending = true;
+        integrationPrivate->pendingImports.insert(this);
+        if (m_integration->rendererInterface()->importBufferAsync(m_planes, format, QSize(width, height), flags, callback)) {
+            return;
+        }
+        m_isImportPending = false;
+        integrationPrivate->pendingImports.remove(this);
+    }
+
+    sendCreated(importBuffer(key, cachedBuffer, QSize(width, height), format, flags));
+}
+
+void LinuxDmaBufParamsV1::cancelImport()
+{
+    // The integration is about to be destroyed. The renderer may still use the file descriptors,
+    // so keep them until the import finishes, but tell the client that it has failed.
+    m_integration = nullptr;
+    if (resource()) {
+        send_failed(resource()->handle);
+    }
+}
+
+void LinuxDmaBufParamsV1::finishAsyncImport(const LinuxDmaBufV1ImportKey &key, LinuxDmaBufV1ClientBuffer *clientBuffer)
+{
+    m_isImportPending = false;
+    if (m_integration) {
+        LinuxDmaBufV1ClientBufferIntegrationPrivate::get(m_integration)->pendingImports.remove(this);
+    }
+
+    if (clientBuffer) {
+        m_planes.clear(); // the ownership of file descriptors has been moved to the buffer
+    }
+
+    // The params object has been destroyed while the import was in progress.
+    if (!resource()) {
+        delete clientBuffer;
+        delete this;
+        return;
+    }
+
+    // The integration has been destroyed while the import was in progress.
+    if (!m_integration) {
+        delete clientBuffer;
+        return;
+    }
+
+    if (clientBuffer) {
+        addToImportCache(key, clientBuffer);
+    }
+    sendCreated(clientBuffer);
+}
+
+void LinuxDmaBufParamsV1::sendCreated(LinuxDmaBufV1ClientBuffer *clientBuffer)
+{
     if (!clientBuffer) {
-        send_failed(resource->handle);
+        send_failed(resource()->handle);
         return;
     }
 
     m_planes.clear(); // the ownership of file descriptors has been moved to the buffer
 
-    wl_resource *bufferResource = wl_resource_create(resource->client(), &wl_buffer_interface, 1, 0);
+    wl_resource *bufferResource = wl_resource_create(resource()->client(), &wl_buffer_interface, 1, 0);
     if (!bufferResource) {
         delete clientBuffer;
-        wl_resource_post_no_memory(resource->handle);
+        wl_resource_post_no_memory(resource()->handle);
         return;
     }
 
     clientBuffer->initialize(bufferResource);
-    send_created(resource->handle, bufferResource);
+    send_created(resource()->handle, bufferResource);
 
     DisplayPrivate *displayPrivate = DisplayPrivate::get(m_integration->display());
     displayPrivate->registerClientBuffer(clientBuffer);
@@ -195,14 +328,17 @@ void LinuxDmaBufParamsV1::zwp_linux_buffer_params_v1_create_immed(Resource *reso
         return;
     }
 
-    if (Q_UNLIKELY(!test(resource, width, height))) {
+    const LinuxDmaBufV1ImportKey key = LinuxDmaBufV1ImportKey::create(m_planes, m_planeCount, format, QSize(width, height), flags);
+    LinuxDmaBufV1ClientBuffer *cachedBuffer = LinuxDmaBufV1ClientBufferIntegrationPrivate::get(m_integration)->importCache.value(key);
+
+    if (Q_UNLIKELY(!test(resource, width, height, !cachedBuffer))) {
         return;
     }
 
     m_isUsed = true;
     m_planes.resize(m_planeCount);
 
-    LinuxDmaBufV1ClientBuffer *clientBuffer = m_integration->rendererInterface()->importBuffer(m_planes, format, QSize(width, height), flags);
+    LinuxDmaBufV1ClientBuffer *clientBuffer = importBuffer(key, cachedBuffer, QSize(width, height), format, flags);
     if (!clientBuffer) {
         wl_resource_post_error(resource->handle, error_invalid_wl_buffer, "importing the supplied dmabufs failed");
         return;
@@ -223,7 +359,40 @@ void LinuxDmaBufParamsV1::zwp_linux_buffer_params_v1_create_immed(Resource *reso
     displayPrivate->registerClientBuffer(clientBuffer);
 }
 
-bool LinuxDmaBufParamsV1::test(Resource *resource, uint32_t width, uint32_t height)
+LinuxDmaBufV1ClientBuffer *LinuxDmaBufParamsV1::importBuffer(const LinuxDmaBufV1ImportKey &key,
+                                                             LinuxDmaBufV1ClientBuffer *cachedBuffer,
+                                                             const QSize &size,
+                                                             uint32_t format,
+                                                             uint32_t flags)
+{
+    LinuxDmaBufV1ClientBuffer *clientBuffer;
+    if (cachedBuffer) {
+        clientBuffer = m_integration->rendererInterface()->reimportBuffer(cachedBuffer, m_planes);
+    } else {
+        clientBuffer = m_integration->rendererInterface()->importBuffer(m_planes, format, size, flags);
+    }
+
+    if (clientBuffer) {
+        addToImportCache(key, clientBuffer);
+    }
+
+    return clientBuffer;
+}
+
+void LinuxDmaBufParamsV1::addToImportCache(const LinuxDmaBufV1ImportKey &key, LinuxDmaBufV1ClientBuffer *clientBuffer)
+{
+    if (!key.isValid()) {
+        return;
+    }
+
+    LinuxDmaBufV1ClientBufferIntegrationPrivate *integrationPrivate = LinuxDmaBufV1ClientBufferIntegrationPrivate::get(m_integration);
+    LinuxDmaBufV1ClientBufferPrivate *bufferPrivate = LinuxDmaBufV1ClientBufferPrivate::get(clientBuffer);
+    bufferPrivate->integration = integrationPrivate;
+    bufferPrivate->importKey = key;
+    integrationPrivate->importCache.insert(key, clientBuffer);
+}
+
+bool LinuxDmaBufParamsV1::test(Resource *resource, uint32_t width, uint32_t height, bool checkBounds)
 {
     if (Q_UNLIKELY(!m_planeCount)) {
         wl_resource_post_error(resource->handle, error_incomplete, "no planes have been specified");
@@ -257,6 +426,11 @@ bool LinuxDmaBufParamsV1::test(Resource *resource, uint32_t width, uint32_t heig
             return false;
         }
 
+        // The bounds of dma-bufs that are already imported have been checked before.
+        if (!checkBounds) {
+            continue;
+        }
+
         // Don't report an error as it might be caused by the kernel not supporting
         // seeking on dmabuf.
         const off_t size = lseek(plane.fd, 0, SEEK_END);
@@ -305,6 +479,26 @@ void LinuxDmaBufV1ClientBufferIntegration::setRendererInterface(RendererInterfac
     d->rendererInterface = rendererInterface;
 }
 
+bool LinuxDmaBufV1ClientBufferIntegration::RendererInterface::importBufferAsync(const QVector<LinuxDmaBufV1Plane> &planes,
+                                                                                quint32 format,
+                                                                                const QSize &size,
+                                                                                quint32 flags,
+                                                                                ImportCallback callback)
+{
+    Q_UNUSED(planes)
+    Q_UNUSED(format)
+    Q_UNUSED(size)
+    Q_UNUSED(flags)
+    Q_UNUSED(callback)
+    return false;
+}
+
+LinuxDmaBufV1ClientBuffer *LinuxDmaBufV1ClientBufferIntegration::RendererInterface::reimportBuffer(LinuxDmaBufV1ClientBuffer *buffer,
+                                                                                                  const QVector<LinuxDmaBufV1Plane> &planes)
+{
+    return importBuffer(planes, buffer->format(), buffer->size(), buffer->flags());
+}
+
 bool operator==(const LinuxDmaBufV1Feedback::Tranche &t1, const LinuxDmaBufV1Feedback::Tranche &t2)
 {
     return t1.device == t2.device && t1.flags == t2.flags && t1.formatTable == t2.formatTable;
@@ -320,6 +514,7 @@ void LinuxDmaBufV1ClientBufferIntegration::setSupportedFormatsWithModifiers(cons
         d->supportedModifiers = set;
         d->mainDevice = tranches.first().device;
         d->table.reset(new LinuxDmaBufV1FormatTable(set));
+        d->tableSerial++;
         d->defaultFeedback->setTranches(tranches);
     }
 }
@@ -361,6 +556,11 @@ static bool testAlphaChannel(uint32_t drmFormat)
     }
 }
 
+LinuxDmaBufV1ClientBufferPrivate *LinuxDmaBufV1ClientBufferPrivate::get(LinuxDmaBufV1ClientBuffer *buffer)
+{
+    return buffer->d_func();
+}
+
 void LinuxDmaBufV1ClientBufferPrivate::buffer_destroy(Resource *resource)
 {
     wl_resource_destroy(resource->handle);
@@ -380,6 +580,9 @@ LinuxDmaBufV1ClientBuffer::LinuxDmaBufV1ClientBuffer(const QSize &size, quint32
 LinuxDmaBufV1ClientBuffer::~LinuxDmaBufV1ClientBuffer()
 {
     Q_D(LinuxDmaBufV1ClientBuffer);
+    if (d->integration) {
+        d->integration->importCache.remove(d->importKey, this);
+    }
     for (int i = 0; i < d->planes.count(); ++i) {
         if (d->planes[i].fd != -1) {
             close(d->planes[i].fd);
@@ -446,6 +649,7 @@ void LinuxDmaBufV1Feedback::setTranches(const QVector<Tranche> &tranches)
 {
     if (d->m_tranches != tranches) {
         d->m_tranches = tranches;
+        d->m_encodedTableSerial.reset();
         const auto &map = d->resourceMap();
         for (const auto &resource : map) {
             d->send(resource);
@@ -463,37 +667,51 @@ LinuxDmaBufV1FeedbackPrivate::LinuxDmaBufV1FeedbackPrivate(LinuxDmaBufV1ClientBu
 {
 }
 
-void LinuxDmaBufV1FeedbackPrivate::send(Resource *resource)
+const QVector<LinuxDmaBufV1EncodedTranche> &LinuxDmaBufV1FeedbackPrivate::encodedTranches()
 {
-    send_format_table(resource->handle, m_bufferintegration->table->fd, m_bufferintegration->table->size);
-    QByteArray bytes;
-    bytes.append(reinterpret_cast<const char *>(&m_bufferintegration->mainDevice), sizeof(dev_t));
-    send_main_device(resource->handle, bytes);
-    const auto &sendTranche = [this, resource](const LinuxDmaBufV1Feedback::Tranche &tranche) {
-        QByteArray targetDevice;
-        targetDevice.append(reinterpret_cast<const char *>(&tranche.device), sizeof(dev_t));
-        QByteArray indices;
+    // The format indices depend on the format table, so re-encode if it has been replaced.
+    if (m_encodedTableSerial == m_bufferintegration->tableSerial) {
+        return m_encodedTranches;
+    }
+
+    m_encodedTranches.clear();
+    m_encodedTranches.reserve(m_tranches.count());
+    for (const auto &tranche : qAsConst(m_tranches)) {
+        LinuxDmaBufV1EncodedTranche encoded;
+        encoded.targetDevice.append(reinterpret_cast<const char *>(&tranche.device), sizeof(dev_t));
         for (auto it = tranche.formatTable.begin(); it != tranche.formatTable.end(); it++) {
             const uint32_t format = it.key();
             for (const auto &mod : qAsConst(it.value())) {
-                uint16_t index = m_bufferintegration->table->indices[std::pair<uint32_t, uint64_t>(format, mod)];
-                indices.append(reinterpret_cast<const char *>(&index), 2);
+                const uint16_t index = m_bufferintegration->table->indices.value(std::pair<uint32_t, uint64_t>(format, mod));
+                encoded.indices.append(reinterpret_cast<const char *>(&index), 2);
             }
         }
-        send_tranche_target_device(resource->handle, targetDevice);
-        send_tranche_formats(resource->handle, indices);
-        send_tranche_flags(resource->handle, static_cast<uint32_t>(tranche.flags));
-        send_tranche_done(resource->handle);
-    };
-    for (const auto &tranche : qAsConst(m_tranches)) {
-        sendTranche(tranche);
+        encoded.flags = static_cast<uint32_t>(tranche.flags);
+        m_encodedTranches.append(encoded);
     }
+    m_encodedTableSerial = m_bufferintegration->tableSerial;
+    return m_encodedTranches;
+}
+
+void LinuxDmaBufV1FeedbackPrivate::send(Resource *resource)
+{
+    send_format_table(resource->handle, m_bufferintegration->table->file->fd(), m_bufferintegration->table->file->size());
+    QByteArray bytes;
+    bytes.append(reinterpret_cast<const char *>(&m_bufferintegration->mainDevice), sizeof(dev_t));
+    send_main_device(resource->handle, bytes);
+    const auto &sendTranches = [this, resource](const QVector<LinuxDmaBufV1EncodedTranche> &tranches) {
+        for (const LinuxDmaBufV1EncodedTranche &tranche : tranches) {
+            send_tranche_target_device(resource->handle, tranche.targetDevice);
+            send_tranche_formats(resource->handle, tranche.indices);
+            send_tranche_flags(resource->handle, tranche.flags);
+            send_tranche_done(resource->handle);
+        }
+    };
+    sendTranches(encodedTranches());
     // send default hints as the last fallback tranche
     const auto defaultFeedbackPrivate = get(m_bufferintegration->defaultFeedback.data());
     if (this != defaultFeedbackPrivate) {
-        for (const auto &tranche : qAsConst(defaultFeedbackPrivate->m_tranches)) {
-            sendTranche(tranche);
-        }
+        sendTranches(defaultFeedbackPrivate->encodedTranches());
     }
     send_done(resource->handle);
 }
@@ -525,35 +743,10 @@ LinuxDmaBufV1FormatTable::LinuxDmaBufV1FormatTable(const QHash<uint32_t, QVector
             data.append({format, 0, mod});
         }
     }
-    size = data.size() * sizeof(linux_dmabuf_feedback_v1_table_entry);
-    QScopedPointer<QTemporaryFile> tmp(new QTemporaryFile());
-    if (!tmp->open()) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to create keymap file:" << tmp->errorString();
-        return;
-    }
-    fd = open(tmp->fileName().toUtf8().constData(), O_RDONLY | O_CLOEXEC);
-    if (fd < 0) {
-        qCWarning(KWAYLAND_SERVER) << "Could not create readonly shm fd!" << strerror(errno);
-        return;
-    }
-    unlink(tmp->fileName().toUtf8().constData());
-    if (!tmp->resize(size)) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to resize keymap file:" << tmp->errorString();
-        return;
-    }
-    uchar *address = tmp->map(0, size);
-    if (!address) {
-        qCWarning(KWAYLAND_SERVER) << "Failed to map keymap file:" << tmp->errorString();
-        return;
-    }
-    memcpy(address, data.data(), size);
-}
 
-LinuxDmaBufV1FormatTable::~LinuxDmaBufV1FormatTable()
-{
-    if (fd != -1) {
-        close(fd);
-    }
+    const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(data.constData()),
+                                                     data.size() * sizeof(linux_dmabuf_feedback_v1_table_entry));
+    file.reset(new RamFile("kwaylandserver-dmabuf-format-table", bytes));
 }
 
 } // namespace KWaylandServer
@@ -15,6 +15,8 @@
 #include <QSet>
 #include <sys/types.h>
 
+#include <functional>
+
 namespace KWaylandServer
 {
 class LinuxDmaBufV1ClientBufferPrivate;
@@ -125,6 +127,41 @@ public:
          * @return The imported buffer on success, and nullptr otherwise.
          */
         virtual LinuxDmaBufV1ClientBuffer *importBuffer(const QVector<LinuxDmaBufV1Plane> &planes, quint32 format, const QSize &size, quint32 flags) = 0;
+
+        /**
+         * Imports a linux-dmabuf buffer that refers to the same dma-bufs, with the same
+         * offsets, strides, modifiers, format, size and flags as the already imported
+         * @a buffer. This lets the compositor share renderer resources, e.g. EGLImages or
+         * textures, between the two buffers.
+         *
+         * The ownership of the file descriptors is the same as with importBuffer().
+         *
+         * The default implementation calls importBuffer(), so nothing is shared unless the
+         * compositor overrides this function. The display only saves the bounds checks of
+         * the dma-bufs in that case.
+         *
+         * @return The imported buffer on success, and nullptr otherwise.
+         */
+        virtual LinuxDmaBufV1ClientBuffer *reimportBuffer(LinuxDmaBufV1ClientBuffer *buffer, const QVector<LinuxDmaBufV1Plane> &planes);
+
+        using ImportCallback = std::function<void(LinuxDmaBufV1ClientBuffer *buffer)>;
+
+        /**
+         * Imports a linux-dmabuf buffer asynchronously, e.g. on a worker or the render thread.
+         *
+         * If asynchronous imports are supported, this function must return @c true and invoke
+         * @a callback exactly once, on the thread the Display lives in, with the imported buffer
+         * or @c nullptr if the import has failed. The callback may be invoked before this
+         * function returns. The file descriptors stay valid until the callback is invoked, even
+         * if the client or this integration is destroyed in the meantime, so the callback must
+         * be invoked in any case. The ownership rules are the same as with importBuffer().
+         *
+         * This is only used for zwp_linux_buffer_params_v1.create requests, the create_immed
+         * request still requires a synchronous import.
+         *
+         * The default implementation returns @c false, in which case importBuffer() is used.
+         */
+        virtual bool importBufferAsync(const QVector<LinuxDmaBufV1Plane> &planes, quint32 format, const QSize &size, quint32 flags, ImportCallback callback);
     };
 
     RendererInterface *rendererInterface() const;
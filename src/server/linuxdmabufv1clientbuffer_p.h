@@ -15,29 +15,75 @@
 #include "display_p.h"
 #include "drm_fourcc.h"
 #include "linuxdmabufv1clientbuffer.h"
+#include "utils/ramfile.h"
 
 #include "qwayland-server-linux-dmabuf-unstable-v1.h"
 #include "qwayland-server-wayland.h"
 
 #include <QDebug>
+#include <QMultiHash>
+#include <QSet>
 #include <QVector>
 
+#include <array>
+#include <optional>
+
 namespace KWaylandServer
 {
 
 class LinuxDmaBufV1FormatTable;
+class LinuxDmaBufParamsV1;
+
+/**
+ * The LinuxDmaBufV1ImportKey type identifies the dma-bufs and the layout of an imported
+ * buffer. Two buffers with equal keys refer to the same memory and can share the renderer
+ * side import.
+ */
+struct LinuxDmaBufV1ImportKey
+{
+    struct Plane
+    {
+        dev_t device = 0;
+        ino_t inode = 0;
+        quint32 offset = 0;
+        quint32 stride = 0;
+        quint64 modifier = 0;
+    };
+
+    static LinuxDmaBufV1ImportKey create(const QVector<LinuxDmaBufV1Plane> &planes, int planeCount, quint32 format, const QSize &size, quint32 flags);
+
+    bool isValid() const
+    {
+        return planeCount > 0;
+    }
+
+    std::array<Plane, 4> planes;
+    int planeCount = 0;
+    quint32 format = 0;
+    QSize size;
+    quint32 flags = 0;
+};
+
+bool operator==(const LinuxDmaBufV1ImportKey &key1, const LinuxDmaBufV1ImportKey &key2);
+uint qHash(const LinuxDmaBufV1ImportKey &key, uint seed = 0);
 
 class LinuxDmaBufV1ClientBufferIntegrationPrivate : public QtWaylandServer::zwp_linux_dmabuf_v1
 {
 public:
     LinuxDmaBufV1ClientBufferIntegrationPrivate(LinuxDmaBufV1ClientBufferIntegration *q, Display *display);
+    ~LinuxDmaBufV1ClientBufferIntegrationPrivate() override;
+
+    static LinuxDmaBufV1ClientBufferIntegrationPrivate *get(LinuxDmaBufV1ClientBufferIntegration *integration);
 
     LinuxDmaBufV1ClientBufferIntegration *q;
     LinuxDmaBufV1ClientBufferIntegration::RendererInterface *rendererInterface = nullptr;
     QScopedPointer<LinuxDmaBufV1Feedback> defaultFeedback;
     QScopedPointer<LinuxDmaBufV1FormatTable> table;
+    quint64 tableSerial = 0;
     dev_t mainDevice;
     QHash<uint32_t, QVector<uint64_t>> supportedModifiers;
+    QMultiHash<LinuxDmaBufV1ImportKey, LinuxDmaBufV1ClientBuffer *> importCache;
+    QSet<LinuxDmaBufParamsV1 *> pendingImports;
 
 protected:
     void zwp_linux_dmabuf_v1_bind_resource(Resource *resource) override;
@@ -50,11 +96,15 @@ protected:
 class LinuxDmaBufV1ClientBufferPrivate : public ClientBufferPrivate, public QtWaylandServer::wl_buffer
 {
 public:
+    static LinuxDmaBufV1ClientBufferPrivate *get(LinuxDmaBufV1ClientBuffer *buffer);
+
     QSize size;
     quint32 format;
     quint32 flags;
     QVector<LinuxDmaBufV1Plane> planes;
     bool hasAlphaChannel = false;
+    LinuxDmaBufV1ClientBufferIntegrationPrivate *integration = nullptr;
+    LinuxDmaBufV1ImportKey importKey;
 
 protected:
     void buffer_destroy(Resource *resource) override;
@@ -66,6 +116,8 @@ public:
     LinuxDmaBufParamsV1(LinuxDmaBufV1ClientBufferIntegration *integration, ::wl_resource *resource);
     ~LinuxDmaBufParamsV1() override;
 
+    void cancelImport();
+
 protected:
     void zwp_linux_buffer_params_v1_destroy_resource(Resource *resource) override;
     void zwp_linux_buffer_params_v1_destroy(Resource *resource) override;
@@ -81,23 +133,37 @@ protected:
     zwp_linux_buffer_params_v1_create_immed(Resource *resource, uint32_t buffer_id, int32_t width, int32_t height, uint32_t format, uint32_t flags) override;
 
 private:
-    bool test(Resource *resource, uint32_t width, uint32_t height);
+    bool test(Resource *resource, uint32_t width, uint32_t height, bool checkBounds);
+    LinuxDmaBufV1ClientBuffer *importBuffer(const LinuxDmaBufV1ImportKey &key, LinuxDmaBufV1ClientBuffer *cachedBuffer, const QSize &size, uint32_t format, uint32_t flags);
+    void addToImportCache(const LinuxDmaBufV1ImportKey &key, LinuxDmaBufV1ClientBuffer *clientBuffer);
+    void finishAsyncImport(const LinuxDmaBufV1ImportKey &key, LinuxDmaBufV1ClientBuffer *clientBuffer);
+    void sendCreated(LinuxDmaBufV1ClientBuffer *clientBuffer);
 
     LinuxDmaBufV1ClientBufferIntegration *m_integration;
     QVector<LinuxDmaBufV1Plane> m_planes;
     int m_planeCount = 0;
     bool m_isUsed = false;
+    bool m_isImportPending = false;
 };
 
 class LinuxDmaBufV1FormatTable
 {
 public:
     LinuxDmaBufV1FormatTable(const QHash<uint32_t, QVector<uint64_t>> &supportedModifiers);
-    ~LinuxDmaBufV1FormatTable();
 
-    int fd = -1;
-    int size;
-    QMap<std::pair<uint32_t, uint64_t>, uint16_t> indices;
+    QScopedPointer<RamFile> file;
+    QHash<std::pair<uint32_t, uint64_t>, uint16_t> indices;
+};
+
+/**
+ * The wire representation of a LinuxDmaBufV1Feedback::Tranche, it's shared by all the
+ * resources of a feedback object.
+ */
+struct LinuxDmaBufV1EncodedTranche
+{
+    QByteArray targetDevice;
+    QByteArray indices;
+    uint32_t flags = 0;
 };
 
 class LinuxDmaBufV1FeedbackPrivate : public QtWaylandServer::zwp_linux_dmabuf_feedback_v1
@@ -107,8 +173,12 @@ public:
 
     static LinuxDmaBufV1FeedbackPrivate *get(LinuxDmaBufV1Feedback *q);
     void send(Resource *resource);
+    const QVector<LinuxDmaBufV1EncodedTranche> &encodedTranches();
 
     QVector<LinuxDmaBufV1Feedback::Tranche> m_tranches;
+    QVector<LinuxDmaBufV1EncodedTranche> m_encodedTranches;
+    // the serial of the format table m_encodedTranches refer to, unset if they are outdated
+    std::optional<quint64> m_encodedTableSerial;
     LinuxDmaBufV1ClientBufferIntegrationPrivate *m_bufferintegration;
 
 protected:
@@ -5,6 +5,7 @@
     SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
 */
 #include "output_interface.h"
+#include "clientconnection_p.h"
 #include "display.h"
 #include "display_p.h"
 #include "utils.h"
@@ -29,6 +30,7 @@ public:
     void sendDone(Resource *resource);
 
     void broadcastGeometry();
+    bool withholdFromCongestedClient(Resource *resource);
 
     OutputInterface *q;
     QPointer<Display> display;
@@ -139,10 +141,33 @@ void OutputInterfacePrivate::broadcastGeometry()
 {
     const auto outputResources = resourceMap();
     for (Resource *resource : outputResources) {
-        sendGeometry(resource);
+        if (!withholdFromCongestedClient(resource)) {
+            sendGeometry(resource);
+        }
     }
 }
 
+bool OutputInterfacePrivate::withholdFromCongestedClient(Resource *resource)
+{
+    ClientConnectionPrivate *clientPrivate = ClientConnectionPrivate::get(resource->client());
+    if (!clientPrivate || !clientPrivate->congested) {
+        return false;
+    }
+
+    // the complete state is sent once the client catches up, no matter what changed
+    wl_client *client = resource->client();
+    clientPrivate->coalesce(this, q, [this, client]() {
+        const auto clientResources = resourceMap().values(client);
+        for (Resource *resource : clientResources) {
+            sendMode(resource);
+            sendScale(resource);
+            sendGeometry(resource);
+            sendDone(resource);
+        }
+    });
+    return true;
+}
+
 void OutputInterfacePrivate::output_destroy_global()
 {
     delete q;
@@ -220,7 +245,9 @@ void OutputInterface::setMode(const Mode &mode)
 
     const auto outputResources = d->resourceMap();
     for (OutputInterfacePrivate::Resource *resource : outputResources) {
-        d->sendMode(resource);
+        if (!d->withholdFromCongestedClient(resource)) {
+            d->sendMode(resource);
+        }
     }
 
     Q_EMIT modeChanged();
@@ -306,7 +333,9 @@ void OutputInterface::setScale(int scale)
 
     const auto outputResources = d->resourceMap();
     for (OutputInterfacePrivate::Resource *resource : outputResources) {
-        d->sendScale(resource);
+        if (!d->withholdFromCongestedClient(resource)) {
+            d->sendScale(resource);
+        }
     }
 
     Q_EMIT scaleChanged(d->scale);
@@ -395,13 +424,18 @@ void OutputInterface::done()
 {
     const auto outputResources = d->resourceMap();
     for (OutputInterfacePrivate::Resource *resource : outputResources) {
-        d->sendDone(resource);
+        if (!d->withholdFromCongestedClient(resource)) {
+            d->sendDone(resource);
+        }
     }
 }
 
 void OutputInterface::done(wl_client *client)
 {
-    d->sendDone(d->resourceMap().value(client));
+    OutputInterfacePrivate::Resource *resource = d->resourceMap().value(client);
+    if (!d->withholdFromCongestedClient(resource)) {
+        d->sendDone(resource);
+    }
 }
 
 OutputInterface *OutputInterface::get(wl_resource *native)
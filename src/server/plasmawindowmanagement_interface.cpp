@@ -4,6 +4,7 @@
     SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
 */
 #include "plasmawindowmanagement_interface.h"
+#include "clientconnection_p.h"
 #include "display.h"
 #include "logging.h"
 #include "plasmavirtualdesktop_interface.h"
@@ -69,6 +70,8 @@ public:
     void setApplicationMenuPaths(const QString &service, const QString &object);
     void setResourceName(const QString &resourceName);
     wl_resource *resourceForParent(PlasmaWindowInterface *parent, Resource *child) const;
+    template<typename Send>
+    void sendProperty(const void *property, Send send);
 
     quint32 windowId = 0;
     QHash<SurfaceInterface *, QRect> minimizedGeometries;
@@ -268,11 +271,11 @@ PlasmaWindowInterface *PlasmaWindowManagementInterface::createWindow(QObject *pa
     window->d->uuid = uuid.toString();
     window->d->windowId = ++d->windowIdCounter; // NOTE the window id is deprecated
 
+    // window_with_uuid is only sent to resources that support it
+    d->broadcast_window_with_uuid(window->d->windowId, window->d->uuid);
     const auto clientResources = d->resourceMap();
     for (auto resource : clientResources) {
-        if (resource->version() >= ORG_KDE_PLASMA_WINDOW_MANAGEMENT_WINDOW_WITH_UUID_SINCE_VERSION) {
-            d->send_window_with_uuid(resource->handle, window->d->windowId, window->d->uuid);
-        } else {
+        if (resource->version() < ORG_KDE_PLASMA_WINDOW_MANAGEMENT_WINDOW_WITH_UUID_SINCE_VERSION) {
             d->send_window(resource->handle, window->d->windowId);
         }
     }
@@ -384,6 +387,30 @@ void PlasmaWindowInterfacePrivate::org_kde_plasma_window_bind_resource(Resource
     }
 }
 
+/**
+ * Sends the change of a frequently updated @p property to every resource. Congested clients
+ * only get the latest value of the property once they catch up.
+ */
+template<typename Send>
+void PlasmaWindowInterfacePrivate::sendProperty(const void *property, Send send)
+{
+    const auto clientResources = resourceMap();
+    for (auto resource : clientResources) {
+        ClientConnectionPrivate *clientPrivate = ClientConnectionPrivate::get(resource->client());
+        if (!clientPrivate || !clientPrivate->congested) {
+            send(resource);
+            continue;
+        }
+        wl_client *client = resource->client();
+        clientPrivate->coalesce(property, q, [this, client, send]() {
+            const auto clientResources = resourceMap().values(client);
+            for (auto resource : clientResources) {
+                send(resource);
+            }
+        });
+    }
+}
+
 void PlasmaWindowInterfacePrivate::setAppId(const QString &appId)
 {
     if (m_appId == appId) {
@@ -391,11 +418,7 @@ void PlasmaWindowInterfacePrivate::setAppId(const QString &appId)
     }
 
     m_appId = appId;
-    const auto clientResources = resourceMap();
-
-    for (auto resource : clientResources) {
-        send_app_id_changed(resource->handle, m_appId);
-    }
+    broadcast_app_id_changed(m_appId);
 }
 
 void PlasmaWindowInterfacePrivate::setPid(quint32 pid)
@@ -417,11 +440,7 @@ void PlasmaWindowInterfacePrivate::setThemedIconName(const QString &iconName)
         return;
     }
     m_themedIconName = iconName;
-    const auto clientResources = resourceMap();
-
-    for (auto resource : clientResources) {
-        send_themed_icon_name_changed(resource->handle, m_themedIconName);
-    }
+    broadcast_themed_icon_name_changed(m_themedIconName);
 }
 
 void PlasmaWindowInterfacePrivate::setIcon(const QIcon &icon)
@@ -443,13 +462,7 @@ void PlasmaWindowInterfacePrivate::setResourceName(const QString &resourceName)
         return;
     }
     m_resourceName = resourceName;
-
-    const auto clientResources = resourceMap();
-    for (auto resource : clientResources) {
-        if (resource->version() >= ORG_KDE_PLASMA_WINDOW_RESOURCE_NAME_CHANGED_SINCE_VERSION) {
-            send_resource_name_changed(resource->handle, resourceName);
-        }
-    }
+    broadcast_resource_name_changed(resourceName);
 }
 
 void PlasmaWindowInterfacePrivate::org_kde_plasma_window_get_icon(Resource *resource, int32_t fd)
@@ -508,11 +521,9 @@ void PlasmaWindowInterfacePrivate::setTitle(const QString &title)
         return;
     }
     m_title = title;
-    const auto clientResources = resourceMap();
-
-    for (auto resource : clientResources) {
+    sendProperty(&m_title, [this](Resource *resource) {
         send_title_changed(resource->handle, m_title);
-    }
+    });
 }
 
 void PlasmaWindowInterfacePrivate::unmap()
@@ -540,11 +551,9 @@ void PlasmaWindowInterfacePrivate::setState(org_kde_plasma_window_management_sta
         return;
     }
     m_state = newState;
-    const auto clientResources = resourceMap();
-
-    for (auto resource : clientResources) {
+    sendProperty(&m_state, [this](Resource *resource) {
         send_state_changed(resource->handle, m_state);
-    }
+    });
 }
 
 wl_resource *PlasmaWindowInterfacePrivate::resourceForParent(PlasmaWindowInterface *parent, Resource *child) const
@@ -597,13 +606,12 @@ void PlasmaWindowInterfacePrivate::setGeometry(const QRect &geo)
         return;
     }
 
-    const auto clientResources = resourceMap();
-    for (auto resource : clientResources) {
-        if (resource->version() < ORG_KDE_PLASMA_WINDOW_GEOMETRY_SINCE_VERSION) {
-            continue;
+    sendProperty(&geometry, [this](Resource *resource) {
+        // the geometry may have become invalid while the client was congested
+        if (resource->version() >= ORG_KDE_PLASMA_WINDOW_GEOMETRY_SINCE_VERSION && geometry.isValid()) {
+            send_geometry(resource->handle, geometry.x(), geometry.y(), geometry.width(), geometry.height());
         }
-        send_geometry(resource->handle, geometry.x(), geometry.y(), geometry.width(), geometry.height());
-    }
+    });
 }
 
 void PlasmaWindowInterfacePrivate::setApplicationMenuPaths(const QString &service, const QString &object)
@@ -914,10 +922,7 @@ void PlasmaWindowInterface::addPlasmaVirtualDesktop(const QString &id)
         removePlasmaVirtualDesktop(id);
     });
 
-    const auto clientResources = d->resourceMap();
-    for (auto resource : clientResources) {
-        d->send_virtual_desktop_entered(resource->handle, id);
-    }
+    d->broadcast_virtual_desktop_entered(id);
 }
 
 void PlasmaWindowInterface::removePlasmaVirtualDesktop(const QString &id)
@@ -927,10 +932,7 @@ void PlasmaWindowInterface::removePlasmaVirtualDesktop(const QString &id)
     }
 
     d->plasmaVirtualDesktops.removeAll(id);
-    const auto clientResources = d->resourceMap();
-    for (auto resource : clientResources) {
-        d->send_virtual_desktop_left(resource->handle, id);
-    }
+    d->broadcast_virtual_desktop_left(id);
 
     // we went on all desktops
     if (d->plasmaVirtualDesktops.isEmpty()) {
@@ -951,12 +953,7 @@ void PlasmaWindowInterface::addPlasmaActivity(const QString &id)
 
     d->plasmaActivities << id;
 
-    const auto clientResources = d->resourceMap();
-    for (auto resource : clientResources) {
-        if (resource->version() >= ORG_KDE_PLASMA_WINDOW_ACTIVITY_ENTERED_SINCE_VERSION) {
-            d->send_activity_entered(resource->handle, id);
-        }
-    }
+    d->broadcast_activity_entered(id);
 }
 
 void PlasmaWindowInterface::removePlasmaActivity(const QString &id)
@@ -965,12 +962,7 @@ void PlasmaWindowInterface::removePlasmaActivity(const QString &id)
         return;
     }
 
-    const auto clientResources = d->resourceMap();
-    for (auto resource : clientResources) {
-        if (resource->version() >= ORG_KDE_PLASMA_WINDOW_ACTIVITY_LEFT_SINCE_VERSION) {
-            d->send_activity_left(resource->handle, id);
-        }
-    }
+    d->broadcast_activity_left(id);
 }
 
 QStringList PlasmaWindowInterface::plasmaActivities() const
@@ -8,12 +8,14 @@
 
 #include "pointer_interface.h"
 #include "clientconnection.h"
+#include "clientconnection_p.h"
 #include "display.h"
 #include "logging.h"
 #include "pointer_interface_p.h"
 #include "pointergestures_v1_interface_p.h"
 #include "relativepointer_v1_interface_p.h"
 #include "seat_interface.h"
+#include "serialtracker.h"
 #include "surface_interface.h"
 #include "surfacerole_p.h"
 #include "utils.h"
@@ -53,11 +55,6 @@ PointerInterfacePrivate::~PointerInterfacePrivate()
 {
 }
 
-QList<PointerInterfacePrivate::Resource *> PointerInterfacePrivate::pointersForClient(ClientConnection *client) const
-{
-    return resourceMap().values(client->client());
-}
-
 void PointerInterfacePrivate::pointer_set_cursor(Resource *resource, uint32_t serial, ::wl_resource *surface_resource, int32_t hotspot_x, int32_t hotspot_y)
 {
     SurfaceInterface *surface = nullptr;
@@ -101,10 +98,12 @@ void PointerInterfacePrivate::pointer_release(Resource *resource)
 
 void PointerInterfacePrivate::pointer_bind_resource(Resource *resource)
 {
+    focusedResources.invalidate();
+
     const ClientConnection *focusedClient = focusedSurface ? focusedSurface->client() : nullptr;
 
     if (focusedClient && focusedClient->client() == resource->client()) {
-        const quint32 serial = seat->display()->nextSerial();
+        const quint32 serial = seat->display()->serialTracker()->next(SerialTracker::EventType::PointerEnter, seat, focusedSurface);
         send_enter(resource->handle, serial, focusedSurface->resource(), wl_fixed_from_double(lastPosition.x()), wl_fixed_from_double(lastPosition.y()));
         if (resource->version() >= WL_POINTER_FRAME_SINCE_VERSION) {
             send_frame(resource->handle);
@@ -112,30 +111,50 @@ void PointerInterfacePrivate::pointer_bind_resource(Resource *resource)
     }
 }
 
+void PointerInterfacePrivate::pointer_destroy_resource(Resource *resource)
+{
+    Q_UNUSED(resource)
+    focusedResources.invalidate();
+}
+
+void PointerInterfacePrivate::flushWithheldMotion()
+{
+    // the motion must not be overtaken by buttons or axis events
+    if (motionWithheld) {
+        ClientConnectionPrivate::get(focusedSurface->client())->flushCoalesced(this);
+    }
+}
+
+void PointerInterfacePrivate::dropWithheldMotion()
+{
+    if (motionWithheld) {
+        motionWithheld = false;
+        ClientConnectionPrivate::get(focusedSurface->client())->dropCoalesced(this);
+    }
+}
+
 void PointerInterfacePrivate::sendLeave(quint32 serial)
 {
-    const QList<Resource *> pointerResources = pointersForClient(focusedSurface->client());
-    for (Resource *resource : pointerResources) {
+    dropWithheldMotion();
+    focusedResources.forEach([this, serial](Resource *resource) {
         send_leave(resource->handle, serial, focusedSurface->resource());
-    }
+    });
 }
 
 void PointerInterfacePrivate::sendEnter(const QPointF &position, quint32 serial)
 {
-    const QList<Resource *> pointerResources = pointersForClient(focusedSurface->client());
-    for (Resource *resource : pointerResources) {
+    focusedResources.forEach([this, &position, serial](Resource *resource) {
         send_enter(resource->handle, serial, focusedSurface->resource(), wl_fixed_from_double(position.x()), wl_fixed_from_double(position.y()));
-    }
+    });
 }
 
 void PointerInterfacePrivate::sendFrame()
 {
-    const QList<Resource *> pointerResources = pointersForClient(focusedSurface->client());
-    for (Resource *resource : pointerResources) {
+    focusedResources.forEach([this](Resource *resource) {
         if (resource->version() >= WL_POINTER_FRAME_SINCE_VERSION) {
             send_frame(resource->handle);
         }
-    }
+    });
 }
 
 PointerInterface::PointerInterface(SeatInterface *seat)
@@ -167,10 +186,12 @@ void PointerInterface::sendEnter(SurfaceInterface *surface, const QPointF &posit
     }
 
     d->focusedSurface = surface;
+    d->focusedResources.setClient(surface->client()->client());
     d->destroyConnection = connect(d->focusedSurface, &SurfaceInterface::aboutToBeDestroyed, this, [this]() {
         d->sendLeave(d->seat->display()->nextSerial());
         d->sendFrame();
         d->focusedSurface = nullptr;
+        d->focusedResources.setClient(nullptr);
         Q_EMIT focusedSurfaceChanged();
     });
 
@@ -191,6 +212,7 @@ void PointerInterface::sendLeave(quint32 serial)
     d->sendFrame();
 
     d->focusedSurface = nullptr;
+    d->focusedResources.setClient(nullptr);
     disconnect(d->destroyConnection);
 
     Q_EMIT focusedSurfaceChanged();
@@ -202,10 +224,12 @@ void PointerInterface::sendButton(quint32 button, PointerButtonState state, quin
         return;
     }
 
-    const auto pointerResources = d->pointersForClient(d->focusedSurface->client());
-    for (PointerInterfacePrivate::Resource *resource : pointerResources) {
-        d->send_button(resource->handle, serial, d->seat->timestamp(), button, quint32(state));
-    }
+    d->flushWithheldMotion();
+
+    const quint32 timestamp = d->seat->timestamp();
+    d->focusedResources.forEach([this, serial, timestamp, button, state](PointerInterfacePrivate::Resource *resource) {
+        d->send_button(resource->handle, serial, timestamp, button, quint32(state));
+    });
 }
 
 void PointerInterface::sendAxis(Qt::Orientation orientation, qreal delta, qint32 discreteDelta, PointerAxisSource source)
@@ -214,8 +238,9 @@ void PointerInterface::sendAxis(Qt::Orientation orientation, qreal delta, qint32
         return;
     }
 
-    const auto pointerResources = d->pointersForClient(d->focusedSurface->client());
-    for (PointerInterfacePrivate::Resource *resource : pointerResources) {
+    d->flushWithheldMotion();
+
+    d->focusedResources.forEach([this, orientation, delta, discreteDelta, source](PointerInterfacePrivate::Resource *resource) {
         const quint32 version = resource->version();
 
         const auto wlOrientation =
@@ -251,7 +276,7 @@ void PointerInterface::sendAxis(Qt::Orientation orientation, qreal delta, qint32
         } else if (version >= WL_POINTER_AXIS_STOP_SINCE_VERSION) {
             d->send_axis_stop(resource->handle, d->seat->timestamp(), wlOrientation);
         }
-    }
+    });
 }
 
 void PointerInterface::sendMotion(const QPointF &position)
@@ -262,15 +287,33 @@ void PointerInterface::sendMotion(const QPointF &position)
         return;
     }
 
-    const auto pointerResources = d->pointersForClient(d->focusedSurface->client());
-    for (PointerInterfacePrivate::Resource *resource : pointerResources) {
-        d->send_motion(resource->handle, d->seat->timestamp(), wl_fixed_from_double(position.x()), wl_fixed_from_double(position.y()));
+    const quint32 timestamp = d->seat->timestamp();
+    const wl_fixed_t x = wl_fixed_from_double(position.x());
+    const wl_fixed_t y = wl_fixed_from_double(position.y());
+    auto send = [this, timestamp, x, y]() {
+        d->focusedResources.forEach([this, timestamp, x, y](PointerInterfacePrivate::Resource *resource) {
+            d->send_motion(resource->handle, timestamp, x, y);
+        });
+    };
+
+    ClientConnectionPrivate *clientPrivate = ClientConnectionPrivate::get(d->focusedSurface->client());
+    if (clientPrivate->congested) {
+        // only the latest position is sent, in a frame of its own, once the client catches up
+        d->motionWithheld = true;
+        clientPrivate->coalesce(d.data(), this, [this, send]() {
+            d->motionWithheld = false;
+            send();
+            d->sendFrame();
+        });
+        return;
     }
+    send();
 }
 
 void PointerInterface::sendFrame()
 {
-    if (d->focusedSurface) {
+    // the frame of a withheld motion is sent along with it
+    if (d->focusedSurface && !d->motionWithheld) {
         d->sendFrame();
     }
 }
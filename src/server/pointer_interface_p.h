@@ -7,6 +7,7 @@
 */
 #pragma once
 
+#include "focusedresources_p.h"
 #include "pointer_interface.h"
 
 #include <QPointF>
@@ -17,7 +18,6 @@
 
 namespace KWaylandServer
 {
-class ClientConnection;
 class PointerPinchGestureV1Interface;
 class PointerSwipeGestureV1Interface;
 class PointerHoldGestureV1Interface;
@@ -31,11 +31,10 @@ public:
     PointerInterfacePrivate(PointerInterface *q, SeatInterface *seat);
     ~PointerInterfacePrivate() override;
 
-    QList<Resource *> pointersForClient(ClientConnection *client) const;
-
     PointerInterface *q;
     SeatInterface *seat;
     SurfaceInterface *focusedSurface = nullptr;
+    FocusedResources<QtWaylandServer::wl_pointer> focusedResources{this};
     QMetaObject::Connection destroyConnection;
     Cursor *cursor = nullptr;
     QScopedPointer<RelativePointerV1Interface> relativePointersV1;
@@ -43,7 +42,13 @@ public:
     QScopedPointer<PointerPinchGestureV1Interface> pinchGesturesV1;
     QScopedPointer<PointerHoldGestureV1Interface> holdGesturesV1;
     QPointF lastPosition;
+    /**
+     * Whether a motion event is withheld from the focused client because it is congested.
+     */
+    bool motionWithheld = false;
 
+    void flushWithheldMotion();
+    void dropWithheldMotion();
     void sendLeave(quint32 serial);
     void sendEnter(const QPointF &parentSurfacePosition, quint32 serial);
     void sendFrame();
@@ -52,6 +57,7 @@ protected:
     void pointer_set_cursor(Resource *resource, uint32_t serial, ::wl_resource *surface_resource, int32_t hotspot_x, int32_t hotspot_y) override;
     void pointer_release(Resource *resource) override;
     void pointer_bind_resource(Resource *resource) override;
+    void pointer_destroy_resource(Resource *resource) override;
 };
 
 }
@@ -106,10 +106,9 @@ void PointerSwipeGestureV1Interface::sendBegin(quint32 serial, quint32 fingerCou
     focusedClient = focusedSurface->client();
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> swipeResources = resourceMap().values(focusedClient->client());
-    for (Resource *swipeResource : swipeResources) {
+    forEachResource(focusedClient->client(), [this, serial, seat, focusedSurface, fingerCount](Resource *swipeResource) {
         send_begin(swipeResource->handle, serial, seat->timestamp(), focusedSurface->resource(), fingerCount);
-    }
+    });
 }
 
 void PointerSwipeGestureV1Interface::sendUpdate(const QSizeF &delta)
@@ -120,10 +119,9 @@ void PointerSwipeGestureV1Interface::sendUpdate(const QSizeF &delta)
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> swipeResources = resourceMap().values(focusedClient->client());
-    for (Resource *swipeResource : swipeResources) {
+    forEachResource(focusedClient->client(), [this, seat, &delta](Resource *swipeResource) {
         send_update(swipeResource->handle, seat->timestamp(), wl_fixed_from_double(delta.width()), wl_fixed_from_double(delta.height()));
-    }
+    });
 }
 
 void PointerSwipeGestureV1Interface::sendEnd(quint32 serial)
@@ -134,10 +132,9 @@ void PointerSwipeGestureV1Interface::sendEnd(quint32 serial)
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> swipeResources = resourceMap().values(focusedClient->client());
-    for (Resource *swipeResource : swipeResources) {
+    forEachResource(focusedClient->client(), [this, serial, seat](Resource *swipeResource) {
         send_end(swipeResource->handle, serial, seat->timestamp(), false);
-    }
+    });
 
     // The gesture session has been just finished, reset the cached focused client.
     focusedClient = nullptr;
@@ -151,10 +148,9 @@ void PointerSwipeGestureV1Interface::sendCancel(quint32 serial)
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> swipeResources = resourceMap().values(focusedClient->client());
-    for (Resource *swipeResource : swipeResources) {
+    forEachResource(focusedClient->client(), [this, serial, seat](Resource *swipeResource) {
         send_end(swipeResource->handle, serial, seat->timestamp(), true);
-    }
+    });
 
     // The gesture session has been just finished, reset the cached focused client.
     focusedClient = nullptr;
@@ -192,10 +188,9 @@ void PointerPinchGestureV1Interface::sendBegin(quint32 serial, quint32 fingerCou
     focusedClient = focusedSurface->client();
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> pinchResources = resourceMap().values(*focusedClient);
-    for (Resource *pinchResource : pinchResources) {
+    forEachResource(*focusedClient, [this, serial, seat, focusedSurface, fingerCount](Resource *pinchResource) {
         send_begin(pinchResource->handle, serial, seat->timestamp(), focusedSurface->resource(), fingerCount);
-    }
+    });
 }
 
 void PointerPinchGestureV1Interface::sendUpdate(const QSizeF &delta, qreal scale, qreal rotation)
@@ -206,15 +201,14 @@ void PointerPinchGestureV1Interface::sendUpdate(const QSizeF &delta, qreal scale
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> pinchResources = resourceMap().values(*focusedClient);
-    for (Resource *pinchResource : pinchResources) {
+    forEachResource(*focusedClient, [this, seat, &delta, scale, rotation](Resource *pinchResource) {
         send_update(pinchResource->handle,
                     seat->timestamp(),
                     wl_fixed_from_double(delta.width()),
                     wl_fixed_from_double(delta.height()),
                     wl_fixed_from_double(scale),
                     wl_fixed_from_double(rotation));
-    }
+    });
 }
 
 void PointerPinchGestureV1Interface::sendEnd(quint32 serial)
@@ -225,10 +219,9 @@ void PointerPinchGestureV1Interface::sendEnd(quint32 serial)
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> pinchResources = resourceMap().values(*focusedClient);
-    for (Resource *pinchResource : pinchResources) {
+    forEachResource(*focusedClient, [this, serial, seat](Resource *pinchResource) {
         send_end(pinchResource->handle, serial, seat->timestamp(), false);
-    }
+    });
 
     // The gesture session has been just finished, reset the cached focused client.
     focusedClient = nullptr;
@@ -242,10 +235,9 @@ void PointerPinchGestureV1Interface::sendCancel(quint32 serial)
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> pinchResources = resourceMap().values(*focusedClient);
-    for (Resource *pinchResource : pinchResources) {
+    forEachResource(*focusedClient, [this, serial, seat](Resource *pinchResource) {
         send_end(pinchResource->handle, serial, seat->timestamp(), true);
-    }
+    });
 
     // The gesture session has been just finished, reset the cached focused client.
     focusedClient = nullptr;
@@ -283,10 +275,9 @@ void PointerHoldGestureV1Interface::sendBegin(quint32 serial, quint32 fingerCoun
     focusedClient = focusedSurface->client();
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> holdResources = resourceMap().values(*focusedClient);
-    for (Resource *holdResource : holdResources) {
+    forEachResource(*focusedClient, [this, serial, seat, focusedSurface, fingerCount](Resource *holdResource) {
         send_begin(holdResource->handle, serial, seat->timestamp(), focusedSurface->resource(), fingerCount);
-    }
+    });
 }
 
 void PointerHoldGestureV1Interface::sendEnd(quint32 serial)
@@ -297,10 +288,9 @@ void PointerHoldGestureV1Interface::sendEnd(quint32 serial)
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> holdResources = resourceMap().values(*focusedClient);
-    for (Resource *holdResource : holdResources) {
+    forEachResource(*focusedClient, [this, serial, seat](Resource *holdResource) {
         send_end(holdResource->handle, serial, seat->timestamp(), false);
-    }
+    });
 
     // The gesture session has been just finished, reset the cached focused client.
     focusedClient = nullptr;
@@ -314,10 +304,9 @@ void PointerHoldGestureV1Interface::sendCancel(quint32 serial)
 
     SeatInterface *seat = pointer->seat();
 
-    const QList<Resource *> holdResources = resourceMap().values(*focusedClient);
-    for (Resource *holdResource : holdResources) {
+    forEachResource(*focusedClient, [this, serial, seat](Resource *holdResource) {
         send_end(holdResource->handle, serial, seat->timestamp(), true);
-    }
+    });
 
     // The gesture session has been just finished, reset the cached focused client.
     focusedClient = nullptr;
@@ -0,0 +1,148 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "protocoltracer.h"
+#include "protocoltracer_p.h"
+
+#include <QIODevice>
+
+namespace KWaylandServer
+{
+static const quint64 s_capacity = 8192; // must be a power of two
+
+/**
+ * A slot in the ring buffer. The sequence number works like a seqlock: it is odd while the
+ * slot is being written and encodes the index of the record once the slot is complete, so
+ * readers can detect both torn and overwritten records without taking a lock.
+ */
+struct TraceSlot
+{
+    std::atomic<quint64> sequence{0};
+    const wl_interface *interface;
+    ProtocolTracer::Direction direction;
+    quint32 opcode;
+    pid_t pid;
+    quint32 size;
+    std::chrono::nanoseconds timestamp;
+    std::chrono::nanoseconds duration;
+};
+
+static TraceSlot s_slots[s_capacity];
+static std::atomic<quint64> s_writeIndex{0};
+
+std::atomic<bool> ProtocolTracerPrivate::enabled{false};
+
+void ProtocolTracerPrivate::record(ProtocolTracer::Direction direction,
+                                   const wl_interface *interface,
+                                   quint32 opcode,
+                                   pid_t pid,
+                                   quint32 size,
+                                   std::chrono::nanoseconds timestamp,
+                                   std::chrono::nanoseconds duration)
+{
+    const quint64 index = s_writeIndex.fetch_add(1, std::memory_order_relaxed);
+    TraceSlot &slot = s_slots[index & (s_capacity - 1)];
+
+    slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.interface = interface;
+    slot.direction = direction;
+    slot.opcode = opcode;
+    slot.pid = pid;
+    slot.size = size;
+    slot.timestamp = timestamp;
+    slot.duration = duration;
+
+    slot.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+void ProtocolTracer::setEnabled(bool enabled)
+{
+    ProtocolTracerPrivate::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool ProtocolTracer::isEnabled()
+{
+    return ProtocolTracerPrivate::enabled.load(std::memory_order_relaxed);
+}
+
+int ProtocolTracer::capacity()
+{
+    return s_capacity;
+}
+
+QVector<ProtocolTracer::Record> ProtocolTracer::records()
+{
+    const quint64 end = s_writeIndex.load(std::memory_order_acquire);
+    const quint64 begin = end > s_capacity ? end - s_capacity : 0;
+
+    QVector<Record> records;
+    records.reserve(end - begin);
+
+    for (quint64 index = begin; index < end; ++index) {
+        const TraceSlot &slot = s_slots[index & (s_capacity - 1)];
+        const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != index * 2 + 2) {
+            continue;
+        }
+
+        const wl_interface *interface = slot.interface;
+        const Direction direction = slot.direction;
+        const quint32 opcode = slot.opcode;
+        const pid_t pid = slot.pid;
+        const quint32 size = slot.size;
+        const std::chrono::nanoseconds timestamp = slot.timestamp;
+        const std::chrono::nanoseconds duration = slot.duration;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        const wl_message *messages = direction == Request ? interface->methods : interface->events;
+        const int messageCount = direction == Request ? interface->method_count : interface->event_count;
+
+        Record record;
+        record.direction = direction;
+        record.interface = QByteArray(interface->name);
+        record.message = int(opcode) < messageCount ? QByteArray(messages[opcode].name) : QByteArray();
+        record.opcode = opcode;
+        record.pid = pid;
+        record.size = size;
+        record.timestamp = timestamp;
+        record.duration = duration;
+        records.append(record);
+    }
+
+    return records;
+}
+
+bool ProtocolTracer::dump(QIODevice *device)
+{
+    const QVector<Record> records = ProtocolTracer::records();
+    for (const Record &record : records) {
+        const QByteArray line = QByteArray::number(qint64(record.timestamp.count())) + '\t'
+            + QByteArray::number(record.pid) + '\t'
+            + (record.direction == Request ? "request" : "event") + '\t'
+            + record.interface + '\t'
+            + record.message + '\t'
+            + QByteArray::number(record.opcode) + '\t'
+            + QByteArray::number(record.size) + '\t'
+            + QByteArray::number(qint64(record.duration.count())) + '\n';
+        if (device->write(line) != line.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ProtocolTracer::clear()
+{
+    // Invalidate everything written so far by moving the write index a full lap ahead.
+    s_writeIndex.fetch_add(s_capacity, std::memory_order_release);
+}
+
+} // namespace KWaylandServer
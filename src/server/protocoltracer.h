@@ -0,0 +1,97 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include <KWaylandServer/kwaylandserver_export.h>
+
+#include <QByteArray>
+#include <QVector>
+
+#include <chrono>
+#include <sys/types.h>
+
+class QIODevice;
+
+namespace KWaylandServer
+{
+/**
+ * @brief Records the requests and events handled by the protocol implementations.
+ *
+ * The generated protocol code reports every request that is dispatched and every event that
+ * is sent to the tracer. While tracing is enabled, the interface, opcode, client, size and
+ * duration of each message are written into a fixed size in-process ring buffer, which the
+ * compositor can dump on demand. Unlike WAYLAND_DEBUG, nothing is formatted while recording,
+ * so tracing is cheap enough to be left on in production.
+ *
+ * Only the most recent messages are kept, see capacity().
+ */
+class KWAYLANDSERVER_EXPORT ProtocolTracer
+{
+public:
+    enum Direction {
+        Request,
+        Event,
+    };
+
+    struct Record
+    {
+        Direction direction;
+        /**
+         * The name of the interface, e.g. "wl_surface".
+         */
+        QByteArray interface;
+        /**
+         * The name of the request or event, e.g. "commit".
+         */
+        QByteArray message;
+        quint32 opcode;
+        /**
+         * The pid of the client that sent the request or receives the event.
+         */
+        pid_t pid;
+        /**
+         * The size of the message on the wire in bytes, file descriptors not included.
+         */
+        quint32 size;
+        /**
+         * The time the message got dispatched or sent, using the steady clock.
+         */
+        std::chrono::nanoseconds timestamp;
+        /**
+         * The time spent in the request handler, or in marshalling the event.
+         */
+        std::chrono::nanoseconds duration;
+    };
+
+    /**
+     * Enables or disables recording of messages. Tracing is disabled by default.
+     */
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    /**
+     * Returns the maximum number of records that are kept.
+     */
+    static int capacity();
+
+    /**
+     * Returns the recorded messages, oldest first. This function can be called from
+     * any thread; records that are being written at the same time are skipped.
+     */
+    static QVector<Record> records();
+    /**
+     * Writes the recorded messages to the @p device, one tab separated line per message.
+     */
+    static bool dump(QIODevice *device);
+    /**
+     * Discards all recorded messages.
+     */
+    static void clear();
+};
+
+} // namespace KWaylandServer
+
+Q_DECLARE_TYPEINFO(KWaylandServer::ProtocolTracer::Record, Q_MOVABLE_TYPE);
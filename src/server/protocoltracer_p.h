@@ -0,0 +1,96 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include "protocoltracer.h"
+
+#include <wayland-server-core.h>
+
+#include <atomic>
+#include <string.h>
+
+namespace KWaylandServer
+{
+class ProtocolTracerPrivate
+{
+public:
+    static void record(ProtocolTracer::Direction direction,
+                       const wl_interface *interface,
+                       quint32 opcode,
+                       pid_t pid,
+                       quint32 size,
+                       std::chrono::nanoseconds timestamp,
+                       std::chrono::nanoseconds duration);
+
+    static std::atomic<bool> enabled;
+};
+
+/**
+ * The ProtocolTraceScope is instantiated by the generated protocol code around every request
+ * handler and event, see the --trace option of qtwaylandscanner_kde. If tracing is disabled,
+ * it costs a relaxed atomic load.
+ */
+class ProtocolTraceScope
+{
+public:
+    ProtocolTraceScope(ProtocolTracer::Direction direction, const wl_interface *interface, quint32 opcode, wl_resource *resource)
+        : m_active(ProtocolTracerPrivate::enabled.load(std::memory_order_relaxed))
+    {
+        if (Q_UNLIKELY(m_active)) {
+            m_direction = direction;
+            m_interface = interface;
+            m_opcode = opcode;
+            // The resource may be gone once a destructor request has been handled.
+            wl_client_get_credentials(wl_resource_get_client(resource), &m_pid, nullptr, nullptr);
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ProtocolTraceScope()
+    {
+        if (Q_UNLIKELY(m_active)) {
+            const auto end = std::chrono::steady_clock::now();
+            ProtocolTracerPrivate::record(m_direction, m_interface, m_opcode, m_pid, m_size, m_start.time_since_epoch(), end - m_start);
+        }
+    }
+
+    bool isActive() const
+    {
+        return m_active;
+    }
+
+    void setSize(quint32 size)
+    {
+        m_size = size;
+    }
+
+    /**
+     * Returns the padded size of the given string argument, excluding its length field.
+     */
+    static quint32 stringSize(const char *string)
+    {
+        return string ? (strlen(string) + 1 + 3) & ~3 : 0;
+    }
+
+    /**
+     * Returns the padded size of an array argument of @p size bytes, excluding its size field.
+     */
+    static quint32 arraySize(size_t size)
+    {
+        return (size + 3) & ~3;
+    }
+
+private:
+    bool m_active;
+    ProtocolTracer::Direction m_direction = ProtocolTracer::Request;
+    const wl_interface *m_interface = nullptr;
+    quint32 m_opcode = 0;
+    pid_t m_pid = 0;
+    quint32 m_size = 0;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace KWaylandServer
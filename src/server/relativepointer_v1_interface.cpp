@@ -77,18 +77,15 @@ void RelativePointerV1Interface::sendRelativeMotion(const QSizeF &delta, const Q
     }
 
     ClientConnection *focusedClient = pointer->focusedSurface()->client();
-    const QList<Resource *> pointerResources = resourceMap().values(focusedClient->client());
-    for (Resource *pointerResource : pointerResources) {
-        if (pointerResource->client() == focusedClient->client()) {
-            send_relative_motion(pointerResource->handle,
-                                 microseconds >> 32,
-                                 microseconds & 0xffffffff,
-                                 wl_fixed_from_double(delta.width()),
-                                 wl_fixed_from_double(delta.height()),
-                                 wl_fixed_from_double(deltaNonAccelerated.width()),
-                                 wl_fixed_from_double(deltaNonAccelerated.height()));
-        }
-    }
+    forEachResource(focusedClient->client(), [this, &delta, microseconds, &deltaNonAccelerated](Resource *pointerResource) {
+        send_relative_motion(pointerResource->handle,
+                             microseconds >> 32,
+                             microseconds & 0xffffffff,
+                             wl_fixed_from_double(delta.width()),
+                             wl_fixed_from_double(delta.height()),
+                             wl_fixed_from_double(deltaNonAccelerated.width()),
+                             wl_fixed_from_double(deltaNonAccelerated.height()));
+    });
 }
 
 } // namespace KWaylandServer
@@ -25,20 +25,127 @@
 #include "primaryselectionsource_v1_interface.h"
 #include "relativepointer_v1_interface_p.h"
 #include "seat_interface_p.h"
+#include "serialtracker.h"
 #include "surface_interface.h"
 #include "textinput_v2_interface_p.h"
 #include "textinput_v3_interface_p.h"
 #include "touch_interface_p.h"
 #include "utils.h"
 
+#include <QVarLengthArray>
+
 #include <linux/input.h>
 
+#include <algorithm>
 #include <functional>
+#include <utility>
 
 namespace KWaylandServer
 {
 static const int s_version = 7;
 
+InputEvent InputEvent::pointerMotion(quint32 timestamp, const QPointF &position)
+{
+    InputEvent event;
+    event.type = Type::PointerMotion;
+    event.timestamp = timestamp;
+    event.position = position;
+    return event;
+}
+
+InputEvent InputEvent::pointerButton(quint32 timestamp, quint32 button, PointerButtonState state)
+{
+    InputEvent event;
+    event.type = Type::PointerButton;
+    event.timestamp = timestamp;
+    event.code = button;
+    event.state = quint32(state);
+    return event;
+}
+
+InputEvent InputEvent::pointerAxis(quint32 timestamp, Qt::Orientation orientation, qreal delta, qint32 discreteDelta, PointerAxisSource source)
+{
+    InputEvent event;
+    event.type = Type::PointerAxis;
+    event.timestamp = timestamp;
+    event.orientation = orientation;
+    event.delta = delta;
+    event.discreteDelta = discreteDelta;
+    event.axisSource = source;
+    return event;
+}
+
+InputEvent InputEvent::pointerFrame()
+{
+    InputEvent event;
+    event.type = Type::PointerFrame;
+    return event;
+}
+
+InputEvent InputEvent::keyboardKey(quint32 timestamp, quint32 keyCode, KeyboardKeyState state)
+{
+    InputEvent event;
+    event.type = Type::KeyboardKey;
+    event.timestamp = timestamp;
+    event.code = keyCode;
+    event.state = quint32(state);
+    return event;
+}
+
+InputEvent InputEvent::keyboardModifiers(quint32 depressed, quint32 latched, quint32 locked, quint32 group)
+{
+    InputEvent event;
+    event.type = Type::KeyboardModifiers;
+    event.depressed = depressed;
+    event.latched = latched;
+    event.locked = locked;
+    event.group = group;
+    return event;
+}
+
+InputEvent InputEvent::touchDown(quint32 timestamp, qint32 id, const QPointF &position)
+{
+    InputEvent event;
+    event.type = Type::TouchDown;
+    event.timestamp = timestamp;
+    event.id = id;
+    event.position = position;
+    return event;
+}
+
+InputEvent InputEvent::touchMotion(quint32 timestamp, qint32 id, const QPointF &position)
+{
+    InputEvent event;
+    event.type = Type::TouchMotion;
+    event.timestamp = timestamp;
+    event.id = id;
+    event.position = position;
+    return event;
+}
+
+InputEvent InputEvent::touchUp(quint32 timestamp, qint32 id)
+{
+    InputEvent event;
+    event.type = Type::TouchUp;
+    event.timestamp = timestamp;
+    event.id = id;
+    return event;
+}
+
+InputEvent InputEvent::touchFrame()
+{
+    InputEvent event;
+    event.type = Type::TouchFrame;
+    return event;
+}
+
+InputEvent InputEvent::touchCancel()
+{
+    InputEvent event;
+    event.type = Type::TouchCancel;
+    return event;
+}
+
 SeatInterfacePrivate *SeatInterfacePrivate::get(SeatInterface *seat)
 {
     return seat->d.data();
@@ -457,21 +564,32 @@ void SeatInterface::notifyPointerMotion(const QPointF &pos)
     d->globalPointer.pos = pos;
     Q_EMIT pointerPosChanged(pos);
 
-    SurfaceInterface *focusedSurface = focusedPointerSurface();
-    if (!focusedSurface) {
+    if (d->motionCoalescing.enabled) {
+        // sent by notifyPointerFrame(), along with the focus checks and the hit test
+        d->motionCoalescing.pending = true;
+        d->motionCoalescing.timestamp = d->timestamp;
         return;
     }
-    if (isDragPointer()) {
+    d->sendPointerMotion();
+}
+
+bool SeatInterfacePrivate::sendPointerMotion()
+{
+    SurfaceInterface *focusedSurface = q->focusedPointerSurface();
+    if (!focusedSurface) {
+        return false;
+    }
+    if (q->isDragPointer()) {
         // data device will handle it directly
         // for xwayland cases we still want to send pointer events
-        if (!d->dataDevicesForSurface(focusedSurface).isEmpty())
-            return;
+        if (!dataDevicesForSurface(focusedSurface).isEmpty())
+            return false;
     }
     if (focusedSurface->lockedPointer() && focusedSurface->lockedPointer()->isLocked()) {
-        return;
+        return false;
     }
 
-    QPointF localPosition = focusedPointerSurfaceTransformation().map(pos);
+    QPointF localPosition = q->focusedPointerSurfaceTransformation().map(globalPointer.pos);
     SurfaceInterface *effectiveFocusedSurface = focusedSurface->inputSurfaceAt(localPosition);
     if (!effectiveFocusedSurface) {
         effectiveFocusedSurface = focusedSurface;
@@ -480,11 +598,66 @@ void SeatInterface::notifyPointerMotion(const QPointF &pos)
         localPosition = focusedSurface->mapToChild(effectiveFocusedSurface, localPosition);
     }
 
-    if (d->pointer->focusedSurface() != effectiveFocusedSurface) {
-        d->pointer->sendEnter(effectiveFocusedSurface, localPosition, display()->nextSerial());
+    if (pointer->focusedSurface() != effectiveFocusedSurface) {
+        pointer->sendEnter(effectiveFocusedSurface,
+                           localPosition,
+                           display->serialTracker()->next(SerialTracker::EventType::PointerEnter, q, effectiveFocusedSurface));
+    }
+
+    pointer->sendMotion(localPosition);
+    return true;
+}
+
+bool SeatInterfacePrivate::flushPointerMotion()
+{
+    if (!motionCoalescing.pending) {
+        return false;
     }
+    motionCoalescing.pending = false;
+    motionCoalescing.lastMotion.start();
 
-    d->pointer->sendMotion(localPosition);
+    // the motion carries the time it happened at, not that of the event it is flushed for
+    const quint32 currentTimestamp = std::exchange(timestamp, motionCoalescing.timestamp);
+    const bool sent = sendPointerMotion();
+    timestamp = currentTimestamp;
+    return sent;
+}
+
+void SeatInterfacePrivate::dropPointerMotion()
+{
+    motionCoalescing.pending = false;
+    if (motionCoalescing.timer) {
+        motionCoalescing.timer->stop();
+    }
+}
+
+void SeatInterface::setPointerMotionCoalescingEnabled(bool enabled)
+{
+    if (d->motionCoalescing.enabled == enabled) {
+        return;
+    }
+    if (!enabled && d->pointer) {
+        if (d->flushPointerMotion()) {
+            d->pointer->sendFrame();
+        }
+        d->dropPointerMotion();
+    }
+    d->motionCoalescing.enabled = enabled;
+}
+
+bool SeatInterface::isPointerMotionCoalescingEnabled() const
+{
+    return d->motionCoalescing.enabled;
+}
+
+void SeatInterface::setPointerMotionCoalescingWindow(std::chrono::microseconds window)
+{
+    d->motionCoalescing.window = std::max(window, std::chrono::microseconds::zero());
+}
+
+std::chrono::microseconds SeatInterface::pointerMotionCoalescingWindow() const
+{
+    return d->motionCoalescing.window;
 }
 
 quint32 SeatInterface::timestamp() const
@@ -572,7 +745,8 @@ void SeatInterface::notifyPointerEnter(SurfaceInterface *surface, const QPointF
         return;
     }
 
-    const quint32 serial = d->display->nextSerial();
+    // the enter event carries the position
+    d->dropPointerMotion();
 
     if (d->globalPointer.focus.surface) {
         disconnect(d->globalPointer.focus.destroyConnection);
@@ -582,7 +756,6 @@ void SeatInterface::notifyPointerEnter(SurfaceInterface *surface, const QPointF
     d->globalPointer.focus.destroyConnection = connect(surface, &QObject::destroyed, this, [this] {
         d->globalPointer.focus = SeatInterfacePrivate::Pointer::Focus();
     });
-    d->globalPointer.focus.serial = serial;
     d->globalPointer.focus.transformation = transformation;
     d->globalPointer.focus.offset = QPointF();
 
@@ -595,6 +768,9 @@ void SeatInterface::notifyPointerEnter(SurfaceInterface *surface, const QPointF
     if (surface != effectiveFocusedSurface) {
         localPosition = surface->mapToChild(effectiveFocusedSurface, localPosition);
     }
+
+    const quint32 serial = d->display->serialTracker()->next(SerialTracker::EventType::PointerEnter, this, effectiveFocusedSurface);
+    d->globalPointer.focus.serial = serial;
     d->pointer->sendEnter(effectiveFocusedSurface, localPosition, serial);
 }
 
@@ -608,6 +784,8 @@ void SeatInterface::notifyPointerLeave()
         return;
     }
 
+    d->dropPointerMotion();
+
     if (d->globalPointer.focus.surface) {
         disconnect(d->globalPointer.focus.destroyConnection);
     }
@@ -695,6 +873,7 @@ void SeatInterface::notifyPointerAxis(Qt::Orientation orientation, qreal delta,
         // ignore
         return;
     }
+    d->flushPointerMotion();
     d->pointer->sendAxis(orientation, delta, discreteDelta, source);
 }
 
@@ -712,7 +891,11 @@ void SeatInterface::notifyPointerButton(quint32 button, PointerButtonState state
     if (!d->pointer) {
         return;
     }
-    const quint32 serial = d->display->nextSerial();
+    d->flushPointerMotion();
+
+    const SerialTracker::EventType eventType =
+        state == PointerButtonState::Pressed ? SerialTracker::EventType::PointerButtonPress : SerialTracker::EventType::PointerButtonRelease;
+    const quint32 serial = d->display->serialTracker()->next(eventType, this, d->pointer->focusedSurface(), button);
 
     if (state == PointerButtonState::Pressed) {
         d->updatePointerButtonSerial(button, serial);
@@ -743,6 +926,35 @@ void SeatInterface::notifyPointerFrame()
     if (!d->pointer) {
         return;
     }
+
+    SeatInterfacePrivate::MotionCoalescing &coalescing = d->motionCoalescing;
+    if (coalescing.pending) {
+        const auto elapsed = std::chrono::nanoseconds(coalescing.lastMotion.isValid() ? coalescing.lastMotion.nsecsElapsed() : 0);
+        if (!coalescing.lastMotion.isValid() || elapsed >= coalescing.window) {
+            d->flushPointerMotion();
+        } else {
+            if (!coalescing.timer) {
+                coalescing.timer = new QTimer(this);
+                coalescing.timer->setSingleShot(true);
+                coalescing.timer->setTimerType(Qt::PreciseTimer);
+                connect(coalescing.timer, &QTimer::timeout, this, [this]() {
+                    if (d->pointer && d->flushPointerMotion()) {
+                        d->motionCoalescing.frameNeeded = false;
+                        d->pointer->sendFrame();
+                    }
+                });
+            }
+            if (!coalescing.timer->isActive()) {
+                coalescing.timer->start(std::chrono::ceil<std::chrono::milliseconds>(coalescing.window - elapsed));
+            }
+            // the frame is sent along with the motion
+            if (!coalescing.frameNeeded) {
+                return;
+            }
+        }
+    }
+
+    coalescing.frameNeeded = false;
     d->pointer->sendFrame();
 }
 
@@ -769,6 +981,8 @@ void SeatInterface::relativePointerMotion(const QSizeF &delta, const QSizeF &del
     auto relativePointer = RelativePointerV1Interface::get(pointer());
     if (relativePointer) {
         relativePointer->sendRelativeMotion(delta, deltaNonAccelerated, microseconds);
+        // every relative delta is delivered in time, even if the absolute motion is withheld
+        d->motionCoalescing.frameNeeded = true;
     }
 }
 
@@ -915,7 +1129,7 @@ void SeatInterface::setFocusedKeyboardSurface(SurfaceInterface *surface)
         return;
     }
 
-    const quint32 serial = d->display->nextSerial();
+    const quint32 serial = surface ? d->display->serialTracker()->next(SerialTracker::EventType::KeyboardEnter, this, surface) : d->display->nextSerial();
 
     if (d->globalKeyboard.focus.surface) {
         disconnect(d->globalKeyboard.focus.destroyConnection);
@@ -1067,7 +1281,7 @@ void SeatInterface::notifyTouchDown(qint32 id, const QPointF &globalPosition)
     if (!d->touch) {
         return;
     }
-    const qint32 serial = display()->nextSerial();
+    const qint32 serial = d->display->serialTracker()->next(SerialTracker::EventType::TouchDown, this, focusedTouchSurface(), id);
     const auto pos = globalPosition - d->globalTouch.focus.offset;
     d->touch->sendDown(id, serial, pos);
 
@@ -1077,7 +1291,7 @@ void SeatInterface::notifyTouchDown(qint32 id, const QPointF &globalPosition)
 
     if (id == 0 && hasPointer() && focusedTouchSurface()) {
         TouchInterfacePrivate *touchPrivate = TouchInterfacePrivate::get(d->touch.data());
-        if (touchPrivate->touchesForClient(focusedTouchSurface()->client()).isEmpty()) {
+        if (touchPrivate->focusedResources.isEmpty()) {
             // If the client did not bind the touch interface fall back
             // to at least emulating touch through pointer events.
             d->pointer->sendEnter(focusedTouchSurface(), pos, serial);
@@ -1113,7 +1327,7 @@ void SeatInterface::notifyTouchMotion(qint32 id, const QPointF &globalPosition)
 
         if (hasPointer() && focusedTouchSurface()) {
             TouchInterfacePrivate *touchPrivate = TouchInterfacePrivate::get(d->touch.data());
-            if (touchPrivate->touchesForClient(focusedTouchSurface()->client()).isEmpty()) {
+            if (touchPrivate->focusedResources.isEmpty()) {
                 // Client did not bind touch, fall back to emulating with pointer events.
                 d->pointer->sendMotion(pos);
                 d->pointer->sendFrame();
@@ -1135,7 +1349,7 @@ void SeatInterface::notifyTouchUp(qint32 id)
         qCWarning(KWAYLAND_SERVER) << "Detected a touch that never started, discarding";
         return;
     }
-    const qint32 serial = d->display->nextSerial();
+    const qint32 serial = d->display->serialTracker()->next(SerialTracker::EventType::TouchUp, this, focusedTouchSurface(), id);
     if (d->drag.mode == SeatInterfacePrivate::Drag::Mode::Touch && d->drag.dragImplicitGrabSerial == d->globalTouch.ids.value(id)) {
         // the implicitly grabbing touch point has been upped
         d->endDrag();
@@ -1144,7 +1358,7 @@ void SeatInterface::notifyTouchUp(qint32 id)
 
     if (id == 0 && hasPointer() && focusedTouchSurface()) {
         TouchInterfacePrivate *touchPrivate = TouchInterfacePrivate::get(d->touch.data());
-        if (touchPrivate->touchesForClient(focusedTouchSurface()->client()).isEmpty()) {
+        if (touchPrivate->focusedResources.isEmpty()) {
             // Client did not bind touch, fall back to emulating with pointer events.
             const quint32 serial = display()->nextSerial();
             d->pointer->sendButton(BTN_LEFT, PointerButtonState::Released, serial);
@@ -1169,9 +1383,142 @@ bool SeatInterface::hasImplicitTouchGrab(quint32 serial) const
         // origin surface has been destroyed
         return false;
     }
+    if (const SerialTracker::Event *event = d->display->serialTracker()->find(serial)) {
+        if (event->seat != this || event->type != SerialTracker::EventType::TouchDown) {
+            return false;
+        }
+        const auto it = d->globalTouch.ids.constFind(qint32(event->detail));
+        return it != d->globalTouch.ids.constEnd() && *it == serial;
+    }
+    // all touch down serials are tracked, so a recent serial the tracker doesn't know isn't one
+    if (d->display->serial() - serial < quint32(SerialTracker::capacity())) {
+        return false;
+    }
     return d->globalTouch.ids.key(serial, -1) != -1;
 }
 
+void SeatInterface::processInputBatch(const QVector<InputEvent> &events)
+{
+    const quint32 initialTimestamp = d->timestamp;
+
+    // the latest motion of the pointer and of every touch point in the current frame
+    std::optional<InputEvent> pointerMotion;
+    QVarLengthArray<InputEvent, 10> touchMotions;
+    bool pointerFrameNeeded = false;
+    bool touchFrameNeeded = false;
+
+    auto flushPointerMotion = [this, &pointerMotion]() {
+        if (pointerMotion) {
+            d->timestamp = pointerMotion->timestamp;
+            notifyPointerMotion(pointerMotion->position);
+            pointerMotion.reset();
+        }
+    };
+    auto flushTouchMotions = [this, &touchMotions]() {
+        for (const InputEvent &motion : qAsConst(touchMotions)) {
+            d->timestamp = motion.timestamp;
+            notifyTouchMotion(motion.id, motion.position);
+        }
+        touchMotions.clear();
+    };
+
+    // flushing a withheld motion rewinds the timestamp, so it's restored after the batch
+    std::optional<quint32> latestTimestamp;
+
+    for (const InputEvent &event : events) {
+        switch (event.type) {
+        case InputEvent::Type::PointerFrame:
+        case InputEvent::Type::KeyboardModifiers:
+        case InputEvent::Type::TouchFrame:
+        case InputEvent::Type::TouchCancel:
+            break;
+        default:
+            latestTimestamp = latestTimestamp ? std::max(*latestTimestamp, event.timestamp) : event.timestamp;
+            break;
+        }
+
+        switch (event.type) {
+        case InputEvent::Type::PointerMotion:
+            pointerMotion = event;
+            pointerFrameNeeded = true;
+            break;
+        case InputEvent::Type::PointerButton:
+            flushPointerMotion();
+            d->timestamp = event.timestamp;
+            notifyPointerButton(event.code, PointerButtonState(event.state));
+            pointerFrameNeeded = true;
+            break;
+        case InputEvent::Type::PointerAxis:
+            flushPointerMotion();
+            d->timestamp = event.timestamp;
+            notifyPointerAxis(event.orientation, event.delta, event.discreteDelta, event.axisSource);
+            pointerFrameNeeded = true;
+            break;
+        case InputEvent::Type::PointerFrame:
+            flushPointerMotion();
+            if (pointerFrameNeeded) {
+                notifyPointerFrame();
+                pointerFrameNeeded = false;
+            }
+            break;
+        case InputEvent::Type::KeyboardKey:
+            d->timestamp = event.timestamp;
+            notifyKeyboardKey(event.code, KeyboardKeyState(event.state));
+            break;
+        case InputEvent::Type::KeyboardModifiers:
+            notifyKeyboardModifiers(event.depressed, event.latched, event.locked, event.group);
+            break;
+        case InputEvent::Type::TouchDown:
+            flushTouchMotions();
+            d->timestamp = event.timestamp;
+            notifyTouchDown(event.id, event.position);
+            touchFrameNeeded = true;
+            break;
+        case InputEvent::Type::TouchMotion: {
+            auto it = std::find_if(touchMotions.begin(), touchMotions.end(), [&event](const InputEvent &motion) {
+                return motion.id == event.id;
+            });
+            if (it != touchMotions.end()) {
+                *it = event;
+            } else {
+                touchMotions.append(event);
+            }
+            touchFrameNeeded = true;
+            break;
+        }
+        case InputEvent::Type::TouchUp:
+            flushTouchMotions();
+            d->timestamp = event.timestamp;
+            notifyTouchUp(event.id);
+            touchFrameNeeded = true;
+            break;
+        case InputEvent::Type::TouchFrame:
+            flushTouchMotions();
+            if (touchFrameNeeded) {
+                notifyTouchFrame();
+                touchFrameNeeded = false;
+            }
+            break;
+        case InputEvent::Type::TouchCancel:
+            // the motions belong to the cancelled sequence
+            touchMotions.clear();
+            notifyTouchCancel();
+            touchFrameNeeded = false;
+            break;
+        }
+    }
+
+    flushPointerMotion();
+    flushTouchMotions();
+    if (latestTimestamp) {
+        d->timestamp = *latestTimestamp;
+    }
+
+    if (d->timestamp != initialTimestamp) {
+        Q_EMIT timestampChanged(d->timestamp);
+    }
+}
+
 bool SeatInterface::isDrag() const
 {
     return d->drag.mode != SeatInterfacePrivate::Drag::Mode::None;
@@ -1189,6 +1536,17 @@ bool SeatInterface::isDragTouch() const
 
 bool SeatInterface::hasImplicitPointerGrab(quint32 serial) const
 {
+    if (const SerialTracker::Event *event = d->display->serialTracker()->find(serial)) {
+        if (event->seat != this || event->type != SerialTracker::EventType::PointerButtonPress) {
+            return false;
+        }
+        return pointerButtonSerial(event->detail) == serial && isPointerButtonPressed(event->detail);
+    }
+    // all button serials are tracked, so a recent serial the tracker doesn't know isn't one
+    if (d->display->serial() - serial < quint32(SerialTracker::capacity())) {
+        return false;
+    }
+    // the serial is too old for the tracker, e.g. a button has been held during a long resize
     const auto &serials = d->globalPointer.buttonSerials;
     for (auto it = serials.constBegin(), end = serials.constEnd(); it != end; it++) {
         if (it.value() == serial) {
@@ -11,6 +11,9 @@
 #include <QMatrix4x4>
 #include <QObject>
 #include <QPoint>
+#include <QVector>
+
+#include <chrono>
 
 struct wl_client;
 struct wl_resource;
@@ -74,6 +77,69 @@ enum class KeyboardKeyState : quint32 {
     Pressed = 1,
 };
 
+/**
+ * @brief An input event for SeatInterface::processInputBatch().
+ *
+ * Use the static factory functions to create the events. Depending on the type, only some of the
+ * members are meaningful. The timestamp is ignored by frame, cancel and modifier events.
+ */
+struct KWAYLANDSERVER_EXPORT InputEvent
+{
+    enum class Type {
+        PointerMotion,
+        PointerButton,
+        PointerAxis,
+        PointerFrame,
+        KeyboardKey,
+        KeyboardModifiers,
+        TouchDown,
+        TouchMotion,
+        TouchUp,
+        TouchFrame,
+        TouchCancel,
+    };
+
+    static InputEvent pointerMotion(quint32 timestamp, const QPointF &position);
+    static InputEvent pointerButton(quint32 timestamp, quint32 button, PointerButtonState state);
+    static InputEvent pointerAxis(quint32 timestamp, Qt::Orientation orientation, qreal delta, qint32 discreteDelta, PointerAxisSource source);
+    static InputEvent pointerFrame();
+    static InputEvent keyboardKey(quint32 timestamp, quint32 keyCode, KeyboardKeyState state);
+    static InputEvent keyboardModifiers(quint32 depressed, quint32 latched, quint32 locked, quint32 group);
+    static InputEvent touchDown(quint32 timestamp, qint32 id, const QPointF &position);
+    static InputEvent touchMotion(quint32 timestamp, qint32 id, const QPointF &position);
+    static InputEvent touchUp(quint32 timestamp, qint32 id);
+    static InputEvent touchFrame();
+    static InputEvent touchCancel();
+
+    Type type = Type::PointerFrame;
+    quint32 timestamp = 0;
+    /**
+     * The global position of pointer motion, touch down and touch motion events.
+     */
+    QPointF position;
+    /**
+     * The button of pointer button events or the key code of keyboard key events.
+     */
+    quint32 code = 0;
+    /**
+     * The state of pointer button and keyboard key events, a PointerButtonState or a
+     * KeyboardKeyState.
+     */
+    quint32 state = 0;
+    /**
+     * The id of the touch point of touch down, motion and up events.
+     */
+    qint32 id = 0;
+    Qt::Orientation orientation = Qt::Vertical;
+    qreal delta = 0;
+    qint32 discreteDelta = 0;
+    PointerAxisSource axisSource = PointerAxisSource::Unknown;
+    quint32 depressed = 0;
+    quint32 latched = 0;
+    quint32 locked = 0;
+    quint32 group = 0;
+};
+
 /**
  * @brief Represents a Seat on the Wayland Display.
  *
@@ -240,9 +306,35 @@ public:
     /**
      * Updates the global pointer @p pos.
      *
-     * Sends a pointer motion event to the focused pointer surface.
+     * Sends a pointer motion event to the focused pointer surface, unless pointer motion
+     * coalescing is enabled.
+     *
+     * @see setPointerMotionCoalescingEnabled
      */
     void notifyPointerMotion(const QPointF &pos);
+    /**
+     * Sets whether pointer motion is coalesced. If enabled, notifyPointerMotion() only updates
+     * the pointer position, the focused pointer surface is sent a single motion event with
+     * the latest position by the next notifyPointerFrame(). With a coalescing window, motion
+     * is sent at most once per window, see setPointerMotionCoalescingWindow().
+     *
+     * The withheld motion is sent before any button or axis event, so they are never
+     * reordered. Relative pointer motion is never coalesced.
+     *
+     * This is useful for pointer devices with a high polling rate, whose events would outnumber
+     * the frames the clients render by far. Coalescing is disabled by default.
+     */
+    void setPointerMotionCoalescingEnabled(bool enabled);
+    bool isPointerMotionCoalescingEnabled() const;
+    /**
+     * Sets the time after sending a pointer motion event during which further motion is
+     * withheld to @p window. The latest position is sent by the first notifyPointerFrame()
+     * after the window, or when the window ends, whichever happens first.
+     *
+     * The default window of zero coalesces only the motion between two notifyPointerFrame() calls.
+     */
+    void setPointerMotionCoalescingWindow(std::chrono::microseconds window);
+    std::chrono::microseconds pointerMotionCoalescingWindow() const;
     /**
      * @returns the global pointer position
      */
@@ -593,6 +685,24 @@ public:
     bool hasImplicitTouchGrab(quint32 serial) const;
     ///@}
 
+    /**
+     * Processes a sequence of input @p events, as if the matching notify methods were called
+     * one after another, with the timestamp of the seat set to that of each event.
+     *
+     * Compositors that drain the input devices in bursts should prefer this over the notify
+     * methods. Within a logical frame, that is between two frame events of the same device,
+     * the motion of the pointer and of every touch point is merged into a single event with
+     * the latest position, so the focus checks and the hit test run once per frame rather
+     * than once per motion. The merged motion is sent before any other event of that device,
+     * so nothing is reordered. A frame event is only sent if the frame has events. The
+     * pointerPosChanged() signal is emitted once per merged motion and timestampChanged() once
+     * per batch.
+     *
+     * A motion at the end of the batch that isn't followed by a frame event is sent without a
+     * frame, just like with the notify methods.
+     */
+    void processInputBatch(const QVector<InputEvent> &events);
+
     /**
      * @name Text input related methods.
      */
@@ -726,4 +836,5 @@ private:
 
 }
 
+Q_DECLARE_TYPEINFO(KWaylandServer::InputEvent, Q_MOVABLE_TYPE);
 Q_DECLARE_METATYPE(KWaylandServer::SeatInterface *)
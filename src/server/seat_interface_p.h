@@ -9,9 +9,11 @@
 // KWayland
 #include "seat_interface.h"
 // Qt
+#include <QElapsedTimer>
 #include <QHash>
 #include <QMap>
 #include <QPointer>
+#include <QTimer>
 #include <QVector>
 
 #include <optional>
@@ -91,6 +93,30 @@ public:
     Pointer globalPointer;
     void updatePointerButtonSerial(quint32 button, quint32 serial);
     void updatePointerButtonState(quint32 button, Pointer::State state);
+    /**
+     * Returns @c true if a motion event has been sent to the focused pointer surface.
+     */
+    bool sendPointerMotion();
+
+    struct MotionCoalescing
+    {
+        bool enabled = false;
+        std::chrono::microseconds window = std::chrono::microseconds::zero();
+        // a motion to the current pointer position is withheld
+        bool pending = false;
+        quint32 timestamp = 0;
+        // events that need a frame have been sent since the last frame, e.g. relative motion
+        bool frameNeeded = false;
+        QElapsedTimer lastMotion;
+        QTimer *timer = nullptr;
+    };
+    MotionCoalescing motionCoalescing;
+    /**
+     * Sends the withheld pointer motion, if any, so it isn't overtaken by other events.
+     * Returns @c true if a motion event has actually been sent.
+     */
+    bool flushPointerMotion();
+    void dropPointerMotion();
 
     // Keyboard related members
     struct Keyboard
@@ -0,0 +1,80 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "serialtracker.h"
+#include "display.h"
+#include "seat_interface.h"
+#include "surface_interface.h"
+
+#include <array>
+
+namespace KWaylandServer
+{
+// Must be a power of two, the serial modulo the capacity is the index of its event.
+static const int s_capacity = 256;
+
+class SerialTrackerPrivate
+{
+public:
+    Display *display;
+    std::array<SerialTracker::Event, s_capacity> events;
+};
+
+SerialTracker::SerialTracker(Display *display)
+    : d(new SerialTrackerPrivate)
+{
+    d->display = display;
+}
+
+SerialTracker::~SerialTracker()
+{
+}
+
+int SerialTracker::capacity()
+{
+    return s_capacity;
+}
+
+quint32 SerialTracker::next(EventType type, SeatInterface *seat, SurfaceInterface *surface, quint32 detail)
+{
+    const quint32 serial = d->display->nextSerial();
+
+    Event &event = d->events[serial & (s_capacity - 1)];
+    event.serial = serial;
+    event.type = type;
+    event.detail = detail;
+    event.timestamp = seat ? seat->timestamp() : 0;
+    event.seat = seat;
+    event.surface = surface;
+
+    return serial;
+}
+
+const SerialTracker::Event *SerialTracker::find(quint32 serial) const
+{
+    const Event &event = d->events[serial & (s_capacity - 1)];
+    // default constructed events have no type, that also rules out serial 0
+    if (event.serial != serial || event.type == EventType()) {
+        return nullptr;
+    }
+    return &event;
+}
+
+bool SerialTracker::isValid(quint32 serial, EventTypes types, SeatInterface *seat, SurfaceInterface *surface) const
+{
+    const Event *event = find(serial);
+    if (!event || !types.testFlag(event->type)) {
+        return false;
+    }
+    if (seat && event->seat != seat) {
+        return false;
+    }
+    if (surface && event->surface != surface) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace KWaylandServer
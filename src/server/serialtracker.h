@@ -0,0 +1,104 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#pragma once
+
+#include <KWaylandServer/kwaylandserver_export.h>
+
+#include <QFlags>
+#include <QPointer>
+#include <QScopedPointer>
+
+namespace KWaylandServer
+{
+class Display;
+class SeatInterface;
+class SerialTrackerPrivate;
+class SurfaceInterface;
+
+/**
+ * @brief Remembers which input event a serial has been sent with.
+ *
+ * Requests such as xdg_toplevel.move, xdg_popup.grab, wl_data_device.start_drag or
+ * xdg_activation_v1 tokens carry the serial of the input event that triggered them. The
+ * SerialTracker keeps the most recent serials that the seats have sent along with pointer,
+ * keyboard and touch events, tagged with the type of the event, the seat, the surface and the
+ * timestamp, so these requests can be validated in constant time.
+ *
+ * The events are stored in a fixed size ring that is indexed by the serial. A serial is
+ * remembered at least until the Display has handed out capacity() newer serials, tracked or
+ * not, and is forgotten when a newer tracked serial takes its place in the ring.
+ *
+ * @see Display::serialTracker()
+ */
+class KWAYLANDSERVER_EXPORT SerialTracker
+{
+public:
+    enum class EventType {
+        PointerEnter = 1 << 0,
+        PointerButtonPress = 1 << 1,
+        PointerButtonRelease = 1 << 2,
+        KeyboardEnter = 1 << 3,
+        KeyboardKeyPress = 1 << 4,
+        KeyboardKeyRelease = 1 << 5,
+        TouchDown = 1 << 6,
+        TouchUp = 1 << 7,
+    };
+    Q_DECLARE_FLAGS(EventTypes, EventType)
+
+    struct Event
+    {
+        quint32 serial = 0;
+        EventType type = EventType();
+        /**
+         * The button, key or touch point id, depending on the type.
+         */
+        quint32 detail = 0;
+        /**
+         * The timestamp of the seat when the event has been sent.
+         */
+        quint32 timestamp = 0;
+        SeatInterface *seat = nullptr;
+        /**
+         * The surface the event has been sent to, or @c null if it has been destroyed since.
+         */
+        QPointer<SurfaceInterface> surface;
+    };
+
+    ~SerialTracker();
+
+    /**
+     * Returns the number of serials that are remembered.
+     */
+    static int capacity();
+
+    /**
+     * Hands out the next serial of the Display and records that it is sent with an event of
+     * the given @p type by the @p seat to the @p surface.
+     */
+    quint32 next(EventType type, SeatInterface *seat, SurfaceInterface *surface, quint32 detail = 0);
+
+    /**
+     * Returns the event the @p serial has been sent with, or @c null if the serial is unknown or
+     * too old. The returned event is valid until the next call to next().
+     */
+    const Event *find(quint32 serial) const;
+
+    /**
+     * Returns @c true if the @p serial has been sent with an event of one of the given @p types.
+     * If @p seat or @p surface are not @c null, the event must have been sent by that seat or to
+     * that surface, respectively.
+     */
+    bool isValid(quint32 serial, EventTypes types, SeatInterface *seat = nullptr, SurfaceInterface *surface = nullptr) const;
+
+private:
+    explicit SerialTracker(Display *display);
+    friend class Display;
+    QScopedPointer<SerialTrackerPrivate> d;
+};
+
+} // namespace KWaylandServer
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KWaylandServer::SerialTracker::EventTypes)
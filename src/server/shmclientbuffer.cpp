@@ -7,40 +7,283 @@
 #include "shmclientbuffer.h"
 #include "clientbuffer_p.h"
 #include "display.h"
+#include "display_p.h"
+#include "drm_fourcc.h"
+#include "logging.h"
+
+#include "qwayland-server-wayland.h"
+
+#include <QPointer>
+#include <QSharedPointer>
 
 #include <wayland-server-core.h>
 #include <wayland-server-protocol.h>
 
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <signal.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#if __has_include(<linux/udmabuf.h>)
+#include <linux/udmabuf.h>
+#define HAVE_UDMABUF 1
+#else
+#define HAVE_UDMABUF 0
+#endif
+
 namespace KWaylandServer
 {
 static const ShmClientBuffer *s_accessedBuffer = nullptr;
 static int s_accessCounter = 0;
 
-class ShmClientBufferPrivate : public ClientBufferPrivate
+// The formats supported in addition to argb8888 and xrgb8888.
+static const uint32_t s_extraShmFormats[] = {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    WL_SHM_FORMAT_ARGB2101010,
+    WL_SHM_FORMAT_XRGB2101010,
+    WL_SHM_FORMAT_ABGR2101010,
+    WL_SHM_FORMAT_XBGR2101010,
+    WL_SHM_FORMAT_ABGR16161616,
+    WL_SHM_FORMAT_XBGR16161616,
+#endif
+};
+
+/**
+ * The /dev/udmabuf device. It's shared by the integration and the shm pools, so buffers
+ * can be promoted to dma-bufs after the integration has been destroyed.
+ */
+class UdmabufDevice
+{
+public:
+    explicit UdmabufDevice(int fd)
+        : fd(fd)
+    {
+    }
+    ~UdmabufDevice()
+    {
+        close(fd);
+    }
+
+    int fd;
+};
+
+/**
+ * The mapping of a wl_shm_pool created by the ShmClientBufferIntegration. It's shared by the
+ * pool and all buffers created from it, so the buffers can be accessed and promoted to
+ * dma-bufs after the pool has been destroyed.
+ */
+class ShmPoolMemory
 {
 public:
-    ShmClientBufferPrivate(ShmClientBuffer *q);
+    ShmPoolMemory(char *data, qint64 size, int fd, bool promotable, const QSharedPointer<UdmabufDevice> &udmabuf);
+    ~ShmPoolMemory();
+
+    bool resize(qint64 size);
+    void beginAccess();
+    bool endAccess();
+
+    char *data;
+    qint64 size;
+    qint64 pendingSize = 0;
+    int accessCount = 0;
+    bool faulted = false;
+    // Whether the pool is sealed against shrinking and the file covers the whole mapping, so
+    // accessing it can't raise SIGBUS.
+    bool sigbusImpossible = false;
+    // The memfd of the pool if it's sealed against shrinking, otherwise -1.
+    int fd;
+    // Whether the buffers of the pool can be promoted to dma-bufs.
+    bool promotable;
+    QSharedPointer<UdmabufDevice> udmabuf;
+
+private:
+    bool finishResize();
+    void updateSigbusImpossible();
+};
+
+/**
+ * The pool that is being accessed on the current thread, see ShmClientBuffer::data().
+ */
+struct ShmSigbusData
+{
+    ShmPoolMemory *memory = nullptr;
+    int accessCount = 0;
+};
+
+static thread_local ShmSigbusData s_sigbusData;
+static struct sigaction s_previousSigbusAction;
+
+static void reraiseSigbus()
+{
+    sigaction(SIGBUS, &s_previousSigbusAction, nullptr);
+    raise(SIGBUS);
+}
+
+static void sigbusHandler(int signum, siginfo_t *info, void *context)
+{
+    Q_UNUSED(signum)
+    Q_UNUSED(context)
+
+    // Only faults in the pool that is being accessed can be caused by a client truncating it.
+    ShmPoolMemory *memory = s_sigbusData.memory;
+    const char *address = static_cast<const char *>(info->si_addr);
+    if (!memory || address < memory->data || address >= memory->data + memory->size) {
+        reraiseSigbus();
+        return;
+    }
+
+    // Replace the mapping with anonymous memory, the client gets an error when the access ends.
+    if (mmap(memory->data, memory->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0) == MAP_FAILED) {
+        reraiseSigbus();
+        return;
+    }
+    memory->faulted = true;
+}
+
+static void installSigbusHandler()
+{
+    static std::once_flag once;
+    std::call_once(once, []() {
+        struct sigaction action = {};
+        action.sa_sigaction = sigbusHandler;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGBUS, &action, &s_previousSigbusAction);
+    });
+}
+
+ShmPoolMemory::ShmPoolMemory(char *data, qint64 size, int fd, bool promotable, const QSharedPointer<UdmabufDevice> &udmabuf)
+    : data(data)
+    , size(size)
+    , fd(fd)
+    , promotable(promotable)
+    , udmabuf(udmabuf)
+{
+    updateSigbusImpossible();
+}
+
+ShmPoolMemory::~ShmPoolMemory()
+{
+    munmap(data, size);
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool ShmPoolMemory::resize(qint64 size)
+{
+    pendingSize = size;
+    // The images returned by ShmClientBuffer::data() point into the mapping and mremap() may
+    // move it, so the resize is deferred until the pool isn't accessed anymore.
+    if (accessCount) {
+        return true;
+    }
+    return finishResize();
+}
+
+bool ShmPoolMemory::finishResize()
+{
+    void *newData = mremap(data, size, pendingSize, MREMAP_MAYMOVE);
+    if (newData == MAP_FAILED) {
+        pendingSize = 0;
+        return false;
+    }
+    data = static_cast<char *>(newData);
+    size = std::exchange(pendingSize, 0);
+    updateSigbusImpossible();
+    return true;
+}
+
+void ShmPoolMemory::updateSigbusImpossible()
+{
+    // The seal only guarantees that the file doesn't get smaller, a client can still declare
+    // a pool that is larger than the file. It can grow in the meantime, so check it again.
+    struct stat info;
+    sigbusImpossible = fd != -1 && fstat(fd, &info) == 0 && info.st_size >= size;
+}
+
+void ShmPoolMemory::beginAccess()
+{
+    if (!sigbusImpossible) {
+        installSigbusHandler();
+        Q_ASSERT(!s_sigbusData.memory || s_sigbusData.memory == this);
+        s_sigbusData.memory = this;
+        s_sigbusData.accessCount++;
+    }
+    accessCount++;
+}
+
+/**
+ * Returns @c false if the client has truncated the pool while it was accessed.
+ */
+bool ShmPoolMemory::endAccess()
+{
+    if (!sigbusImpossible) {
+        Q_ASSERT(s_sigbusData.memory == this);
+        if (--s_sigbusData.accessCount == 0) {
+            s_sigbusData.memory = nullptr;
+        }
+    }
+    if (--accessCount == 0 && pendingSize) {
+        if (!finishResize()) {
+            qCWarning(KWAYLAND_SERVER) << "Failed to resize a shm pool:" << strerror(errno);
+        }
+    }
+    return !std::exchange(faulted, false);
+}
+
+class ShmClientBufferPrivate : public ClientBufferPrivate, public QtWaylandServer::wl_buffer
+{
+public:
+    ~ShmClientBufferPrivate() override;
+
+    void setShmFormat(uint32_t format);
 
     static void buffer_destroy_callback(wl_listener *listener, void *data);
 
-    ShmClientBuffer *q;
+    ShmClientBuffer *q = nullptr;
     QImage::Format format = QImage::Format_Invalid;
     uint32_t width = 0;
     uint32_t height = 0;
+    uint32_t stride = 0;
+    uint32_t shmFormat = 0;
     bool hasAlphaChannel = false;
     QImage savedData;
 
+    // Set if the buffer has been created by the ShmClientBufferIntegration rather than libwayland.
+    QSharedPointer<ShmPoolMemory> memory;
+    quint32 offset = 0;
+    mutable bool dmaBufCreated = false;
+    mutable LinuxDmaBufV1Plane dmaBufPlane;
+
     struct DestroyListener
     {
         wl_listener listener;
         ShmClientBufferPrivate *receiver;
     };
     DestroyListener destroyListener;
+
+protected:
+    void buffer_destroy(Resource *resource) override;
 };
 
-ShmClientBufferPrivate::ShmClientBufferPrivate(ShmClientBuffer *q)
-    : q(q)
+ShmClientBufferPrivate::~ShmClientBufferPrivate()
+{
+    if (dmaBufPlane.fd != -1) {
+        close(dmaBufPlane.fd);
+    }
+}
+
+void ShmClientBufferPrivate::buffer_destroy(Resource *resource)
 {
+    wl_resource_destroy(resource->handle);
 }
 
 static void cleanupShmPool(void *poolHandle)
@@ -111,16 +354,178 @@ static QImage::Format imageFormatForShmFormat(uint32_t format)
     }
 }
 
+void ShmClientBufferPrivate::setShmFormat(uint32_t format)
+{
+    shmFormat = format;
+    hasAlphaChannel = alphaChannelFromFormat(format);
+    this->format = imageFormatForShmFormat(format);
+}
+
+class ShmClientBufferIntegrationPrivate : public QtWaylandServer::wl_shm
+{
+public:
+    ShmClientBufferIntegrationPrivate(Display *display);
+
+    Display *display;
+    QSharedPointer<UdmabufDevice> udmabuf;
+
+protected:
+    void shm_bind_resource(Resource *resource) override;
+    void shm_create_pool(Resource *resource, uint32_t id, int32_t fd, int32_t size) override;
+};
+
+class ShmPool : public QtWaylandServer::wl_shm_pool
+{
+public:
+    ShmPool(Display *display, wl_resource *resource, const QSharedPointer<ShmPoolMemory> &memory);
+
+protected:
+    void shm_pool_destroy_resource(Resource *resource) override;
+    void shm_pool_create_buffer(Resource *resource, uint32_t id, int32_t offset, int32_t width, int32_t height, int32_t stride, uint32_t format) override;
+    void shm_pool_destroy(Resource *resource) override;
+    void shm_pool_resize(Resource *resource, int32_t size) override;
+
+private:
+    Display *m_display;
+    QSharedPointer<ShmPoolMemory> m_memory;
+};
+
+ShmClientBufferIntegrationPrivate::ShmClientBufferIntegrationPrivate(Display *display)
+    : QtWaylandServer::wl_shm(*display, 1)
+    , display(display)
+{
+#if HAVE_UDMABUF
+    const int fd = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (fd != -1) {
+        udmabuf = QSharedPointer<UdmabufDevice>::create(fd);
+    }
+#endif
+}
+
+void ShmClientBufferIntegrationPrivate::shm_bind_resource(Resource *resource)
+{
+    send_format(resource->handle, WL_SHM_FORMAT_ARGB8888);
+    send_format(resource->handle, WL_SHM_FORMAT_XRGB8888);
+    for (const uint32_t format : s_extraShmFormats) {
+        send_format(resource->handle, format);
+    }
+}
+
+void ShmClientBufferIntegrationPrivate::shm_create_pool(Resource *resource, uint32_t id, int32_t fd, int32_t size)
+{
+    if (Q_UNLIKELY(size <= 0)) {
+        wl_resource_post_error(resource->handle, error_invalid_stride, "invalid size (%d)", size);
+        close(fd);
+        return;
+    }
+
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (Q_UNLIKELY(data == MAP_FAILED)) {
+        wl_resource_post_error(resource->handle, error_invalid_fd, "failed mmap fd %d: %s", fd, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    // The fd of a pool that is sealed against shrinking is kept to check whether accessing the
+    // pool can raise SIGBUS. udmabuf only accepts memfds that are sealed against shrinking and
+    // not against writing.
+    const int seals = fcntl(fd, F_GET_SEALS);
+    const bool sealed = seals != -1 && (seals & F_SEAL_SHRINK);
+    const bool promotable = udmabuf && sealed && !(seals & F_SEAL_WRITE);
+    if (!sealed) {
+        close(fd);
+        fd = -1;
+    }
+    auto memory = QSharedPointer<ShmPoolMemory>::create(static_cast<char *>(data), size, fd, promotable, udmabuf);
+
+    wl_resource *poolResource = wl_resource_create(resource->client(), &wl_shm_pool_interface, resource->version(), id);
+    if (!poolResource) {
+        wl_resource_post_no_memory(resource->handle);
+        return;
+    }
+    new ShmPool(display, poolResource, memory);
+}
+
+ShmPool::ShmPool(Display *display, wl_resource *resource, const QSharedPointer<ShmPoolMemory> &memory)
+    : QtWaylandServer::wl_shm_pool(resource)
+    , m_display(display)
+    , m_memory(memory)
+{
+}
+
+void ShmPool::shm_pool_destroy_resource(Resource *resource)
+{
+    Q_UNUSED(resource)
+    delete this;
+}
+
+void ShmPool::shm_pool_destroy(Resource *resource)
+{
+    wl_resource_destroy(resource->handle);
+}
+
+static bool isShmFormatSupported(uint32_t format)
+{
+    if (format == WL_SHM_FORMAT_ARGB8888 || format == WL_SHM_FORMAT_XRGB8888) {
+        return true;
+    }
+    return std::find(std::begin(s_extraShmFormats), std::end(s_extraShmFormats), format) != std::end(s_extraShmFormats);
+}
+
+void ShmPool::shm_pool_create_buffer(Resource *resource, uint32_t id, int32_t offset, int32_t width, int32_t height, int32_t stride, uint32_t format)
+{
+    if (Q_UNLIKELY(!isShmFormatSupported(format))) {
+        wl_resource_post_error(resource->handle, WL_SHM_ERROR_INVALID_FORMAT, "invalid format 0x%x", format);
+        return;
+    }
+
+    if (Q_UNLIKELY(offset < 0 || width <= 0 || height <= 0 || stride < width || INT32_MAX / stride <= height
+                   || offset > m_memory->size - qint64(stride) * height)) {
+        wl_resource_post_error(resource->handle, WL_SHM_ERROR_INVALID_STRIDE, "invalid width, height or stride (%dx%d, %d)", width, height, stride);
+        return;
+    }
+
+    wl_resource *bufferResource = wl_resource_create(resource->client(), &wl_buffer_interface, 1, id);
+    if (!bufferResource) {
+        wl_resource_post_no_memory(resource->handle);
+        return;
+    }
+
+    auto bufferPrivate = new ShmClientBufferPrivate;
+    bufferPrivate->width = width;
+    bufferPrivate->height = height;
+    bufferPrivate->stride = stride;
+    bufferPrivate->setShmFormat(format);
+    bufferPrivate->memory = m_memory;
+    bufferPrivate->offset = offset;
+    bufferPrivate->init(bufferResource);
+    auto buffer = new ShmClientBuffer(bufferResource, *bufferPrivate);
+
+    DisplayPrivate::get(m_display)->registerClientBuffer(buffer);
+}
+
+void ShmPool::shm_pool_resize(Resource *resource, int32_t size)
+{
+    if (Q_UNLIKELY(size < m_memory->size)) {
+        wl_resource_post_error(resource->handle, WL_SHM_ERROR_INVALID_FD, "shrinking pool invalid");
+        return;
+    }
+    if (Q_UNLIKELY(!m_memory->resize(size))) {
+        wl_resource_post_error(resource->handle, WL_SHM_ERROR_INVALID_FD, "failed mremap");
+    }
+}
+
 ShmClientBuffer::ShmClientBuffer(wl_resource *resource)
-    : ClientBuffer(resource, *new ShmClientBufferPrivate(this))
+    : ClientBuffer(resource, *new ShmClientBufferPrivate)
 {
     Q_D(ShmClientBuffer);
+    d->q = this;
 
     wl_shm_buffer *buffer = wl_shm_buffer_get(resource);
     d->width = wl_shm_buffer_get_width(buffer);
     d->height = wl_shm_buffer_get_height(buffer);
-    d->hasAlphaChannel = alphaChannelFromFormat(wl_shm_buffer_get_format(buffer));
-    d->format = imageFormatForShmFormat(wl_shm_buffer_get_format(buffer));
+    d->stride = wl_shm_buffer_get_stride(buffer);
+    d->setShmFormat(wl_shm_buffer_get_format(buffer));
 
     // The underlying shm pool will be referenced if the wl_shm_buffer is destroyed so the
     // compositor can access buffer data even after the buffer is gone.
@@ -129,6 +534,14 @@ ShmClientBuffer::ShmClientBuffer(wl_resource *resource)
     wl_resource_add_destroy_listener(resource, &d->destroyListener.listener);
 }
 
+ShmClientBuffer::ShmClientBuffer(wl_resource *resource, ShmClientBufferPrivate &dd)
+    : ClientBuffer(resource, dd)
+{
+    // The buffer keeps the pool memory mapped, there's no need to save the data when the
+    // wl_buffer is destroyed.
+    dd.q = this;
+}
+
 QSize ShmClientBuffer::size() const
 {
     Q_D(const ShmClientBuffer);
@@ -146,16 +559,40 @@ ClientBuffer::Origin ShmClientBuffer::origin() const
     return Origin::TopLeft;
 }
 
-static void cleanupShmData(void *bufferHandle)
+static void endShmAccess()
 {
     Q_ASSERT_X(s_accessCounter > 0, "cleanup", "access counter must be positive");
     s_accessCounter--;
     if (s_accessCounter == 0) {
         s_accessedBuffer = nullptr;
     }
+}
+
+static void cleanupShmData(void *bufferHandle)
+{
+    endShmAccess();
     wl_shm_buffer_end_access(static_cast<wl_shm_buffer *>(bufferHandle));
 }
 
+/**
+ * An access to the memory of a shm pool created by the ShmClientBufferIntegration.
+ */
+struct ShmPoolAccess
+{
+    QSharedPointer<ShmPoolMemory> memory;
+    QPointer<ShmClientBuffer> buffer;
+};
+
+static void cleanupShmPoolData(void *accessHandle)
+{
+    endShmAccess();
+    auto access = static_cast<ShmPoolAccess *>(accessHandle);
+    if (!access->memory->endAccess() && access->buffer && access->buffer->resource()) {
+        wl_resource_post_error(access->buffer->resource(), WL_SHM_ERROR_INVALID_FD, "error accessing SHM buffer");
+    }
+    delete access;
+}
+
 QImage ShmClientBuffer::data() const
 {
     if (s_accessedBuffer && s_accessedBuffer != this) {
@@ -163,6 +600,14 @@ QImage ShmClientBuffer::data() const
     }
 
     Q_D(const ShmClientBuffer);
+    if (d->memory) {
+        s_accessedBuffer = this;
+        s_accessCounter++;
+        d->memory->beginAccess();
+        auto access = new ShmPoolAccess{d->memory, const_cast<ShmClientBuffer *>(this)};
+        const uchar *data = reinterpret_cast<const uchar *>(d->memory->data + d->offset);
+        return QImage(data, d->width, d->height, d->stride, d->format, cleanupShmPoolData, access);
+    }
     if (wl_shm_buffer *buffer = wl_shm_buffer_get(resource())) {
         s_accessedBuffer = this;
         s_accessCounter++;
@@ -174,22 +619,91 @@ QImage ShmClientBuffer::data() const
     return d->savedData;
 }
 
-ShmClientBufferIntegration::ShmClientBufferIntegration(Display *display)
-    : ClientBufferIntegration(display)
+quint32 ShmClientBuffer::drmFormat() const
 {
-#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
-    wl_display_add_shm_format(*display, WL_SHM_FORMAT_ARGB2101010);
-    wl_display_add_shm_format(*display, WL_SHM_FORMAT_XRGB2101010);
-    wl_display_add_shm_format(*display, WL_SHM_FORMAT_ABGR2101010);
-    wl_display_add_shm_format(*display, WL_SHM_FORMAT_XBGR2101010);
-    wl_display_add_shm_format(*display, WL_SHM_FORMAT_ABGR16161616);
-    wl_display_add_shm_format(*display, WL_SHM_FORMAT_XBGR16161616);
+    Q_D(const ShmClientBuffer);
+    // All wl_shm formats but argb8888 and xrgb8888 use the DRM fourcc codes.
+    switch (d->shmFormat) {
+    case WL_SHM_FORMAT_ARGB8888:
+        return DRM_FORMAT_ARGB8888;
+    case WL_SHM_FORMAT_XRGB8888:
+        return DRM_FORMAT_XRGB8888;
+    default:
+        return d->shmFormat;
+    }
+}
+
+QVector<LinuxDmaBufV1Plane> ShmClientBuffer::dmaBufPlanes() const
+{
+    Q_D(const ShmClientBuffer);
+    if (!d->memory || !d->memory->promotable) {
+        return QVector<LinuxDmaBufV1Plane>();
+    }
+
+#if HAVE_UDMABUF
+    if (!d->dmaBufCreated) {
+        d->dmaBufCreated = true;
+
+        // udmabuf only accepts page aligned ranges that lie within the memfd.
+        const quint64 pageSize = sysconf(_SC_PAGESIZE);
+        const quint64 start = d->offset;
+        const quint64 end = start + quint64(d->stride) * d->height;
+        const quint64 alignedStart = start & ~(pageSize - 1);
+        const quint64 alignedEnd = (end + pageSize - 1) & ~(pageSize - 1);
+
+        struct stat info;
+        if (fstat(d->memory->fd, &info) == -1 || quint64(info.st_size) < alignedEnd) {
+            return QVector<LinuxDmaBufV1Plane>();
+        }
+
+        udmabuf_create create = {};
+        create.memfd = d->memory->fd;
+        create.flags = UDMABUF_FLAGS_CLOEXEC;
+        create.offset = alignedStart;
+        create.size = alignedEnd - alignedStart;
+
+        const int fd = ioctl(d->memory->udmabuf->fd, UDMABUF_CREATE, &create);
+        if (fd == -1) {
+            qCDebug(KWAYLAND_SERVER) << "Failed to create a udmabuf for a shm buffer:" << strerror(errno);
+            return QVector<LinuxDmaBufV1Plane>();
+        }
+
+        d->dmaBufPlane.fd = fd;
+        d->dmaBufPlane.offset = start - alignedStart;
+        d->dmaBufPlane.stride = d->stride;
+        d->dmaBufPlane.modifier = DRM_FORMAT_MOD_LINEAR;
+    }
+
+    if (d->dmaBufPlane.fd != -1) {
+        return {d->dmaBufPlane};
+    }
 #endif
+    return QVector<LinuxDmaBufV1Plane>();
+}
+
+ShmClientBufferIntegration::ShmClientBufferIntegration(Display *display, Display::ShmOptions options)
+    : ClientBufferIntegration(display)
+{
+    // libwayland's wl_shm implementation doesn't expose the file descriptors of the pools,
+    // so the buffers can only be promoted to dma-bufs with our own implementation.
+    if (options.testFlag(Display::ShmOption::DmaBufPromotion)) {
+        d.reset(new ShmClientBufferIntegrationPrivate(display));
+        return;
+    }
+
+    for (const uint32_t format : s_extraShmFormats) {
+        wl_display_add_shm_format(*display, format);
+    }
     wl_display_init_shm(*display);
 }
 
+ShmClientBufferIntegration::~ShmClientBufferIntegration()
+{
+}
+
 ClientBuffer *ShmClientBufferIntegration::createBuffer(::wl_resource *resource)
 {
+    // The buffers of our own wl_shm implementation are registered when they are created.
     if (wl_shm_buffer_get(resource)) {
         return new ShmClientBuffer(resource);
     }
@@ -8,10 +8,13 @@
 
 #include "clientbuffer.h"
 #include "clientbufferintegration.h"
+#include "display.h"
+#include "linuxdmabufv1clientbuffer.h"
 
 namespace KWaylandServer
 {
 class ShmClientBufferPrivate;
+class ShmClientBufferIntegrationPrivate;
 
 /**
  * The ShmClientBuffer class represents a wl_shm_buffer client buffer.
@@ -29,9 +32,31 @@ public:
 
     QImage data() const;
 
+    /**
+     * Returns the dma-buf planes of the buffer, or an empty list if the buffer can't be
+     * accessed as a dma-buf. This is only supported if the wl_shm global has been created
+     * with the Display::ShmOption::DmaBufPromotion option, /dev/udmabuf is available and
+     * the client's shm pool is a memfd sealed against shrinking.
+     *
+     * The dma-buf is created when this function is called for the first time. The file
+     * descriptors are owned by the buffer.
+     *
+     * @see drmFormat()
+     */
+    QVector<LinuxDmaBufV1Plane> dmaBufPlanes() const;
+
+    /**
+     * Returns the DRM fourcc format of the buffer's pixel data.
+     */
+    quint32 drmFormat() const;
+
     QSize size() const override;
     bool hasAlphaChannel() const override;
     Origin origin() const override;
+
+private:
+    ShmClientBuffer(wl_resource *resource, ShmClientBufferPrivate &dd);
+    friend class ShmPool;
 };
 
 /**
@@ -42,9 +67,13 @@ class ShmClientBufferIntegration : public ClientBufferIntegration
     Q_OBJECT
 
 public:
-    explicit ShmClientBufferIntegration(Display *display);
+    explicit ShmClientBufferIntegration(Display *display, Display::ShmOptions options = Display::ShmOptions());
+    ~ShmClientBufferIntegration() override;
 
     ClientBuffer *createBuffer(::wl_resource *resource) override;
+
+private:
+    QScopedPointer<ShmClientBufferIntegrationPrivate> d;
 };
 
 } // namespace KWaylandServer
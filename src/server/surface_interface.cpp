@@ -7,6 +7,7 @@
 #include "surface_interface.h"
 #include "clientbuffer.h"
 #include "clientconnection.h"
+#include "clientconnection_p.h"
 #include "compositor_interface.h"
 #include "display.h"
 #include "idleinhibit_v1_interface_p.h"
@@ -276,9 +277,14 @@ void SurfaceInterfacePrivate::surface_frame(Resource *resource, uint32_t callbac
 
     wl_resource_set_implementation(callbackResource, nullptr, nullptr, [](wl_resource *resource) {
         wl_list_remove(wl_resource_get_link(resource));
+        // not found anymore while the client is being destroyed
+        if (ClientConnectionPrivate *connectionPrivate = ClientConnectionPrivate::get(wl_resource_get_client(resource))) {
+            connectionPrivate->removeFrameCallback();
+        }
     });
 
     wl_list_insert(pending.frameCallbacks.prev, wl_resource_get_link(callbackResource));
+    ClientConnectionPrivate::get(client)->addFrameCallback();
 }
 
 void SurfaceInterfacePrivate::surface_set_opaque_region(Resource *resource, struct ::wl_resource *region)
@@ -63,7 +63,7 @@ struct SurfaceState
     } viewport;
 };
 
-class SurfaceInterfacePrivate : public QtWaylandServer::wl_surface
+class SurfaceInterfacePrivate : public QtWaylandServer::wl_surface_static<SurfaceInterfacePrivate>
 {
 public:
     static SurfaceInterfacePrivate *get(SurfaceInterface *surface)
@@ -141,6 +141,9 @@ protected:
     void surface_offset(Resource *resource, int32_t x, int32_t y) override;
 
 private:
+    // dispatches the requests to the handlers above without going through the vtable
+    friend class QtWaylandServer::wl_surface_static<SurfaceInterfacePrivate>;
+
     QMetaObject::Connection constrainsOneShotConnection;
     QMetaObject::Connection constrainsUnboundConnection;
 };
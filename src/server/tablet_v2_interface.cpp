@@ -5,6 +5,7 @@
 */
 
 #include "tablet_v2_interface.h"
+#include "clientconnection_p.h"
 #include "display.h"
 #include "seat_interface.h"
 #include "surface_interface.h"
@@ -12,6 +13,9 @@
 #include "qwayland-server-tablet-unstable-v2.h"
 #include <QHash>
 
+#include <optional>
+#include <utility>
+
 namespace KWaylandServer
 {
 static int s_version = 1;
@@ -151,6 +155,74 @@ public:
         return r ? r->handle : nullptr;
     }
 
+    /**
+     * Returns @c true if the axis events of the current frame are withheld from the client of
+     * the current surface because it is congested.
+     */
+    bool withholdAxes()
+    {
+        if (m_withheldAxes) {
+            return true;
+        }
+        if (!m_surface || !targetResource()) {
+            return false;
+        }
+        ClientConnectionPrivate *clientPrivate = ClientConnectionPrivate::get(m_surface->client());
+        if (!clientPrivate->congested) {
+            return false;
+        }
+        m_withheldAxes.emplace();
+        clientPrivate->coalesce(this, q, [this]() {
+            sendWithheldAxes();
+        });
+        return true;
+    }
+
+    void sendWithheldAxes()
+    {
+        if (!m_withheldAxes) {
+            return;
+        }
+        const WithheldAxes axes = *std::exchange(m_withheldAxes, std::nullopt);
+        wl_resource *resource = targetResource();
+        if (!resource) {
+            return;
+        }
+        if (axes.position) {
+            send_motion(resource, wl_fixed_from_double(axes.position->x()), wl_fixed_from_double(axes.position->y()));
+        }
+        if (axes.pressure) {
+            send_pressure(resource, *axes.pressure);
+        }
+        if (axes.distance) {
+            send_distance(resource, *axes.distance);
+        }
+        if (axes.tilt) {
+            send_tilt(resource, wl_fixed_from_double(axes.tilt->x()), wl_fixed_from_double(axes.tilt->y()));
+        }
+        if (axes.rotation) {
+            send_rotation(resource, wl_fixed_from_double(*axes.rotation));
+        }
+        if (axes.slider) {
+            send_slider(resource, *axes.slider);
+        }
+        send_frame(resource, axes.time);
+    }
+
+    /**
+     * Sends the withheld axis events right away, they must not be overtaken by other events.
+     */
+    void flushWithheldAxes()
+    {
+        if (!m_withheldAxes) {
+            return;
+        }
+        if (m_surface) {
+            ClientConnectionPrivate::get(m_surface->client())->flushCoalesced(this);
+        }
+        m_withheldAxes.reset();
+    }
+
     quint64 hardwareId() const
     {
         return quint64(quint64(m_hardwareIdHigh) << 32) + m_hardwareIdLow;
@@ -199,6 +271,19 @@ public:
     const QVector<TabletToolV2Interface::Capability> m_capabilities;
     QHash<wl_resource *, TabletCursorV2 *> m_cursors;
     TabletToolV2Interface *const q;
+
+    // The latest axis values, sent along with a frame once the client catches up.
+    struct WithheldAxes
+    {
+        std::optional<QPointF> position;
+        std::optional<uint32_t> pressure;
+        std::optional<uint32_t> distance;
+        std::optional<QPointF> tilt;
+        std::optional<qreal> rotation;
+        std::optional<int32_t> slider;
+        uint32_t time = 0;
+    };
+    std::optional<WithheldAxes> m_withheldAxes;
 };
 
 TabletToolV2Interface::TabletToolV2Interface(Display *display,
@@ -227,6 +312,8 @@ void TabletToolV2Interface::setCurrentSurface(SurfaceInterface *surface)
     if (d->m_surface == surface)
         return;
 
+    d->flushWithheldAxes();
+
     TabletV2Interface *const lastTablet = d->m_lastTablet;
     if (d->m_surface && d->resourceMap().contains(*d->m_surface->client())) {
         sendProximityOut();
@@ -251,6 +338,7 @@ bool TabletToolV2Interface::isClientSupported() const
 
 void TabletToolV2Interface::sendButton(uint32_t button, bool pressed)
 {
+    d->flushWithheldAxes();
     d->send_button(d->targetResource(),
                    d->m_display->nextSerial(),
                    button,
@@ -259,16 +347,28 @@ void TabletToolV2Interface::sendButton(uint32_t button, bool pressed)
 
 void TabletToolV2Interface::sendMotion(const QPointF &pos)
 {
+    if (d->withholdAxes()) {
+        d->m_withheldAxes->position = pos;
+        return;
+    }
     d->send_motion(d->targetResource(), wl_fixed_from_double(pos.x()), wl_fixed_from_double(pos.y()));
 }
 
 void TabletToolV2Interface::sendDistance(uint32_t distance)
 {
+    if (d->withholdAxes()) {
+        d->m_withheldAxes->distance = distance;
+        return;
+    }
     d->send_distance(d->targetResource(), distance);
 }
 
 void TabletToolV2Interface::sendFrame(uint32_t time)
 {
+    if (d->m_withheldAxes) {
+        d->m_withheldAxes->time = time;
+        return;
+    }
     d->send_frame(d->targetResource(), time);
 
     if (d->m_cleanup) {
@@ -280,31 +380,49 @@ void TabletToolV2Interface::sendFrame(uint32_t time)
 
 void TabletToolV2Interface::sendPressure(uint32_t pressure)
 {
+    if (d->withholdAxes()) {
+        d->m_withheldAxes->pressure = pressure;
+        return;
+    }
     d->send_pressure(d->targetResource(), pressure);
 }
 
 void TabletToolV2Interface::sendRotation(qreal rotation)
 {
+    if (d->withholdAxes()) {
+        d->m_withheldAxes->rotation = rotation;
+        return;
+    }
     d->send_rotation(d->targetResource(), wl_fixed_from_double(rotation));
 }
 
 void TabletToolV2Interface::sendSlider(int32_t position)
 {
+    if (d->withholdAxes()) {
+        d->m_withheldAxes->slider = position;
+        return;
+    }
     d->send_slider(d->targetResource(), position);
 }
 
 void TabletToolV2Interface::sendTilt(qreal degreesX, qreal degreesY)
 {
+    if (d->withholdAxes()) {
+        d->m_withheldAxes->tilt = QPointF(degreesX, degreesY);
+        return;
+    }
     d->send_tilt(d->targetResource(), wl_fixed_from_double(degreesX), wl_fixed_from_double(degreesY));
 }
 
 void TabletToolV2Interface::sendWheel(int32_t degrees, int32_t clicks)
 {
+    d->flushWithheldAxes();
     d->send_wheel(d->targetResource(), degrees, clicks);
 }
 
 void TabletToolV2Interface::sendProximityIn(TabletV2Interface *tablet)
 {
+    d->flushWithheldAxes();
     wl_resource *tabletResource = tablet->d->resourceForSurface(d->m_surface);
     d->send_proximity_in(d->targetResource(), d->m_display->nextSerial(), tabletResource, d->m_surface->resource());
     d->m_lastTablet = tablet;
@@ -312,17 +430,20 @@ void TabletToolV2Interface::sendProximityIn(TabletV2Interface *tablet)
 
 void TabletToolV2Interface::sendProximityOut()
 {
+    d->flushWithheldAxes();
     d->send_proximity_out(d->targetResource());
     d->m_cleanup = true;
 }
 
 void TabletToolV2Interface::sendDown()
 {
+    d->flushWithheldAxes();
     d->send_down(d->targetResource(), d->m_display->nextSerial());
 }
 
 void TabletToolV2Interface::sendUp()
 {
+    d->flushWithheldAxes();
     d->send_up(d->targetResource());
 }
 
@@ -7,11 +7,15 @@
 */
 #include "touch_interface.h"
 #include "clientconnection.h"
+#include "clientconnection_p.h"
 #include "display.h"
 #include "seat_interface.h"
 #include "surface_interface.h"
 #include "touch_interface_p.h"
 
+#include <algorithm>
+#include <utility>
+
 namespace KWaylandServer
 {
 TouchInterfacePrivate *TouchInterfacePrivate::get(TouchInterface *touch)
@@ -25,14 +29,39 @@ TouchInterfacePrivate::TouchInterfacePrivate(TouchInterface *q, SeatInterface *s
 {
 }
 
+void TouchInterfacePrivate::flushWithheldMotion()
+{
+    // the motions must not be overtaken by touch points going up or down
+    if (!withheldMotions.isEmpty()) {
+        ClientConnectionPrivate::get(focusedSurface->client())->flushCoalesced(this);
+    }
+}
+
+void TouchInterfacePrivate::dropWithheldMotion()
+{
+    if (!withheldMotions.isEmpty()) {
+        withheldMotions.clear();
+        if (focusedSurface) {
+            ClientConnectionPrivate::get(focusedSurface->client())->dropCoalesced(this);
+        }
+    }
+}
+
 void TouchInterfacePrivate::touch_release(Resource *resource)
 {
     wl_resource_destroy(resource->handle);
 }
 
-QList<TouchInterfacePrivate::Resource *> TouchInterfacePrivate::touchesForClient(ClientConnection *client) const
+void TouchInterfacePrivate::touch_bind_resource(Resource *resource)
+{
+    Q_UNUSED(resource)
+    focusedResources.invalidate();
+}
+
+void TouchInterfacePrivate::touch_destroy_resource(Resource *resource)
 {
-    return resourceMap().values(client->client());
+    Q_UNUSED(resource)
+    focusedResources.invalidate();
 }
 
 TouchInterface::TouchInterface(SeatInterface *seat)
@@ -51,7 +80,21 @@ SurfaceInterface *TouchInterface::focusedSurface() const
 
 void TouchInterface::setFocusedSurface(SurfaceInterface *surface)
 {
+    if (d->focusedSurface == surface) {
+        return;
+    }
+    d->dropWithheldMotion();
+    disconnect(d->destroyConnection);
+
     d->focusedSurface = surface;
+    d->focusedResources.setClient(surface ? surface->client()->client() : nullptr);
+    if (surface) {
+        d->destroyConnection = connect(surface, &SurfaceInterface::aboutToBeDestroyed, this, [this]() {
+            d->dropWithheldMotion();
+            d->focusedSurface = nullptr;
+            d->focusedResources.setClient(nullptr);
+        });
+    }
 }
 
 void TouchInterface::sendCancel()
@@ -60,22 +103,22 @@ void TouchInterface::sendCancel()
         return;
     }
 
-    const auto touchResources = d->touchesForClient(d->focusedSurface->client());
-    for (TouchInterfacePrivate::Resource *resource : touchResources) {
+    d->dropWithheldMotion();
+    d->focusedResources.forEach([this](TouchInterfacePrivate::Resource *resource) {
         d->send_cancel(resource->handle);
-    }
+    });
 }
 
 void TouchInterface::sendFrame()
 {
-    if (!d->focusedSurface) {
+    // the frame of withheld motions is sent along with them
+    if (!d->focusedSurface || !d->withheldMotions.isEmpty()) {
         return;
     }
 
-    const auto touchResources = d->touchesForClient(d->focusedSurface->client());
-    for (TouchInterfacePrivate::Resource *resource : touchResources) {
+    d->focusedResources.forEach([this](TouchInterfacePrivate::Resource *resource) {
         d->send_frame(resource->handle);
-    }
+    });
 }
 
 void TouchInterface::sendMotion(qint32 id, const QPointF &localPos)
@@ -84,10 +127,40 @@ void TouchInterface::sendMotion(qint32 id, const QPointF &localPos)
         return;
     }
 
-    const auto touchResources = d->touchesForClient(d->focusedSurface->client());
-    for (TouchInterfacePrivate::Resource *resource : touchResources) {
-        d->send_motion(resource->handle, d->seat->timestamp(), id, wl_fixed_from_double(localPos.x()), wl_fixed_from_double(localPos.y()));
+    const quint32 timestamp = d->seat->timestamp();
+    const wl_fixed_t x = wl_fixed_from_double(localPos.x());
+    const wl_fixed_t y = wl_fixed_from_double(localPos.y());
+
+    ClientConnectionPrivate *clientPrivate = ClientConnectionPrivate::get(d->focusedSurface->client());
+    if (clientPrivate->congested) {
+        // only the latest position of every touch point is sent, in a frame of its own, once
+        // the client catches up
+        auto it = std::find_if(d->withheldMotions.begin(), d->withheldMotions.end(), [id](const TouchInterfacePrivate::WithheldMotion &motion) {
+            return motion.id == id;
+        });
+        if (it != d->withheldMotions.end()) {
+            *it = {id, timestamp, x, y};
+        } else {
+            d->withheldMotions.append({id, timestamp, x, y});
+        }
+        clientPrivate->coalesce(d.data(), this, [this]() {
+            const QVector<TouchInterfacePrivate::WithheldMotion> motions = std::exchange(d->withheldMotions, {});
+            if (!d->focusedSurface) {
+                return;
+            }
+            d->focusedResources.forEach([this, &motions](TouchInterfacePrivate::Resource *resource) {
+                for (const TouchInterfacePrivate::WithheldMotion &motion : motions) {
+                    d->send_motion(resource->handle, motion.timestamp, motion.id, motion.x, motion.y);
+                }
+                d->send_frame(resource->handle);
+            });
+        });
+        return;
     }
+
+    d->focusedResources.forEach([this, timestamp, id, x, y](TouchInterfacePrivate::Resource *resource) {
+        d->send_motion(resource->handle, timestamp, id, x, y);
+    });
 }
 
 void TouchInterface::sendUp(qint32 id, quint32 serial)
@@ -96,10 +169,12 @@ void TouchInterface::sendUp(qint32 id, quint32 serial)
         return;
     }
 
-    const auto touchResources = d->touchesForClient(d->focusedSurface->client());
-    for (TouchInterfacePrivate::Resource *resource : touchResources) {
-        d->send_up(resource->handle, serial, d->seat->timestamp(), id);
-    }
+    d->flushWithheldMotion();
+
+    const quint32 timestamp = d->seat->timestamp();
+    d->focusedResources.forEach([this, serial, timestamp, id](TouchInterfacePrivate::Resource *resource) {
+        d->send_up(resource->handle, serial, timestamp, id);
+    });
 }
 
 void TouchInterface::sendDown(qint32 id, quint32 serial, const QPointF &localPos)
@@ -108,16 +183,14 @@ void TouchInterface::sendDown(qint32 id, quint32 serial, const QPointF &localPos
         return;
     }
 
-    const auto touchResources = d->touchesForClient(d->focusedSurface->client());
-    for (TouchInterfacePrivate::Resource *resource : touchResources) {
-        d->send_down(resource->handle,
-                     serial,
-                     d->seat->timestamp(),
-                     d->focusedSurface->resource(),
-                     id,
-                     wl_fixed_from_double(localPos.x()),
-                     wl_fixed_from_double(localPos.y()));
-    }
+    d->flushWithheldMotion();
+
+    const quint32 timestamp = d->seat->timestamp();
+    const wl_fixed_t x = wl_fixed_from_double(localPos.x());
+    const wl_fixed_t y = wl_fixed_from_double(localPos.y());
+    d->focusedResources.forEach([this, serial, timestamp, id, x, y](TouchInterfacePrivate::Resource *resource) {
+        d->send_down(resource->handle, serial, timestamp, d->focusedSurface->resource(), id, x, y);
+    });
 }
 
 } // namespace KWaylandServer
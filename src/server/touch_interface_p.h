@@ -6,28 +6,48 @@
 
 #pragma once
 
+#include "focusedresources_p.h"
 #include "touch_interface.h"
 
+#include <QPointer>
+#include <QVector>
+
 #include "qwayland-server-wayland.h"
 
 namespace KWaylandServer
 {
-class ClientConnection;
-
 class TouchInterfacePrivate : public QtWaylandServer::wl_touch
 {
 public:
     static TouchInterfacePrivate *get(TouchInterface *touch);
     TouchInterfacePrivate(TouchInterface *q, SeatInterface *seat);
 
-    QList<Resource *> touchesForClient(ClientConnection *client) const;
+    void flushWithheldMotion();
+    void dropWithheldMotion();
 
     TouchInterface *q;
     QPointer<SurfaceInterface> focusedSurface;
+    FocusedResources<QtWaylandServer::wl_touch> focusedResources{this};
+    QMetaObject::Connection destroyConnection;
     SeatInterface *seat;
 
+    struct WithheldMotion
+    {
+        qint32 id;
+        quint32 timestamp;
+        wl_fixed_t x;
+        wl_fixed_t y;
+    };
+    /**
+     * The latest motion of every touch point withheld from the focused client because it is
+     * congested.
+     */
+    QVector<WithheldMotion> withheldMotions;
+
 protected:
     void touch_release(Resource *resource) override;
+    void touch_bind_resource(Resource *resource) override;
+    void touch_destroy_resource(Resource *resource) override;
 };
 
 } // namespace KWaylandServer
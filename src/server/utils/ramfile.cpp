@@ -0,0 +1,108 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "ramfile.h"
+#include "logging.h"
+
+#include <QTemporaryFile>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace KWaylandServer
+{
+static bool writeAll(int fd, const char *data, int size)
+{
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+RamFile::RamFile(const char *name, const QByteArray &data, Flags flags)
+    : m_size(data.size() + (flags & Flag::NullTerminated ? 1 : 0))
+{
+    // QByteArray::constData() is always null terminated
+    const char *contents = data.constData();
+
+#if defined(MFD_ALLOW_SEALING)
+    if (!(flags & Flag::NoMemfd)) {
+        int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd != -1) {
+            if (!writeAll(fd, contents, m_size)) {
+                qCWarning(KWAYLAND_SERVER, "Failed to write %s file: %s", name, strerror(errno));
+            } else if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+                // an unsealed memfd can be written by every client it's handed to
+                qCWarning(KWAYLAND_SERVER, "Failed to seal %s file: %s", name, strerror(errno));
+            } else {
+                m_fd = fd;
+                m_isSealed = true;
+                return;
+            }
+            close(fd);
+        }
+    }
+#else
+    Q_UNUSED(name)
+#endif
+
+    // Fall back to a temporary file that is only handed out as a read-only file descriptor.
+    QTemporaryFile tmp;
+    if (!tmp.open()) {
+        qCWarning(KWAYLAND_SERVER) << "Failed to create temporary file:" << tmp.errorString();
+        return;
+    }
+    if (tmp.write(contents, m_size) != m_size || !tmp.flush()) {
+        qCWarning(KWAYLAND_SERVER) << "Failed to write temporary file:" << tmp.errorString();
+        return;
+    }
+    const QByteArray fileName = tmp.fileName().toUtf8();
+    m_fd = open(fileName.constData(), O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1) {
+        qCWarning(KWAYLAND_SERVER) << "Could not create read-only file descriptor:" << strerror(errno);
+    }
+    unlink(fileName.constData());
+}
+
+RamFile::~RamFile()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool RamFile::isValid() const
+{
+    return m_fd != -1;
+}
+
+bool RamFile::isSealed() const
+{
+    return m_isSealed;
+}
+
+int RamFile::fd() const
+{
+    return m_fd;
+}
+
+int RamFile::size() const
+{
+    return m_size;
+}
+
+} // namespace KWaylandServer
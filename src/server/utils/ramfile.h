@@ -0,0 +1,70 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <KWaylandServer/kwaylandserver_export.h>
+
+#include <QByteArray>
+#include <QFlags>
+
+namespace KWaylandServer
+{
+/**
+ * The RamFile class is a helper for sharing a block of read-only data, e.g. a keymap or a
+ * dmabuf format table, with clients.
+ *
+ * The data is copied once into an anonymous in-memory file that is sealed so it can't be
+ * modified or resized anymore, which allows handing out the same file descriptor to any number
+ * of clients. If the file can't be sealed, an unlinked temporary file is used instead, which is
+ * only shared through a read-only file descriptor.
+ */
+class KWAYLANDSERVER_EXPORT RamFile // exported for unit tests
+{
+public:
+    enum class Flag {
+        /**
+         * Appends a terminating null byte to the data, e.g. for keymaps.
+         */
+        NullTerminated = 0x1,
+        /**
+         * Always uses the read-only temporary file.
+         */
+        NoMemfd = 0x2,
+    };
+    Q_DECLARE_FLAGS(Flags, Flag)
+
+    RamFile(const char *name, const QByteArray &data, Flags flags = Flags());
+    ~RamFile();
+
+    /**
+     * Returns @c true if the file has been created successfully; otherwise returns @c false.
+     */
+    bool isValid() const;
+
+    /**
+     * Returns @c true if the file is a memfd sealed against writes, shrinking and growing;
+     * otherwise the file descriptor is a read-only temporary file.
+     */
+    bool isSealed() const;
+
+    int fd() const;
+    /**
+     * Returns the size of the file, including the terminating null byte if any.
+     */
+    int size() const;
+
+private:
+    Q_DISABLE_COPY(RamFile)
+
+    int m_fd = -1;
+    int m_size = 0;
+    bool m_isSealed = false;
+};
+
+} // namespace KWaylandServer
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KWaylandServer::RamFile::Flags)
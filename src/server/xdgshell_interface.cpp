@@ -346,6 +346,8 @@ void XdgToplevelInterfacePrivate::reset()
 
     windowTitle = QString();
     windowClass = QString();
+    windowTitleUtf8 = QByteArray();
+    windowClassUtf8 = QByteArray();
     current = next = State();
 
     Q_EMIT q->resetOccurred();
@@ -374,24 +376,27 @@ void XdgToplevelInterfacePrivate::xdg_toplevel_set_parent(Resource *resource, ::
     Q_EMIT q->parentXdgToplevelChanged();
 }
 
-void XdgToplevelInterfacePrivate::xdg_toplevel_set_title(Resource *resource, const QString &title)
+void XdgToplevelInterfacePrivate::xdg_toplevel_set_title(Resource *resource, const QByteArray &title)
 {
     Q_UNUSED(resource)
-    if (windowTitle == title) {
+    // title doesn't own its data, compare the bytes before paying for a copy and the conversion
+    if (windowTitleUtf8 == title) {
         return;
     }
-    windowTitle = title;
-    Q_EMIT q->windowTitleChanged(title);
+    windowTitleUtf8 = QByteArray(title.constData(), title.size());
+    windowTitle = QString::fromUtf8(windowTitleUtf8);
+    Q_EMIT q->windowTitleChanged(windowTitle);
 }
 
-void XdgToplevelInterfacePrivate::xdg_toplevel_set_app_id(Resource *resource, const QString &app_id)
+void XdgToplevelInterfacePrivate::xdg_toplevel_set_app_id(Resource *resource, const QByteArray &app_id)
 {
     Q_UNUSED(resource)
-    if (windowClass == app_id) {
+    if (windowClassUtf8 == app_id) {
         return;
     }
-    windowClass = app_id;
-    Q_EMIT q->windowClassChanged(app_id);
+    windowClassUtf8 = QByteArray(app_id.constData(), app_id.size());
+    windowClass = QString::fromUtf8(windowClassUtf8);
+    Q_EMIT q->windowClassChanged(windowClass);
 }
 
 void XdgToplevelInterfacePrivate::xdg_toplevel_show_window_menu(Resource *resource, ::wl_resource *seatResource, uint32_t serial, int32_t x, int32_t y)
@@ -139,6 +139,9 @@ public:
 
     QString windowTitle;
     QString windowClass;
+    // The raw UTF-8 data, clients may resend the same values, e.g. terminals on every prompt
+    QByteArray windowTitleUtf8;
+    QByteArray windowClassUtf8;
 
     struct State
     {
@@ -153,8 +156,8 @@ protected:
     void xdg_toplevel_destroy_resource(Resource *resource) override;
     void xdg_toplevel_destroy(Resource *resource) override;
     void xdg_toplevel_set_parent(Resource *resource, ::wl_resource *parent) override;
-    void xdg_toplevel_set_title(Resource *resource, const QString &title) override;
-    void xdg_toplevel_set_app_id(Resource *resource, const QString &app_id) override;
+    void xdg_toplevel_set_title(Resource *resource, const QByteArray &title) override;
+    void xdg_toplevel_set_app_id(Resource *resource, const QByteArray &app_id) override;
     void xdg_toplevel_show_window_menu(Resource *resource, ::wl_resource *seat, uint32_t serial, int32_t x, int32_t y) override;
     void xdg_toplevel_move(Resource *resource, ::wl_resource *seat, uint32_t serial) override;
     void xdg_toplevel_resize(Resource *resource, ::wl_resource *seat, uint32_t serial, uint32_t edges) override;
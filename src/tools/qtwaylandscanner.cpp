@@ -41,6 +41,7 @@
 #include <QFile>
 #include <QXmlStreamReader>
 
+#include <algorithm>
 #include <vector>
 
 class Scanner
@@ -79,6 +80,8 @@ private:
         bool request;
         QByteArray name;
         QByteArray type;
+        int since;
+        bool stringView;
         std::vector<WaylandArgument> arguments;
     };
 
@@ -101,15 +104,21 @@ private:
     Scanner::WaylandEnum readEnum(QXmlStreamReader &xml);
     Scanner::WaylandInterface readInterface(QXmlStreamReader &xml);
     QByteArray waylandToCType(const QByteArray &waylandType, const QByteArray &interface);
-    QByteArray waylandToQtType(const QByteArray &waylandType, const QByteArray &interface, bool cStyleArray);
+    QByteArray waylandToQtType(const QByteArray &waylandType, const QByteArray &interface, bool cStyleArray, bool stringView = false);
     const Scanner::WaylandArgument *newIdArgument(const std::vector<WaylandArgument> &arguments);
+    QByteArray messageSizeExpression(const WaylandEvent &e);
+    bool canBroadcast(const WaylandInterface &interface, const WaylandEvent &e);
 
-    void printEvent(const WaylandEvent &e, bool omitNames = false, bool withResource = false);
+    void printEvent(const WaylandEvent &e, bool omitNames = false, bool withResource = false, bool withClient = false);
+    void printBroadcast(const WaylandEvent &e, const char *interfaceName, int opcode, bool withClient);
     void printEventHandlerSignature(const WaylandEvent &e, const char *interfaceName, bool deepIndent = true);
+    void printRequestHandlerBody(const WaylandEvent &e, const WaylandInterface &interface, int opcode, bool staticDispatch);
+    void printStaticDispatchClass(const WaylandInterface &interface);
     void printEnums(const std::vector<WaylandEnum> &enums);
 
     QByteArray stripInterfaceName(const QByteArray &name);
     bool ignoreInterface(const QByteArray &name);
+    bool hasStaticDispatch(const WaylandInterface &interface);
 
     enum Option {
         ClientHeader,
@@ -124,6 +133,11 @@ private:
     QByteArray m_headerPath;
     QByteArray m_prefix;
     QVector <QByteArray> m_includes;
+    bool m_trace = false;
+    bool m_stringViews = false;
+    QVector<QByteArray> m_stringViewRequests;
+    QVector<QByteArray> m_staticDispatchInterfaces;
+    QVector<QByteArray> m_broadcastInterfaces;
     QXmlStreamReader *m_xml = nullptr;
 };
 
@@ -141,28 +155,50 @@ bool Scanner::parseArguments(int argc, char **argv)
 
     m_protocolFilePath = args[2];
 
+    int pos = 3;
     if (argc > 3 && !args[3].startsWith('-')) {
-        // legacy positional arguments
-            m_headerPath = args[3];
-        if (argc == 5)
-            m_prefix = args[4];
-    } else {
-        // --header-path=<path> (14 characters)
-        // --prefix=<prefix> (9 characters)
-        // --add-include=<include> (14 characters)
-        for (int pos = 3; pos < argc; pos++) {
-            const QByteArray &option = args[pos];
-            if (option.startsWith("--header-path=")) {
-                m_headerPath = option.mid(14);
-            } else if (option.startsWith("--prefix=")) {
-                m_prefix = option.mid(10);
-            } else if (option.startsWith("--add-include=")) {
-                auto include = option.mid(14);
-                if (!include.isEmpty())
-                    m_includes << include;
-            } else {
-                return false;
-            }
+        // legacy positional arguments, optionally followed by options
+        m_headerPath = args[pos++];
+        if (pos < argc && !args[pos].startsWith('-'))
+            m_prefix = args[pos++];
+    }
+
+    // --header-path=<path> (14 characters)
+    // --prefix=<prefix> (9 characters)
+    // --add-include=<include> (14 characters)
+    // --trace
+    // --string-views
+    // --string-view=<interface>.<request> (14 characters)
+    // --static-dispatch=<interface> (18 characters)
+    // --broadcast=<interface> (12 characters)
+    for (; pos < argc; pos++) {
+        const QByteArray &option = args[pos];
+        if (option.startsWith("--header-path=")) {
+            m_headerPath = option.mid(14);
+        } else if (option.startsWith("--prefix=")) {
+            m_prefix = option.mid(10);
+        } else if (option.startsWith("--add-include=")) {
+            auto include = option.mid(14);
+            if (!include.isEmpty())
+                m_includes << include;
+        } else if (option == "--trace") {
+            m_trace = true;
+        } else if (option == "--string-views") {
+            m_stringViews = true;
+        } else if (option.startsWith("--string-view=")) {
+            auto request = option.mid(14);
+            if (!request.isEmpty())
+                m_stringViewRequests << request;
+        } else if (option.startsWith("--static-dispatch=")) {
+            auto interface = option.mid(18);
+            if (!interface.isEmpty())
+                m_staticDispatchInterfaces << interface;
+        } else if (option.startsWith("--broadcast=")) {
+            auto interface = option.mid(12);
+            if (!interface.isEmpty())
+                m_broadcastInterfaces << interface;
+        } else {
+            return false;
         }
     }
 
@@ -171,7 +207,7 @@ bool Scanner::parseArguments(int argc, char **argv)
 
 void Scanner::printUsage()
 {
-    fprintf(stderr, "Usage: %s [client-header|server-header|client-code|server-code] specfile [--header-path=<path>] [--prefix=<prefix>] [--add-include=<include>]\n", m_scannerName.constData());
+    fprintf(stderr, "Usage: %s [client-header|server-header|client-code|server-code] specfile [--header-path=<path>] [--prefix=<prefix>] [--add-include=<include>] [--trace] [--string-views] [--string-view=<interface>.<request>] [--static-dispatch=<interface>] [--broadcast=<interface>]\n", m_scannerName.constData());
 }
 
 bool Scanner::isServerSide()
@@ -220,6 +256,8 @@ Scanner::WaylandEvent Scanner::readEvent(QXmlStreamReader &xml, bool request)
         .request = request,
         .name = byteArrayValue(xml, "name"),
         .type = byteArrayValue(xml, "type"),
+        .since = intValue(xml, "since", 1),
+        .stringView = false,
         .arguments = {},
     };
     while (xml.readNextStartElement()) {
@@ -283,6 +321,14 @@ Scanner::WaylandInterface Scanner::readInterface(QXmlStreamReader &xml)
             xml.skipCurrentElement();
     }
 
+    // Requests opted into string views get their string arguments as QByteArrays that don't
+    // own the UTF-8 data in the message buffer, the handler decides whether it needs a QString
+    // at all. The data is only valid during the call, handlers must copy it to keep it.
+    if (isServerSide()) {
+        for (WaylandEvent &request : interface.requests)
+            request.stringView = m_stringViews || m_stringViewRequests.contains(interface.name + '.' + request.name);
+    }
+
     return interface;
 }
 
@@ -310,10 +356,10 @@ QByteArray Scanner::waylandToCType(const QByteArray &waylandType, const QByteArr
     return waylandType;
 }
 
-QByteArray Scanner::waylandToQtType(const QByteArray &waylandType, const QByteArray &interface, bool cStyleArray)
+QByteArray Scanner::waylandToQtType(const QByteArray &waylandType, const QByteArray &interface, bool cStyleArray, bool stringView)
 {
     if (waylandType == "string")
-        return "const QString &";
+        return stringView ? "const QByteArray &" : "const QString &";
     else if (waylandType == "array")
         return cStyleArray ? "wl_array *" : "const QByteArray &";
     else
@@ -329,7 +375,44 @@ const Scanner::WaylandArgument *Scanner::newIdArgument(const std::vector<Wayland
     return nullptr;
 }
 
-void Scanner::printEvent(const WaylandEvent &e, bool omitNames, bool withResource)
+// The size of the message on the wire as computed by wl_closure_marshal(), for the tracer.
+QByteArray Scanner::messageSizeExpression(const WaylandEvent &e)
+{
+    int fixedSize = 8;
+    QByteArray expression;
+    for (const WaylandArgument &a : e.arguments) {
+        if (a.type == "fd")
+            continue;
+        fixedSize += 4;
+        if (a.type == "string") {
+            if (e.request)
+                expression += " + KWaylandServer::ProtocolTraceScope::stringSize(" + a.name + ")";
+            else
+                expression += " + KWaylandServer::ProtocolTraceScope::stringSize(" + a.name + "_utf8.constData())";
+        } else if (a.type == "array") {
+            if (e.request)
+                expression += " + KWaylandServer::ProtocolTraceScope::arraySize(" + a.name + "->size)";
+            else
+                expression += " + KWaylandServer::ProtocolTraceScope::arraySize(" + a.name + ".size())";
+        }
+    }
+    return QByteArray::number(fixedSize) + expression;
+}
+
+// Only the interfaces passed with --broadcast get broadcast_* helpers. Events referring to
+// objects are specific to a client, so they can't be broadcast.
+bool Scanner::canBroadcast(const WaylandInterface &interface, const WaylandEvent &e)
+{
+    if (!isServerSide() || !m_broadcastInterfaces.contains(interface.name))
+        return false;
+    for (const WaylandArgument &a : e.arguments) {
+        if (a.type == "object" || a.type == "new_id")
+            return false;
+    }
+    return true;
+}
+
+void Scanner::printEvent(const WaylandEvent &e, bool omitNames, bool withResource, bool withClient)
 {
     printf("%s(", e.name.constData());
     bool needsComma = false;
@@ -340,6 +423,9 @@ void Scanner::printEvent(const WaylandEvent &e, bool omitNames, bool withResourc
         } else if (withResource) {
             printf("struct ::wl_resource *%s", omitNames ? "" : "resource");
             needsComma = true;
+        } else if (withClient) {
+            printf("struct ::wl_client *%s", omitNames ? "" : "client");
+            needsComma = true;
         }
     }
     for (const WaylandArgument &a : e.arguments) {
@@ -365,12 +451,83 @@ void Scanner::printEvent(const WaylandEvent &e, bool omitNames, bool withResourc
             }
         }
 
-        QByteArray qtType = waylandToQtType(a.type, a.interface, e.request == isServerSide());
+        QByteArray qtType = waylandToQtType(a.type, a.interface, e.request == isServerSide(), e.stringView);
         printf("%s%s%s", qtType.constData(), qtType.endsWith("&") || qtType.endsWith("*") ? "" : " ", omitNames ? "" : a.name.constData());
     }
     printf(")");
 }
 
+// The arguments are converted and marshalled into a wl_argument array only once and then
+// posted to every resource, resources bound with a version older than the event are skipped.
+void Scanner::printBroadcast(const WaylandEvent &e, const char *interfaceName, int opcode, bool withClient)
+{
+    printf("    void %s::broadcast_", interfaceName);
+    printEvent(e, false, false, withClient);
+    printf("\n");
+    printf("    {\n");
+
+    if (withClient) {
+        printf("        const auto client_resources = m_client_resources.constFind(client);\n");
+        printf("        if (client_resources == m_client_resources.constEnd())\n");
+        printf("            return;\n");
+        printf("\n");
+    } else {
+        printf("        if (m_resource_map.isEmpty())\n");
+        printf("            return;\n");
+        printf("\n");
+    }
+
+    for (const WaylandArgument &a : e.arguments) {
+        const char *name = a.name.constData();
+        if (a.type == "string") {
+            printf("        const QByteArray %s_utf8 = %s.toUtf8();\n", name, name);
+        } else if (a.type == "array") {
+            printf("        struct wl_array %s_data;\n", name);
+            printf("        %s_data.size = %s.size();\n", name, name);
+            printf("        %s_data.data = static_cast<void *>(const_cast<char *>(%s.constData()));\n", name, name);
+            printf("        %s_data.alloc = 0;\n", name);
+        }
+    }
+
+    printf("        union ::wl_argument event_arguments[%d];\n", int(std::max<size_t>(e.arguments.size(), 1)));
+    int index = 0;
+    for (const WaylandArgument &a : e.arguments) {
+        const char *name = a.name.constData();
+        if (a.type == "string")
+            printf("        event_arguments[%d].s = %s_utf8.constData();\n", index, name);
+        else if (a.type == "array")
+            printf("        event_arguments[%d].a = &%s_data;\n", index, name);
+        else if (a.type == "int")
+            printf("        event_arguments[%d].i = %s;\n", index, name);
+        else if (a.type == "uint")
+            printf("        event_arguments[%d].u = %s;\n", index, name);
+        else if (a.type == "fixed")
+            printf("        event_arguments[%d].f = %s;\n", index, name);
+        else if (a.type == "fd")
+            printf("        event_arguments[%d].h = %s;\n", index, name);
+        ++index;
+    }
+    printf("\n");
+
+    if (withClient)
+        printf("        for (Resource *resource : *client_resources) {\n");
+    else
+        printf("        for (Resource *resource : qAsConst(m_resource_map)) {\n");
+    if (e.since > 1) {
+        printf("            if (resource->version() < %d)\n", e.since);
+        printf("                continue;\n");
+    }
+    if (m_trace) {
+        printf("            KWaylandServer::ProtocolTraceScope traceScope(KWaylandServer::ProtocolTracer::Event, &::%s_interface, %d, resource->handle);\n", interfaceName, opcode);
+        printf("            if (Q_UNLIKELY(traceScope.isActive()))\n");
+        printf("                traceScope.setSize(%s);\n", messageSizeExpression(e).constData());
+    }
+    printf("            wl_resource_post_event_array(resource->handle, %d, event_arguments);\n", opcode);
+    printf("        }\n");
+    printf("    }\n");
+    printf("\n");
+}
+
 void Scanner::printEventHandlerSignature(const WaylandEvent &e, const char *interfaceName, bool deepIndent)
 {
     const char *indent = deepIndent ? "    " : "";
@@ -395,6 +552,121 @@ void Scanner::printEventHandlerSignature(const WaylandEvent &e, const char *inte
     printf(")");
 }
 
+// With static dispatch the handler is instantiated for the final class, the qualified call
+// bypasses the vtable and can be inlined.
+void Scanner::printRequestHandlerBody(const WaylandEvent &e, const WaylandInterface &interface, int opcode, bool staticDispatch)
+{
+    const char *interfaceName = interface.name.constData();
+    QByteArray stripped = stripInterfaceName(interface.name);
+    const char *interfaceNameStripped = stripped.constData();
+
+    printf("    {\n");
+    printf("        Q_UNUSED(client);\n");
+    if (staticDispatch)
+        printf("        Resource *r = static_cast<Resource *>(wl_resource_get_user_data(resource));\n");
+    else
+        printf("        Resource *r = Resource::fromResource(resource);\n");
+    printf("        if (Q_UNLIKELY(!r->%s_object)) {\n", interfaceNameStripped);
+    for (const WaylandArgument &a : e.arguments) {
+        if (a.type == QByteArrayLiteral("fd"))
+            printf("        close(%s);\n", a.name.constData());
+    }
+    if (e.type == "destructor")
+        printf("            wl_resource_destroy(resource);\n");
+    printf("            return;\n");
+    printf("        }\n");
+    if (m_trace) {
+        printf("        KWaylandServer::ProtocolTraceScope traceScope(KWaylandServer::ProtocolTracer::Request, &::%s_interface, %d, resource);\n", interfaceName, opcode);
+        printf("        if (Q_UNLIKELY(traceScope.isActive()))\n");
+        printf("            traceScope.setSize(%s);\n", messageSizeExpression(e).constData());
+    }
+    if (staticDispatch)
+        printf("        static_cast<Derived *>(r->%s_object)->Derived::%s_%s(\n", interfaceNameStripped, interfaceNameStripped, e.name.constData());
+    else
+        printf("        static_cast<%s *>(r->%s_object)->%s_%s(\n", interfaceName, interfaceNameStripped, interfaceNameStripped, e.name.constData());
+    printf("            r");
+    for (const WaylandArgument &a : e.arguments) {
+        printf(",\n");
+        QByteArray cType = waylandToCType(a.type, a.interface);
+        QByteArray qtType = waylandToQtType(a.type, a.interface, e.request, e.stringView);
+        const char *argumentName = a.name.constData();
+        if (cType == qtType)
+            printf("            %s", argumentName);
+        else if (a.type == "string" && e.stringView)
+            printf("            QByteArray::fromRawData(%s, qstrlen(%s))", argumentName, argumentName);
+        else if (a.type == "string")
+            printf("            QString::fromUtf8(%s)", argumentName);
+    }
+    printf(");\n");
+    printf("    }\n");
+}
+
+// The X_static<Derived> class template dispatches requests directly to the handlers of Derived,
+// which has to befriend it if the handlers aren't public.
+void Scanner::printStaticDispatchClass(const WaylandInterface &interface)
+{
+    const char *interfaceName = interface.name.constData();
+
+    printf("\n");
+    printf("    template<typename Derived>\n");
+    printf("    class %s_static : public %s\n", interfaceName, interfaceName);
+    printf("    {\n");
+    printf("    public:\n");
+    printf("        %s_static(struct ::wl_client *client, int id, int version)\n", interfaceName);
+    printf("            : %s(&m_static_%s_interface)\n", interfaceName, interfaceName);
+    printf("        {\n");
+    printf("            init(client, id, version);\n");
+    printf("        }\n");
+    printf("        %s_static(struct ::wl_display *display, int version)\n", interfaceName);
+    printf("            : %s(&m_static_%s_interface)\n", interfaceName, interfaceName);
+    printf("        {\n");
+    printf("            init(display, version);\n");
+    printf("        }\n");
+    printf("        %s_static(struct ::wl_resource *resource)\n", interfaceName);
+    printf("            : %s(&m_static_%s_interface)\n", interfaceName, interfaceName);
+    printf("        {\n");
+    printf("            init(resource);\n");
+    printf("        }\n");
+    printf("        %s_static()\n", interfaceName);
+    printf("            : %s(&m_static_%s_interface)\n", interfaceName, interfaceName);
+    printf("        {\n");
+    printf("        }\n");
+    printf("\n");
+    printf("    private:\n");
+    printf("        static const struct ::%s_interface m_static_%s_interface;\n", interfaceName, interfaceName);
+    printf("\n");
+    for (const WaylandEvent &e : interface.requests) {
+        printf("        static void ");
+        printEventHandlerSignature(e, interfaceName);
+        printf(";\n");
+    }
+    printf("    };\n");
+
+    printf("\n");
+    printf("    template<typename Derived>\n");
+    printf("    const struct ::%s_interface %s_static<Derived>::m_static_%s_interface = {", interfaceName, interfaceName, interfaceName);
+    bool needsComma = false;
+    for (const WaylandEvent &e : interface.requests) {
+        if (needsComma)
+            printf(",");
+        needsComma = true;
+        printf("\n");
+        printf("        %s_static<Derived>::handle_%s", interfaceName, e.name.constData());
+    }
+    printf("\n");
+    printf("    };\n");
+
+    int opcode = 0;
+    for (const WaylandEvent &e : interface.requests) {
+        printf("\n");
+        printf("    template<typename Derived>\n");
+        printf("    void %s_static<Derived>::", interfaceName);
+        printEventHandlerSignature(e, interfaceName, false);
+        printf("\n");
+        printRequestHandlerBody(e, interface, opcode++, true);
+    }
+}
+
 void Scanner::printEnums(const std::vector<WaylandEnum> &enums)
 {
     for (const WaylandEnum &e : enums) {
@@ -426,6 +698,11 @@ bool Scanner::ignoreInterface(const QByteArray &name)
            || (isServerSide() && name == "wl_registry");
 }
 
+bool Scanner::hasStaticDispatch(const WaylandInterface &interface)
+{
+    return isServerSide() && !interface.requests.empty() && m_staticDispatchInterfaces.contains(interface.name);
+}
+
 bool Scanner::process()
 {
     QFile file(m_protocolFilePath);
@@ -484,8 +761,14 @@ bool Scanner::process()
         else
             printf("#include <%s/wayland-%s-server-protocol.h>\n", m_headerPath.constData(), QByteArray(m_protocolName).replace('_', '-').constData());
         printf("#include <QByteArray>\n");
+        printf("#include <QHash>\n");
         printf("#include <QMultiMap>\n");
         printf("#include <QString>\n");
+        printf("#include <QVarLengthArray>\n");
+        if (m_trace && std::any_of(interfaces.cbegin(), interfaces.cend(), [this](const WaylandInterface &interface) {
+                return hasStaticDispatch(interface);
+            }))
+            printf("#include \"protocoltracer_p.h\"\n");
 
         printf("\n");
         printf("#include <unistd.h>\n");
@@ -572,6 +855,23 @@ bool Scanner::process()
             printf("        QMultiMap<struct ::wl_client*, Resource*> resourceMap() { return m_resource_map; }\n");
             printf("        const QMultiMap<struct ::wl_client*, Resource*> resourceMap() const { return m_resource_map; }\n");
             printf("\n");
+            printf("        // Calls function for every resource of client, in the order they have been bound.\n");
+            printf("        // Unlike resourceMap().values(client), which lists the newest resource first.\n");
+            printf("        template<typename Function>\n");
+            printf("        void forEachResource(struct ::wl_client *client, Function &&function) const\n");
+            printf("        {\n");
+            printf("            const auto it = m_client_resources.constFind(client);\n");
+            printf("            if (it == m_client_resources.constEnd())\n");
+            printf("                return;\n");
+            printf("            // iterate over a copy on the stack, so the function may destroy the resource it is\n");
+            printf("            // called with, it must not destroy the other resources of the client\n");
+            printf("            QVarLengthArray<Resource *, 4> resources;\n");
+            printf("            resources.append(it->constData(), it->size());\n");
+            printf("            for (Resource *resource : qAsConst(resources))\n");
+            printf("                function(resource);\n");
+            printf("        }\n");
+            printf("        bool hasResources(struct ::wl_client *client) const { return m_client_resources.contains(client); }\n");
+            printf("\n");
             printf("        bool isGlobalRemoved() const { return m_globalRemovedEvent; }\n");
             printf("        void globalRemove();\n");
             printf("\n");
@@ -596,11 +896,23 @@ bool Scanner::process()
                     printf("        void send_");
                     printEvent(e, false, true);
                     printf(";\n");
+                    if (canBroadcast(interface, e)) {
+                        printf("        void broadcast_");
+                        printEvent(e);
+                        printf(";\n");
+                        printf("        void broadcast_");
+                        printEvent(e, false, false, true);
+                        printf(";\n");
+                    }
                 }
             }
 
             printf("\n");
             printf("    protected:\n");
+            if (hasStaticDispatch(interface)) {
+                printf("        explicit %s(const struct ::%s_interface *implementation);\n", interfaceName, interfaceName);
+                printf("\n");
+            }
             printf("        virtual Resource *%s_allocate();\n", interfaceNameStripped);
             printf("\n");
             printf("        virtual void %s_destroy_global();\n", interfaceNameStripped);
@@ -632,6 +944,8 @@ bool Scanner::process()
             if (hasRequests) {
                 printf("\n");
                 printf("        static const struct ::%s_interface m_%s_interface;\n", interfaceName, interfaceName);
+                if (hasStaticDispatch(interface))
+                    printf("        static const struct ::%s_interface *m_static_implementation;\n", interfaceName);
 
                 printf("\n");
                 for (const WaylandEvent &e : interface.requests) {
@@ -642,17 +956,26 @@ bool Scanner::process()
                 }
             }
 
+            printf("\n");
+            printf("        void addClientResource(struct ::wl_client *client, Resource *resource);\n");
+            printf("        void removeClientResource(struct ::wl_client *client, Resource *resource);\n");
             printf("\n");
             printf("        QMultiMap<struct ::wl_client*, Resource*> m_resource_map;\n");
+            printf("        QHash<struct ::wl_client*, QVarLengthArray<Resource*, 1>> m_client_resources;\n");
             printf("        Resource *m_resource;\n");
             printf("        struct ::wl_global *m_global;\n");
             printf("        struct ::wl_display *m_display;\n");
             printf("        struct wl_event_source *m_globalRemovedEvent;\n");
+            if (hasStaticDispatch(interface))
+                printf("        const struct ::%s_interface *m_implementation;\n", interfaceName);
             printf("        struct DisplayDestroyedListener : ::wl_listener {\n");
             printf("            %s *parent;\n", interfaceName);
             printf("        };\n");
             printf("        DisplayDestroyedListener m_displayDestroyedListener;\n");
             printf("    };\n");
+
+            if (hasStaticDispatch(interface))
+                printStaticDispatchClass(interface);
         }
 
         printf("}\n");
@@ -668,6 +991,8 @@ bool Scanner::process()
             printf("#include \"qwayland-server-%s.h\"\n", QByteArray(m_protocolName).replace('_', '-').constData());
         else
             printf("#include <%s/qwayland-server-%s.h>\n", m_headerPath.constData(), QByteArray(m_protocolName).replace('_', '-').constData());
+        if (m_trace)
+            printf("#include \"protocoltracer_p.h\"\n");
         printf("\n");
         printf("QT_BEGIN_NAMESPACE\n");
         printf("QT_WARNING_PUSH\n");
@@ -691,6 +1016,7 @@ bool Scanner::process()
 
             QByteArray stripped = stripInterfaceName(interface.name);
             const char *interfaceNameStripped = stripped.constData();
+            const bool staticDispatch = hasStaticDispatch(interface);
 
             printf("\n");
             printf("    int %s::deferred_destroy_global_func(void *data) {\n", interfaceName);
@@ -707,10 +1033,13 @@ bool Scanner::process()
 
             printf("    %s::%s(struct ::wl_client *client, int id, int version)\n", interfaceName, interfaceName);
             printf("        : m_resource_map()\n");
+            printf("        , m_client_resources()\n");
             printf("        , m_resource(nullptr)\n");
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (staticDispatch)
+                printf("        , m_implementation(&m_%s_interface)\n", interfaceName);
             printf("    {\n");
             printf("        init(client, id, version);\n");
             printf("    }\n");
@@ -718,10 +1047,13 @@ bool Scanner::process()
 
             printf("    %s::%s(struct ::wl_display *display, int version)\n", interfaceName, interfaceName);
             printf("        : m_resource_map()\n");
+            printf("        , m_client_resources()\n");
             printf("        , m_resource(nullptr)\n");
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (staticDispatch)
+                printf("        , m_implementation(&m_%s_interface)\n", interfaceName);
             printf("    {\n");
             printf("        init(display, version);\n");
             printf("    }\n");
@@ -729,10 +1061,13 @@ bool Scanner::process()
 
             printf("    %s::%s(struct ::wl_resource *resource)\n", interfaceName, interfaceName);
             printf("        : m_resource_map()\n");
+            printf("        , m_client_resources()\n");
             printf("        , m_resource(nullptr)\n");
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (staticDispatch)
+                printf("        , m_implementation(&m_%s_interface)\n", interfaceName);
             printf("    {\n");
             printf("        init(resource);\n");
             printf("    }\n");
@@ -740,14 +1075,36 @@ bool Scanner::process()
 
             printf("    %s::%s()\n", interfaceName, interfaceName);
             printf("        : m_resource_map()\n");
+            printf("        , m_client_resources()\n");
             printf("        , m_resource(nullptr)\n");
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (staticDispatch)
+                printf("        , m_implementation(&m_%s_interface)\n", interfaceName);
             printf("    {\n");
             printf("    }\n");
             printf("\n");
 
+            if (staticDispatch) {
+                printf("    const struct ::%s_interface *%s::m_static_implementation = nullptr;\n", interfaceName, interfaceName);
+                printf("\n");
+                printf("    %s::%s(const struct ::%s_interface *implementation)\n", interfaceName, interfaceName, interfaceName);
+                printf("        : m_resource_map()\n");
+                printf("        , m_client_resources()\n");
+                printf("        , m_resource(nullptr)\n");
+                printf("        , m_global(nullptr)\n");
+                printf("        , m_display(nullptr)\n");
+                printf("        , m_globalRemovedEvent(nullptr)\n");
+                printf("        , m_implementation(implementation)\n");
+                printf("    {\n");
+                printf("        // Resource::fromResource() only knows about a single static implementation\n");
+                printf("        Q_ASSERT(!m_static_implementation || m_static_implementation == implementation);\n");
+                printf("        m_static_implementation = implementation;\n");
+                printf("    }\n");
+                printf("\n");
+            }
+
             printf("    %s::~%s()\n", interfaceName, interfaceName);
             printf("    {\n");
             printf("        for (auto resource : qAsConst(m_resource_map))\n");
@@ -781,6 +1138,7 @@ bool Scanner::process()
             printf("    {\n");
             printf("        Resource *resource = bind(client, 0, version);\n");
             printf("        m_resource_map.insert(client, resource);\n");
+            printf("        addClientResource(client, resource);\n");
             printf("        return resource;\n");
             printf("    }\n");
             printf("\n");
@@ -789,10 +1147,30 @@ bool Scanner::process()
             printf("    {\n");
             printf("        Resource *resource = bind(client, id, version);\n");
             printf("        m_resource_map.insert(client, resource);\n");
+            printf("        addClientResource(client, resource);\n");
             printf("        return resource;\n");
             printf("    }\n");
             printf("\n");
 
+            printf("    void %s::addClientResource(struct ::wl_client *client, Resource *resource)\n", interfaceName);
+            printf("    {\n");
+            printf("        m_client_resources[client].append(resource);\n");
+            printf("    }\n");
+            printf("\n");
+
+            printf("    void %s::removeClientResource(struct ::wl_client *client, Resource *resource)\n", interfaceName);
+            printf("    {\n");
+            printf("        auto it = m_client_resources.find(client);\n");
+            printf("        if (it == m_client_resources.end())\n");
+            printf("            return;\n");
+            printf("        const int index = it->indexOf(resource);\n");
+            printf("        if (index != -1)\n");
+            printf("            it->remove(index);\n");
+            printf("        if (it->isEmpty())\n");
+            printf("            m_client_resources.erase(it);\n");
+            printf("    }\n");
+            printf("\n");
+
             printf("    void %s::init(struct ::wl_display *display, int version)\n", interfaceName);
             printf("    {\n");
             printf("        m_display = display;\n");
@@ -853,6 +1231,7 @@ bool Scanner::process()
             printf("        %s *that = resource->%s_object;\n", interfaceName, interfaceNameStripped);
             printf("        if (Q_LIKELY(that)) {\n");
             printf("            that->m_resource_map.remove(resource->client(), resource);\n");
+            printf("            that->removeClientResource(resource->client(), resource);\n");
             printf("            that->%s_destroy_resource(resource);\n", interfaceNameStripped);
             printf("\n");
             printf("            that = resource->%s_object;\n", interfaceNameStripped);
@@ -898,7 +1277,7 @@ bool Scanner::process()
             printf("        Resource *resource = %s_allocate();\n", interfaceNameStripped);
             printf("        resource->%s_object = this;\n", interfaceNameStripped);
             printf("\n");
-            printf("        wl_resource_set_implementation(handle, %s, resource, destroy_func);", interfaceMember.constData());
+            printf("        wl_resource_set_implementation(handle, %s, resource, destroy_func);", staticDispatch ? "m_implementation" : interfaceMember.constData());
             printf("\n");
             printf("        resource->handle = handle;\n");
             printf("        %s_bind_resource(resource);\n", interfaceNameStripped);
@@ -911,6 +1290,10 @@ bool Scanner::process()
             printf("            return nullptr;\n");
             printf("        if (wl_resource_instance_of(resource, &::%s_interface, %s))\n",  interfaceName, interfaceMember.constData());
             printf("            return static_cast<Resource *>(wl_resource_get_user_data(resource));\n");
+            if (staticDispatch) {
+                printf("        if (m_static_implementation && wl_resource_instance_of(resource, &::%s_interface, m_static_implementation))\n", interfaceName);
+                printf("            return static_cast<Resource *>(wl_resource_get_user_data(resource));\n");
+            }
             printf("        return nullptr;\n");
             printf("    }\n");
 
@@ -938,6 +1321,7 @@ bool Scanner::process()
                 }
                 printf("\n");
 
+                int opcode = 0;
                 for (const WaylandEvent &e : interface.requests) {
                     printf("\n");
                     printf("    void %s::", interfaceName);
@@ -945,36 +1329,13 @@ bool Scanner::process()
                     printEventHandlerSignature(e, interfaceName, false);
 
                     printf("\n");
-                    printf("    {\n");
-                    printf("        Q_UNUSED(client);\n");
-                    printf("        Resource *r = Resource::fromResource(resource);\n");
-                    printf("        if (Q_UNLIKELY(!r->%s_object)) {\n", interfaceNameStripped);
-                    for (const WaylandArgument &a : e.arguments) {
-                        if (a.type == QByteArrayLiteral("fd"))
-                            printf("        close(%s);\n", a.name.constData());
-                    }
-                    if (e.type == "destructor")
-                        printf("            wl_resource_destroy(resource);\n");
-                    printf("            return;\n");
-                    printf("        }\n");
-                    printf("        static_cast<%s *>(r->%s_object)->%s_%s(\n", interfaceName, interfaceNameStripped, interfaceNameStripped, e.name.constData());
-                    printf("            r");
-                    for (const WaylandArgument &a : e.arguments) {
-                        printf(",\n");
-                        QByteArray cType = waylandToCType(a.type, a.interface);
-                        QByteArray qtType = waylandToQtType(a.type, a.interface, e.request);
-                        const char *argumentName = a.name.constData();
-                        if (cType == qtType)
-                            printf("            %s", argumentName);
-                        else if (a.type == "string")
-                            printf("            QString::fromUtf8(%s)", argumentName);
-                    }
-                    printf(");\n");
-                    printf("    }\n");
+                    printRequestHandlerBody(e, interface, opcode++, false);
                 }
             }
 
+            int eventOpcode = 0;
             for (const WaylandEvent &e : interface.events) {
+                const int opcode = eventOpcode++;
                 printf("\n");
                 printf("    void %s::send_", interfaceName);
                 printEvent(e);
@@ -1013,6 +1374,23 @@ bool Scanner::process()
                     printf("\n");
                 }
 
+                bool hasStrings = false;
+                for (const WaylandArgument &a : e.arguments) {
+                    if (a.type != "string")
+                        continue;
+                    printf("        const QByteArray %s_utf8 = %s.toUtf8();\n", a.name.constData(), a.name.constData());
+                    hasStrings = true;
+                }
+                if (hasStrings)
+                    printf("\n");
+
+                if (m_trace) {
+                    printf("        KWaylandServer::ProtocolTraceScope traceScope(KWaylandServer::ProtocolTracer::Event, &::%s_interface, %d, resource);\n", interfaceName, opcode);
+                    printf("        if (Q_UNLIKELY(traceScope.isActive()))\n");
+                    printf("            traceScope.setSize(%s);\n", messageSizeExpression(e).constData());
+                    printf("\n");
+                }
+
                 printf("        %s_send_%s(\n", interfaceName, e.name.constData());
                 printf("            resource");
 
@@ -1021,7 +1399,7 @@ bool Scanner::process()
                     QByteArray cType = waylandToCType(a.type, a.interface);
                     QByteArray qtType = waylandToQtType(a.type, a.interface, e.request);
                     if (a.type == "string")
-                        printf("            %s.toUtf8().constData()", a.name.constData());
+                        printf("            %s_utf8.constData()", a.name.constData());
                     else if (a.type == "array")
                         printf("            &%s_data", a.name.constData());
                     else if (cType == qtType)
@@ -1031,6 +1409,11 @@ bool Scanner::process()
                 printf(");\n");
                 printf("    }\n");
                 printf("\n");
+
+                if (canBroadcast(interface, e)) {
+                    printBroadcast(e, interfaceName, opcode, false);
+                    printBroadcast(e, interfaceName, opcode, true);
+                }
             }
         }
         printf("}\n");
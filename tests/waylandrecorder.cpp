@@ -0,0 +1,294 @@
+/*
+    SPDX-FileCopyrightText: 2022 KDE Community
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+// Records the requests of a Wayland client for the WireReplayer in autotests/server.
+//
+// The recorder sits between the program and the running compositor and forwards the traffic
+// in both directions. The requests of every connection are written to client-<n>.kwlrec in
+// the output directory once the connection is closed.
+#include "../autotests/server/wirerecording.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <iostream>
+
+static const int s_maxFileDescriptors = 28;
+
+static int connectSocket(const QByteArray &path)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.constData(), sizeof(address.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listenSocket(const QByteArray &path)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.constData(), sizeof(address.sun_path) - 1);
+    unlink(path.constData());
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 || listen(fd, 16) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Forwards one read worth of data and fds, returns false once the connection is closed.
+static bool forward(int from, int to, QByteArray *data, QVector<qint64> *fileDescriptorSizes)
+{
+    char buffer[4096];
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+
+    char control[CMSG_SPACE(sizeof(int) * s_maxFileDescriptors)];
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t length;
+    do {
+        length = recvmsg(from, &message, MSG_CMSG_CLOEXEC);
+    } while (length == -1 && errno == EINTR);
+    if (length <= 0) {
+        return false;
+    }
+
+    QVector<int> fds;
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            const int count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *received = reinterpret_cast<const int *>(CMSG_DATA(header));
+            for (int i = 0; i < count; ++i) {
+                fds.append(received[i]);
+            }
+        }
+    }
+
+    // the kernel closes the fds which didn't fit, forwarding the rest would corrupt the stream
+    if (message.msg_flags & MSG_CTRUNC) {
+        std::cerr << "Received more than " << s_maxFileDescriptors << " file descriptors at once, closing the connection" << std::endl;
+        for (int fd : qAsConst(fds)) {
+            close(fd);
+        }
+        return false;
+    }
+
+    if (data) {
+        data->append(buffer, length);
+        for (int fd : qAsConst(fds)) {
+            struct stat info;
+            fileDescriptorSizes->append(fstat(fd, &info) == 0 ? info.st_size : 0);
+        }
+    }
+
+    iov.iov_len = length;
+    message.msg_controllen = 0;
+    message.msg_control = nullptr;
+    char forwardControl[CMSG_SPACE(sizeof(int) * s_maxFileDescriptors)] = {};
+    if (!fds.isEmpty()) {
+        message.msg_control = forwardControl;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.count());
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.count());
+        memcpy(CMSG_DATA(header), fds.constData(), sizeof(int) * fds.count());
+    }
+
+    ssize_t written = 0;
+    while (written < length) {
+        iov.iov_base = buffer + written;
+        iov.iov_len = length - written;
+        const ssize_t result = sendmsg(to, &message, MSG_NOSIGNAL);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += result;
+        // the fds go along with the first part only
+        message.msg_control = nullptr;
+        message.msg_controllen = 0;
+    }
+
+    for (int fd : qAsConst(fds)) {
+        close(fd);
+    }
+    return written == length;
+}
+
+class Connection : public QObject
+{
+    Q_OBJECT
+public:
+    Connection(int client, int compositor, const QString &fileName, QObject *parent)
+        : QObject(parent)
+        , m_client(client)
+        , m_compositor(compositor)
+        , m_fileName(fileName)
+        , m_clientNotifier(client, QSocketNotifier::Read)
+        , m_compositorNotifier(compositor, QSocketNotifier::Read)
+    {
+        m_timer.start();
+        connect(&m_clientNotifier, &QSocketNotifier::activated, this, &Connection::handleRequests);
+        connect(&m_compositorNotifier, &QSocketNotifier::activated, this, &Connection::handleEvents);
+    }
+
+    ~Connection() override
+    {
+        save();
+        close(m_client);
+        close(m_compositor);
+    }
+
+Q_SIGNALS:
+    void closed();
+
+private:
+    void handleRequests()
+    {
+        WireRecording::Chunk chunk;
+        chunk.timestamp = m_timer.nsecsElapsed();
+        if (!forward(m_client, m_compositor, &chunk.data, &chunk.fileDescriptorSizes)) {
+            shutdown();
+            return;
+        }
+        m_recording.chunks.append(chunk);
+    }
+
+    void handleEvents()
+    {
+        if (!forward(m_compositor, m_client, nullptr, nullptr)) {
+            shutdown();
+        }
+    }
+
+    void shutdown()
+    {
+        m_clientNotifier.setEnabled(false);
+        m_compositorNotifier.setEnabled(false);
+        Q_EMIT closed();
+    }
+
+    void save()
+    {
+        QFile file(m_fileName);
+        if (!file.open(QIODevice::WriteOnly) || !m_recording.save(&file)) {
+            std::cerr << "Failed to write " << qPrintable(m_fileName) << std::endl;
+            return;
+        }
+        std::cout << "Recorded " << m_recording.chunks.count() << " chunks to " << qPrintable(m_fileName) << std::endl;
+    }
+
+    int m_client;
+    int m_compositor;
+    QString m_fileName;
+    QSocketNotifier m_clientNotifier;
+    QSocketNotifier m_compositorNotifier;
+    QElapsedTimer m_timer;
+    WireRecording m_recording;
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const QStringList arguments = app.arguments();
+    if (arguments.count() < 3) {
+        std::cerr << "Usage: " << qPrintable(arguments.first()) << " <output directory> <program> [arguments...]" << std::endl;
+        return 1;
+    }
+
+    const QDir outputDirectory(arguments.at(1));
+    if (!outputDirectory.exists() && !QDir().mkpath(outputDirectory.absolutePath())) {
+        std::cerr << "Cannot create " << qPrintable(outputDirectory.absolutePath()) << std::endl;
+        return 1;
+    }
+
+    const QByteArray runtimeDirectory = qgetenv("XDG_RUNTIME_DIR");
+    QByteArray compositorDisplay = qgetenv("WAYLAND_DISPLAY");
+    if (compositorDisplay.isEmpty()) {
+        compositorDisplay = QByteArrayLiteral("wayland-0");
+    }
+    const QByteArray compositorPath = compositorDisplay.startsWith('/') ? compositorDisplay : runtimeDirectory + '/' + compositorDisplay;
+
+    const QByteArray recorderDisplay = QByteArrayLiteral("wayland-recorder-") + QByteArray::number(getpid());
+    const QByteArray recorderPath = runtimeDirectory + '/' + recorderDisplay;
+    const int listenFd = listenSocket(recorderPath);
+    if (listenFd == -1) {
+        std::cerr << "Cannot listen on " << recorderPath.constData() << std::endl;
+        return 1;
+    }
+
+    int connectionCount = 0;
+    QSocketNotifier listenNotifier(listenFd, QSocketNotifier::Read);
+    QObject::connect(&listenNotifier, &QSocketNotifier::activated, &app, [&]() {
+        const int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client == -1) {
+            return;
+        }
+        const int compositor = connectSocket(compositorPath);
+        if (compositor == -1) {
+            std::cerr << "Cannot connect to " << compositorPath.constData() << std::endl;
+            close(client);
+            return;
+        }
+        const QString fileName = outputDirectory.filePath(QStringLiteral("client-%1.kwlrec").arg(connectionCount++));
+        auto connection = new Connection(client, compositor, fileName, &app);
+        QObject::connect(connection, &Connection::closed, connection, &QObject::deleteLater);
+    });
+
+    QProcess process;
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QStringLiteral("WAYLAND_DISPLAY"), QString::fromUtf8(recorderDisplay));
+    process.setProcessEnvironment(environment);
+    process.setProcessChannelMode(QProcess::ForwardedChannels);
+    QObject::connect(&process, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), &app, &QCoreApplication::quit);
+    process.start(arguments.at(2), arguments.mid(3));
+    if (!process.waitForStarted()) {
+        std::cerr << "Failed to start " << qPrintable(arguments.at(2)) << std::endl;
+        unlink(recorderPath.constData());
+        return 1;
+    }
+
+    const int result = app.exec();
+
+    // the remaining connections are saved when they're destroyed along with the application
+    close(listenFd);
+    unlink(recorderPath.constData());
+    return result;
+}
+
+#include "waylandrecorder.moc"